@@ -269,11 +269,25 @@ module mcu_top (
     logic mem_stop_pending;
     logic [8:0] mem_counter;
 
+    logic mem_test_start;
+    logic mem_test_verify;
+    logic [1:0] mem_test_pattern;
+    logic [31:0] mem_test_length;
+    logic [31:0] mem_test_seed;
+
+    logic mem_test_busy;
+    logic [31:0] mem_test_errors;
+    logic [31:0] mem_test_error_address;
+    logic [31:0] mem_test_error_data;
+
+    mem_bus mem_copy_bus ();
+    mem_bus mem_test_bus ();
+
     always_ff @(posedge clk) begin
         if (reset) begin
             mem_busy <= 1'b0;
             mem_stop_pending <= 1'b0;
-            mem_bus.request <= 1'b0;
+            mem_copy_bus.request <= 1'b0;
         end else begin
             if (mem_read) begin
                 mem_rdata <= mem_buffer[{address, mem_word_select}];
@@ -285,25 +299,25 @@ module mcu_top (
 
             if (mem_stop) begin
                 mem_stop_pending <= mem_busy;
-            end else if (mem_start && !mem_busy) begin
-                mem_bus.write <= mem_direction;
-                mem_bus.address <= mem_address;
+            end else if (mem_start && !mem_busy && !mem_test_busy) begin
+                mem_copy_bus.write <= mem_direction;
+                mem_copy_bus.address <= mem_address;
                 mem_busy <= 1'b1;
                 mem_counter <= 9'd0;
             end
 
             if (mem_busy) begin
-                if (!mem_bus.request) begin
-                    mem_bus.request <= 1'b1;
-                    mem_bus.wdata <= mem_buffer[mem_counter];
+                if (!mem_copy_bus.request) begin
+                    mem_copy_bus.request <= 1'b1;
+                    mem_copy_bus.wdata <= mem_buffer[mem_counter];
                 end
 
-                if (mem_bus.ack) begin
-                    mem_bus.request <= 1'b0;
-                    mem_bus.address <= mem_bus.address + 2'd2;
+                if (mem_copy_bus.ack) begin
+                    mem_copy_bus.request <= 1'b0;
+                    mem_copy_bus.address <= mem_copy_bus.address + 2'd2;
                     mem_counter <= mem_counter + 1'd1;
-                    if (!mem_bus.write) begin
-                        mem_buffer[mem_counter] <= mem_bus.rdata;
+                    if (!mem_copy_bus.write) begin
+                        mem_buffer[mem_counter] <= mem_copy_bus.rdata;
                     end
                     if ((mem_counter == mem_length) || mem_stop_pending) begin
                         mem_busy <= 1'b0;
@@ -315,7 +329,39 @@ module mcu_top (
     end
 
     always_comb begin
-        mem_bus.wmask = 2'b11;
+        mem_copy_bus.wmask = 2'b11;
+    end
+
+    memory_test memory_test_inst (
+        .clk(clk),
+        .reset(reset),
+
+        .start(mem_test_start && !mem_busy),
+        .verify(mem_test_verify),
+        .pattern(mem_test_pattern),
+        .starting_address(mem_address[26:0]),
+        .length(mem_test_length),
+        .seed(mem_test_seed),
+
+        .busy(mem_test_busy),
+        .errors(mem_test_errors),
+        .error_address(mem_test_error_address),
+        .error_data(mem_test_error_data),
+
+        .mem_bus(mem_test_bus)
+    );
+
+    always_comb begin
+        mem_bus.request = mem_test_busy ? mem_test_bus.request : mem_copy_bus.request;
+        mem_bus.write = mem_test_busy ? mem_test_bus.write : mem_copy_bus.write;
+        mem_bus.wmask = mem_test_busy ? mem_test_bus.wmask : mem_copy_bus.wmask;
+        mem_bus.address = mem_test_busy ? mem_test_bus.address : mem_copy_bus.address;
+        mem_bus.wdata = mem_test_busy ? mem_test_bus.wdata : mem_copy_bus.wdata;
+
+        mem_copy_bus.ack = !mem_test_busy && mem_bus.ack;
+        mem_copy_bus.rdata = mem_bus.rdata;
+        mem_test_bus.ack = mem_test_busy && mem_bus.ack;
+        mem_test_bus.rdata = mem_bus.rdata;
     end
 
 
@@ -361,7 +407,16 @@ module mcu_top (
         REG_DEBUG_1,
         REG_CIC_0,
         REG_CIC_1,
-        REG_AUX
+        REG_AUX,
+        REG_MEM_TEST_SCR,
+        REG_MEM_TEST_LENGTH,
+        REG_MEM_TEST_SEED,
+        REG_MEM_TEST_ERRORS,
+        REG_MEM_TEST_ERROR_ADDRESS,
+        REG_MEM_TEST_ERROR_DATA,
+        REG_DD_BLOCK_ADDRESS,
+        REG_ISV_SCR,
+        REG_STREAM_SCR
     } reg_address_e;
 
     logic bootloader_skip;
@@ -376,6 +431,8 @@ module mcu_top (
     logic cic_invalid_region;
 
     logic aux_pending;
+    logic isv_pending;
+    logic stream_pending;
 
 
     // Register read logic
@@ -599,7 +656,9 @@ module mcu_top (
 
                 REG_DD_SCR: begin
                     reg_rdata <= {
-                        14'd0,
+                        11'd0,
+                        dd_scb.bm_block_active,
+                        2'd0,
                         dd_bm_ack,
                         dd_scb.bm_micro_error,
                         dd_scb.bm_transfer_c2,
@@ -684,6 +743,58 @@ module mcu_top (
                 REG_AUX: begin
                     reg_rdata <= n64_scb.aux_rdata;
                 end
+
+                REG_MEM_TEST_SCR: begin
+                    reg_rdata <= {
+                        27'd0,
+                        mem_test_busy,
+                        mem_test_pattern,
+                        mem_test_verify,
+                        1'b0
+                    };
+                end
+
+                REG_MEM_TEST_LENGTH: begin
+                    reg_rdata <= mem_test_length;
+                end
+
+                REG_MEM_TEST_SEED: begin
+                    reg_rdata <= mem_test_seed;
+                end
+
+                REG_MEM_TEST_ERRORS: begin
+                    reg_rdata <= mem_test_errors;
+                end
+
+                REG_MEM_TEST_ERROR_ADDRESS: begin
+                    reg_rdata <= mem_test_error_address;
+                end
+
+                REG_MEM_TEST_ERROR_DATA: begin
+                    reg_rdata <= mem_test_error_data;
+                end
+
+                REG_DD_BLOCK_ADDRESS: begin
+                    reg_rdata <= {6'd0, dd_scb.bm_block_address};
+                end
+
+                REG_ISV_SCR: begin
+                    reg_rdata <= {
+                        n64_scb.isv_enabled,
+                        isv_pending,
+                        4'd0,
+                        n64_scb.isv_address
+                    };
+                end
+
+                REG_STREAM_SCR: begin
+                    reg_rdata <= {
+                        n64_scb.stream_enabled,
+                        stream_pending,
+                        4'd0,
+                        n64_scb.stream_address
+                    };
+                end
             endcase
         end
     end
@@ -694,6 +805,7 @@ module mcu_top (
     always_ff @(posedge clk) begin
         mem_start <= 1'b0;
         mem_stop <= 1'b0;
+        mem_test_start <= 1'b0;
 
         usb_scb.fifo_flush <= 1'b0;
         usb_scb.write_buffer_flush <= 1'b0;
@@ -729,6 +841,7 @@ module mcu_top (
         dd_scb.bm_stop_clear <= 1'b0;
         dd_scb.bm_clear <= 1'b0;
         dd_scb.bm_ready <= 1'b0;
+        dd_scb.bm_block_start <= 1'b0;
 
         vendor_scb.control_valid <= 1'b0;
 
@@ -752,6 +865,14 @@ module mcu_top (
             aux_pending <= 1'b1;
         end
 
+        if (n64_scb.isv_written) begin
+            isv_pending <= 1'b1;
+        end
+
+        if (n64_scb.stream_written) begin
+            stream_pending <= 1'b1;
+        end
+
         if (reset) begin
             mcu_int <= 1'b0;
             sd_scb.clock_mode <= 2'd0;
@@ -777,6 +898,10 @@ module mcu_top (
             n64_scb.cic_seed <= 8'h3F;
             n64_scb.cic_checksum <= 48'hA536C0F1D859;
             aux_pending <= 1'b0;
+            n64_scb.isv_enabled <= 1'b0;
+            isv_pending <= 1'b0;
+            n64_scb.stream_enabled <= 1'b0;
+            stream_pending <= 1'b0;
         end else if (reg_write) begin
             case (address)
                 REG_MEM_ADDRESS: begin
@@ -922,6 +1047,7 @@ module mcu_top (
                 end
 
                 REG_DD_SCR: begin
+                    dd_scb.bm_block_start <= reg_wdata[21];
                     dd_scb.bm_clear <= reg_wdata[19];
                     if (reg_wdata[18]) begin
                         dd_bm_ack <= 1'b0;
@@ -978,6 +1104,42 @@ module mcu_top (
                     n64_scb.aux_irq <= 1'b1;
                     n64_scb.aux_wdata <= reg_wdata;
                 end
+
+                REG_MEM_TEST_SCR: begin
+                    {
+                        mem_test_pattern,
+                        mem_test_verify,
+                        mem_test_start
+                    } <= reg_wdata[3:0];
+                end
+
+                REG_MEM_TEST_LENGTH: begin
+                    mem_test_length <= reg_wdata;
+                end
+
+                REG_MEM_TEST_SEED: begin
+                    mem_test_seed <= reg_wdata;
+                end
+
+                REG_DD_BLOCK_ADDRESS: begin
+                    dd_scb.bm_block_address <= reg_wdata[25:0];
+                end
+
+                REG_ISV_SCR: begin
+                    n64_scb.isv_enabled <= reg_wdata[31];
+                    if (reg_wdata[30]) begin
+                        isv_pending <= 1'b0;
+                    end
+                    n64_scb.isv_address <= reg_wdata[25:0];
+                end
+
+                REG_STREAM_SCR: begin
+                    n64_scb.stream_enabled <= reg_wdata[31];
+                    if (reg_wdata[30]) begin
+                        stream_pending <= 1'b0;
+                    end
+                    n64_scb.stream_address <= reg_wdata[25:0];
+                end
             endcase
         end
     end
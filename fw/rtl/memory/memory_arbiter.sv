@@ -5,6 +5,7 @@ module memory_arbiter (
     n64_scb.arbiter n64_scb,
 
     mem_bus.memory n64_bus,
+    mem_bus.memory dd_bus,
     mem_bus.memory cfg_bus,
     mem_bus.memory usb_dma_bus,
     mem_bus.memory sd_dma_bus,
@@ -14,14 +15,16 @@ module memory_arbiter (
     mem_bus.controller bram_mem_bus
 );
 
-    typedef enum bit [1:0] {
+    typedef enum bit [2:0] {
         SOURCE_N64,
+        SOURCE_DD,
         SOURCE_CFG,
         SOURCE_USB_DMA,
         SOURCE_SD_DMA
     } e_source_request;
 
     logic n64_sdram_request;
+    logic dd_sdram_request;
     logic cfg_sdram_request;
     logic usb_dma_sdram_request;
     logic sd_dma_sdram_request;
@@ -37,6 +40,7 @@ module memory_arbiter (
     logic sd_dma_bram_request;
 
     assign n64_sdram_request = n64_bus.request && !n64_bus.address[26];
+    assign dd_sdram_request = !n64_scb.pi_sdram_active && dd_bus.request && !dd_bus.address[26];
     assign cfg_sdram_request = !n64_scb.pi_sdram_active && cfg_bus.request && !cfg_bus.address[26];
     assign usb_dma_sdram_request = !n64_scb.pi_sdram_active && usb_dma_bus.request && !usb_dma_bus.address[26];
     assign sd_dma_sdram_request = !n64_scb.pi_sdram_active && sd_dma_bus.request && !sd_dma_bus.address[26];
@@ -60,6 +64,7 @@ module memory_arbiter (
             if (!sdram_mem_bus.request) begin
                 sdram_mem_bus.request <= (
                     n64_sdram_request ||
+                    dd_sdram_request ||
                     cfg_sdram_request ||
                     usb_dma_sdram_request ||
                     sd_dma_sdram_request
@@ -71,6 +76,12 @@ module memory_arbiter (
                     sdram_mem_bus.address <= n64_bus.address;
                     sdram_mem_bus.wdata <= n64_bus.wdata;
                     sdram_source_request <= SOURCE_N64;
+                end else if (dd_sdram_request) begin
+                    sdram_mem_bus.write <= dd_bus.write;
+                    sdram_mem_bus.wmask <= dd_bus.wmask;
+                    sdram_mem_bus.address <= dd_bus.address;
+                    sdram_mem_bus.wdata <= dd_bus.wdata;
+                    sdram_source_request <= SOURCE_DD;
                 end else if (cfg_sdram_request) begin
                     sdram_mem_bus.write <= cfg_bus.write;
                     sdram_mem_bus.wmask <= cfg_bus.wmask;
@@ -198,6 +209,7 @@ module memory_arbiter (
             ((flash_source_request == SOURCE_N64) && flash_mem_bus.ack) ||
             ((bram_source_request == SOURCE_N64) && bram_mem_bus.ack)
         );
+        dd_bus.ack = ((sdram_source_request == SOURCE_DD) && sdram_mem_bus.ack);
         cfg_bus.ack = (
             ((sdram_source_request == SOURCE_CFG) && sdram_mem_bus.ack) ||
             ((flash_source_request == SOURCE_CFG) && flash_mem_bus.ack) ||
@@ -217,6 +229,7 @@ module memory_arbiter (
         n64_bus.rdata = n64_bram_request ? bram_mem_bus.rdata :
             n64_flash_request ? flash_mem_bus.rdata :
             sdram_mem_bus.rdata;
+        dd_bus.rdata = sdram_mem_bus.rdata;
         cfg_bus.rdata = cfg_bram_request ? bram_mem_bus.rdata :
             cfg_flash_request ? flash_mem_bus.rdata :
             sdram_mem_bus.rdata;
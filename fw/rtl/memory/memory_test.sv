@@ -0,0 +1,97 @@
+module memory_test (
+    input clk,
+    input reset,
+
+    input start,
+    input verify,
+    input [1:0] pattern,
+    input [26:0] starting_address,
+    input [31:0] length,
+    input [31:0] seed,
+
+    output logic busy,
+    output logic [31:0] errors,
+    output logic [31:0] error_address,
+    output logic [31:0] error_data,
+
+    mem_bus.controller mem_bus
+);
+
+    typedef enum bit [1:0] {
+        PATTERN_CONSTANT,
+        PATTERN_OWN_ADDRESS,
+        PATTERN_RANDOM,
+        PATTERN_WALKING_ONES
+    } e_pattern;
+
+    logic [31:0] counter;
+    logic [31:0] lfsr;
+
+    logic [31:0] word;
+    logic [15:0] expected;
+
+    always_comb begin
+        case (pattern)
+            PATTERN_OWN_ADDRESS: word = {5'd0, mem_bus.address[26:2], 2'b00} ^ seed;
+            PATTERN_RANDOM: word = lfsr;
+            PATTERN_WALKING_ONES: word = {
+                16'd1 << {mem_bus.address[4:2], 1'b0},
+                16'd1 << {mem_bus.address[4:2], 1'b1}
+            } ^ seed;
+            default: word = seed;
+        endcase
+        expected = mem_bus.address[1] ? word[15:0] : word[31:16];
+    end
+
+    always_ff @(posedge clk) begin
+        if (reset) begin
+            busy <= 1'b0;
+            errors <= 32'd0;
+            error_address <= 32'd0;
+            error_data <= 32'd0;
+            mem_bus.request <= 1'b0;
+        end else begin
+            if (start && !busy && (length != 32'd0)) begin
+                mem_bus.write <= !verify;
+                mem_bus.address <= starting_address;
+                busy <= 1'b1;
+                counter <= length;
+                lfsr <= seed;
+                errors <= 32'd0;
+                error_address <= 32'd0;
+                error_data <= 32'd0;
+            end
+
+            if (busy) begin
+                if (!mem_bus.request) begin
+                    mem_bus.request <= 1'b1;
+                    mem_bus.wdata <= expected;
+                end
+
+                if (mem_bus.ack) begin
+                    mem_bus.request <= 1'b0;
+                    mem_bus.address <= mem_bus.address + 2'd2;
+                    counter <= counter - 1'd1;
+                    if (mem_bus.address[1]) begin
+                        lfsr <= {1'b0, lfsr[31:1]} ^ (lfsr[0] ? 32'hD0000001 : 32'd0);
+                    end
+                    if (!mem_bus.write && (mem_bus.rdata != expected)) begin
+                        if (errors == 32'd0) begin
+                            error_address <= {5'd0, mem_bus.address};
+                            error_data <= {expected, mem_bus.rdata};
+                        end
+                        errors <= errors + 1'd1;
+                    end
+                    if (counter == 32'd1) begin
+                        busy <= 1'b0;
+                    end
+                end
+            end
+        end
+    end
+
+    always_comb begin
+        mem_bus.wmask = 2'b11;
+    end
+
+endmodule
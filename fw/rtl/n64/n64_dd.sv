@@ -18,6 +18,7 @@ interface dd_scb ();
     logic [7:0] sector_size;
     logic [7:0] sector_size_full;
     logic [7:0] sectors_in_block;
+    logic bm_block_active;
 
 
     // CPU controlled regs
@@ -37,6 +38,8 @@ interface dd_scb ();
     logic index_lock;
     logic [12:0] head_track;
     logic [15:0] drive_id;
+    logic bm_block_start;
+    logic [25:0] bm_block_address;
 
     modport controller (
         input hard_reset,
@@ -53,6 +56,7 @@ interface dd_scb ();
         input sector_size,
         input sector_size_full,
         input sectors_in_block,
+        input bm_block_active,
 
         output hard_reset_clear,
         output cmd_data,
@@ -68,7 +72,9 @@ interface dd_scb ();
         output disk_changed,
         output index_lock,
         output head_track,
-        output drive_id
+        output drive_id,
+        output bm_block_start,
+        output bm_block_address
     );
 
     modport dd (
@@ -88,6 +94,7 @@ interface dd_scb ();
         output sector_size,
         output sector_size_full,
         output sectors_in_block,
+        output bm_block_active,
 
         input hard_reset_clear,
         input cmd_data,
@@ -103,7 +110,9 @@ interface dd_scb ();
         input disk_changed,
         input index_lock,
         input head_track,
-        input drive_id
+        input drive_id,
+        input bm_block_start,
+        input bm_block_address
     );
 
 endinterface
@@ -118,6 +127,8 @@ module n64_dd (
     n64_scb.dd n64_scb,
     dd_scb.dd dd_scb,
 
+    mem_bus.controller mem_bus,
+
     output logic irq
 );
 
@@ -143,6 +154,17 @@ module n64_dd (
         BM_CONTROL_MECHANIC_INTERRUPT_RESET = 4'd8
     } e_bm_control_id;
 
+    logic sector_buffer_end;
+    logic block_sector_ready;
+    logic block_done;
+
+    always_comb begin
+        sector_buffer_end = (
+            (reg_bus.address[10:0] == (MEM_SECTOR_BUFFER + {dd_scb.sector_size[7:1], 1'b0})) &&
+            (reg_bus.read || reg_bus.write)
+        );
+    end
+
     always_comb begin
         reg_bus.rdata = 16'd0;
         if (reg_bus.address[10:8] == MEM_SECTOR_BUFFER[10:8]) begin
@@ -195,13 +217,16 @@ module n64_dd (
         if (dd_scb.bm_clear) begin
             dd_scb.bm_pending <= 1'b0;
         end
-        if (dd_scb.bm_ready) begin
+        if (dd_scb.bm_ready || block_sector_ready) begin
             dd_scb.bm_interrupt <= 1'b1;
         end
         if (reg_bus.address[10:0] == (MEM_C2_BUFFER + ({dd_scb.sector_size[7:1], 1'b0} * 3'd4)) && reg_bus.read) begin
             dd_scb.bm_pending <= 1'b1;
         end
-        if (reg_bus.address[10:0] == (MEM_SECTOR_BUFFER + {dd_scb.sector_size[7:1], 1'b0}) && (reg_bus.read || reg_bus.write)) begin
+        if (sector_buffer_end && !dd_scb.bm_block_active) begin
+            dd_scb.bm_pending <= 1'b1;
+        end
+        if (block_done) begin
             dd_scb.bm_pending <= 1'b1;
         end
         if (reg_bus.address[10:0] == REG_CMD_SR && reg_bus.read) begin
@@ -277,10 +302,146 @@ module n64_dd (
         irq = dd_scb.cmd_interrupt || dd_scb.bm_interrupt;
     end
 
+
+    // Block buffer streaming
+
+    typedef enum bit [1:0] {
+        BLOCK_STATE_IDLE,
+        BLOCK_STATE_FETCH,
+        BLOCK_STATE_STORE_READ,
+        BLOCK_STATE_STORE_WRITE
+    } e_block_state;
+
+    e_block_state block_state;
+
+    logic block_abort;
+    logic block_last_sector;
+    logic block_last_word;
+    logic [7:0] block_sector;
+    logic [6:0] block_word;
+    logic [25:0] block_sector_address;
+
+    always_comb begin
+        block_abort = reset || n64_scb.n64_reset || (reg_bus.write && (
+            ((reg_bus.address[10:0] == REG_BM_SCR) && (
+                reg_bus.wdata[BM_CONTROL_START_BUFFER_MANAGER] ||
+                reg_bus.wdata[BM_CONTROL_BUFFER_MANAGER_RESET]
+            )) ||
+            ((reg_bus.address[10:0] == REG_RESET) && (reg_bus.wdata == 16'hAAAA))
+        ));
+        block_last_sector = ((block_sector + 1'd1) == (dd_scb.sectors_in_block - 3'd4));
+        block_last_word = (block_word == dd_scb.sector_size[7:1]);
+        mem_bus.wmask = 2'b11;
+    end
+
+    always_ff @(posedge clk) begin
+        block_sector_ready <= 1'b0;
+        block_done <= 1'b0;
+
+        if (block_abort) begin
+            dd_scb.bm_block_active <= 1'b0;
+        end else if (dd_scb.bm_block_start) begin
+            dd_scb.bm_block_active <= 1'b1;
+            block_sector <= 8'd0;
+            block_sector_address <= dd_scb.bm_block_address;
+            block_word <= 7'd0;
+            if (dd_scb.bm_transfer_mode) begin
+                block_state <= BLOCK_STATE_FETCH;
+            end else begin
+                block_sector_ready <= 1'b1;
+            end
+        end else if (dd_scb.bm_block_active && (block_state == BLOCK_STATE_IDLE) && sector_buffer_end) begin
+            block_word <= 7'd0;
+            if (dd_scb.bm_transfer_mode) begin
+                if (block_last_sector) begin
+                    dd_scb.bm_block_active <= 1'b0;
+                    block_done <= 1'b1;
+                end else begin
+                    block_sector <= block_sector + 1'd1;
+                    block_sector_address <= block_sector_address + dd_scb.sector_size + 1'd1;
+                    block_state <= BLOCK_STATE_FETCH;
+                end
+            end else begin
+                block_state <= BLOCK_STATE_STORE_READ;
+            end
+        end
+
+        case (block_state)
+            BLOCK_STATE_IDLE: begin end
+
+            BLOCK_STATE_FETCH: begin
+                if (!mem_bus.request) begin
+                    if (dd_scb.bm_block_active) begin
+                        mem_bus.request <= 1'b1;
+                        mem_bus.write <= 1'b0;
+                        mem_bus.address <= {1'b0, block_sector_address + {block_word, 1'b0}};
+                    end else begin
+                        block_state <= BLOCK_STATE_IDLE;
+                    end
+                end
+                if (mem_bus.ack) begin
+                    mem_bus.request <= 1'b0;
+                    block_word <= block_word + 1'd1;
+                    if (block_last_word) begin
+                        block_state <= BLOCK_STATE_IDLE;
+                        block_sector_ready <= dd_scb.bm_block_active;
+                    end
+                end
+            end
+
+            BLOCK_STATE_STORE_READ: begin
+                block_state <= BLOCK_STATE_STORE_WRITE;
+            end
+
+            BLOCK_STATE_STORE_WRITE: begin
+                if (!mem_bus.request) begin
+                    if (dd_scb.bm_block_active) begin
+                        mem_bus.request <= 1'b1;
+                        mem_bus.write <= 1'b1;
+                        mem_bus.address <= {1'b0, block_sector_address + {block_word, 1'b0}};
+                        mem_bus.wdata <= n64_scb.dd_rdata;
+                    end else begin
+                        block_state <= BLOCK_STATE_IDLE;
+                    end
+                end
+                if (mem_bus.ack) begin
+                    mem_bus.request <= 1'b0;
+                    block_word <= block_word + 1'd1;
+                    block_state <= BLOCK_STATE_STORE_READ;
+                    if (block_last_word) begin
+                        block_state <= BLOCK_STATE_IDLE;
+                        if (block_last_sector) begin
+                            dd_scb.bm_block_active <= 1'b0;
+                            block_done <= dd_scb.bm_block_active;
+                        end else begin
+                            block_sector <= block_sector + 1'd1;
+                            block_sector_address <= block_sector_address + dd_scb.sector_size + 1'd1;
+                            block_sector_ready <= dd_scb.bm_block_active;
+                        end
+                    end
+                end
+            end
+
+            default: begin
+                block_state <= BLOCK_STATE_IDLE;
+            end
+        endcase
+
+        if (reset) begin
+            block_state <= BLOCK_STATE_IDLE;
+            mem_bus.request <= 1'b0;
+        end
+    end
+
     always_comb begin
         n64_scb.dd_write = reg_bus.write && reg_bus.address[10:8] == MEM_SECTOR_BUFFER[10:8];
         n64_scb.dd_address = reg_bus.address[7:1];
         n64_scb.dd_wdata = reg_bus.wdata;
+        if ((block_state != BLOCK_STATE_IDLE) && dd_scb.bm_block_active) begin
+            n64_scb.dd_write = (block_state == BLOCK_STATE_FETCH) && mem_bus.ack && !block_abort;
+            n64_scb.dd_address = block_word;
+            n64_scb.dd_wdata = mem_bus.rdata;
+        end
     end
 
 endmodule
@@ -476,6 +476,35 @@ module n64_pi (
         end
     end
 
+    // ISV write snooping
+
+    const bit [26:0] ISV_SETUP_TOKEN_ADDRESS = 27'h000_0100;
+
+    always_ff @(posedge clk) begin
+        n64_scb.isv_written <= 1'b0;
+
+        if (n64_scb.isv_enabled && mem_bus.write && mem_bus.ack) begin
+            if (
+                (mem_bus.address[26:1] == {1'b0, n64_scb.isv_address[25:2], 1'b1}) ||
+                (mem_bus.address[26:1] == {ISV_SETUP_TOKEN_ADDRESS[26:2], 1'b1})
+            ) begin
+                n64_scb.isv_written <= 1'b1;
+            end
+        end
+    end
+
+    // USB stream write pointer snooping
+
+    always_ff @(posedge clk) begin
+        n64_scb.stream_written <= 1'b0;
+
+        if (n64_scb.stream_enabled && mem_bus.write && mem_bus.ack) begin
+            if (mem_bus.address[26:1] == {1'b0, n64_scb.stream_address[25:2], 1'b1}) begin
+                n64_scb.stream_written <= 1'b1;
+            end
+        end
+    end
+
     always_comb begin
         read_fifo_write = !mem_bus.write && mem_bus.ack;
         read_fifo_wdata = mem_bus.rdata;
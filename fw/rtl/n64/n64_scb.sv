@@ -62,6 +62,14 @@ interface n64_scb ();
 
     logic [15:0] save_count;
 
+    logic isv_enabled;
+    logic [25:0] isv_address;
+    logic isv_written;
+
+    logic stream_enabled;
+    logic [25:0] stream_address;
+    logic stream_written;
+
     logic cic_invalid_region;
     logic cic_disabled;
     logic cic_64dd_mode;
@@ -123,6 +131,14 @@ interface n64_scb ();
 
         input save_count,
 
+        output isv_enabled,
+        output isv_address,
+        input isv_written,
+
+        output stream_enabled,
+        output stream_address,
+        input stream_written,
+
         input cic_invalid_region,
         output cic_disabled,
         output cic_64dd_mode,
@@ -155,6 +171,14 @@ interface n64_scb ();
 
         input flashram_read_mode,
 
+        input isv_enabled,
+        input isv_address,
+        output isv_written,
+
+        input stream_enabled,
+        input stream_address,
+        output stream_written,
+
         input cfg_unlock,
 
         output pi_sdram_active,
@@ -6,6 +6,7 @@ module n64_top (
     dd_scb.dd dd_scb,
 
     mem_bus.controller mem_bus,
+    mem_bus.controller dd_mem_bus,
 
     input n64_reset,
     input n64_nmi,
@@ -69,6 +70,8 @@ module n64_top (
         .n64_scb(n64_scb),
         .dd_scb(dd_scb),
 
+        .mem_bus(dd_mem_bus),
+
         .irq(n64_dd_irq)
     );
 
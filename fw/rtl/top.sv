@@ -75,6 +75,7 @@ module top (
     fifo_bus sd_fifo_bus ();
 
     mem_bus n64_mem_bus ();
+    mem_bus dd_mem_bus ();
     mem_bus cfg_mem_bus ();
     mem_bus usb_dma_mem_bus ();
     mem_bus sd_dma_mem_bus ();
@@ -129,6 +130,7 @@ module top (
         .dd_scb(dd_scb),
 
         .mem_bus(n64_mem_bus),
+        .dd_mem_bus(dd_mem_bus),
 
         .n64_reset(n64_reset),
         .n64_nmi(n64_nmi),
@@ -217,6 +219,7 @@ module top (
         .n64_scb(n64_scb),
 
         .n64_bus(n64_mem_bus),
+        .dd_bus(dd_mem_bus),
         .cfg_bus(cfg_mem_bus),
         .usb_dma_bus(usb_dma_mem_bus),
         .sd_dma_bus(sd_dma_mem_bus),
@@ -0,0 +1,159 @@
+module memory_test_tb;
+
+    logic clk;
+    logic reset;
+
+    mem_bus mem_bus ();
+
+    logic start;
+    logic verify;
+    logic [1:0] pattern;
+    logic [26:0] starting_address;
+    logic [31:0] length;
+    logic [31:0] seed;
+
+    logic busy;
+    logic [31:0] errors;
+    logic [31:0] error_address;
+    logic [31:0] error_data;
+
+    memory_test memory_test (
+        .clk(clk),
+        .reset(reset),
+
+        .start(start),
+        .verify(verify),
+        .pattern(pattern),
+        .starting_address(starting_address),
+        .length(length),
+        .seed(seed),
+
+        .busy(busy),
+        .errors(errors),
+        .error_address(error_address),
+        .error_data(error_data),
+
+        .mem_bus(mem_bus)
+    );
+
+    logic [15:0] memory [0:1023];
+
+    always_ff @(posedge clk) begin
+        mem_bus.ack <= 1'b0;
+        if (mem_bus.request && !mem_bus.ack) begin
+            mem_bus.ack <= 1'b1;
+            mem_bus.rdata <= memory[mem_bus.address[10:1]];
+            if (mem_bus.write) begin
+                memory[mem_bus.address[10:1]] <= mem_bus.wdata;
+            end
+        end
+    end
+
+    initial begin
+        clk = 1'b0;
+        forever begin
+            clk = ~clk; #0.5;
+        end
+    end
+
+    initial begin
+        reset = 1'b0;
+        #10;
+        reset = 1'b1;
+        #10;
+        reset = 1'b0;
+    end
+
+    localparam bit [26:0] TEST_ADDRESS = 27'h100;
+    localparam int TEST_LENGTH = 64;
+
+    task automatic run (input bit test_verify);
+        @(posedge clk);
+        verify <= test_verify;
+        start <= 1'b1;
+        @(posedge clk);
+        start <= 1'b0;
+        @(posedge clk);
+        while (busy) begin
+            @(posedge clk);
+        end
+    endtask
+
+    task automatic check (input [1:0] test_pattern, input [31:0] test_seed);
+        logic [31:0] lfsr;
+        logic [31:0] word;
+        logic [26:0] address;
+        logic [15:0] expected;
+
+        pattern <= test_pattern;
+        seed <= test_seed;
+        starting_address <= TEST_ADDRESS;
+        length <= TEST_LENGTH;
+
+        run(1'b0);
+
+        lfsr = test_seed;
+        for (int i = 0; i < TEST_LENGTH; i++) begin
+            address = TEST_ADDRESS + 27'(i * 2);
+            case (test_pattern)
+                2'd1: word = {5'd0, address[26:2], 2'b00} ^ test_seed;
+                2'd2: word = lfsr;
+                2'd3: word = {16'd1 << {address[4:2], 1'b0}, 16'd1 << {address[4:2], 1'b1}} ^ test_seed;
+                default: word = test_seed;
+            endcase
+            expected = address[1] ? word[15:0] : word[31:16];
+            if (address[1]) begin
+                lfsr = {1'b0, lfsr[31:1]} ^ (lfsr[0] ? 32'hD0000001 : 32'd0);
+            end
+            if (memory[address[10:1]] !== expected) begin
+                $error("Pattern %0d: 0x%04X written at 0x%07X, expected 0x%04X", test_pattern, memory[address[10:1]], address, expected);
+            end
+        end
+
+        run(1'b1);
+
+        if (errors != 32'd0) begin
+            $error("Pattern %0d: %0d errors reported on unchanged memory", test_pattern, errors);
+        end
+
+        address = TEST_ADDRESS + 27'h2A;
+        expected = memory[address[10:1]];
+        memory[address[10:1]] = expected ^ 16'h0100;
+
+        run(1'b1);
+
+        if ((errors != 32'd1) || (error_address != {5'd0, address}) || (error_data != {expected, expected ^ 16'h0100})) begin
+            $error("Pattern %0d: corrupted word not reported (%0d errors, 0x%08X, 0x%08X)", test_pattern, errors, error_address, error_data);
+        end
+    endtask
+
+    initial begin
+        $dumpfile("traces/memory_test_tb.vcd");
+
+        start = 1'b0;
+
+        #100;
+
+        $dumpvars();
+
+        check(2'd0, 32'hAAAA5555);
+        check(2'd1, 32'h00000000);
+        check(2'd1, 32'hFFFFFFFF);
+        check(2'd2, 32'h12345678);
+        check(2'd3, 32'h00000000);
+        check(2'd3, 32'hFFFFFFFF);
+
+        pattern <= 2'd0;
+        length <= 32'd0;
+        run(1'b1);
+
+        if (busy || (errors != 32'd1)) begin
+            $error("Zero length test was not ignored");
+        end
+
+        #100;
+
+        $finish;
+    end
+
+endmodule
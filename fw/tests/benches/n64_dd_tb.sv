@@ -0,0 +1,275 @@
+module n64_dd_tb;
+
+    logic clk;
+    logic reset;
+
+    n64_reg_bus reg_bus ();
+    n64_scb n64_scb ();
+    dd_scb dd_scb ();
+    mem_bus mem_bus ();
+
+    logic irq;
+
+    n64_dd n64_dd (
+        .clk(clk),
+        .reset(reset),
+
+        .reg_bus(reg_bus),
+
+        .n64_scb(n64_scb),
+        .dd_scb(dd_scb),
+
+        .mem_bus(mem_bus),
+
+        .irq(irq)
+    );
+
+    logic [15:0] sector_buffer [0:127];
+
+    always_ff @(posedge clk) begin
+        if (n64_scb.dd_write) begin
+            sector_buffer[n64_scb.dd_address] <= n64_scb.dd_wdata;
+        end
+        n64_scb.dd_rdata <= sector_buffer[n64_scb.dd_address];
+    end
+
+    logic [15:0] memory [0:1023];
+    logic [3:0] memory_latency;
+    logic [3:0] memory_delay;
+
+    always_ff @(posedge clk) begin
+        mem_bus.ack <= 1'b0;
+        if (reset) begin
+            memory_delay <= 4'd0;
+        end else if (mem_bus.request && !mem_bus.ack) begin
+            if (memory_delay >= memory_latency) begin
+                memory_delay <= 4'd0;
+                mem_bus.ack <= 1'b1;
+                mem_bus.rdata <= memory[mem_bus.address[10:1]];
+                if (mem_bus.write) begin
+                    memory[mem_bus.address[10:1]] <= mem_bus.wdata;
+                end
+            end else begin
+                memory_delay <= memory_delay + 1'd1;
+            end
+        end
+    end
+
+    initial begin
+        clk = 1'b0;
+        forever begin
+            clk = ~clk; #0.5;
+        end
+    end
+
+    initial begin
+        reset = 1'b0;
+        #10;
+        reset = 1'b1;
+        #10;
+        reset = 1'b0;
+    end
+
+    localparam bit [10:0] SECTOR_BUFFER = 11'h400;
+    localparam bit [10:0] REG_CMD_SR = 11'h508;
+    localparam bit [10:0] REG_BM_SCR = 11'h510;
+    localparam bit [10:0] REG_SEC_SIZ = 11'h528;
+    localparam bit [10:0] REG_SEC_INFO = 11'h530;
+
+    localparam bit [15:0] BM_START = 16'h8000;
+    localparam bit [15:0] BM_MODE_READ = 16'h4000;
+    localparam bit [15:0] BM_RESET = 16'h1000;
+
+    localparam int SECTOR_WORDS = 4;
+    localparam int SECTORS = 3;
+    localparam bit [25:0] READ_BLOCK_ADDRESS = 26'h200;
+    localparam bit [25:0] WRITE_BLOCK_ADDRESS = 26'h300;
+
+    task automatic reg_write (input [10:0] address, input [15:0] data);
+        @(posedge clk);
+        reg_bus.address <= {6'd0, address};
+        reg_bus.wdata <= data;
+        reg_bus.write <= 1'b1;
+        @(posedge clk);
+        reg_bus.write <= 1'b0;
+    endtask
+
+    task automatic reg_read (input [10:0] address, output [15:0] data);
+        @(posedge clk);
+        reg_bus.address <= {6'd0, address};
+        reg_bus.read <= 1'b1;
+        @(posedge clk);
+        reg_bus.read <= 1'b0;
+        @(posedge clk);
+        data = reg_bus.rdata;
+    endtask
+
+    task automatic block_start (input bit read, input [25:0] address);
+        reg_write(REG_BM_SCR, BM_START | (read ? BM_MODE_READ : 16'h0000));
+        @(posedge clk);
+        dd_scb.bm_block_address <= address;
+        dd_scb.bm_block_start <= 1'b1;
+        @(posedge clk);
+        dd_scb.bm_block_start <= 1'b0;
+    endtask
+
+    task automatic wait_sector;
+        logic [15:0] status;
+        for (int timeout = 0; !dd_scb.bm_interrupt; timeout++) begin
+            if (timeout == 1000) begin
+                $error("Sector interrupt timed out");
+                break;
+            end
+            @(posedge clk);
+        end
+        reg_read(REG_CMD_SR, status);
+    endtask
+
+    task automatic check_block_end (input string name);
+        repeat (4) @(posedge clk);
+        if (dd_scb.bm_block_active || !dd_scb.bm_pending) begin
+            $error("%s: block not finished (active %b, pending %b)", name, dd_scb.bm_block_active, dd_scb.bm_pending);
+        end
+    endtask
+
+    task automatic test_read;
+        logic [15:0] data;
+        logic [15:0] expected;
+
+        for (int i = 0; i < (SECTORS * SECTOR_WORDS); i++) begin
+            memory[10'((READ_BLOCK_ADDRESS / 2) + i)] = 16'(16'hA000 + i);
+        end
+
+        block_start(1'b1, READ_BLOCK_ADDRESS);
+
+        for (int sector = 0; sector < SECTORS; sector++) begin
+            wait_sector();
+            for (int word = 0; word < SECTOR_WORDS; word++) begin
+                reg_read(SECTOR_BUFFER + 11'(word * 2), data);
+                expected = 16'(16'hA000 + (sector * SECTOR_WORDS) + word);
+                if (data !== expected) begin
+                    $error("Read: sector %0d word %0d is 0x%04X, expected 0x%04X", sector, word, data, expected);
+                end
+            end
+        end
+
+        check_block_end("Read");
+    endtask
+
+    task automatic test_write;
+        logic [15:0] expected;
+
+        block_start(1'b0, WRITE_BLOCK_ADDRESS);
+
+        for (int sector = 0; sector < SECTORS; sector++) begin
+            wait_sector();
+            for (int word = 0; word < SECTOR_WORDS; word++) begin
+                reg_write(SECTOR_BUFFER + 11'(word * 2), 16'(16'hB000 + (sector * SECTOR_WORDS) + word));
+            end
+            repeat (4 * SECTOR_WORDS * (memory_latency + 4)) @(posedge clk);
+        end
+
+        check_block_end("Write");
+
+        for (int i = 0; i < (SECTORS * SECTOR_WORDS); i++) begin
+            expected = 16'(16'hB000 + i);
+            if (memory[10'((WRITE_BLOCK_ADDRESS / 2) + i)] !== expected) begin
+                $error("Write: block word %0d is 0x%04X, expected 0x%04X", i, memory[10'((WRITE_BLOCK_ADDRESS / 2) + i)], expected);
+            end
+        end
+    endtask
+
+    task automatic test_abort;
+        logic [15:0] data;
+
+        for (int word = 0; word < SECTOR_WORDS; word++) begin
+            reg_write(SECTOR_BUFFER + 11'(word * 2), 16'h5555);
+        end
+
+        // Abort while the first fetch waits for the memory, its data must not reach the sector buffer
+        memory_latency = 4'd8;
+
+        block_start(1'b1, READ_BLOCK_ADDRESS);
+
+        while (!mem_bus.request) begin
+            @(posedge clk);
+        end
+
+        reg_write(REG_BM_SCR, BM_RESET);
+
+        repeat (32) @(posedge clk);
+
+        if (dd_scb.bm_block_active || dd_scb.bm_interrupt || mem_bus.request) begin
+            $error("Abort: block still running (active %b, interrupt %b)", dd_scb.bm_block_active, dd_scb.bm_interrupt);
+        end
+
+        for (int word = 0; word < SECTOR_WORDS; word++) begin
+            reg_read(SECTOR_BUFFER + 11'(word * 2), data);
+            if (data !== 16'h5555) begin
+                $error("Abort: sector buffer word %0d overwritten with 0x%04X", word, data);
+            end
+        end
+
+        memory_latency = 4'd0;
+    endtask
+
+    initial begin
+        $dumpfile("traces/n64_dd_tb.vcd");
+
+        reg_bus.flashram_select = 1'b0;
+        reg_bus.dd_select = 1'b1;
+        reg_bus.cfg_select = 1'b0;
+        reg_bus.read = 1'b0;
+        reg_bus.write = 1'b0;
+        reg_bus.address = 17'd0;
+        reg_bus.wdata = 16'd0;
+
+        n64_scb.n64_reset = 1'b0;
+        n64_scb.n64_nmi = 1'b0;
+
+        dd_scb.hard_reset_clear = 1'b0;
+        dd_scb.cmd_data = 16'd0;
+        dd_scb.cmd_ready = 1'b0;
+        dd_scb.bm_start_clear = 1'b0;
+        dd_scb.bm_stop_clear = 1'b0;
+        dd_scb.bm_transfer_c2 = 1'b0;
+        dd_scb.bm_transfer_data = 1'b0;
+        dd_scb.bm_micro_error = 1'b0;
+        dd_scb.bm_clear = 1'b0;
+        dd_scb.bm_ready = 1'b0;
+        dd_scb.disk_inserted = 1'b1;
+        dd_scb.disk_changed = 1'b0;
+        dd_scb.index_lock = 1'b0;
+        dd_scb.head_track = 13'd0;
+        dd_scb.drive_id = 16'd0;
+        dd_scb.bm_block_start = 1'b0;
+        dd_scb.bm_block_address = 26'd0;
+
+        memory_latency = 4'd0;
+
+        #100;
+
+        $dumpvars();
+
+        // 8 byte sectors, 3 data sectors + 4 C2 sectors in a block
+        reg_write(REG_SEC_SIZ, 16'h0007);
+        reg_write(REG_SEC_INFO, 16'h0707);
+
+        test_read();
+        reg_write(REG_BM_SCR, BM_RESET);
+
+        memory_latency = 4'd2;
+        test_read();
+        reg_write(REG_BM_SCR, BM_RESET);
+
+        test_write();
+        reg_write(REG_BM_SCR, BM_RESET);
+
+        test_abort();
+
+        #100;
+
+        $finish;
+    end
+
+endmodule
@@ -0,0 +1,362 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <verilated.h>
+#include <verilated_vcd_c.h>
+#include "Vcosim_top.h"
+#include "cosim.h"
+#include "models.h"
+
+
+#define CLOCK_FREQUENCY             (100000000ULL)
+#define CLOCK_PERIOD_PS             (1000000000000ULL / CLOCK_FREQUENCY)
+#define CYCLES_PER_US               (CLOCK_FREQUENCY / 1000000ULL)
+
+#define RESET_CYCLES                (64)
+
+// MCU runs SPI at 8 MHz, half period is expressed in FPGA clock cycles
+#define SPI_DEFAULT_HALF_PERIOD     (6)
+#define SPI_CS_SETUP_CYCLES         (8)
+
+#define COMMAND_IDS                 (256)
+#define PACKET_HEADER_LENGTH        (8)
+
+
+typedef struct {
+    uint64_t count;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+} latency_t;
+
+struct cosim {
+    VerilatedContext *context;
+    Vcosim_top *top;
+    VerilatedVcdC *trace;
+
+    uint64_t cycle;
+    uint64_t cycle_limit;
+    uint64_t report_interval;
+    uint64_t next_report;
+    struct timespec start_time;
+    volatile sig_atomic_t stop;
+
+    uint64_t systick_period;
+    uint64_t systick_next;
+    void (*systick_callback) (void);
+
+    uint32_t spi_half_period;
+    uint64_t spi_transactions;
+    uint64_t spi_bytes;
+    uint64_t spi_cycles;
+    uint64_t spi_start_cycle;
+
+    bool request_pending;
+    uint64_t request_cycle;
+    uint8_t response_header[PACKET_HEADER_LENGTH];
+    uint32_t response_index;
+    uint32_t response_remaining;
+    uint64_t response_cycle;
+    latency_t latency[COMMAND_IDS];
+};
+
+static struct cosim p;
+
+
+static double cosim_cycles_to_us (uint64_t cycles) {
+    return ((double) (cycles) / CYCLES_PER_US);
+}
+
+static double cosim_throughput (uint64_t bytes, uint64_t cycles) {
+    if (cycles == 0) {
+        return 0.0;
+    }
+    return (((double) (bytes) / (1024.0 * 1024.0)) / (cosim_cycles_to_us(cycles) / 1000000.0));
+}
+
+static double cosim_percent (uint64_t part, uint64_t total) {
+    return ((total > 0) ? ((100.0 * part) / total) : 0.0);
+}
+
+static void cosim_report (void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double wall_time = ((now.tv_sec - p.start_time.tv_sec) + ((now.tv_nsec - p.start_time.tv_nsec) / 1e9));
+
+    sdram_stats_t sdram = sdram_stats_get();
+    flash_stats_t flash = flash_stats_get();
+    sd_card_stats_t sd = sd_card_stats_get();
+    ft1248_stats_t usb = ft1248_stats_get();
+
+    uint64_t usb_rx_window = (usb.last_rx_cycle - usb.first_rx_cycle);
+    uint64_t usb_tx_window = (usb.last_tx_cycle - usb.first_tx_cycle);
+
+    fprintf(stderr, "\n");
+    fprintf(stderr, "%-32s %.3f ms (%lu cycles)\n", "simulated time", (cosim_cycles_to_us(p.cycle) / 1000.0), p.cycle);
+    fprintf(stderr, "%-32s %.3f s (%.1f kcycles/s)\n", "wall time", wall_time, ((wall_time > 0) ? ((p.cycle / wall_time) / 1000.0) : 0.0));
+    fprintf(stderr, "%-32s %lu txn, %lu bytes, %.1f%% busy\n", "mcu spi", p.spi_transactions, p.spi_bytes, cosim_percent(p.spi_cycles, p.cycle));
+    fprintf(stderr, "%-32s %lu bytes, %.2f MiB/s\n", "usb host -> device", usb.rx_bytes, cosim_throughput(usb.rx_bytes, usb_rx_window));
+    fprintf(stderr, "%-32s %lu bytes, %.2f MiB/s\n", "usb device -> host", usb.tx_bytes, cosim_throughput(usb.tx_bytes, usb_tx_window));
+    fprintf(stderr, "%-32s %lu txn, %.1f%% busy\n", "usb ft1248 bus", usb.transactions, cosim_percent(usb.busy_cycles, p.cycle));
+    fprintf(stderr, "%-32s %lu act, %lu rd, %lu wr, %lu ref, %.1f%% data bus\n", "sdram", sdram.activates, sdram.reads, sdram.writes, sdram.refreshes, cosim_percent(sdram.reads + sdram.writes, p.cycle));
+    fprintf(stderr, "%-32s %lu rd, %lu prog, %lu erase\n", "flash", flash.reads, flash.programs, flash.erases);
+    fprintf(stderr, "%-32s %lu cmd, %lu rd, %lu wr, %lu crc err, %.1f%% busy\n", "sd card", sd.commands, sd.sectors_read, sd.sectors_written, sd.crc_errors, cosim_percent(sd.busy_cycles, p.cycle));
+
+    bool header = false;
+    for (int id = 0; id < COMMAND_IDS; id++) {
+        latency_t *latency = &p.latency[id];
+        if (latency->count == 0) {
+            continue;
+        }
+        if (!header) {
+            fprintf(stderr, "%-32s %8s %12s %12s %12s\n", "usb command latency", "count", "min_us", "avg_us", "max_us");
+            header = true;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "  '%c' (0x%02X)", ((id >= 0x20) && (id < 0x7F)) ? id : '?', id);
+        fprintf(
+            stderr,
+            "%-32s %8lu %12.1f %12.1f %12.1f\n",
+            name,
+            latency->count,
+            cosim_cycles_to_us(latency->min),
+            cosim_cycles_to_us(latency->total / latency->count),
+            cosim_cycles_to_us(latency->max)
+        );
+    }
+}
+
+
+static void cosim_usb_rx_byte (uint8_t data, uint64_t cycle) {
+    if (!p.request_pending) {
+        p.request_pending = true;
+        p.request_cycle = cycle;
+    }
+}
+
+static void cosim_usb_tx_byte (uint8_t data, uint64_t cycle) {
+    if (p.response_remaining > 0) {
+        p.response_remaining -= 1;
+        return;
+    }
+
+    if (p.response_index == 0) {
+        p.response_cycle = cycle;
+    }
+    p.response_header[p.response_index++] = data;
+    if (p.response_index < PACKET_HEADER_LENGTH) {
+        return;
+    }
+    p.response_index = 0;
+
+    uint8_t *header = p.response_header;
+    p.response_remaining = ((header[4] << 24) | (header[5] << 16) | (header[6] << 8) | header[7]);
+
+    bool response = ((memcmp(header, "CMP", 3) == 0) || (memcmp(header, "ERR", 3) == 0));
+    if (response && p.request_pending) {
+        latency_t *latency = &p.latency[header[3]];
+        uint64_t cycles = (p.response_cycle - p.request_cycle);
+        if ((latency->count == 0) || (cycles < latency->min)) {
+            latency->min = cycles;
+        }
+        if (cycles > latency->max) {
+            latency->max = cycles;
+        }
+        latency->total += cycles;
+        latency->count += 1;
+        p.request_pending = false;
+    }
+}
+
+
+static void cosim_cycle (void) {
+    p.top->inclk = 0;
+    p.top->eval();
+    if (p.trace != NULL) {
+        p.trace->dump(p.cycle * CLOCK_PERIOD_PS);
+    }
+
+    p.top->inclk = 1;
+    p.top->eval();
+    if (p.trace != NULL) {
+        p.trace->dump((p.cycle * CLOCK_PERIOD_PS) + (CLOCK_PERIOD_PS / 2));
+    }
+
+    p.cycle += 1;
+
+    sdram_eval(p.top, p.cycle);
+    flash_eval(p.top, p.cycle);
+    sd_card_eval(p.top, p.cycle);
+    ft1248_eval(p.top, p.cycle);
+
+    if ((p.systick_callback != NULL) && (p.cycle >= p.systick_next)) {
+        p.systick_next += p.systick_period;
+        p.systick_callback();
+    }
+
+    if ((p.report_interval > 0) && (p.cycle >= p.next_report)) {
+        p.next_report += p.report_interval;
+        cosim_report();
+    }
+
+    if (p.stop || ((p.cycle_limit > 0) && (p.cycle >= p.cycle_limit))) {
+        cosim_exit(0);
+    }
+}
+
+static void cosim_signal_handler (int signal) {
+    p.stop = 1;
+}
+
+static void cosim_usage (const char *name) {
+    fprintf(stderr, "Usage: %s [options]\n", name);
+    fprintf(stderr, "  --sd <image>            SD card image file (card slot is empty when omitted)\n");
+    fprintf(stderr, "  --trace <file.vcd>      Dump waveforms of the whole design\n");
+    fprintf(stderr, "  --cycles <count>        Stop after given number of FPGA clock cycles\n");
+    fprintf(stderr, "  --report <ms>           Print statistics every given amount of simulated time\n");
+    fprintf(stderr, "  --spi-half-period <n>   MCU SPI clock half period in FPGA clock cycles (default %d)\n", SPI_DEFAULT_HALF_PERIOD);
+}
+
+
+void cosim_tick (uint64_t cycles) {
+    for (uint64_t i = 0; i < cycles; i++) {
+        cosim_cycle();
+    }
+}
+
+void cosim_delay_us (uint64_t delay_us) {
+    cosim_tick(delay_us * CYCLES_PER_US);
+}
+
+uint64_t cosim_time_us (void) {
+    return (p.cycle / CYCLES_PER_US);
+}
+
+void cosim_systick_config (uint32_t period_ms, void (*callback) (void)) {
+    p.systick_period = (period_ms * 1000ULL * CYCLES_PER_US);
+    p.systick_next = (p.cycle + p.systick_period);
+    p.systick_callback = callback;
+}
+
+void cosim_spi_start (void) {
+    p.spi_start_cycle = p.cycle;
+    p.top->mcu_cs = 0;
+    cosim_tick(SPI_CS_SETUP_CYCLES);
+}
+
+void cosim_spi_stop (void) {
+    cosim_tick(SPI_CS_SETUP_CYCLES);
+    p.top->mcu_cs = 1;
+    cosim_tick(SPI_CS_SETUP_CYCLES);
+    p.spi_transactions += 1;
+    p.spi_cycles += (p.cycle - p.spi_start_cycle);
+}
+
+void cosim_spi_transfer (uint8_t *tx_data, uint8_t *rx_data, int length) {
+    for (int i = 0; i < length; i++) {
+        uint8_t tx = ((tx_data != NULL) ? tx_data[i] : 0x00);
+        uint8_t rx = 0;
+        for (int bit = 7; bit >= 0; bit--) {
+            p.top->mcu_mosi = ((tx >> bit) & (1 << 0));
+            p.top->mcu_clk = 1;
+            cosim_tick(p.spi_half_period);
+            rx = ((rx << 1) | (p.top->mcu_miso & (1 << 0)));
+            p.top->mcu_clk = 0;
+            cosim_tick(p.spi_half_period);
+        }
+        if (rx_data != NULL) {
+            rx_data[i] = rx;
+        }
+    }
+    p.spi_bytes += length;
+}
+
+void cosim_exit (int status) {
+    cosim_report();
+    if (p.trace != NULL) {
+        p.trace->close();
+    }
+    p.top->final();
+    ft1248_deinit();
+    sd_card_deinit();
+    exit(status);
+}
+
+
+int main (int argc, char *argv[]) {
+    const char *sd_image_path = NULL;
+    const char *trace_path = NULL;
+    const char *port_path = NULL;
+
+    p.spi_half_period = SPI_DEFAULT_HALF_PERIOD;
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = ((i + 1) < argc);
+        if (has_value && (strcmp(argv[i], "--sd") == 0)) {
+            sd_image_path = argv[++i];
+        } else if (has_value && (strcmp(argv[i], "--trace") == 0)) {
+            trace_path = argv[++i];
+        } else if (has_value && (strcmp(argv[i], "--cycles") == 0)) {
+            p.cycle_limit = strtoull(argv[++i], NULL, 0);
+        } else if (has_value && (strcmp(argv[i], "--report") == 0)) {
+            p.report_interval = (strtoull(argv[++i], NULL, 0) * 1000ULL * CYCLES_PER_US);
+            p.next_report = p.report_interval;
+        } else if (has_value && (strcmp(argv[i], "--spi-half-period") == 0)) {
+            p.spi_half_period = strtoul(argv[++i], NULL, 0);
+        } else {
+            cosim_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (p.spi_half_period < 4) {
+        fprintf(stderr, "SPI half period must be at least 4 cycles to pass FPGA input synchronizers\n");
+        return 1;
+    }
+
+    sdram_init();
+    flash_init();
+    if (sd_card_init(sd_image_path)) {
+        fprintf(stderr, "Couldn't open SD card image [%s]\n", sd_image_path);
+        return 1;
+    }
+    if (ft1248_init(&port_path)) {
+        fprintf(stderr, "Couldn't create pseudo terminal\n");
+        return 1;
+    }
+    ft1248_set_callbacks(cosim_usb_rx_byte, cosim_usb_tx_byte);
+
+    p.context = new VerilatedContext;
+    p.context->commandArgs(argc, argv);
+    p.top = new Vcosim_top(p.context);
+
+    if (trace_path != NULL) {
+        p.context->traceEverOn(true);
+        p.trace = new VerilatedVcdC;
+        p.top->trace(p.trace, 99);
+        p.trace->open(trace_path);
+    }
+
+    p.top->mcu_cs = 1;
+    p.top->mcu_clk = 0;
+    p.top->mcu_mosi = 0;
+    p.top->button = 1;
+    p.top->sd_det = (sd_card_inserted() ? 0 : 1);
+    p.top->usb_pwrsav = 1;
+    p.top->usb_miso = 1;
+
+    signal(SIGINT, cosim_signal_handler);
+    signal(SIGTERM, cosim_signal_handler);
+
+    clock_gettime(CLOCK_MONOTONIC, &p.start_time);
+
+    cosim_tick(RESET_CYCLES);
+
+    fprintf(stderr, "Co-simulation running, connect with: sc64deployer --port serial://%s\n", port_path);
+
+    app();
+
+    return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef COSIM_H__
+#define COSIM_H__
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void cosim_tick (uint64_t cycles);
+void cosim_delay_us (uint64_t delay_us);
+uint64_t cosim_time_us (void);
+void cosim_systick_config (uint32_t period_ms, void (*callback) (void));
+
+void cosim_spi_start (void);
+void cosim_spi_stop (void);
+void cosim_spi_transfer (uint8_t *tx_data, uint8_t *rx_data, int length);
+
+void cosim_exit (int status);
+
+void app (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
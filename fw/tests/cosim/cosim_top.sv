@@ -0,0 +1,144 @@
+module cosim_top (
+    input inclk,
+
+    input usb_pwrsav,
+    output usb_clk,
+    output usb_cs,
+    input usb_miso,
+    output [7:0] usb_miosi_o,
+    input [7:0] usb_miosi_i,
+    input usb_miosi_oe,
+
+    input sd_det,
+    output sd_clk,
+    output sd_cmd_o,
+    input sd_cmd_i,
+    input sd_cmd_oe,
+    output [3:0] sd_dat_o,
+    input [3:0] sd_dat_i,
+    input [3:0] sd_dat_oe,
+
+    output sdram_cs,
+    output sdram_ras,
+    output sdram_cas,
+    output sdram_we,
+    output [1:0] sdram_ba,
+    output [12:0] sdram_a,
+    output [1:0] sdram_dqm,
+    output [15:0] sdram_dq_o,
+    input [15:0] sdram_dq_i,
+    input sdram_dq_oe,
+
+    output flash_clk,
+    output flash_cs,
+    output [3:0] flash_dq_o,
+    input [3:0] flash_dq_i,
+    input [3:0] flash_dq_oe,
+
+    input button,
+
+    output mcu_int,
+    input mcu_clk,
+    input mcu_cs,
+    input mcu_mosi,
+    output mcu_miso
+);
+
+    // Bidirectional pins, models drive them through separate input and output enable ports
+
+    wire [7:0] usb_miosi;
+    tri1 sd_cmd;
+    tri1 [3:0] sd_dat;
+    wire [15:0] sdram_dq;
+    tri1 [3:0] flash_dq;
+    tri1 mcu_miso_pin;
+
+    assign usb_miosi = usb_miosi_oe ? usb_miosi_i : 8'hZZ;
+    assign sd_cmd = sd_cmd_oe ? sd_cmd_i : 1'bZ;
+    assign sdram_dq = sdram_dq_oe ? sdram_dq_i : 16'hZZZZ;
+
+    genvar i;
+
+    generate
+        for (i = 0; i < 4; i++) begin : tristate_drivers
+            assign sd_dat[i] = sd_dat_oe[i] ? sd_dat_i[i] : 1'bZ;
+            assign flash_dq[i] = flash_dq_oe[i] ? flash_dq_i[i] : 1'bZ;
+        end
+    endgenerate
+
+    assign usb_miosi_o = usb_miosi;
+    assign sd_cmd_o = sd_cmd;
+    assign sd_dat_o = sd_dat;
+    assign sdram_dq_o = sdram_dq;
+    assign flash_dq_o = flash_dq;
+    assign mcu_miso = mcu_miso_pin;
+
+
+    // N64 side is kept in reset, console bus is idle
+
+    wire [15:0] n64_pi_ad;
+    tri1 n64_si_dq;
+    tri1 n64_cic_dq;
+    wire n64_irq;
+    wire sdram_clk;
+    wire n64_video_sync;
+    wire [2:0] test_point;
+
+    top top_inst (
+        .inclk(inclk),
+
+        .n64_reset(1'b0),
+        .n64_nmi(1'b1),
+        .n64_irq(n64_irq),
+
+        .n64_pi_alel(1'b0),
+        .n64_pi_aleh(1'b0),
+        .n64_pi_read(1'b1),
+        .n64_pi_write(1'b1),
+        .n64_pi_ad(n64_pi_ad),
+
+        .n64_si_clk(1'b1),
+        .n64_si_dq(n64_si_dq),
+
+        .n64_cic_clk(1'b1),
+        .n64_cic_dq(n64_cic_dq),
+
+        .usb_pwrsav(usb_pwrsav),
+        .usb_clk(usb_clk),
+        .usb_cs(usb_cs),
+        .usb_miso(usb_miso),
+        .usb_miosi(usb_miosi),
+
+        .sd_det(sd_det),
+        .sd_clk(sd_clk),
+        .sd_cmd(sd_cmd),
+        .sd_dat(sd_dat),
+
+        .sdram_clk(sdram_clk),
+        .sdram_cs(sdram_cs),
+        .sdram_ras(sdram_ras),
+        .sdram_cas(sdram_cas),
+        .sdram_we(sdram_we),
+        .sdram_ba(sdram_ba),
+        .sdram_a(sdram_a),
+        .sdram_dqm(sdram_dqm),
+        .sdram_dq(sdram_dq),
+
+        .flash_clk(flash_clk),
+        .flash_cs(flash_cs),
+        .flash_dq(flash_dq),
+
+        .button(button),
+
+        .mcu_int(mcu_int),
+        .mcu_clk(mcu_clk),
+        .mcu_cs(mcu_cs),
+        .mcu_mosi(mcu_mosi),
+        .mcu_miso(mcu_miso_pin),
+
+        .n64_video_sync(n64_video_sync),
+
+        .test_point(test_point)
+    );
+
+endmodule
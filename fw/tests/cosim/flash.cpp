@@ -0,0 +1,192 @@
+#include <string.h>
+#include <vector>
+#include "models.h"
+
+
+#define FLASH_LENGTH                (16 * 1024 * 1024)
+#define FLASH_PAGE_LENGTH           (256)
+#define FLASH_BLOCK_LENGTH          (64 * 1024)
+
+#define FLASH_CMD_PAGE_PROGRAM      (0x02)
+#define FLASH_CMD_READ_STATUS_1     (0x05)
+#define FLASH_CMD_WRITE_ENABLE      (0x06)
+#define FLASH_CMD_BLOCK_ERASE_64KB  (0xD8)
+#define FLASH_CMD_FAST_READ_QUAD_IO (0xEB)
+
+#define FAST_READ_DATA_INDEX        (7)
+
+#define STATUS_1_WEL                (1 << 1)
+
+
+struct flash_model {
+    std::vector<uint8_t> memory;
+    bool last_cs;
+    bool last_clk;
+    bool write_enabled;
+    bool quad;
+    bool output;
+    uint32_t index;
+    uint8_t bits;
+    uint8_t shift;
+    uint8_t cmd;
+    uint32_t address;
+    flash_stats_t stats;
+};
+
+static struct flash_model p;
+
+
+static void flash_select (void) {
+    p.quad = false;
+    p.output = false;
+    p.index = 0;
+    p.bits = 0;
+    p.shift = 0;
+    p.cmd = 0;
+    p.address = 0;
+}
+
+static void flash_deselect (void) {
+    switch (p.cmd) {
+        case FLASH_CMD_WRITE_ENABLE:
+            p.write_enabled = true;
+            break;
+
+        case FLASH_CMD_BLOCK_ERASE_64KB:
+            if (p.write_enabled && (p.index >= 4)) {
+                uint32_t block = (p.address & ~(FLASH_BLOCK_LENGTH - 1) & (FLASH_LENGTH - 1));
+                memset(&p.memory[block], 0xFF, FLASH_BLOCK_LENGTH);
+                p.stats.erases += 1;
+            }
+            p.write_enabled = false;
+            break;
+
+        case FLASH_CMD_PAGE_PROGRAM:
+            p.write_enabled = false;
+            break;
+
+        default:
+            break;
+    }
+    p.cmd = 0;
+    p.output = false;
+}
+
+static void flash_byte_received (uint8_t data) {
+    uint32_t index = p.index++;
+
+    if (index == 0) {
+        p.cmd = data;
+        if (p.cmd == FLASH_CMD_FAST_READ_QUAD_IO) {
+            p.quad = true;
+        }
+        if (p.cmd == FLASH_CMD_READ_STATUS_1) {
+            p.output = true;
+            p.shift = (p.write_enabled ? STATUS_1_WEL : 0);
+        }
+        return;
+    }
+
+    if (index <= 3) {
+        p.address = ((p.address << 8) | data);
+        return;
+    }
+
+    switch (p.cmd) {
+        case FLASH_CMD_PAGE_PROGRAM:
+            if (p.write_enabled) {
+                p.memory[p.address & (FLASH_LENGTH - 1)] &= data;
+                p.address = ((p.address & ~(FLASH_PAGE_LENGTH - 1)) | ((p.address + 1) & (FLASH_PAGE_LENGTH - 1)));
+                p.stats.programs += 1;
+            }
+            break;
+
+        case FLASH_CMD_FAST_READ_QUAD_IO:
+            // Mode byte and four dummy clocks, data follows
+            if ((index + 1) == FAST_READ_DATA_INDEX) {
+                p.output = true;
+                p.bits = 0;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void flash_clock_rising (Vcosim_top *top) {
+    if (p.output) {
+        return;
+    }
+    if (p.quad) {
+        p.shift = ((p.shift << 4) | (top->flash_dq_o & 0x0F));
+        p.bits += 4;
+    } else {
+        p.shift = ((p.shift << 1) | (top->flash_dq_o & (1 << 0)));
+        p.bits += 1;
+    }
+    if (p.bits == 8) {
+        p.bits = 0;
+        flash_byte_received(p.shift);
+    }
+}
+
+static void flash_clock_falling (Vcosim_top *top) {
+    if (!p.output) {
+        return;
+    }
+    if (p.cmd == FLASH_CMD_FAST_READ_QUAD_IO) {
+        uint8_t data = p.memory[p.address & (FLASH_LENGTH - 1)];
+        top->flash_dq_i = ((p.bits == 0) ? (data >> 4) : data) & 0x0F;
+        top->flash_dq_oe = 0x0F;
+        p.bits ^= 4;
+        if (p.bits == 0) {
+            p.address += 1;
+            p.stats.reads += 1;
+        }
+    } else {
+        top->flash_dq_i = ((p.shift & (1 << 7)) ? (1 << 1) : 0);
+        top->flash_dq_oe = (1 << 1);
+        p.shift <<= 1;
+    }
+}
+
+
+void flash_init (void) {
+    p.memory.assign(FLASH_LENGTH, 0xFF);
+    p.last_cs = true;
+    p.last_clk = false;
+    p.write_enabled = false;
+    flash_select();
+    memset(&p.stats, 0, sizeof(p.stats));
+}
+
+void flash_eval (Vcosim_top *top, uint64_t cycle) {
+    bool cs = top->flash_cs;
+    bool clk = top->flash_clk;
+
+    if (p.last_cs && !cs) {
+        flash_select();
+    }
+
+    if (!p.last_cs && cs) {
+        flash_deselect();
+        top->flash_dq_oe = 0;
+    }
+
+    if (!cs) {
+        if (!p.last_clk && clk) {
+            flash_clock_rising(top);
+        }
+        if (p.last_clk && !clk) {
+            flash_clock_falling(top);
+        }
+    }
+
+    p.last_cs = cs;
+    p.last_clk = clk;
+}
+
+flash_stats_t flash_stats_get (void) {
+    return p.stats;
+}
@@ -0,0 +1,236 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <deque>
+#include "models.h"
+
+
+#define RX_BUFFER_LENGTH        (4096)
+#define TX_BUFFER_LENGTH        (1024)
+#define POLL_INTERVAL_CYCLES    (1000)
+
+#define CMD_WRITE               (0x00)
+#define CMD_READ                (0x40)
+#define CMD_READ_MODEM_STATUS   (0x20)
+#define CMD_WRITE_MODEM_STATUS  (0x60)
+#define CMD_WRITE_BUFFER_FLUSH  (0x08)
+
+#define ACK                     (0)
+#define NAK                     (1)
+
+
+struct ft1248_model {
+    int master;
+    int slave;
+    std::deque<uint8_t> rx;
+    std::deque<uint8_t> tx;
+    uint64_t next_poll;
+    bool last_cs;
+    bool last_clk;
+    uint32_t edge;
+    uint8_t cmd;
+    ft1248_byte_callback_t *rx_callback;
+    ft1248_byte_callback_t *tx_callback;
+    ft1248_stats_t stats;
+};
+
+static struct ft1248_model p;
+
+
+static void ft1248_pty_poll (void) {
+    uint8_t buffer[RX_BUFFER_LENGTH];
+
+    if (p.rx.size() < RX_BUFFER_LENGTH) {
+        ssize_t length = read(p.master, buffer, (RX_BUFFER_LENGTH - p.rx.size()));
+        if (length > 0) {
+            p.rx.insert(p.rx.end(), buffer, (buffer + length));
+        }
+    }
+
+    while (!p.tx.empty()) {
+        size_t length = 0;
+        for (auto byte : p.tx) {
+            buffer[length++] = byte;
+            if (length == sizeof(buffer)) {
+                break;
+            }
+        }
+        ssize_t written = write(p.master, buffer, length);
+        if (written <= 0) {
+            break;
+        }
+        p.tx.erase(p.tx.begin(), (p.tx.begin() + written));
+    }
+}
+
+static void ft1248_clock_rising (Vcosim_top *top, uint64_t cycle) {
+    uint32_t edge = p.edge++;
+
+    top->usb_miosi_oe = 0;
+
+    if (edge == 0) {
+        p.cmd = top->usb_miosi_o;
+        p.stats.transactions += 1;
+        return;
+    }
+
+    if (edge == 1) {
+        switch (p.cmd) {
+            case CMD_READ:
+                top->usb_miso = (p.rx.empty() ? NAK : ACK);
+                break;
+            case CMD_WRITE:
+                top->usb_miso = ((p.tx.size() >= TX_BUFFER_LENGTH) ? NAK : ACK);
+                break;
+            default:
+                top->usb_miso = ACK;
+                break;
+        }
+        return;
+    }
+
+    switch (p.cmd) {
+        case CMD_READ:
+            if (p.rx.empty()) {
+                top->usb_miso = NAK;
+            } else {
+                uint8_t data = p.rx.front();
+                p.rx.pop_front();
+                top->usb_miosi_i = data;
+                top->usb_miosi_oe = 1;
+                top->usb_miso = ACK;
+                if (p.stats.rx_bytes++ == 0) {
+                    p.stats.first_rx_cycle = cycle;
+                }
+                p.stats.last_rx_cycle = cycle;
+                if (p.rx_callback != NULL) {
+                    p.rx_callback(data, cycle);
+                }
+            }
+            break;
+
+        case CMD_WRITE:
+            if (p.tx.size() >= TX_BUFFER_LENGTH) {
+                top->usb_miso = NAK;
+            } else {
+                uint8_t data = top->usb_miosi_o;
+                p.tx.push_back(data);
+                top->usb_miso = ACK;
+                if (p.stats.tx_bytes++ == 0) {
+                    p.stats.first_tx_cycle = cycle;
+                }
+                p.stats.last_tx_cycle = cycle;
+                if (p.tx_callback != NULL) {
+                    p.tx_callback(data, cycle);
+                }
+            }
+            break;
+
+        case CMD_READ_MODEM_STATUS:
+            // Pseudo terminals have no modem control lines, DTR is always reported as inactive
+            top->usb_miosi_i = 0x00;
+            top->usb_miosi_oe = 1;
+            top->usb_miso = ACK;
+            break;
+
+        case CMD_WRITE_MODEM_STATUS:
+            top->usb_miso = ACK;
+            break;
+
+        case CMD_WRITE_BUFFER_FLUSH:
+            p.next_poll = cycle;
+            top->usb_miso = ACK;
+            break;
+
+        default:
+            top->usb_miso = NAK;
+            break;
+    }
+}
+
+
+bool ft1248_init (const char **port_path) {
+    struct termios attributes;
+
+    p.rx.clear();
+    p.tx.clear();
+    p.next_poll = 0;
+    p.last_cs = true;
+    p.last_clk = false;
+    p.edge = 0;
+    p.cmd = 0;
+    p.rx_callback = NULL;
+    p.tx_callback = NULL;
+    memset(&p.stats, 0, sizeof(p.stats));
+
+    p.master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (p.master < 0) {
+        return true;
+    }
+    if (grantpt(p.master) || unlockpt(p.master)) {
+        close(p.master);
+        return true;
+    }
+
+    *port_path = ptsname(p.master);
+
+    // Keep slave side open, otherwise master reports errors between deployer sessions
+    p.slave = open(*port_path, O_RDWR | O_NOCTTY);
+    if (p.slave < 0) {
+        close(p.master);
+        return true;
+    }
+    if (tcgetattr(p.slave, &attributes) == 0) {
+        cfmakeraw(&attributes);
+        tcsetattr(p.slave, TCSANOW, &attributes);
+    }
+
+    fcntl(p.master, F_SETFL, fcntl(p.master, F_GETFL) | O_NONBLOCK);
+
+    return false;
+}
+
+void ft1248_deinit (void) {
+    close(p.slave);
+    close(p.master);
+}
+
+void ft1248_set_callbacks (ft1248_byte_callback_t *rx, ft1248_byte_callback_t *tx) {
+    p.rx_callback = rx;
+    p.tx_callback = tx;
+}
+
+void ft1248_eval (Vcosim_top *top, uint64_t cycle) {
+    bool cs = top->usb_cs;
+    bool clk = top->usb_clk;
+
+    if (cycle >= p.next_poll) {
+        p.next_poll = (cycle + POLL_INTERVAL_CYCLES);
+        ft1248_pty_poll();
+    }
+
+    top->usb_pwrsav = 1;
+
+    if (p.last_cs && !cs) {
+        p.edge = 0;
+    }
+
+    if (!cs) {
+        p.stats.busy_cycles += 1;
+        if (!p.last_clk && clk) {
+            ft1248_clock_rising(top, cycle);
+        }
+    } else {
+        top->usb_miosi_oe = 0;
+        top->usb_miso = NAK;
+    }
+
+    p.last_cs = cs;
+    p.last_clk = clk;
+}
+
+ft1248_stats_t ft1248_stats_get (void) {
+    return p.stats;
+}
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <string.h>
+#include "cosim.h"
+#include "hw.h"
+#include "vendor.h"
+
+
+#define FLASH_SIZE          (64 * 1024)
+#define GPIO_COUNT          (128)
+#define RTC_MEMORY_LENGTH   (256)
+
+
+static uint32_t gpio_state[GPIO_COUNT];
+static uint8_t flash[FLASH_SIZE];
+static uint8_t rtc[RTC_MEMORY_LENGTH];
+static uint32_t crc32;
+
+
+void hw_set_vector_table (uint32_t offset) {
+}
+
+void hw_enter_critical (void) {
+}
+
+void hw_exit_critical (void) {
+}
+
+void hw_delay_us (uint32_t delay_us) {
+    cosim_delay_us(delay_us);
+}
+
+void hw_delay_ms (uint32_t delay_ms) {
+    cosim_delay_us(delay_ms * 1000ULL);
+}
+
+void hw_systick_config (uint32_t period_ms, void (*callback) (void)) {
+    cosim_systick_config(period_ms, callback);
+}
+
+uint32_t hw_time_us (void) {
+    return (uint32_t) (cosim_time_us());
+}
+
+uint32_t hw_gpio_get (gpio_id_t id) {
+    return gpio_state[id];
+}
+
+void hw_gpio_set (gpio_id_t id) {
+    gpio_state[id] = 1;
+}
+
+void hw_gpio_reset (gpio_id_t id) {
+    gpio_state[id] = 0;
+}
+
+void hw_uart_read (uint8_t *data, int length) {
+    memset(data, 0, length);
+}
+
+void hw_uart_write (uint8_t *data, int length) {
+    fwrite(data, 1, length, stderr);
+}
+
+void hw_uart_write_wait_busy (void) {
+}
+
+void hw_spi_start (void) {
+    cosim_spi_start();
+}
+
+void hw_spi_stop (void) {
+    cosim_spi_stop();
+}
+
+void hw_spi_rx (uint8_t *data, int length) {
+    cosim_spi_transfer(NULL, data, length);
+}
+
+void hw_spi_tx (uint8_t *data, int length) {
+    cosim_spi_transfer(data, NULL, length);
+}
+
+i2c_error_t hw_i2c_trx (uint8_t i2c_address, uint8_t *tx_data, uint8_t tx_length, uint8_t *rx_data, uint8_t rx_length) {
+    if (tx_length == 0) {
+        return I2C_ERROR_NACK;
+    }
+    uint8_t address = tx_data[0];
+    for (int i = 1; i < tx_length; i++) {
+        rtc[address++] = tx_data[i];
+    }
+    for (int i = 0; i < rx_length; i++) {
+        rx_data[i] = rtc[address++];
+    }
+    return I2C_OK;
+}
+
+void hw_crc32_reset (void) {
+    crc32 = 0xFFFFFFFFUL;
+}
+
+uint32_t hw_crc32_calculate (uint8_t *data, uint32_t length) {
+    for (uint32_t i = 0; i < length; i++) {
+        crc32 ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc32 = (crc32 >> 1) ^ ((crc32 & 1) ? 0xEDB88320UL : 0);
+        }
+    }
+    return ~crc32;
+}
+
+uint32_t hw_flash_size (void) {
+    return FLASH_SIZE;
+}
+
+hw_flash_t hw_flash_read (uint32_t offset) {
+    hw_flash_t value;
+    memcpy(&value, &flash[offset], sizeof(value));
+    return value;
+}
+
+void hw_flash_erase (void) {
+    memset(flash, 0xFF, sizeof(flash));
+}
+
+void hw_flash_program (uint32_t offset, hw_flash_t value) {
+    memcpy(&flash[offset], &value, sizeof(value));
+}
+
+void hw_reset (loader_parameters_t *parameters) {
+    fprintf(stderr, "MCU reset requested, exiting\n");
+    cosim_exit(0);
+}
+
+void hw_loader_get_parameters (loader_parameters_t *parameters) {
+    memset(parameters, 0, sizeof(loader_parameters_t));
+}
+
+void hw_adc_read_voltage_temperature (uint16_t *voltage, int16_t *temperature) {
+    *voltage = 3300;
+    *temperature = 250;
+}
+
+void hw_primer_init (void) {
+}
+
+void hw_loader_init (void) {
+}
+
+void hw_app_init (void) {
+    memset(gpio_state, 0, sizeof(gpio_state));
+    hw_gpio_set(GPIO_ID_N64_RESET);
+    hw_gpio_set(GPIO_ID_SPI_CS);
+    hw_flash_erase();
+}
+
+
+uint32_t vendor_flash_size (void) {
+    return 0;
+}
+
+vendor_error_t vendor_backup (uint32_t address, uint32_t *length) {
+    *length = 0;
+    return VENDOR_ERROR_INIT;
+}
+
+vendor_error_t vendor_update (uint32_t address, uint32_t length) {
+    return VENDOR_ERROR_INIT;
+}
+
+vendor_error_t vendor_reconfigure (void) {
+    return VENDOR_OK;
+}
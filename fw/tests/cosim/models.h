@@ -0,0 +1,68 @@
+#ifndef MODELS_H__
+#define MODELS_H__
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "Vcosim_top.h"
+
+
+typedef struct {
+    uint64_t activates;
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t refreshes;
+    uint64_t precharges;
+} sdram_stats_t;
+
+typedef struct {
+    uint64_t reads;
+    uint64_t programs;
+    uint64_t erases;
+} flash_stats_t;
+
+typedef struct {
+    uint64_t commands;
+    uint64_t sectors_read;
+    uint64_t sectors_written;
+    uint64_t crc_errors;
+    uint64_t clocks;
+    uint64_t busy_cycles;
+} sd_card_stats_t;
+
+typedef struct {
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint64_t transactions;
+    uint64_t busy_cycles;
+    uint64_t first_rx_cycle;
+    uint64_t last_rx_cycle;
+    uint64_t first_tx_cycle;
+    uint64_t last_tx_cycle;
+} ft1248_stats_t;
+
+typedef void ft1248_byte_callback_t (uint8_t data, uint64_t cycle);
+
+
+void sdram_init (void);
+void sdram_eval (Vcosim_top *top, uint64_t cycle);
+sdram_stats_t sdram_stats_get (void);
+
+void flash_init (void);
+void flash_eval (Vcosim_top *top, uint64_t cycle);
+flash_stats_t flash_stats_get (void);
+
+bool sd_card_init (const char *image_path);
+void sd_card_deinit (void);
+bool sd_card_inserted (void);
+void sd_card_eval (Vcosim_top *top, uint64_t cycle);
+sd_card_stats_t sd_card_stats_get (void);
+
+bool ft1248_init (const char **port_path);
+void ft1248_deinit (void);
+void ft1248_set_callbacks (ft1248_byte_callback_t *rx, ft1248_byte_callback_t *tx);
+void ft1248_eval (Vcosim_top *top, uint64_t cycle);
+ft1248_stats_t ft1248_stats_get (void);
+
+
+#endif
@@ -0,0 +1,561 @@
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+#include "models.h"
+
+
+#define SECTOR_LENGTH           (512)
+#define CMD6_DATA_LENGTH        (64)
+
+#define CMD_FRAME_BITS          (48)
+#define CMD_TRANSMISSION_BIT    (1ULL << 46)
+
+#define NCR_CLOCKS              (2)
+#define NWR_CLOCKS              (2)
+#define NAC_CLOCKS              (CMD_FRAME_BITS + 4)
+#define BUSY_CLOCKS             (16)
+
+#define RCA                     (0x0001)
+
+#define R1_OUT_OF_RANGE         (1UL << 31)
+#define R1_ILLEGAL_COMMAND      (1 << 22)
+#define R1_CURRENT_STATE_BIT    (9)
+#define R1_READY_FOR_DATA       (1 << 8)
+#define R1_APP_CMD              (1 << 5)
+
+#define OCR_BUSY                (1UL << 31)
+#define OCR_CCS                 (1 << 30)
+#define OCR_VOLTAGE_WINDOW      (0x00FF8000UL)
+
+#define RELEASE                 (-1)
+
+
+typedef enum {
+    STATE_IDLE = 0,
+    STATE_READY = 1,
+    STATE_IDENT = 2,
+    STATE_STBY = 3,
+    STATE_TRAN = 4,
+    STATE_DATA = 5,
+    STATE_RCV = 6,
+} card_state_t;
+
+typedef enum {
+    DAT_IDLE,
+    DAT_READ,
+    DAT_WRITE,
+} dat_mode_t;
+
+typedef struct {
+    int8_t value;
+    uint8_t mask;
+} dat_output_t;
+
+struct sd_card_model {
+    FILE *image;
+    uint32_t sectors;
+    bool last_clk;
+
+    bool cmd_receiving;
+    int cmd_bits;
+    uint64_t cmd_shift;
+    std::deque<int8_t> cmd_output;
+
+    card_state_t state;
+    uint16_t rca;
+    bool app_cmd;
+    bool illegal_cmd;
+    bool out_of_range;
+
+    dat_mode_t dat_mode;
+    bool dat_multiple;
+    bool dat_first_block;
+    uint32_t dat_sector;
+    bool dat_cmd6_pending;
+    std::deque<dat_output_t> dat_output;
+    bool dat_receiving;
+    int dat_nibbles;
+    uint8_t dat_buffer[SECTOR_LENGTH];
+    uint16_t dat_crc[4];
+
+    sd_card_stats_t stats;
+};
+
+static struct sd_card_model p;
+
+
+static uint8_t sd_crc7 (const uint8_t *data, int length) {
+    uint8_t crc = 0;
+    for (int i = 0; i < length; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            uint8_t inv = (((crc >> 6) ^ (data[i] >> bit)) & (1 << 0));
+            crc = (((crc << 1) ^ (inv ? 0x09 : 0)) & 0x7F);
+        }
+    }
+    return crc;
+}
+
+static void sd_crc16_nibble (uint16_t *crc, uint8_t nibble) {
+    for (int line = 0; line < 4; line++) {
+        uint16_t inv = (((crc[line] >> 15) ^ (nibble >> line)) & (1 << 0));
+        crc[line] = ((crc[line] << 1) ^ (inv ? 0x1021 : 0));
+    }
+}
+
+
+static uint32_t sd_r1_status (void) {
+    uint32_t status = ((p.state << R1_CURRENT_STATE_BIT) | R1_READY_FOR_DATA);
+    if (p.app_cmd) {
+        status |= R1_APP_CMD;
+    }
+    if (p.illegal_cmd) {
+        status |= R1_ILLEGAL_COMMAND;
+    }
+    if (p.out_of_range) {
+        status |= R1_OUT_OF_RANGE;
+    }
+    p.illegal_cmd = false;
+    p.out_of_range = false;
+    return status;
+}
+
+static void sd_response_bytes (const uint8_t *data, int length) {
+    for (int i = 0; i < NCR_CLOCKS; i++) {
+        p.cmd_output.push_back(RELEASE);
+    }
+    for (int i = 0; i < length; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            p.cmd_output.push_back((data[i] >> bit) & (1 << 0));
+        }
+    }
+    p.cmd_output.push_back(RELEASE);
+}
+
+static void sd_response_short (uint8_t index, uint32_t arg, bool reserved) {
+    uint8_t rsp[6] = {
+        (uint8_t) (reserved ? 0x3F : (index & 0x3F)),
+        (uint8_t) (arg >> 24),
+        (uint8_t) (arg >> 16),
+        (uint8_t) (arg >> 8),
+        (uint8_t) (arg),
+        0xFF,
+    };
+    if (!reserved) {
+        rsp[5] = ((sd_crc7(rsp, 5) << 1) | (1 << 0));
+    }
+    sd_response_bytes(rsp, sizeof(rsp));
+}
+
+static void sd_response_long (const uint8_t *reg) {
+    uint8_t rsp[17];
+    rsp[0] = 0x3F;
+    memcpy(&rsp[1], reg, 15);
+    rsp[16] = ((sd_crc7(&rsp[1], 15) << 1) | (1 << 0));
+    sd_response_bytes(rsp, sizeof(rsp));
+}
+
+static void sd_dat_busy (int delay) {
+    for (int i = 0; i < delay; i++) {
+        p.dat_output.push_back({ RELEASE, 0 });
+    }
+    for (int i = 0; i < BUSY_CLOCKS; i++) {
+        p.dat_output.push_back({ 0, (1 << 0) });
+    }
+    p.dat_output.push_back({ RELEASE, 0 });
+}
+
+static void sd_dat_send_block (const uint8_t *data, int length, int delay) {
+    uint16_t crc[4] = { 0, 0, 0, 0 };
+
+    for (int i = 0; i < delay; i++) {
+        p.dat_output.push_back({ RELEASE, 0 });
+    }
+    p.dat_output.push_back({ 0x0, 0xF });
+    for (int i = 0; i < length; i++) {
+        uint8_t nibbles[2] = { (uint8_t) (data[i] >> 4), (uint8_t) (data[i] & 0x0F) };
+        for (int n = 0; n < 2; n++) {
+            sd_crc16_nibble(crc, nibbles[n]);
+            p.dat_output.push_back({ (int8_t) nibbles[n], 0xF });
+        }
+    }
+    for (int bit = 15; bit >= 0; bit--) {
+        uint8_t nibble = 0;
+        for (int line = 0; line < 4; line++) {
+            nibble |= (((crc[line] >> bit) & (1 << 0)) << line);
+        }
+        p.dat_output.push_back({ (int8_t) nibble, 0xF });
+    }
+    p.dat_output.push_back({ 0xF, 0xF });
+    p.dat_output.push_back({ RELEASE, 0 });
+}
+
+static void sd_dat_stop (void) {
+    p.dat_mode = DAT_IDLE;
+    p.dat_receiving = false;
+    p.dat_cmd6_pending = false;
+    p.dat_output.clear();
+}
+
+static void sd_dat_process (void) {
+    if ((p.dat_mode != DAT_READ) || !p.dat_output.empty()) {
+        return;
+    }
+
+    if (p.dat_cmd6_pending) {
+        uint8_t status[CMD6_DATA_LENGTH];
+        memset(status, 0, sizeof(status));
+        status[1] = 100;
+        for (int group = 0; group < 6; group++) {
+            status[2 + (group * 2)] = 0x80;
+            status[3 + (group * 2)] = 0x01;
+        }
+        p.dat_cmd6_pending = false;
+        p.dat_mode = DAT_IDLE;
+        p.state = STATE_TRAN;
+        sd_dat_send_block(status, sizeof(status), NAC_CLOCKS);
+        return;
+    }
+
+    if (p.dat_sector >= p.sectors) {
+        p.out_of_range = true;
+        p.dat_mode = DAT_IDLE;
+        p.state = STATE_TRAN;
+        return;
+    }
+
+    uint8_t buffer[SECTOR_LENGTH];
+    fseek(p.image, (long) p.dat_sector * SECTOR_LENGTH, SEEK_SET);
+    if (fread(buffer, 1, SECTOR_LENGTH, p.image) != SECTOR_LENGTH) {
+        memset(buffer, 0, sizeof(buffer));
+    }
+    p.dat_sector += 1;
+    p.stats.sectors_read += 1;
+    if (!p.dat_multiple) {
+        p.dat_mode = DAT_IDLE;
+        p.state = STATE_TRAN;
+    }
+    sd_dat_send_block(buffer, sizeof(buffer), p.dat_first_block ? NAC_CLOCKS : NWR_CLOCKS);
+    p.dat_first_block = false;
+}
+
+static void sd_dat_block_received (void) {
+    bool crc_valid = true;
+    uint16_t expected[4] = { 0, 0, 0, 0 };
+
+    for (int i = 0; i < SECTOR_LENGTH; i++) {
+        sd_crc16_nibble(expected, p.dat_buffer[i] >> 4);
+        sd_crc16_nibble(expected, p.dat_buffer[i] & 0x0F);
+    }
+    for (int line = 0; line < 4; line++) {
+        crc_valid &= (expected[line] == p.dat_crc[line]);
+    }
+
+    if (crc_valid && (p.dat_sector < p.sectors)) {
+        fseek(p.image, (long) p.dat_sector * SECTOR_LENGTH, SEEK_SET);
+        fwrite(p.dat_buffer, 1, SECTOR_LENGTH, p.image);
+        fflush(p.image);
+        p.stats.sectors_written += 1;
+    }
+    if (!crc_valid) {
+        p.stats.crc_errors += 1;
+    }
+    if (p.dat_sector >= p.sectors) {
+        p.out_of_range = true;
+    }
+    p.dat_sector += 1;
+
+    // CRC status token: start bit, "010" accepted or "101" rejected, end bit, then busy while programming
+    const int8_t token[] = { 0, 0, 1, 0, 1 };
+    const int8_t token_error[] = { 0, 1, 0, 1, 1 };
+    for (int i = 0; i < NWR_CLOCKS - 1; i++) {
+        p.dat_output.push_back({ RELEASE, 0 });
+    }
+    for (int i = 0; i < 5; i++) {
+        p.dat_output.push_back({ crc_valid ? token[i] : token_error[i], (1 << 0) });
+    }
+    sd_dat_busy(0);
+
+    if (!p.dat_multiple) {
+        p.dat_mode = DAT_IDLE;
+        p.state = STATE_TRAN;
+    }
+}
+
+
+static void sd_cmd_received (uint64_t frame) {
+    uint8_t bytes[6];
+    for (int i = 0; i < 6; i++) {
+        bytes[i] = (frame >> ((5 - i) * 8));
+    }
+
+    if (((sd_crc7(bytes, 5) << 1) | (1 << 0)) != bytes[5]) {
+        p.stats.crc_errors += 1;
+        return;
+    }
+
+    uint8_t index = (bytes[0] & 0x3F);
+    uint32_t arg = ((bytes[1] << 24) | (bytes[2] << 16) | (bytes[3] << 8) | bytes[4]);
+    bool app_cmd = p.app_cmd;
+
+    p.stats.commands += 1;
+
+    if (app_cmd) {
+        p.app_cmd = false;
+        switch (index) {
+            case 6:
+                sd_response_short(index, sd_r1_status(), false);
+                return;
+
+            case 41:
+                p.state = STATE_READY;
+                sd_response_short(index, (OCR_BUSY | OCR_CCS | OCR_VOLTAGE_WINDOW), true);
+                return;
+
+            default:
+                break;
+        }
+    }
+
+    switch (index) {
+        case 0:
+            p.state = STATE_IDLE;
+            p.rca = 0;
+            sd_dat_stop();
+            break;
+
+        case 2: {
+            const uint8_t cid[15] = { 0x00, 'S', 'C', 'C', 'O', 'S', 'I', 'M', 0x10, 0x00, 0x00, 0x00, 0x01, 0x01, 0x8A };
+            p.state = STATE_IDENT;
+            sd_response_long(cid);
+            break;
+        }
+
+        case 3:
+            p.rca = RCA;
+            p.state = STATE_STBY;
+            sd_response_short(index, ((p.rca << 16) | (sd_r1_status() & 0x1FFF)), false);
+            break;
+
+        case 6:
+            sd_response_short(index, sd_r1_status(), false);
+            p.state = STATE_DATA;
+            p.dat_mode = DAT_READ;
+            p.dat_cmd6_pending = true;
+            break;
+
+        case 7:
+            if ((arg >> 16) == p.rca) {
+                sd_response_short(index, sd_r1_status(), false);
+                p.state = STATE_TRAN;
+                sd_dat_busy(NCR_CLOCKS + CMD_FRAME_BITS);
+            } else {
+                p.state = STATE_STBY;
+            }
+            break;
+
+        case 8:
+            sd_response_short(index, (arg & 0xFFF), false);
+            break;
+
+        case 9: {
+            uint32_t c_size = ((p.sectors / 1024) - 1);
+            const uint8_t csd[15] = {
+                0x40, 0x0E, 0x00, 0x32, 0x5B, 0x59, 0x00,
+                (uint8_t) ((c_size >> 16) & 0x3F), (uint8_t) (c_size >> 8), (uint8_t) (c_size),
+                0x7F, 0x80, 0x0A, 0x40, 0x00,
+            };
+            sd_response_long(csd);
+            break;
+        }
+
+        case 10: {
+            const uint8_t cid[15] = { 0x00, 'S', 'C', 'C', 'O', 'S', 'I', 'M', 0x10, 0x00, 0x00, 0x00, 0x01, 0x01, 0x8A };
+            sd_response_long(cid);
+            break;
+        }
+
+        case 12:
+            sd_dat_stop();
+            sd_response_short(index, sd_r1_status(), false);
+            p.state = STATE_TRAN;
+            sd_dat_busy(NCR_CLOCKS + CMD_FRAME_BITS);
+            break;
+
+        case 13:
+            sd_response_short(index, sd_r1_status(), false);
+            break;
+
+        case 16:
+            sd_response_short(index, sd_r1_status(), false);
+            break;
+
+        case 17:
+        case 18:
+            sd_response_short(index, sd_r1_status(), false);
+            p.state = STATE_DATA;
+            p.dat_mode = DAT_READ;
+            p.dat_multiple = (index == 18);
+            p.dat_first_block = true;
+            p.dat_sector = arg;
+            break;
+
+        case 24:
+        case 25:
+            sd_response_short(index, sd_r1_status(), false);
+            p.state = STATE_RCV;
+            p.dat_mode = DAT_WRITE;
+            p.dat_multiple = (index == 25);
+            p.dat_sector = arg;
+            p.dat_receiving = false;
+            break;
+
+        case 55:
+            p.app_cmd = true;
+            sd_response_short(index, sd_r1_status(), false);
+            break;
+
+        default:
+            p.illegal_cmd = true;
+            break;
+    }
+}
+
+
+static void sd_clock_rising (Vcosim_top *top) {
+    bool cmd = top->sd_cmd_o;
+    uint8_t dat = (top->sd_dat_o & 0x0F);
+
+    if (p.cmd_output.empty() && !top->sd_cmd_oe) {
+        if (!p.cmd_receiving && !cmd) {
+            p.cmd_receiving = true;
+            p.cmd_bits = 0;
+            p.cmd_shift = 0;
+        }
+        if (p.cmd_receiving) {
+            p.cmd_shift = ((p.cmd_shift << 1) | cmd);
+            p.cmd_bits += 1;
+            if (p.cmd_bits == CMD_FRAME_BITS) {
+                p.cmd_receiving = false;
+                if (p.cmd_shift & CMD_TRANSMISSION_BIT) {
+                    sd_cmd_received(p.cmd_shift);
+                }
+            }
+        }
+    }
+
+    if ((p.dat_mode == DAT_WRITE) && p.dat_output.empty()) {
+        if (!p.dat_receiving) {
+            if (!(dat & (1 << 0))) {
+                p.dat_receiving = true;
+                p.dat_nibbles = 0;
+                memset(p.dat_crc, 0, sizeof(p.dat_crc));
+            }
+        } else {
+            int index = p.dat_nibbles++;
+            if (index < (SECTOR_LENGTH * 2)) {
+                if (index & 1) {
+                    p.dat_buffer[index / 2] |= dat;
+                } else {
+                    p.dat_buffer[index / 2] = (dat << 4);
+                }
+            } else if (index < ((SECTOR_LENGTH * 2) + 16)) {
+                for (int line = 0; line < 4; line++) {
+                    p.dat_crc[line] = ((p.dat_crc[line] << 1) | ((dat >> line) & (1 << 0)));
+                }
+            } else {
+                p.dat_receiving = false;
+                sd_dat_block_received();
+            }
+        }
+    }
+}
+
+static void sd_clock_falling (Vcosim_top *top) {
+    sd_dat_process();
+
+    if (!p.cmd_output.empty()) {
+        int8_t value = p.cmd_output.front();
+        p.cmd_output.pop_front();
+        top->sd_cmd_oe = (value != RELEASE);
+        top->sd_cmd_i = (value == 1);
+    }
+
+    if (!p.dat_output.empty()) {
+        dat_output_t output = p.dat_output.front();
+        p.dat_output.pop_front();
+        top->sd_dat_oe = ((output.value != RELEASE) ? output.mask : 0);
+        top->sd_dat_i = ((output.value != RELEASE) ? output.value : 0xF);
+    }
+}
+
+
+bool sd_card_init (const char *image_path) {
+    p.image = NULL;
+    p.sectors = 0;
+    p.last_clk = false;
+    p.cmd_receiving = false;
+    p.cmd_output.clear();
+    p.state = STATE_IDLE;
+    p.rca = 0;
+    p.app_cmd = false;
+    p.illegal_cmd = false;
+    p.out_of_range = false;
+    sd_dat_stop();
+    memset(&p.stats, 0, sizeof(p.stats));
+
+    if (image_path == NULL) {
+        return false;
+    }
+
+    p.image = fopen(image_path, "r+b");
+    if (p.image == NULL) {
+        return true;
+    }
+
+    fseek(p.image, 0, SEEK_END);
+    p.sectors = (uint32_t) (ftell(p.image) / SECTOR_LENGTH);
+    if (p.sectors < 1024) {
+        fclose(p.image);
+        p.image = NULL;
+        return true;
+    }
+
+    return false;
+}
+
+void sd_card_deinit (void) {
+    if (p.image != NULL) {
+        fclose(p.image);
+        p.image = NULL;
+    }
+}
+
+bool sd_card_inserted (void) {
+    return (p.image != NULL);
+}
+
+void sd_card_eval (Vcosim_top *top, uint64_t cycle) {
+    bool clk = top->sd_clk;
+
+    if (p.image == NULL) {
+        return;
+    }
+
+    if (!p.last_clk && clk) {
+        sd_clock_rising(top);
+        p.stats.clocks += 1;
+    }
+    if (p.last_clk && !clk) {
+        sd_clock_falling(top);
+    }
+
+    if (!p.dat_output.empty() || p.dat_receiving) {
+        p.stats.busy_cycles += 1;
+    }
+
+    p.last_clk = clk;
+}
+
+sd_card_stats_t sd_card_stats_get (void) {
+    return p.stats;
+}
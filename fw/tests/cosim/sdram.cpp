@@ -0,0 +1,101 @@
+#include <string.h>
+#include <vector>
+#include "models.h"
+
+
+#define SDRAM_WORDS         (32 * 1024 * 1024)
+#define SDRAM_BANKS         (4)
+#define CAS_LATENCY         (2)
+
+#define NO_READ             (-1)
+
+// /CS, /RAS, /CAS, /WE
+#define CMD_READ            (0b0101)
+#define CMD_WRITE           (0b0100)
+#define CMD_ACT             (0b0011)
+#define CMD_PRE             (0b0010)
+#define CMD_REF             (0b0001)
+
+
+struct sdram_model {
+    std::vector<uint16_t> memory;
+    uint16_t row[SDRAM_BANKS];
+    int64_t read_pipeline[CAS_LATENCY];
+    sdram_stats_t stats;
+};
+
+static struct sdram_model p;
+
+
+static uint32_t sdram_word_index (uint8_t bank, uint16_t column) {
+    return ((bank << 23) | (p.row[bank] << 10) | (column & 0x3FF));
+}
+
+
+void sdram_init (void) {
+    p.memory.assign(SDRAM_WORDS, 0);
+    memset(p.row, 0, sizeof(p.row));
+    for (int i = 0; i < CAS_LATENCY; i++) {
+        p.read_pipeline[i] = NO_READ;
+    }
+    memset(&p.stats, 0, sizeof(p.stats));
+}
+
+void sdram_eval (Vcosim_top *top, uint64_t cycle) {
+    int64_t read_index = p.read_pipeline[CAS_LATENCY - 1];
+
+    for (int i = (CAS_LATENCY - 1); i > 0; i--) {
+        p.read_pipeline[i] = p.read_pipeline[i - 1];
+    }
+    p.read_pipeline[0] = NO_READ;
+
+    if (read_index != NO_READ) {
+        top->sdram_dq_i = p.memory[read_index];
+        top->sdram_dq_oe = 1;
+    } else {
+        top->sdram_dq_oe = 0;
+    }
+
+    uint8_t cmd = ((top->sdram_cs << 3) | (top->sdram_ras << 2) | (top->sdram_cas << 1) | top->sdram_we);
+    uint8_t bank = top->sdram_ba;
+
+    switch (cmd) {
+        case CMD_ACT:
+            p.row[bank] = top->sdram_a;
+            p.stats.activates += 1;
+            break;
+
+        case CMD_READ:
+            p.read_pipeline[0] = sdram_word_index(bank, top->sdram_a);
+            p.stats.reads += 1;
+            break;
+
+        case CMD_WRITE: {
+            uint16_t *word = &p.memory[sdram_word_index(bank, top->sdram_a)];
+            uint16_t data = top->sdram_dq_o;
+            if (!(top->sdram_dqm & (1 << 0))) {
+                *word = ((*word & 0xFF00) | (data & 0x00FF));
+            }
+            if (!(top->sdram_dqm & (1 << 1))) {
+                *word = ((*word & 0x00FF) | (data & 0xFF00));
+            }
+            p.stats.writes += 1;
+            break;
+        }
+
+        case CMD_PRE:
+            p.stats.precharges += 1;
+            break;
+
+        case CMD_REF:
+            p.stats.refreshes += 1;
+            break;
+
+        default:
+            break;
+    }
+}
+
+sdram_stats_t sdram_stats_get (void) {
+    return p.stats;
+}
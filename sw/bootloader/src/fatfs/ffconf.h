@@ -38,13 +38,19 @@
 /* This option switches fast seek feature. (0:Disable or 1:Enable) */
 
 
+#ifndef FF_USE_EXPAND
 #define FF_USE_EXPAND	0
-/* This option switches f_expand(). (0:Disable or 1:Enable) */
+#endif
+/* This option switches f_expand(). (0:Disable or 1:Enable)
+/  Deployer build enables it from its build script, bootloader doesn't need it. */
 
 
+#ifndef FF_USE_CHMOD
 #define FF_USE_CHMOD	0
+#endif
 /* This option switches attribute control API functions, f_chmod() and f_utime().
-/  (0:Disable or 1:Enable) Also FF_FS_READONLY needs to be 0 to enable this option. */
+/  (0:Disable or 1:Enable) Also FF_FS_READONLY needs to be 0 to enable this option.
+/  Deployer build enables it from its build script, bootloader doesn't need it. */
 
 
 #define FF_USE_LABEL	1
@@ -166,8 +172,11 @@
 / Drive/Volume Configurations
 /---------------------------------------------------------------------------*/
 
+#ifndef FF_VOLUMES
 #define FF_VOLUMES		1
-/* Number of volumes (logical drives) to be used. (1-10) */
+#endif
+/* Number of volumes (logical drives) to be used. (1-10)
+/  Deployer build raises it from its build script to mount SD cards of multiple devices. */
 
 
 #define FF_STR_VOLUME_ID	0
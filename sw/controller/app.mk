@@ -20,7 +20,9 @@ SRC_FILES = \
 	led.c \
 	rtc.c \
 	sd.c \
+	stream.c \
 	timer.c \
+	trace.c \
 	update.c \
 	usb.c \
 	version.c \
@@ -8,9 +8,16 @@ case "$1" in
         make all -j -f loader.mk USER_FLAGS="$USER_FLAGS"
         make all -j -f app.mk USER_FLAGS="$USER_FLAGS"
         ;;
+    host)
+        make all -j -f host.mk USER_FLAGS="$USER_FLAGS"
+        ;;
+    bench)
+        make bench -j -f host.mk USER_FLAGS="$USER_FLAGS" SD_IMAGE="$2"
+        ;;
     clean)
         make clean -f primer.mk
         make clean -f loader.mk
         make clean -f app.mk
+        make clean -f host.mk
         ;;
 esac
@@ -0,0 +1,59 @@
+EXE_NAME = host
+BUILD_DIR = build/host
+
+CC = gcc
+
+FLAGS = $(USER_FLAGS) -g
+CFLAGS = -O2 -Wall -Wno-incompatible-pointer-types -MMD -MP -I. -Isrc -Ihost
+LDFLAGS =
+
+SRC_FILES = \
+	button.c \
+	cfg.c \
+	cic.c \
+	dd.c \
+	debug.c \
+	flash.c \
+	flashram.c \
+	fpga.c \
+	isv.c \
+	led.c \
+	rtc.c \
+	sd.c \
+	stream.c \
+	timer.c \
+	trace.c \
+	update.c \
+	usb.c \
+	version.c \
+	writeback.c
+
+HOST_FILES = \
+	bench.c \
+	hw.c \
+	sim.c
+
+SRCS = $(addprefix src/, $(SRC_FILES)) $(addprefix host/, $(HOST_FILES))
+OBJS = $(addprefix $(BUILD_DIR)/, $(notdir $(patsubst %,%.o,$(SRCS))))
+DEPS = $(OBJS:.o=.d)
+VPATH = host src
+
+$(@info $(shell mkdir -p ./$(BUILD_DIR) &> /dev/null))
+
+$(BUILD_DIR)/%.c.o: %.c
+	$(CC) $(FLAGS) $(CFLAGS) -c $< -o $@
+
+$(BUILD_DIR)/$(EXE_NAME): $(OBJS)
+	$(CC) $(FLAGS) $(LDFLAGS) $(OBJS) -o $@
+
+all: $(BUILD_DIR)/$(EXE_NAME)
+
+bench: $(BUILD_DIR)/$(EXE_NAME)
+	@./$(BUILD_DIR)/$(EXE_NAME) $(SD_IMAGE)
+
+clean:
+	@rm -rf ./$(BUILD_DIR)/*
+
+.PHONY: all bench clean
+
+-include $(DEPS)
@@ -0,0 +1,658 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "button.h"
+#include "cfg.h"
+#include "cic.h"
+#include "dd.h"
+#include "flash.h"
+#include "flashram.h"
+#include "fpga.h"
+#include "hw.h"
+#include "isv.h"
+#include "led.h"
+#include "rtc.h"
+#include "sd.h"
+#include "sim.h"
+#include "stream.h"
+#include "timer.h"
+#include "trace.h"
+#include "usb.h"
+#include "writeback.h"
+
+
+#define STEP_LIMIT                  (1000000)
+
+#define RESPONSE_BUFFER_LENGTH      (8 + (1024 * 1024))
+
+#define TEST_BUFFER_ADDRESS         (0x00100000UL)
+
+#define DD_SECTOR_SIZE              (232)
+#define DD_SECTORS_IN_BLOCK         (89)
+#define DD_BLOCK_DATA_SECTORS       (85)
+#define DD_BLOCK_LENGTH             (DD_SECTOR_SIZE * DD_BLOCK_DATA_SECTORS)
+#define DD_DISK_MAPPING_ADDRESS     (0x01000000UL)
+#define DD_THB_TABLE_ADDRESS        (0x01001000UL)
+#define DD_SECTOR_TABLE_ADDRESS     (0x01002000UL)
+#define DD_SD_FIRST_SECTOR          (1024)
+#define DD_STAGING_TAGS_ADDRESS     (0x03BA1FE0UL)
+#define DD_STAGING_TAG_VALID        (1 << 31)
+
+#define SAVE_SECTOR_TABLE_ADDRESS   (0x01010000UL)
+#define SAVE_SECTOR_TABLE_PI_ADDRESS    (0x10000000UL + SAVE_SECTOR_TABLE_ADDRESS)
+#define SAVE_SD_FIRST_SECTOR        (4096)
+#define SAVE_CLUSTER_SECTORS        (8)
+#define SAVE_EEPROM_ADDRESS         (0x05002000UL)
+#define SAVE_SRAM_FLASHRAM_ADDRESS  (0x03FE0000UL)
+#define SAVE_READBACK_ADDRESS       (0x00200000UL)
+
+#define FLASH_ADDRESS               (0x04000000UL)
+#define FLASH_ERASE_LENGTH          (4 * 1024 * 1024)
+
+#define ISV_ADDRESS                 (0x03E00000UL)
+#define ISV_TOKEN                   (0x49533634UL)
+#define ISV_READ_POINTER_OFFSET     (0x04)
+#define ISV_WRITE_POINTER_OFFSET    (0x14)
+
+#define STREAM_ADDRESS              (0x02000000UL)
+#define STREAM_PI_ADDRESS           (0x10000000UL + STREAM_ADDRESS)
+#define STREAM_BUFFER_LENGTH        (1024 * 1024)
+#define STREAM_DATATYPE             (0x02)
+
+#define CFG_ID_ISV_ADDRESS          (4)
+#define CFG_ID_SAVE_TYPE            (6)
+#define CFG_ID_DD_USB_STAGING       (15)
+#define CFG_ID_ISV_BUFFER_SIZE      (16)
+
+
+static uint8_t response[RESPONSE_BUFFER_LENGTH];
+static uint32_t steps;
+
+
+static void app_init (void) {
+    hw_app_init();
+
+    timer_init();
+
+    while (fpga_id_get() != FPGA_ID);
+
+    rtc_init();
+
+    button_init();
+    cfg_init();
+    cic_init();
+    dd_init();
+    flash_init();
+    flashram_init();
+    isv_init();
+    led_init();
+    sd_init();
+    stream_init();
+    trace_init();
+    usb_init();
+    writeback_init();
+}
+
+static void app_step (void) {
+    button_process();
+    cfg_process();
+    cic_process();
+    dd_process();
+    flash_process();
+    flashram_process();
+    isv_process();
+    led_process();
+    rtc_process();
+    sd_process();
+    stream_process();
+    usb_process();
+    writeback_process();
+    steps += 1;
+}
+
+
+static void put_u32 (uint8_t *buffer, uint32_t value) {
+    buffer[0] = (value >> 24);
+    buffer[1] = (value >> 16);
+    buffer[2] = (value >> 8);
+    buffer[3] = value;
+}
+
+static uint32_t get_u32 (uint8_t *buffer) {
+    return ((buffer[0] << 24) | (buffer[1] << 16) | (buffer[2] << 8) | buffer[3]);
+}
+
+
+static void measure_start (void) {
+    sim_stats_reset();
+    steps = 0;
+}
+
+static void measure_report_stats (const char *name, sim_spi_stats_t stats, uint32_t loops) {
+    printf(
+        "%-32s %8u %10u %10u %8u %8u %12.1f %8u\n",
+        name,
+        stats.transactions,
+        stats.tx_bytes,
+        stats.rx_bytes,
+        stats.reg_reads,
+        stats.reg_writes,
+        (stats.spi_time_ns / 1000.0),
+        loops
+    );
+}
+
+static void measure_report (const char *name) {
+    measure_report_stats(name, sim_stats_get(), steps);
+}
+
+
+static bool usb_command (uint8_t id, uint32_t arg0, uint32_t arg1, uint8_t *data, size_t length, size_t *response_length) {
+    uint8_t header[12] = { 'C', 'M', 'D', id };
+    size_t received = 0;
+
+    put_u32(&header[4], arg0);
+    put_u32(&header[8], arg1);
+
+    sim_usb_host_write(header, sizeof(header));
+    if (length > 0) {
+        sim_usb_host_write(data, length);
+    }
+
+    for (uint32_t i = 0; i < STEP_LIMIT; i++) {
+        app_step();
+
+        size_t available = sim_usb_host_available();
+        if ((received + available) > sizeof(response)) {
+            return true;
+        }
+        received += sim_usb_host_read(&response[received], available);
+
+        while (received >= 8) {
+            size_t total = (8 + get_u32(&response[4]));
+            if (received < total) {
+                break;
+            }
+            if (memcmp(response, "PKT", 3) == 0) {
+                memmove(response, &response[total], (received - total));
+                received -= total;
+                continue;
+            }
+            if (response_length != NULL) {
+                *response_length = (total - 8);
+            }
+            return ((memcmp(response, "CMP", 3) != 0) || (response[3] != id));
+        }
+    }
+
+    return true;
+}
+
+static bool usb_tagged_commands (uint8_t id, uint32_t arg0, uint32_t arg1, int count) {
+    uint8_t header[16] = { 'C', 'M', 'T', id };
+    size_t received = 0;
+    int completed = 0;
+
+    for (int i = 0; i < count; i++) {
+        put_u32(&header[4], i);
+        put_u32(&header[8], arg0);
+        put_u32(&header[12], arg1);
+        sim_usb_host_write(header, sizeof(header));
+    }
+
+    for (uint32_t i = 0; i < STEP_LIMIT; i++) {
+        app_step();
+
+        size_t available = sim_usb_host_available();
+        if ((received + available) > sizeof(response)) {
+            return true;
+        }
+        received += sim_usb_host_read(&response[received], available);
+
+        while (received >= 8) {
+            bool packet = (memcmp(response, "PKT", 3) == 0);
+            size_t header_length = (packet ? 8 : 12);
+            if (received < header_length) {
+                break;
+            }
+            size_t total = (header_length + get_u32(&response[header_length - 4]));
+            if (received < total) {
+                break;
+            }
+            if (!packet) {
+                if ((memcmp(response, "CPT", 3) != 0) || (response[3] != id) || (get_u32(&response[4]) != completed)) {
+                    return true;
+                }
+                completed += 1;
+            }
+            memmove(response, &response[total], (received - total));
+            received -= total;
+            if (completed == count) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool n64_command (uint8_t id, uint32_t arg0, uint32_t arg1) {
+    sim_reg_poke(REG_CFG_DATA_0, arg0);
+    sim_reg_poke(REG_CFG_DATA_1, arg1);
+    sim_reg_poke(REG_CFG_CMD, CFG_CMD_PENDING | id);
+
+    for (uint32_t i = 0; i < STEP_LIMIT; i++) {
+        uint32_t reg = sim_reg_peek(REG_CFG_CMD);
+        if (reg & CFG_CMD_DONE) {
+            sim_reg_poke(REG_CFG_CMD, 0);
+            return (reg & CFG_CMD_ERROR);
+        }
+        app_step();
+    }
+
+    return true;
+}
+
+static void bench_usb_command (const char *name, uint8_t id, uint32_t arg0, uint32_t arg1, uint8_t *data, size_t length) {
+    measure_start();
+    if (usb_command(id, arg0, arg1, data, length, NULL)) {
+        printf("%-32s failed\n", name);
+        return;
+    }
+    measure_report(name);
+}
+
+
+static void bench_idle (void) {
+    for (int i = 0; i < 10; i++) {
+        app_step();
+    }
+    measure_start();
+    app_step();
+    measure_report("idle main loop iteration");
+}
+
+static void bench_usb (void) {
+    static uint8_t data[1024 * 1024];
+    uint8_t sector[4];
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (i & 0xFF);
+    }
+
+    bench_usb_command("usb identifier get (v)", 'v', 0, 0, NULL, 0);
+    bench_usb_command("usb version get (V)", 'V', 0, 0, NULL, 0);
+    bench_usb_command("usb config get (c)", 'c', CFG_ID_SAVE_TYPE, 0, NULL, 0);
+    bench_usb_command("usb config set (C)", 'C', CFG_ID_SAVE_TYPE, SAVE_TYPE_NONE, NULL, 0);
+    bench_usb_command("usb time get (t)", 't', 0, 0, NULL, 0);
+
+    measure_start();
+    for (int i = 0; i < 4; i++) {
+        if (usb_command('c', CFG_ID_SAVE_TYPE, 0, NULL, 0, NULL)) {
+            printf("%-32s failed\n", "usb 4x config get (c)");
+            return;
+        }
+    }
+    measure_report("usb 4x config get (c)");
+
+    measure_start();
+    if (usb_tagged_commands('c', CFG_ID_SAVE_TYPE, 0, 4)) {
+        printf("%-32s failed\n", "usb 4x config get (tagged c)");
+        return;
+    }
+    measure_report("usb 4x config get (tagged c)");
+
+    bench_usb_command("usb memory read 4 kiB (m)", 'm', TEST_BUFFER_ADDRESS, 4 * 1024, NULL, 0);
+    bench_usb_command("usb memory read 1 MiB (m)", 'm', TEST_BUFFER_ADDRESS, sizeof(data), NULL, 0);
+    bench_usb_command("usb memory write 4 kiB (M)", 'M', TEST_BUFFER_ADDRESS, 4 * 1024, data, 4 * 1024);
+    bench_usb_command("usb memory write 1 MiB (M)", 'M', TEST_BUFFER_ADDRESS, sizeof(data), data, sizeof(data));
+    bench_usb_command("usb memory checksum 1 MiB (k)", 'k', TEST_BUFFER_ADDRESS, sizeof(data), NULL, 0);
+    put_u32(sector, 64 * 1024);
+    bench_usb_command("usb chunk checksums 1 MiB (K)", 'K', TEST_BUFFER_ADDRESS, sizeof(data), sector, sizeof(sector));
+
+    bench_usb_command("usb sd card init (i)", 'i', 0, SD_OP_INIT, NULL, 0);
+    put_u32(sector, 0);
+    bench_usb_command("usb sd write 8 sectors (S)", 'S', TEST_BUFFER_ADDRESS, 8, sector, sizeof(sector));
+    bench_usb_command("usb sd read 8 sectors (s)", 's', TEST_BUFFER_ADDRESS, 8, sector, sizeof(sector));
+    bench_usb_command("usb sd read 2048 sectors (s)", 's', TEST_BUFFER_ADDRESS, 2048, sector, sizeof(sector));
+    bench_usb_command("usb sd card deinit (i)", 'i', 0, SD_OP_DEINIT, NULL, 0);
+}
+
+static void bench_dd_block_read (const char *name, bool starting_block) {
+    measure_start();
+
+    uint32_t sector_info = (
+        ((DD_SECTORS_IN_BLOCK) << 24) |
+        ((DD_SECTOR_SIZE - 1) << 16) |
+        ((DD_SECTOR_SIZE - 1) << 8) |
+        (starting_block ? (DD_SECTORS_IN_BLOCK + 1) : 0)
+    );
+    sim_reg_poke(REG_DD_SECTOR_INFO, sector_info);
+    sim_reg_poke(REG_DD_SCR, sim_reg_peek(REG_DD_SCR) | DD_SCR_BM_START | DD_SCR_BM_TRANSFER_MODE);
+
+    // Act as the N64 side, request next sector each time previous one was marked as ready
+    uint32_t ready_count = sim_dd_ready_count();
+    uint32_t sectors_read = 0;
+    for (uint32_t i = 0; (i < STEP_LIMIT) && (sectors_read < DD_BLOCK_DATA_SECTORS); i++) {
+        app_step();
+        if (sim_dd_ready_count() != ready_count) {
+            ready_count = sim_dd_ready_count();
+            sectors_read += 1;
+            if (sim_reg_peek(REG_DD_SCR) & DD_SCR_BM_MICRO_ERROR) {
+                break;
+            }
+            sim_dd_sector_buffer_end();
+        }
+    }
+
+    if (sectors_read < DD_BLOCK_DATA_SECTORS) {
+        printf("%-32s failed\n", name);
+    } else {
+        measure_report(name);
+    }
+
+    sim_reg_poke(REG_DD_SCR, sim_reg_peek(REG_DD_SCR) | DD_SCR_BM_STOP);
+    app_step();
+}
+
+static void bench_dd_block (void) {
+    uint8_t *mapping = sim_memory(DD_DISK_MAPPING_ADDRESS, 8);
+    uint8_t *thb = sim_memory(DD_THB_TABLE_ADDRESS, 64 * 4);
+    uint8_t *sectors = sim_memory(DD_SECTOR_TABLE_ADDRESS, 256 * 4);
+
+    put_u32(&mapping[0], DD_THB_TABLE_ADDRESS);
+    put_u32(&mapping[4], DD_SECTOR_TABLE_ADDRESS);
+    for (int i = 0; i < 64; i++) {
+        put_u32(&thb[i * 4], 0xFFFFFFFF);
+    }
+    put_u32(&thb[0], 0);
+    put_u32(&thb[4], DD_BLOCK_LENGTH);
+    for (int i = 0; i < 256; i++) {
+        put_u32(&sectors[i * 4], DD_SD_FIRST_SECTOR + i);
+    }
+
+    if ((sd_card_init() != SD_OK) || (sd_try_lock(SD_LOCK_N64) != SD_OK)) {
+        printf("%-32s failed\n", "64dd block read (sd)");
+        return;
+    }
+    dd_set_sd_mode(true);
+    dd_set_disk_mapping(DD_DISK_MAPPING_ADDRESS, 8);
+    dd_set_disk_state(DD_DISK_STATE_INSERTED);
+    app_step();
+
+    bench_dd_block_read("64dd block read (sd)", false);
+    bench_dd_block_read("64dd next block read (sd)", true);
+
+    dd_set_sd_mode(false);
+    sd_release_lock(SD_LOCK_N64);
+
+    // Block pushed ahead by the host, served without waiting for USB reply
+    uint8_t *tag = sim_memory(DD_STAGING_TAGS_ADDRESS, 8);
+    if (usb_command('C', CFG_ID_DD_USB_STAGING, true, NULL, 0, NULL)) {
+        printf("%-32s failed\n", "64dd block read (usb staged)");
+        return;
+    }
+    put_u32(&tag[0], DD_STAGING_TAG_VALID | 0);
+    put_u32(&tag[4], DD_BLOCK_LENGTH);
+
+    bench_dd_block_read("64dd block read (usb staged)", false);
+
+    while (sim_usb_host_available() > 0) {
+        sim_usb_host_read(response, sizeof(response));
+    }
+    usb_command('C', CFG_ID_DD_USB_STAGING, false, NULL, 0, NULL);
+}
+
+static void bench_flash (void) {
+    size_t length;
+    uint32_t pending;
+
+    if (usb_command('E', FLASH_ADDRESS, FLASH_ERASE_LENGTH, NULL, 0, NULL)) {
+        printf("%-32s failed\n", "usb flash erase 4 MiB (E + p)");
+        return;
+    }
+
+    bench_usb_command("usb flash erase status (p)", 'p', false, true, NULL, 0);
+
+    measure_start();
+    do {
+        if (usb_command('p', false, true, NULL, 0, &length) || (length != 8)) {
+            printf("%-32s failed\n", "usb flash erase 4 MiB (E + p)");
+            return;
+        }
+        pending = get_u32(&response[12]);
+    } while (pending > 0);
+    if (usb_command('p', true, false, NULL, 0, NULL)) {
+        printf("%-32s failed\n", "usb flash erase 4 MiB (E + p)");
+        return;
+    }
+    measure_report("usb flash erase 4 MiB (E + p)");
+}
+
+static void bench_isv_output (const char *name, uint32_t length) {
+    uint8_t *isv = sim_memory(ISV_ADDRESS, 0x20);
+
+    put_u32(&isv[ISV_WRITE_POINTER_OFFSET], length);
+    sim_isv_written();
+
+    measure_start();
+    for (uint32_t i = 0; i < STEP_LIMIT; i++) {
+        app_step();
+        sim_usb_host_read(response, sizeof(response));
+        if (get_u32(&isv[ISV_READ_POINTER_OFFSET]) == length) {
+            measure_report(name);
+            return;
+        }
+    }
+    printf("%-32s failed\n", name);
+}
+
+static void bench_isv (void) {
+    uint8_t *isv = sim_memory(ISV_ADDRESS, 0x20);
+
+    put_u32(&isv[0], ISV_TOKEN);
+    put_u32(&isv[ISV_READ_POINTER_OFFSET], 0);
+    put_u32(&isv[ISV_WRITE_POINTER_OFFSET], 0);
+
+    if (usb_command('C', CFG_ID_ISV_ADDRESS, ISV_ADDRESS, NULL, 0, NULL)) {
+        printf("%-32s failed\n", "isv idle main loop iteration");
+        return;
+    }
+    app_step();
+
+    measure_start();
+    app_step();
+    measure_report("isv idle main loop iteration");
+
+    bench_isv_output("isv output 4 kiB", 4 * 1024);
+
+    usb_command('C', CFG_ID_ISV_ADDRESS, 0, NULL, 0, NULL);
+    if (usb_command('C', CFG_ID_ISV_BUFFER_SIZE, 1024 * 1024, NULL, 0, NULL)) {
+        printf("%-32s failed\n", "isv output 512 kiB (1 MiB ring)");
+        return;
+    }
+    put_u32(&isv[ISV_READ_POINTER_OFFSET], 0);
+    put_u32(&isv[ISV_WRITE_POINTER_OFFSET], 0);
+    usb_command('C', CFG_ID_ISV_ADDRESS, ISV_ADDRESS, NULL, 0, NULL);
+    app_step();
+
+    bench_isv_output("isv output 512 kiB (1 MiB ring)", 512 * 1024);
+
+    usb_command('C', CFG_ID_ISV_ADDRESS, 0, NULL, 0, NULL);
+    usb_command('C', CFG_ID_ISV_BUFFER_SIZE, 64 * 1024, NULL, 0, NULL);
+}
+
+static void bench_usb_write (const char *name, uint32_t length, uint32_t packet_length) {
+    measure_start();
+    for (uint32_t offset = 0; offset < length; offset += packet_length) {
+        uint32_t arg1 = ((STREAM_DATATYPE << 24) | packet_length);
+        if (n64_command('M', (STREAM_PI_ADDRESS + offset), arg1)) {
+            printf("%-32s failed\n", name);
+            return;
+        }
+        while (true) {
+            sim_usb_host_read(response, sizeof(response));
+            if (n64_command('U', 0, 0)) {
+                printf("%-32s failed\n", name);
+                return;
+            }
+            if (!(sim_reg_peek(REG_CFG_DATA_0) & (1 << 31))) {
+                break;
+            }
+        }
+    }
+    measure_report(name);
+}
+
+static void bench_stream (void) {
+    uint8_t *header = sim_memory(STREAM_ADDRESS, STREAM_HEADER_LENGTH);
+    uint32_t length = (512 * 1024);
+
+    bench_usb_write("usb write 512 kiB (64 kiB pkts)", length, (64 * 1024));
+
+    if (n64_command('O', STREAM_PI_ADDRESS, ((STREAM_DATATYPE << 24) | STREAM_BUFFER_LENGTH))) {
+        printf("%-32s failed\n", "stream idle main loop iteration");
+        return;
+    }
+    app_step();
+
+    measure_start();
+    app_step();
+    measure_report("stream idle main loop iteration");
+
+    put_u32(&header[0], length);
+    sim_stream_written();
+
+    measure_start();
+    for (uint32_t i = 0; i < STEP_LIMIT; i++) {
+        app_step();
+        sim_usb_host_read(response, sizeof(response));
+        if (get_u32(&header[4]) == length) {
+            measure_report("stream 512 kiB (1 MiB ring)");
+            break;
+        }
+    }
+
+    n64_command('O', 0, 0);
+}
+
+static void bench_trace (void) {
+    if (usb_command('g', 1, 0, NULL, 0, NULL)) {
+        printf("%-32s failed\n", "usb trace read (g)");
+        return;
+    }
+    bench_usb_command("usb config get (c, tracing)", 'c', CFG_ID_SAVE_TYPE, 0, NULL, 0);
+    bench_usb_command("usb trace read (g)", 'g', 1, 0, NULL, 0);
+    usb_command('g', 0, 0, NULL, 0, NULL);
+}
+
+static void bench_writeback (const char *name, save_type_t save_type, uint32_t address, uint32_t length, bool fragmented) {
+    static uint32_t sector_table[WRITEBACK_SECTOR_TABLE_SIZE / 4];
+    static uint8_t run = 0;
+    uint8_t *sectors = sim_memory(SAVE_SECTOR_TABLE_ADDRESS, WRITEBACK_SECTOR_TABLE_SIZE);
+    uint8_t *save = sim_memory(address, length);
+    uint32_t count = (length / SD_SECTOR_SIZE);
+
+    // Fragmented save file leaves a gap after every cluster, like a file interleaved with another one
+    for (uint32_t i = 0; i < (WRITEBACK_SECTOR_TABLE_SIZE / 4); i++) {
+        uint32_t gap = (fragmented ? ((i / SAVE_CLUSTER_SECTORS) * SAVE_CLUSTER_SECTORS) : 0);
+        sector_table[i] = (SAVE_SD_FIRST_SECTOR + i + gap);
+        put_u32(&sectors[i * 4], sector_table[i]);
+    }
+
+    // Same sequence as N64 software: SD card init, then sector table of the save file
+    if (
+        usb_command('C', CFG_ID_SAVE_TYPE, save_type, NULL, 0, NULL) ||
+        n64_command('i', 0, SD_OP_INIT) ||
+        n64_command('W', SAVE_SECTOR_TABLE_PI_ADDRESS, 0)
+    ) {
+        printf("%-32s failed\n", name);
+        return;
+    }
+
+    // Game writes the save, FPGA bumps the save counter after each completed write
+    // Pattern changes every run so data left on the SD card by a previous run can't pass the check
+    run += 1;
+    for (uint32_t i = 0; i < length; i++) {
+        save[i] = (uint8_t) ((i * 7) + run);
+    }
+    sim_reg_poke(REG_SAVE_COUNT, sim_reg_peek(REG_SAVE_COUNT) + 1);
+    app_step();
+
+    bool flushed = false;
+
+    if (writeback_pending()) {
+        // Skip the debounce delay, only the flush itself is measured
+        sim_time_advance_us(2 * 1000 * 1000);
+
+        measure_start();
+        app_step();
+        sim_spi_stats_t stats = sim_stats_get();
+        uint32_t flush_steps = steps;
+
+        // Save data has to land in the sectors listed in the table
+        if (
+            !writeback_pending() &&
+            (sd_optimize_sectors(SAVE_READBACK_ADDRESS, sector_table, count, sd_read_sectors) == SD_OK) &&
+            (memcmp(sim_memory(SAVE_READBACK_ADDRESS, length), save, length) == 0)
+        ) {
+            flushed = true;
+            measure_report_stats(name, stats, flush_steps);
+        }
+    }
+
+    if (!flushed) {
+        printf("%-32s failed\n", name);
+    }
+
+    n64_command('i', 0, SD_OP_DEINIT);
+    usb_command('C', CFG_ID_SAVE_TYPE, SAVE_TYPE_NONE, NULL, 0, NULL);
+}
+
+static void bench_save_writeback (void) {
+    bench_writeback("save writeback eeprom 16k (sd)", SAVE_TYPE_EEPROM_16K, SAVE_EEPROM_ADDRESS, (2 * 1024), false);
+    bench_writeback("save writeback sram 256k (sd)", SAVE_TYPE_SRAM, SAVE_SRAM_FLASHRAM_ADDRESS, (32 * 1024), false);
+    bench_writeback("save writeback flashram (sd)", SAVE_TYPE_FLASHRAM, SAVE_SRAM_FLASHRAM_ADDRESS, (128 * 1024), false);
+    bench_writeback("save writeback sram 256k (frag)", SAVE_TYPE_SRAM, SAVE_SRAM_FLASHRAM_ADDRESS, (32 * 1024), true);
+    bench_writeback("save writeback flashram (frag)", SAVE_TYPE_FLASHRAM, SAVE_SRAM_FLASHRAM_ADDRESS, (128 * 1024), true);
+}
+
+int main (int argc, char *argv[]) {
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [sd_card_image]\n", argv[0]);
+        return 1;
+    }
+
+    if (sim_init((argc == 2) ? argv[1] : NULL)) {
+        fprintf(stderr, "Couldn't initialize simulation\n");
+        return 1;
+    }
+
+    app_init();
+
+    printf(
+        "%-32s %8s %10s %10s %8s %8s %12s %8s\n",
+        "operation",
+        "spi_txn",
+        "tx_bytes",
+        "rx_bytes",
+        "reg_rd",
+        "reg_wr",
+        "spi_time_us",
+        "loops"
+    );
+
+    bench_idle();
+    bench_usb();
+    bench_flash();
+    bench_dd_block();
+    bench_save_writeback();
+
+    bench_isv();
+    bench_stream();
+    bench_trace();
+
+    sim_deinit();
+
+    return 0;
+}
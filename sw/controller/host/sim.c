@@ -0,0 +1,847 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hw.h"
+#include "sd.h"
+#include "sim.h"
+
+
+#define MEMORY_LENGTH                   (0x08000000UL)
+
+#define SPI_BYTE_TIME_NS                (1000)
+#define SPI_TRANSACTION_OVERHEAD_NS     (500)
+
+#define REG_COUNT                       (REG_STREAM_SCR + 1)
+
+#define CFG_IDENTIFIER                  (0x53437632UL)
+
+#define SD_CARD_DEFAULT_LENGTH          (64 * 1024 * 1024)
+#define SD_RCA                          (0x00010000UL)
+#define SD_R1_APP_CMD                   (1 << 5)
+#define SD_R1_ILLEGAL_COMMAND           (1 << 22)
+#define SD_R3_READY                     ((1UL << 31) | (1 << 30) | 0x300000)
+
+#define RTC_MEMORY_LENGTH               (256)
+
+#define FLASH_ADDRESS                   (0x04000000UL)
+#define FLASH_ERASE_BLOCK_LENGTH        (64 * 1024)
+#define FLASH_ERASE_TIME_NS             (130 * 1000 * 1000)
+
+
+typedef struct {
+    uint8_t *data;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+} queue_t;
+
+struct spi {
+    bool selected;
+    uint8_t cmd;
+    uint32_t index;
+    uint8_t reg;
+    uint32_t value;
+    uint8_t buffer[FPGA_MAX_MEM_TRANSFER + 2];
+    uint32_t buffer_address;
+};
+
+struct usb {
+    queue_t rx;
+    queue_t tx;
+    bool dma_active;
+    uint32_t dma_address;
+    uint32_t dma_remaining;
+};
+
+struct sd {
+    FILE *image;
+    uint32_t sectors;
+    uint32_t scr;
+    bool cmd_error;
+    bool app_cmd;
+    bool illegal_cmd;
+    bool dat_error;
+    uint32_t dat_blocks;
+    bool dma_armed;
+    bool dma_read;
+    bool dma_byte_swap;
+    uint32_t dma_address;
+    uint32_t dma_length;
+    int64_t read_sector;
+    int64_t write_sector;
+};
+
+struct process {
+    uint32_t regs[REG_COUNT];
+    uint8_t *memory;
+    struct spi spi;
+    struct usb usb;
+    struct sd sd;
+    uint32_t dd_scr;
+    uint32_t dd_ready_count;
+    uint32_t dd_block_sector;
+    uint8_t rtc[RTC_MEMORY_LENGTH];
+    sim_spi_stats_t stats;
+    uint64_t time_ns;
+    uint64_t flash_busy_until_ns;
+    uint64_t systick_period_ns;
+    uint64_t systick_next_ns;
+    void (*systick_callback) (void);
+};
+
+
+static struct process p;
+
+
+static void queue_push (queue_t *queue, const uint8_t *data, size_t length) {
+    if ((queue->tail + length) > queue->capacity) {
+        size_t used = (queue->tail - queue->head);
+        memmove(queue->data, queue->data + queue->head, used);
+        queue->head = 0;
+        queue->tail = used;
+        if ((used + length) > queue->capacity) {
+            queue->capacity = ((used + length) * 2);
+            queue->data = realloc(queue->data, queue->capacity);
+        }
+    }
+    memcpy(queue->data + queue->tail, data, length);
+    queue->tail += length;
+}
+
+static size_t queue_pop (queue_t *queue, uint8_t *data, size_t length) {
+    size_t available = (queue->tail - queue->head);
+    if (length > available) {
+        length = available;
+    }
+    if (data != NULL) {
+        memcpy(data, queue->data + queue->head, length);
+    }
+    queue->head += length;
+    return length;
+}
+
+static size_t queue_length (queue_t *queue) {
+    return (queue->tail - queue->head);
+}
+
+static void queue_clear (queue_t *queue) {
+    queue->head = 0;
+    queue->tail = 0;
+}
+
+
+static bool sim_memory_valid (uint32_t address, size_t length) {
+    return ((address < MEMORY_LENGTH) && (length <= (MEMORY_LENGTH - address)));
+}
+
+
+static void sim_usb_dma_process (void) {
+    if (!p.usb.dma_active) {
+        return;
+    }
+    size_t length = queue_length(&p.usb.rx);
+    if (length > p.usb.dma_remaining) {
+        length = p.usb.dma_remaining;
+    }
+    if (sim_memory_valid(p.usb.dma_address, length)) {
+        queue_pop(&p.usb.rx, &p.memory[p.usb.dma_address], length);
+    } else {
+        queue_pop(&p.usb.rx, NULL, length);
+    }
+    p.usb.dma_address += length;
+    p.usb.dma_remaining -= length;
+    if (p.usb.dma_remaining == 0) {
+        p.usb.dma_active = false;
+    }
+}
+
+static void sim_usb_dma_start (uint32_t scr) {
+    uint32_t address = p.regs[REG_USB_DMA_ADDRESS];
+    uint32_t length = p.regs[REG_USB_DMA_LENGTH];
+
+    if (scr & DMA_SCR_DIRECTION) {
+        p.usb.dma_active = true;
+        p.usb.dma_address = address;
+        p.usb.dma_remaining = length;
+        sim_usb_dma_process();
+    } else if (sim_memory_valid(address, length)) {
+        queue_push(&p.usb.tx, &p.memory[address], length);
+    }
+}
+
+
+static void sim_sd_transfer (void) {
+    if (!p.sd.dma_armed) {
+        return;
+    }
+
+    int64_t sector = (p.sd.dma_read ? p.sd.read_sector : p.sd.write_sector);
+    if (sector < 0) {
+        return;
+    }
+
+    uint32_t count = (p.sd.dma_length / SD_SECTOR_SIZE);
+    uint8_t *data = sim_memory(p.sd.dma_address, p.sd.dma_length);
+
+    p.sd.dma_armed = false;
+    p.sd.read_sector = -1;
+    p.sd.write_sector = -1;
+
+    if ((data == NULL) || (count > p.sd.dat_blocks) || ((sector + count) > p.sd.sectors)) {
+        p.sd.dat_error = true;
+        return;
+    }
+
+    if (fseek(p.sd.image, (long) (sector * SD_SECTOR_SIZE), SEEK_SET) != 0) {
+        p.sd.dat_error = true;
+        return;
+    }
+
+    if (p.sd.dma_read) {
+        if (fread(data, SD_SECTOR_SIZE, count, p.sd.image) != count) {
+            p.sd.dat_error = true;
+            return;
+        }
+        if (p.sd.dma_byte_swap) {
+            for (uint32_t i = 0; i < p.sd.dma_length; i += 2) {
+                uint8_t tmp = data[i];
+                data[i] = data[i + 1];
+                data[i + 1] = tmp;
+            }
+        }
+    } else {
+        if (fwrite(data, SD_SECTOR_SIZE, count, p.sd.image) != count) {
+            p.sd.dat_error = true;
+        }
+    }
+}
+
+static void sim_sd_set_long_response (const uint8_t *data) {
+    for (int i = 0; i < 4; i++) {
+        const uint8_t *word = &data[i * 4];
+        p.regs[REG_SD_RSP_3 - i] = ((word[0] << 24) | (word[1] << 16) | (word[2] << 8) | word[3]);
+    }
+}
+
+static void sim_sd_cmd (uint32_t cmd_data) {
+    uint8_t cmd = (cmd_data & SD_CMD_INDEX_MASK);
+    uint32_t arg = p.regs[REG_SD_ARG];
+    bool app_cmd = p.sd.app_cmd;
+    uint8_t long_response[16];
+
+    p.sd.app_cmd = false;
+    p.sd.cmd_error = false;
+    p.regs[REG_SD_RSP_0] = 0;
+
+    if (p.sd.image == NULL) {
+        p.sd.cmd_error = true;
+        return;
+    }
+
+    switch (cmd) {
+        case 0:
+        case 2:
+        case 7:
+            break;
+
+        case 12:
+            p.sd.read_sector = -1;
+            p.sd.write_sector = -1;
+            break;
+
+        case 3:
+            p.regs[REG_SD_RSP_0] = SD_RCA;
+            break;
+
+        case 6:
+            if (!app_cmd) {
+                // High speed mode switch is reported as unsupported, card stays at 25 MHz
+                p.sd.illegal_cmd = true;
+                p.sd.cmd_error = true;
+            }
+            break;
+
+        case 8:
+            p.regs[REG_SD_RSP_0] = (arg & 0xFFF);
+            break;
+
+        case 9: {
+            uint32_t c_size = ((p.sd.sectors / 1024) - 1);
+            memset(long_response, 0, sizeof(long_response));
+            long_response[0] = 0x40;
+            long_response[7] = ((c_size >> 16) & 0x3F);
+            long_response[8] = ((c_size >> 8) & 0xFF);
+            long_response[9] = (c_size & 0xFF);
+            sim_sd_set_long_response(long_response);
+            break;
+        }
+
+        case 10:
+            memset(long_response, 0, sizeof(long_response));
+            memcpy(&long_response[3], "SIMSD", 5);
+            sim_sd_set_long_response(long_response);
+            break;
+
+        case 13:
+            p.regs[REG_SD_RSP_0] = (p.sd.illegal_cmd ? SD_R1_ILLEGAL_COMMAND : 0);
+            p.sd.illegal_cmd = false;
+            break;
+
+        case 18:
+            p.sd.read_sector = arg;
+            sim_sd_transfer();
+            break;
+
+        case 25:
+            p.sd.write_sector = arg;
+            sim_sd_transfer();
+            break;
+
+        case 41:
+            p.regs[REG_SD_RSP_0] = SD_R3_READY;
+            break;
+
+        case 55:
+            p.regs[REG_SD_RSP_0] = SD_R1_APP_CMD;
+            p.sd.app_cmd = true;
+            break;
+
+        default:
+            p.sd.illegal_cmd = true;
+            p.sd.cmd_error = true;
+            break;
+    }
+}
+
+static void sim_sd_dat_write (uint32_t value) {
+    if (value & SD_DAT_STOP) {
+        p.sd.read_sector = -1;
+        p.sd.write_sector = -1;
+    }
+    if (value & (SD_DAT_START_READ | SD_DAT_START_WRITE)) {
+        p.sd.dat_blocks = (((value & SD_DAT_BLOCKS_MASK) >> SD_DAT_BLOCKS_BIT) + 1);
+        p.sd.dat_error = false;
+    }
+}
+
+static void sim_sd_dma_write (uint32_t value) {
+    if (value & DMA_SCR_STOP) {
+        p.sd.dma_armed = false;
+    }
+    if (value & DMA_SCR_START) {
+        p.sd.dma_armed = true;
+        p.sd.dma_read = (value & DMA_SCR_DIRECTION);
+        p.sd.dma_byte_swap = (value & DMA_SCR_BYTE_SWAP);
+        p.sd.dma_address = p.regs[REG_SD_DMA_ADDRESS];
+        p.sd.dma_length = p.regs[REG_SD_DMA_LENGTH];
+        sim_sd_transfer();
+    }
+}
+
+
+static void sim_dd_scr_write (uint32_t value) {
+    uint32_t mcu_bits = (
+        DD_SCR_DISK_INSERTED |
+        DD_SCR_DISK_CHANGED |
+        DD_SCR_BM_TRANSFER_DATA |
+        DD_SCR_BM_TRANSFER_C2 |
+        DD_SCR_BM_MICRO_ERROR
+    );
+
+    if (value & DD_SCR_HARD_RESET_CLEAR) {
+        p.dd_scr &= ~(DD_SCR_HARD_RESET);
+    }
+    if (value & DD_SCR_CMD_READY) {
+        p.dd_scr &= ~(DD_SCR_CMD_PENDING);
+    }
+    if (value & DD_SCR_BM_START_CLEAR) {
+        p.dd_scr &= ~(DD_SCR_BM_START);
+    }
+    if (value & DD_SCR_BM_STOP_CLEAR) {
+        p.dd_scr &= ~(DD_SCR_BM_STOP);
+    }
+    if (value & DD_SCR_BM_CLEAR) {
+        p.dd_scr &= ~(DD_SCR_BM_PENDING);
+    }
+    if (value & DD_SCR_BM_ACK_CLEAR) {
+        p.dd_scr &= ~(DD_SCR_BM_ACK);
+    }
+    if (value & DD_SCR_BM_READY) {
+        p.dd_ready_count += 1;
+    }
+    if (value & DD_SCR_BM_BLOCK_START) {
+        p.dd_scr |= DD_SCR_BM_BLOCK_ACTIVE;
+        p.dd_block_sector = 0;
+        p.dd_ready_count += 1;
+    }
+
+    p.dd_scr = ((p.dd_scr & ~(mcu_bits)) | (value & mcu_bits));
+}
+
+
+static void sim_mem_test (uint32_t scr) {
+    uint32_t address = p.regs[REG_MEM_ADDRESS];
+    uint32_t length = (p.regs[REG_MEM_TEST_LENGTH] * 2);
+    uint32_t seed = p.regs[REG_MEM_TEST_SEED];
+    uint32_t pattern = ((scr & MEM_TEST_SCR_PATTERN_MASK) >> MEM_TEST_SCR_PATTERN_BIT);
+    bool verify = (scr & MEM_TEST_SCR_VERIFY);
+    uint32_t state = seed;
+    uint32_t errors = 0;
+
+    if (!sim_memory_valid(address, length)) {
+        return;
+    }
+
+    for (uint32_t offset = 0; offset < length; offset += 4) {
+        uint32_t word;
+        switch (pattern) {
+            case MEM_TEST_PATTERN_OWN_ADDRESS:
+                word = ((address + offset) ^ seed);
+                break;
+            case MEM_TEST_PATTERN_RANDOM:
+                word = state;
+                state = ((state >> 1) ^ ((state & 1) ? 0xD0000001UL : 0));
+                break;
+            case MEM_TEST_PATTERN_WALKING_ONES: {
+                uint32_t bit = (((address + offset) >> 1) & 0xE);
+                word = (((1UL << bit) << 16) | (1UL << (bit + 1))) ^ seed;
+                break;
+            }
+            default:
+                word = seed;
+                break;
+        }
+        for (int half = 0; half < 4; half += 2) {
+            uint8_t *data = &p.memory[address + offset + half];
+            uint16_t expected = (word >> ((2 - half) * 8));
+            if (verify) {
+                uint16_t read = ((data[0] << 8) | data[1]);
+                if (read != expected) {
+                    if (errors == 0) {
+                        p.regs[REG_MEM_TEST_ERROR_ADDRESS] = (address + offset + half);
+                        p.regs[REG_MEM_TEST_ERROR_DATA] = ((expected << 16) | read);
+                    }
+                    errors += 1;
+                }
+            } else {
+                data[0] = (expected >> 8);
+                data[1] = (expected & 0xFF);
+            }
+        }
+    }
+
+    if (verify) {
+        p.regs[REG_MEM_TEST_ERRORS] = errors;
+        if (errors == 0) {
+            p.regs[REG_MEM_TEST_ERROR_ADDRESS] = 0;
+            p.regs[REG_MEM_TEST_ERROR_DATA] = 0;
+        }
+    }
+}
+
+
+static uint32_t sim_reg_read (fpga_reg_t reg) {
+    p.stats.reg_reads += 1;
+
+    switch (reg) {
+        case REG_MEM_SCR:
+        case REG_MEM_TEST_SCR:
+        case REG_SD_DMA_SCR:
+            return 0;
+
+        case REG_FLASH_SCR:
+            return ((p.time_ns < p.flash_busy_until_ns) ? FLASH_SCR_BUSY : 0);
+
+        case REG_USB_SCR: {
+            uint32_t rx_count = queue_length(&p.usb.rx);
+            if (rx_count > 0x7FF) {
+                rx_count = 0x7FF;
+            }
+            return (
+                ((rx_count << USB_SCR_RX_COUNT_BIT) & USB_SCR_RX_COUNT_MASK) |
+                USB_SCR_TXE |
+                ((rx_count > 0) ? USB_SCR_RXNE : 0)
+            );
+        }
+
+        case REG_USB_DMA_SCR:
+            sim_usb_dma_process();
+            return (p.usb.dma_active ? DMA_SCR_BUSY : 0);
+
+        case REG_CFG_IDENTIFIER:
+            return CFG_IDENTIFIER;
+
+        case REG_SD_SCR:
+            return (
+                (p.sd.scr & SD_SCR_CLOCK_MODE_MASK) |
+                (p.sd.cmd_error ? SD_SCR_CMD_ERROR : 0) |
+                ((p.sd.image != NULL) ? SD_SCR_CARD_INSERTED : 0)
+            );
+
+        case REG_SD_DAT:
+            return (p.sd.dat_error ? SD_DAT_ERROR : 0);
+
+        case REG_DD_SCR:
+            return p.dd_scr;
+
+        default:
+            return p.regs[reg];
+    }
+}
+
+static void sim_reg_write (fpga_reg_t reg, uint32_t value) {
+    p.stats.reg_writes += 1;
+
+    switch (reg) {
+        case REG_MEM_SCR: {
+            uint32_t address = p.regs[REG_MEM_ADDRESS];
+            uint32_t length = (value >> MEM_SCR_LENGTH_BIT);
+            if ((value & MEM_SCR_START) && (length <= sizeof(p.spi.buffer)) && sim_memory_valid(address, length)) {
+                if (value & MEM_SCR_DIRECTION) {
+                    memcpy(&p.memory[address], p.spi.buffer, length);
+                } else {
+                    memcpy(p.spi.buffer, &p.memory[address], length);
+                }
+            }
+            break;
+        }
+
+        case REG_MEM_TEST_SCR:
+            if (value & MEM_TEST_SCR_START) {
+                sim_mem_test(value);
+            }
+            break;
+
+        case REG_FLASH_SCR: {
+            uint32_t address = (FLASH_ADDRESS + (value & ~(FLASH_ERASE_BLOCK_LENGTH - 1)));
+            if (sim_memory_valid(address, FLASH_ERASE_BLOCK_LENGTH)) {
+                memset(&p.memory[address], 0xFF, FLASH_ERASE_BLOCK_LENGTH);
+            }
+            p.flash_busy_until_ns = (p.time_ns + FLASH_ERASE_TIME_NS);
+            break;
+        }
+
+        case REG_USB_SCR:
+            if (value & USB_SCR_FIFO_FLUSH) {
+                queue_clear(&p.usb.rx);
+                queue_clear(&p.usb.tx);
+            }
+            break;
+
+        case REG_USB_DMA_SCR:
+            if (value & DMA_SCR_STOP) {
+                p.usb.dma_active = false;
+            }
+            if (value & DMA_SCR_START) {
+                sim_usb_dma_start(value);
+            }
+            break;
+
+        case REG_SD_SCR:
+            p.sd.scr = (value & SD_SCR_CLOCK_MODE_MASK);
+            break;
+
+        case REG_SD_CMD:
+            sim_sd_cmd(value);
+            break;
+
+        case REG_SD_DAT:
+            sim_sd_dat_write(value);
+            break;
+
+        case REG_SD_DMA_SCR:
+            sim_sd_dma_write(value);
+            break;
+
+        case REG_DD_SCR:
+            sim_dd_scr_write(value);
+            break;
+
+        case REG_ISV_SCR: {
+            uint32_t pending = (value & ISV_SCR_PENDING) ? 0 : (p.regs[REG_ISV_SCR] & ISV_SCR_PENDING);
+            p.regs[REG_ISV_SCR] = ((value & ~(ISV_SCR_PENDING)) | pending);
+            break;
+        }
+
+        case REG_STREAM_SCR: {
+            uint32_t pending = (value & STREAM_SCR_PENDING) ? 0 : (p.regs[REG_STREAM_SCR] & STREAM_SCR_PENDING);
+            p.regs[REG_STREAM_SCR] = ((value & ~(STREAM_SCR_PENDING)) | pending);
+            break;
+        }
+
+        default:
+            if (reg < REG_COUNT) {
+                p.regs[reg] = value;
+            }
+            break;
+    }
+}
+
+
+static void sim_spi_elapse (uint64_t time_ns) {
+    p.stats.spi_time_ns += time_ns;
+    p.time_ns += time_ns;
+    sim_time_advance_us(0);
+}
+
+static void sim_spi_tx_byte (uint8_t data) {
+    uint32_t index = p.spi.index++;
+
+    if (index == 0) {
+        p.spi.cmd = data;
+        if (p.spi.cmd < SIM_SPI_CMD_COUNT) {
+            p.stats.cmd_transactions[p.spi.cmd] += 1;
+        }
+        return;
+    }
+
+    switch (p.spi.cmd) {
+        case CMD_REG_WRITE:
+            if (index == 1) {
+                p.spi.reg = data;
+            } else if (index <= 5) {
+                p.spi.value |= (data << ((index - 2) * 8));
+                if (index == 5) {
+                    sim_reg_write(p.spi.reg, p.spi.value);
+                }
+            }
+            break;
+
+        case CMD_REG_READ:
+            if (index == 1) {
+                p.spi.reg = data;
+                p.spi.value = sim_reg_read(p.spi.reg);
+            }
+            break;
+
+        case CMD_MEM_READ:
+        case CMD_MEM_WRITE:
+            if (index == 1) {
+                p.spi.buffer_address = data;
+            } else if ((p.spi.cmd == CMD_MEM_WRITE) && (p.spi.buffer_address < sizeof(p.spi.buffer))) {
+                p.spi.buffer[p.spi.buffer_address++] = data;
+            }
+            break;
+
+        case CMD_USB_WRITE:
+            queue_push(&p.usb.tx, &data, 1);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static uint8_t sim_spi_rx_byte (void) {
+    uint32_t index = p.spi.index++;
+
+    switch (p.spi.cmd) {
+        case CMD_IDENTIFY:
+            return FPGA_ID;
+
+        case CMD_REG_READ:
+            return ((index >= 2) && (index < 6)) ? ((p.spi.value >> ((index - 2) * 8)) & 0xFF) : 0;
+
+        case CMD_MEM_READ:
+            if (p.spi.buffer_address < sizeof(p.spi.buffer)) {
+                return p.spi.buffer[p.spi.buffer_address++];
+            }
+            return 0;
+
+        case CMD_USB_STATUS:
+            return (USB_STATUS_TXE | ((queue_length(&p.usb.rx) > 0) ? USB_STATUS_RXNE : 0));
+
+        case CMD_USB_READ: {
+            uint8_t data = 0;
+            queue_pop(&p.usb.rx, &data, 1);
+            return data;
+        }
+
+        default:
+            return 0;
+    }
+}
+
+
+bool sim_init (const char *sd_image_path) {
+    memset(&p, 0, sizeof(p));
+
+    p.memory = calloc(MEMORY_LENGTH, 1);
+    if (p.memory == NULL) {
+        return true;
+    }
+
+    p.sd.read_sector = -1;
+    p.sd.write_sector = -1;
+
+    if (sd_image_path != NULL) {
+        p.sd.image = fopen(sd_image_path, "r+b");
+        if (p.sd.image == NULL) {
+            return true;
+        }
+        fseek(p.sd.image, 0, SEEK_END);
+        p.sd.sectors = (ftell(p.sd.image) / SD_SECTOR_SIZE);
+    } else {
+        p.sd.image = tmpfile();
+        if (p.sd.image == NULL) {
+            return true;
+        }
+        fseek(p.sd.image, SD_CARD_DEFAULT_LENGTH - 1, SEEK_SET);
+        fputc(0, p.sd.image);
+        p.sd.sectors = (SD_CARD_DEFAULT_LENGTH / SD_SECTOR_SIZE);
+    }
+
+    return false;
+}
+
+void sim_deinit (void) {
+    if (p.sd.image != NULL) {
+        fclose(p.sd.image);
+    }
+    free(p.usb.rx.data);
+    free(p.usb.tx.data);
+    free(p.memory);
+    memset(&p, 0, sizeof(p));
+}
+
+
+void sim_spi_start (void) {
+    p.spi.selected = true;
+    p.spi.index = 0;
+    p.spi.value = 0;
+    p.stats.transactions += 1;
+    sim_spi_elapse(SPI_TRANSACTION_OVERHEAD_NS);
+}
+
+void sim_spi_stop (void) {
+    p.spi.selected = false;
+}
+
+void sim_spi_tx (uint8_t *data, int length) {
+    for (int i = 0; i < length; i++) {
+        sim_spi_tx_byte(data[i]);
+    }
+    p.stats.tx_bytes += length;
+    sim_spi_elapse(length * SPI_BYTE_TIME_NS);
+}
+
+void sim_spi_rx (uint8_t *data, int length) {
+    for (int i = 0; i < length; i++) {
+        data[i] = sim_spi_rx_byte();
+    }
+    p.stats.rx_bytes += length;
+    sim_spi_elapse(length * SPI_BYTE_TIME_NS);
+}
+
+
+void sim_stats_reset (void) {
+    memset(&p.stats, 0, sizeof(p.stats));
+}
+
+sim_spi_stats_t sim_stats_get (void) {
+    return p.stats;
+}
+
+
+uint64_t sim_time_us (void) {
+    return (p.time_ns / 1000);
+}
+
+void sim_time_advance_us (uint64_t time_us) {
+    p.time_ns += (time_us * 1000);
+    while ((p.systick_callback != NULL) && (p.time_ns >= p.systick_next_ns)) {
+        p.systick_next_ns += p.systick_period_ns;
+        p.systick_callback();
+    }
+}
+
+void sim_systick_config (uint32_t period_ms, void (*callback) (void)) {
+    p.systick_period_ns = (period_ms * 1000000ULL);
+    p.systick_next_ns = (p.time_ns + p.systick_period_ns);
+    p.systick_callback = callback;
+}
+
+
+uint8_t *sim_memory (uint32_t address, size_t length) {
+    if (!sim_memory_valid(address, length)) {
+        return NULL;
+    }
+    return &p.memory[address];
+}
+
+
+uint32_t sim_reg_peek (fpga_reg_t reg) {
+    if (reg == REG_DD_SCR) {
+        return p.dd_scr;
+    }
+    return (reg < REG_COUNT) ? p.regs[reg] : 0;
+}
+
+void sim_reg_poke (fpga_reg_t reg, uint32_t value) {
+    if (reg == REG_DD_SCR) {
+        if (value & (DD_SCR_BM_START | DD_SCR_BM_STOP)) {
+            value &= ~(DD_SCR_BM_BLOCK_ACTIVE);
+        }
+        p.dd_scr = value;
+    } else if (reg < REG_COUNT) {
+        p.regs[reg] = value;
+    }
+}
+
+void sim_isv_written (void) {
+    if (p.regs[REG_ISV_SCR] & ISV_SCR_ENABLED) {
+        p.regs[REG_ISV_SCR] |= ISV_SCR_PENDING;
+    }
+}
+
+void sim_stream_written (void) {
+    if (p.regs[REG_STREAM_SCR] & STREAM_SCR_ENABLED) {
+        p.regs[REG_STREAM_SCR] |= STREAM_SCR_PENDING;
+    }
+}
+
+uint32_t sim_dd_ready_count (void) {
+    return p.dd_ready_count;
+}
+
+void sim_dd_sector_buffer_end (void) {
+    if (p.dd_scr & DD_SCR_BM_BLOCK_ACTIVE) {
+        uint8_t sectors_in_block = ((p.regs[REG_DD_SECTOR_INFO] >> 24) & 0xFF);
+        p.dd_block_sector += 1;
+        if (p.dd_block_sector < (sectors_in_block - 4)) {
+            p.dd_ready_count += 1;
+            return;
+        }
+        p.dd_scr &= ~(DD_SCR_BM_BLOCK_ACTIVE);
+    }
+    p.dd_scr |= DD_SCR_BM_PENDING;
+}
+
+
+void sim_usb_host_write (const uint8_t *data, size_t length) {
+    queue_push(&p.usb.rx, data, length);
+    sim_usb_dma_process();
+}
+
+size_t sim_usb_host_read (uint8_t *data, size_t length) {
+    return queue_pop(&p.usb.tx, data, length);
+}
+
+size_t sim_usb_host_available (void) {
+    return queue_length(&p.usb.tx);
+}
+
+
+i2c_error_t sim_i2c_trx (uint8_t i2c_address, uint8_t *tx_data, uint8_t tx_length, uint8_t *rx_data, uint8_t rx_length) {
+    if (tx_length == 0) {
+        return I2C_ERROR_NACK;
+    }
+    uint8_t address = tx_data[0];
+    for (int i = 1; i < tx_length; i++) {
+        p.rtc[address++] = tx_data[i];
+    }
+    for (int i = 0; i < rx_length; i++) {
+        rx_data[i] = p.rtc[address++];
+    }
+    return I2C_OK;
+}
@@ -0,0 +1,57 @@
+#ifndef SIM_H__
+#define SIM_H__
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "fpga.h"
+#include "hw.h"
+
+
+#define SIM_SPI_CMD_COUNT       (CMD_USB_WRITE + 1)
+
+
+typedef struct {
+    uint32_t transactions;
+    uint32_t tx_bytes;
+    uint32_t rx_bytes;
+    uint32_t cmd_transactions[SIM_SPI_CMD_COUNT];
+    uint32_t reg_reads;
+    uint32_t reg_writes;
+    uint64_t spi_time_ns;
+} sim_spi_stats_t;
+
+
+bool sim_init (const char *sd_image_path);
+void sim_deinit (void);
+
+void sim_spi_start (void);
+void sim_spi_stop (void);
+void sim_spi_tx (uint8_t *data, int length);
+void sim_spi_rx (uint8_t *data, int length);
+
+void sim_stats_reset (void);
+sim_spi_stats_t sim_stats_get (void);
+
+uint64_t sim_time_us (void);
+void sim_time_advance_us (uint64_t time_us);
+void sim_systick_config (uint32_t period_ms, void (*callback) (void));
+
+uint8_t *sim_memory (uint32_t address, size_t length);
+
+uint32_t sim_reg_peek (fpga_reg_t reg);
+void sim_reg_poke (fpga_reg_t reg, uint32_t value);
+uint32_t sim_dd_ready_count (void);
+void sim_dd_sector_buffer_end (void);
+void sim_isv_written (void);
+void sim_stream_written (void);
+
+void sim_usb_host_write (const uint8_t *data, size_t length);
+size_t sim_usb_host_read (uint8_t *data, size_t length);
+size_t sim_usb_host_available (void);
+
+i2c_error_t sim_i2c_trx (uint8_t i2c_address, uint8_t *tx_data, uint8_t tx_length, uint8_t *rx_data, uint8_t rx_length);
+
+
+#endif
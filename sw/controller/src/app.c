@@ -3,6 +3,7 @@
 #include "cfg.h"
 #include "cic.h"
 #include "dd.h"
+#include "flash.h"
 #include "flashram.h"
 #include "fpga.h"
 #include "hw.h"
@@ -10,7 +11,9 @@
 #include "led.h"
 #include "rtc.h"
 #include "sd.h"
+#include "stream.h"
 #include "timer.h"
+#include "trace.h"
 #include "usb.h"
 #include "writeback.h"
 
@@ -28,10 +31,13 @@ void app (void) {
     cfg_init();
     cic_init();
     dd_init();
+    flash_init();
     flashram_init();
     isv_init();
     led_init();
     sd_init();
+    stream_init();
+    trace_init();
     usb_init();
     writeback_init();
 
@@ -40,11 +46,13 @@ void app (void) {
         cfg_process();
         cic_process();
         dd_process();
+        flash_process();
         flashram_process();
         isv_process();
         led_process();
         rtc_process();
         sd_process();
+        stream_process();
         usb_process();
         writeback_process();
     }
@@ -9,6 +9,8 @@
 #include "led.h"
 #include "rtc.h"
 #include "sd.h"
+#include "stream.h"
+#include "trace.h"
 #include "usb.h"
 #include "version.h"
 #include "writeback.h"
@@ -31,6 +33,7 @@ typedef enum {
     CMD_ID_USB_WRITE = 'M',
     CMD_ID_USB_READ_STATUS = 'u',
     CMD_ID_USB_WRITE_STATUS = 'U',
+    CMD_ID_USB_STREAM_SET = 'O',
     CMD_ID_SD_CARD_OP = 'i',
     CMD_ID_SD_SECTOR_SET = 'I',
     CMD_ID_SD_READ = 's',
@@ -60,6 +63,8 @@ typedef enum {
     CFG_ID_BUTTON_STATE = 12,
     CFG_ID_BUTTON_MODE = 13,
     CFG_ID_ROM_EXTENDED_ENABLE = 14,
+    CFG_ID_DD_USB_STAGING_ENABLE = 15,
+    CFG_ID_ISV_BUFFER_SIZE = 16,
 } cfg_id_t;
 
 typedef enum {
@@ -157,6 +162,7 @@ static bool cfg_cmd_check (void) {
         p.cmd = (cmd_id_t) ((reg & CFG_CMD_MASK) >> CFG_CMD_BIT);
         p.data[0] = fpga_reg_get(REG_CFG_DATA_0);
         p.data[1] = fpga_reg_get(REG_CFG_DATA_1);
+        trace_event(TRACE_EVENT_CFG_COMMAND_START, p.cmd);
     }
 
     return false;
@@ -167,6 +173,7 @@ static void cfg_cmd_reply_success (void) {
     fpga_reg_set(REG_CFG_DATA_0, p.data[0]);
     fpga_reg_set(REG_CFG_DATA_1, p.data[1]);
     fpga_reg_set(REG_CFG_CMD, CFG_CMD_DONE);
+    trace_event(TRACE_EVENT_CFG_COMMAND_END, p.cmd);
 }
 
 static void cfg_cmd_reply_error (error_type_t type, uint32_t error) {
@@ -174,6 +181,7 @@ static void cfg_cmd_reply_error (error_type_t type, uint32_t error) {
     fpga_reg_set(REG_CFG_DATA_0, ((type & 0xFF) << 24) | (error & 0xFFFFFF));
     fpga_reg_set(REG_CFG_DATA_1, 0);
     fpga_reg_set(REG_CFG_CMD, CFG_CMD_ERROR | CFG_CMD_DONE);
+    trace_event(TRACE_EVENT_CFG_COMMAND_END, (p.cmd | (1 << 8)));
 }
 
 static void cfg_change_scr_bits (uint32_t mask, bool value) {
@@ -371,6 +379,12 @@ bool cfg_query (uint32_t *args) {
         case CFG_ID_ROM_EXTENDED_ENABLE:
             args[1] = (scr & CFG_SCR_ROM_EXTENDED_ENABLED);
             break;
+        case CFG_ID_DD_USB_STAGING_ENABLE:
+            args[1] = dd_get_usb_staging();
+            break;
+        case CFG_ID_ISV_BUFFER_SIZE:
+            args[1] = isv_get_buffer_size();
+            break;
         default:
             return true;
     }
@@ -451,6 +465,11 @@ bool cfg_update (uint32_t *args) {
         case CFG_ID_ROM_EXTENDED_ENABLE:
             cfg_change_scr_bits(CFG_SCR_ROM_EXTENDED_ENABLED, args[1]);
             break;
+        case CFG_ID_DD_USB_STAGING_ENABLE:
+            dd_set_usb_staging(args[1]);
+            break;
+        case CFG_ID_ISV_BUFFER_SIZE:
+            return isv_set_buffer_size(args[1]);
         default:
             return true;
     }
@@ -531,7 +550,10 @@ void cfg_reset_state (void) {
     dd_set_drive_type(DD_DRIVE_TYPE_RETAIL);
     dd_set_disk_state(DD_DISK_STATE_EJECTED);
     dd_set_sd_mode(false);
+    dd_set_usb_staging(false);
     isv_set_address(0);
+    isv_set_buffer_size(ISV_DEFAULT_BUFFER_SIZE);
+    stream_disable();
     p.cic_seed = CIC_SEED_AUTO;
     p.tv_type = TV_TYPE_PASSTHROUGH;
     p.boot_mode = BOOT_MODE_MENU;
@@ -632,6 +654,24 @@ void cfg_process (void) {
             p.data[0] = p.usb_output_ready ? 0 : (1 << 31);
             break;
 
+        case CMD_ID_USB_STREAM_SET: {
+            uint32_t length = (p.data[1] & 0xFFFFFF);
+            if (length == 0) {
+                stream_disable();
+                break;
+            }
+            if (stream_busy()) {
+                return;
+            }
+            if (cfg_translate_address(&p.data[0], (STREAM_HEADER_LENGTH + length), SDRAM)) {
+                return cfg_cmd_reply_error(ERROR_TYPE_CFG, CFG_ERROR_INVALID_ADDRESS);
+            }
+            if (stream_set_buffer(p.data[0], length, (p.data[1] >> 24))) {
+                return cfg_cmd_reply_error(ERROR_TYPE_CFG, CFG_ERROR_INVALID_ARGUMENT);
+            }
+            break;
+        }
+
         case CMD_ID_SD_CARD_OP: {
             sd_error_t error = SD_OK;
             switch (p.data[1]) {
@@ -4,6 +4,7 @@
 #include "rtc.h"
 #include "sd.h"
 #include "timer.h"
+#include "trace.h"
 #include "usb.h"
 
 
@@ -11,9 +12,16 @@
 #define DD_BLOCK_DATA_SECTORS_NUM   (85)
 #define DD_BLOCK_BUFFER_SIZE        (ALIGN(DD_SECTOR_MAX_SIZE * DD_BLOCK_DATA_SECTORS_NUM, SD_SECTOR_SIZE) + SD_SECTOR_SIZE)
 #define DD_BLOCK_BUFFER_ADDRESS     (0x03BC0000UL - DD_BLOCK_BUFFER_SIZE)
+#define DD_PREFETCH_BUFFER_ADDRESS  (DD_BLOCK_BUFFER_ADDRESS - DD_BLOCK_BUFFER_SIZE)
+#define DD_STAGING_SLOTS            (4)
+#define DD_STAGING_BUFFER_ADDRESS   (DD_PREFETCH_BUFFER_ADDRESS - (DD_STAGING_SLOTS * DD_BLOCK_BUFFER_SIZE))
+#define DD_STAGING_TAGS_ADDRESS     (DD_STAGING_BUFFER_ADDRESS - (DD_STAGING_SLOTS * sizeof(dd_staging_tag_t)))
 #define DD_SECTOR_BUFFER_ADDRESS    (0x05002800UL)
 #define DD_SD_SECTOR_TABLE_SIZE     (DD_BLOCK_BUFFER_SIZE / SD_SECTOR_SIZE)
 #define DD_SD_MAX_DISKS             (4)
+#define DD_SD_TRACK_CACHE_SIZE      (2)
+#define DD_SD_BLOCK_MAX_RUNS        (8)
+#define DD_TRACKS_PER_HEAD          (1175)
 
 #define DD_DRIVE_ID_RETAIL          (0x0003)
 #define DD_DRIVE_ID_DEVELOPMENT     (0x0004)
@@ -24,6 +32,8 @@
 #define DD_THB_UNMAPPED             (0xFFFFFFFF)
 #define DD_THB_WRITABLE_FLAG        (1 << 31)
 
+#define DD_STAGING_TAG_VALID        (1 << 31)
+
 
 typedef enum {
     DD_CMD_SEEK_READ                = 0x01,
@@ -69,6 +79,43 @@ typedef struct {
     uint32_t sector_table_address;
 } sd_disk_info_t;
 
+typedef struct {
+    uint32_t sector;
+    uint32_t count;
+} sd_run_t;
+
+typedef struct {
+    bool mapped;
+    bool writable;
+    bool fragmented;
+    uint16_t offset;
+    uint32_t table_start;
+    uint8_t table_count;
+    uint8_t run_count;
+    sd_run_t runs[DD_SD_BLOCK_MAX_RUNS];
+} sd_block_map_t;
+
+typedef struct {
+    bool valid;
+    uint8_t disk;
+    uint8_t sector_size;
+    uint16_t index;
+    sd_block_map_t blocks[2];
+} sd_track_map_t;
+
+typedef struct {
+    bool valid;
+    uint16_t index;
+    uint8_t sector_size;
+    uint32_t buffer_address;
+    uint32_t offset;
+} dd_prefetch_t;
+
+typedef struct {
+    uint32_t index;
+    uint32_t length;
+} dd_staging_tag_t;
+
 struct process {
     enum state state;
     rtc_real_time_t time;
@@ -83,11 +130,20 @@ struct process {
     sector_info_t sector_info;
     bool block_ready;
     bool block_valid;
+    bool block_streaming;
     uint32_t block_offset;
+    uint32_t block_buffer_address;
+    uint16_t block_index;
+    uint16_t previous_block_index;
+    bool prefetch_pending;
+    dd_prefetch_t prefetch;
     dd_drive_type_t drive_type;
     bool sd_mode;
+    bool usb_staging;
     uint8_t sd_current_disk;
     sd_disk_info_t sd_disk_info[DD_SD_MAX_DISKS];
+    sd_track_map_t sd_track_cache[DD_SD_TRACK_CACHE_SIZE];
+    uint8_t sd_track_cache_next;
 };
 
 
@@ -101,49 +157,278 @@ static uint16_t dd_track_head_block (void) {
     return (track | head | block);
 }
 
-static uint32_t dd_fill_sd_sector_table (uint32_t index, uint32_t *sector_table, bool is_write) {
-    uint32_t tmp;
+static void dd_sd_sector_table_read (uint32_t start, uint32_t count, uint32_t *sector_table) {
+    uint32_t address = (p.sd_disk_info[p.sd_current_disk].sector_table_address + (start * sizeof(uint32_t)));
+    fpga_mem_read(address, (count * sizeof(uint32_t)), (uint8_t *) (sector_table));
+    for (int i = 0; i < count; i++) {
+        sector_table[i] = SWAP32(sector_table[i]);
+    }
+}
+
+static void dd_sd_block_map_decode (sd_block_map_t *block, uint32_t *sector_table) {
+    block->run_count = 0;
+    for (int i = 0; i < block->table_count; i++) {
+        if (sector_table[i] == 0) {
+            block->mapped = false;
+            return;
+        }
+        if (block->run_count > 0) {
+            sd_run_t *run = &block->runs[block->run_count - 1];
+            if ((run->sector + run->count) == sector_table[i]) {
+                run->count += 1;
+                continue;
+            }
+        }
+        if (block->run_count == DD_SD_BLOCK_MAX_RUNS) {
+            block->fragmented = true;
+            return;
+        }
+        block->runs[block->run_count].sector = sector_table[i];
+        block->runs[block->run_count].count = 1;
+        block->run_count += 1;
+    }
+}
+
+static sd_track_map_t *dd_sd_track_map_get (uint16_t index) {
+    uint16_t track_index = (index >> 1);
     sd_disk_info_t info = p.sd_disk_info[p.sd_current_disk];
+
+    for (int i = 0; i < DD_SD_TRACK_CACHE_SIZE; i++) {
+        sd_track_map_t *track = &p.sd_track_cache[i];
+        if (
+            track->valid &&
+            (track->disk == p.sd_current_disk) &&
+            (track->index == track_index) &&
+            (track->sector_size == p.sector_info.sector_size)
+        ) {
+            return track;
+        }
+    }
+
     if (info.thb_table_address == 0xFFFFFFFF) {
-        return 0;
+        return NULL;
+    }
+
+    sd_track_map_t *track = &p.sd_track_cache[p.sd_track_cache_next];
+    p.sd_track_cache_next = ((p.sd_track_cache_next + 1) % DD_SD_TRACK_CACHE_SIZE);
+
+    // Both blocks of a track have adjacent THB entries
+    uint32_t thb[2];
+    fpga_mem_read((info.thb_table_address + (track_index * sizeof(thb))), sizeof(thb), (uint8_t *) (thb));
+
+    uint32_t block_length = ((p.sector_info.sector_size + 1) * DD_BLOCK_DATA_SECTORS_NUM);
+    uint32_t sector_table[DD_SD_SECTOR_TABLE_SIZE];
+
+    for (int i = 0; i < 2; i++) {
+        sd_block_map_t *block = &track->blocks[i];
+        uint32_t start_offset = SWAP32(thb[i]);
+        block->mapped = (start_offset != DD_THB_UNMAPPED);
+        block->writable = (start_offset & DD_THB_WRITABLE_FLAG);
+        block->fragmented = false;
+        block->run_count = 0;
+        if (!block->mapped) {
+            continue;
+        }
+        start_offset &= ~(DD_THB_WRITABLE_FLAG);
+        uint32_t end_offset = ((start_offset + block_length) - 1);
+        block->offset = (start_offset % SD_SECTOR_SIZE);
+        block->table_start = (start_offset / SD_SECTOR_SIZE);
+        block->table_count = (1 + ((end_offset / SD_SECTOR_SIZE) - block->table_start));
+        dd_sd_sector_table_read(block->table_start, block->table_count, sector_table);
+        dd_sd_block_map_decode(block, sector_table);
     }
-    uint32_t thb_entry_address = (info.thb_table_address + (index * sizeof(uint32_t)));
-    fpga_mem_read(thb_entry_address, sizeof(uint32_t), (uint8_t *) (&tmp));
-    uint32_t start_offset = SWAP32(tmp);
-    if (start_offset == DD_THB_UNMAPPED) {
-        return 0;
+
+    track->valid = true;
+    track->disk = p.sd_current_disk;
+    track->sector_size = p.sector_info.sector_size;
+    track->index = track_index;
+
+    return track;
+}
+
+static void dd_sd_track_cache_invalidate (void) {
+    for (int i = 0; i < DD_SD_TRACK_CACHE_SIZE; i++) {
+        p.sd_track_cache[i].valid = false;
     }
-    if (is_write && ((start_offset & DD_THB_WRITABLE_FLAG) == 0)) {
-        return 0;
+}
+
+static sd_error_t dd_sd_block_process (uint32_t address, uint16_t index, uint32_t *offset, bool is_write) {
+    sd_process_sectors_t *sd_process_sectors = (is_write ? sd_write_sectors : sd_read_sectors);
+
+    sd_track_map_t *track = dd_sd_track_map_get(index);
+    if (track == NULL) {
+        return SD_ERROR_INVALID_ARGUMENT;
     }
-    start_offset &= ~(DD_THB_WRITABLE_FLAG);
-    p.block_offset = (start_offset % SD_SECTOR_SIZE);
-    uint32_t block_length = ((p.sector_info.sector_size + 1) * DD_BLOCK_DATA_SECTORS_NUM);
-    uint32_t end_offset = ((start_offset + block_length) - 1);
-    uint32_t starting_sector = (start_offset / SD_SECTOR_SIZE);
-    uint32_t sectors = (1 + ((end_offset / SD_SECTOR_SIZE) - starting_sector));
-    for (int i = 0; i < sectors; i++) {
-        uint32_t sector_entry_address = info.sector_table_address + ((starting_sector + i) * sizeof(uint32_t));
-        fpga_mem_read(sector_entry_address, sizeof(uint32_t), (uint8_t *) (&tmp));
-        sector_table[i] = SWAP32(tmp);
-    }
-    return sectors;
+
+    sd_block_map_t *block = &track->blocks[index & 1];
+    if (!block->mapped || (is_write && !block->writable)) {
+        return SD_ERROR_INVALID_ARGUMENT;
+    }
+
+    *offset = block->offset;
+
+    if (block->fragmented) {
+        uint32_t sector_table[DD_SD_SECTOR_TABLE_SIZE];
+        dd_sd_sector_table_read(block->table_start, block->table_count, sector_table);
+        return sd_optimize_sectors(address, sector_table, block->table_count, sd_process_sectors);
+    }
+
+    for (int i = 0; i < block->run_count; i++) {
+        sd_error_t error = sd_process_sectors(address, block->runs[i].sector, block->runs[i].count);
+        if (error != SD_OK) {
+            return error;
+        }
+        address += (block->runs[i].count * SD_SECTOR_SIZE);
+    }
+
+    return SD_OK;
+}
+
+static void dd_prefetch_invalidate (void) {
+    p.prefetch.valid = false;
+}
+
+static bool dd_prefetch_take (uint16_t index) {
+    if (!p.prefetch.valid || (p.prefetch.index != index) || (p.prefetch.sector_size != p.sector_info.sector_size)) {
+        return false;
+    }
+    p.prefetch.valid = false;
+    p.block_buffer_address = p.prefetch.buffer_address;
+    p.block_offset = p.prefetch.offset;
+    return true;
+}
+
+static bool dd_prefetch_next_index (uint16_t *index) {
+    uint16_t track = (p.block_index >> 2);
+    bool head = (p.block_index & (1 << 1));
+
+    // Blocks on a track are read in pairs, starting block alternates between consecutive tracks
+    if ((p.block_index ^ 1) != p.previous_block_index) {
+        *index = (p.block_index ^ 1);
+        return true;
+    }
+
+    // Head 0 tracks are laid out outwards, head 1 tracks inwards
+    if (head) {
+        if (track == 0) {
+            return false;
+        }
+        track -= 1;
+    } else {
+        track += 1;
+        if (track >= DD_TRACKS_PER_HEAD) {
+            return false;
+        }
+    }
+
+    *index = ((track << 2) | (p.block_index & 0x3));
+    return true;
+}
+
+static void dd_block_prefetch (void) {
+    uint16_t index;
+
+    if (!dd_prefetch_next_index(&index)) {
+        return;
+    }
+
+    if (p.prefetch.valid && (p.prefetch.index == index) && (p.prefetch.sector_size == p.sector_info.sector_size)) {
+        return;
+    }
+
+    p.prefetch.valid = false;
+    p.prefetch.buffer_address = (
+        (p.block_buffer_address == DD_BLOCK_BUFFER_ADDRESS) ? DD_PREFETCH_BUFFER_ADDRESS : DD_BLOCK_BUFFER_ADDRESS
+    );
+
+    if (sd_get_lock(SD_LOCK_N64) != SD_OK) {
+        return;
+    }
+
+    uint32_t offset;
+    led_activity_on();
+    sd_error_t error = dd_sd_block_process(p.prefetch.buffer_address, index, &offset, false);
+    led_activity_off();
+
+    if (error == SD_OK) {
+        p.prefetch.valid = true;
+        p.prefetch.index = index;
+        p.prefetch.sector_size = p.sector_info.sector_size;
+        p.prefetch.offset = offset;
+    }
+}
+
+static bool dd_usb_staging_take (uint16_t index, bool *hit) {
+    dd_staging_tag_t tags[DD_STAGING_SLOTS];
+    uint32_t length = ((p.sector_info.sector_size + 1) * DD_BLOCK_DATA_SECTORS_NUM);
+
+    *hit = false;
+
+    // Host pushes predicted blocks ahead, tags are written after data so valid tag means complete block
+    fpga_mem_read(DD_STAGING_TAGS_ADDRESS, sizeof(tags), (uint8_t *) (tags));
+
+    for (int slot = 0; slot < DD_STAGING_SLOTS; slot++) {
+        if ((SWAP32(tags[slot].index) != (DD_STAGING_TAG_VALID | index)) || (SWAP32(tags[slot].length) != length)) {
+            continue;
+        }
+
+        uint32_t buffer_address = (DD_STAGING_BUFFER_ADDRESS + (slot * DD_BLOCK_BUFFER_SIZE));
+
+        // Host must learn which slot is in use before it recycles any of them
+        usb_tx_info_t packet_info;
+        usb_create_packet(&packet_info, PACKET_CMD_DD_REQUEST);
+        packet_info.data_length = 12;
+        packet_info.data[0] = 3;
+        packet_info.data[1] = buffer_address;
+        packet_info.data[2] = index;
+        if (!usb_enqueue_packet(&packet_info)) {
+            return false;
+        }
+
+        tags[slot].index = 0;
+        tags[slot].length = 0;
+        fpga_mem_write(DD_STAGING_TAGS_ADDRESS + (slot * sizeof(dd_staging_tag_t)), sizeof(dd_staging_tag_t), (uint8_t *) (&tags[slot]));
+
+        p.block_buffer_address = buffer_address;
+        p.block_offset = 0;
+        dd_set_block_ready(true);
+        *hit = true;
+        break;
+    }
+
+    return true;
 }
 
 static bool dd_block_read_request (void) {
     uint16_t index = dd_track_head_block();
-    uint32_t buffer_address = DD_BLOCK_BUFFER_ADDRESS;
+    uint32_t buffer_address = p.block_buffer_address;
+    trace_event(TRACE_EVENT_DD_BLOCK_REQUEST, index);
     if (p.sd_mode) {
+        p.previous_block_index = p.block_index;
+        p.block_index = index;
+        if (dd_prefetch_take(index)) {
+            dd_set_block_ready(true);
+            return true;
+        }
         sd_error_t error = sd_get_lock(SD_LOCK_N64);
         if (error == SD_OK) {
-            uint32_t sector_table[DD_SD_SECTOR_TABLE_SIZE];
-            uint32_t sectors = dd_fill_sd_sector_table(index, sector_table, false);
             led_activity_on();
-            error = sd_optimize_sectors(buffer_address, sector_table, sectors, sd_read_sectors);
+            error = dd_sd_block_process(buffer_address, index, &p.block_offset, false);
             led_activity_off();
         }
         dd_set_block_ready(error == SD_OK);
     } else {
+        if (p.usb_staging && p.transfer_mode) {
+            bool hit;
+            if (!dd_usb_staging_take(index, &hit)) {
+                return false;
+            }
+            if (hit) {
+                return true;
+            }
+        }
+        buffer_address = DD_BLOCK_BUFFER_ADDRESS;
+        p.block_buffer_address = buffer_address;
         usb_tx_info_t packet_info;
         usb_create_packet(&packet_info, PACKET_CMD_DD_REQUEST);
         packet_info.data_length = 12;
@@ -159,14 +444,14 @@ static bool dd_block_read_request (void) {
 
 static bool dd_block_write_request (void) {
     uint32_t index = dd_track_head_block();
-    uint32_t buffer_address = DD_BLOCK_BUFFER_ADDRESS;
+    uint32_t buffer_address = p.block_buffer_address;
+    trace_event(TRACE_EVENT_DD_BLOCK_REQUEST, (index | (1 << 16)));
     if (p.sd_mode) {
+        dd_prefetch_invalidate();
         sd_error_t error = sd_get_lock(SD_LOCK_N64);
         if (error == SD_OK) {
-            uint32_t sector_table[DD_SD_SECTOR_TABLE_SIZE];
-            uint32_t sectors = dd_fill_sd_sector_table(index, sector_table, true);
             led_activity_on();
-            error = sd_optimize_sectors(buffer_address, sector_table, sectors, sd_write_sectors);
+            error = dd_sd_block_process(buffer_address, index, &p.block_offset, true);
             led_activity_off();
         }
         dd_set_block_ready(error == SD_OK);
@@ -186,10 +471,21 @@ static bool dd_block_write_request (void) {
     return true;
 }
 
+static bool dd_block_stream_start (void) {
+    // FPGA moves sectors between block and sector buffers on its own, block start must be 16-bit aligned
+    if (!p.block_valid || (p.block_offset % 2)) {
+        return false;
+    }
+    fpga_reg_set(REG_DD_BLOCK_ADDRESS, p.block_buffer_address + p.block_offset);
+    p.block_streaming = true;
+    return true;
+}
+
 
 void dd_set_block_ready (bool valid) {
     p.block_ready = true;
     p.block_valid = valid;
+    trace_event(TRACE_EVENT_DD_BLOCK_READY, valid);
 }
 
 dd_drive_type_t dd_get_drive_type (void) {
@@ -253,12 +549,25 @@ bool dd_get_sd_mode (void) {
 
 void dd_set_sd_mode (bool value) {
     p.sd_mode = value;
+    p.block_buffer_address = DD_BLOCK_BUFFER_ADDRESS;
+    dd_prefetch_invalidate();
+    dd_sd_track_cache_invalidate();
+}
+
+bool dd_get_usb_staging (void) {
+    return p.usb_staging;
+}
+
+void dd_set_usb_staging (bool value) {
+    p.usb_staging = value;
 }
 
 void dd_set_disk_mapping (uint32_t address, uint32_t length) {
     sd_disk_info_t info;
     length /= sizeof(info);
     p.sd_current_disk = 0;
+    dd_prefetch_invalidate();
+    dd_sd_track_cache_invalidate();
     for (int i = 0; i < DD_SD_MAX_DISKS; i++) {
         if (i < length) {
             fpga_mem_read(address, sizeof(info), (uint8_t *) (&info));
@@ -282,6 +591,7 @@ void dd_handle_button (void) {
             uint8_t sd_next_disk = ((p.sd_current_disk + i + 1) % DD_SD_MAX_DISKS);
             if (p.sd_disk_info[sd_next_disk].thb_table_address != 0xFFFFFFFF) {
                 p.sd_current_disk = sd_next_disk;
+                dd_prefetch_invalidate();
                 break;
             }
         }
@@ -297,9 +607,15 @@ void dd_init (void) {
     p.cmd_response_delayed = false;
     p.disk_spinning = false;
     p.bm_running = false;
+    p.block_streaming = false;
     p.drive_type = DD_DRIVE_TYPE_RETAIL;
     p.sd_mode = false;
+    p.usb_staging = false;
     p.sd_current_disk = 0;
+    p.block_buffer_address = DD_BLOCK_BUFFER_ADDRESS;
+    p.block_index = 0xFFFF;
+    p.previous_block_index = 0xFFFF;
+    p.prefetch_pending = false;
     dd_set_disk_mapping(0, 0);
 }
 
@@ -313,7 +629,10 @@ void dd_process (void) {
         p.cmd_response_delayed = false;
         p.disk_spinning = false;
         p.bm_running = false;
+        p.block_streaming = false;
         p.head_track = 0;
+        p.prefetch_pending = false;
+        dd_prefetch_invalidate();
         scr &= ~(DD_SCR_DISK_CHANGED);
     }
 
@@ -336,6 +655,9 @@ void dd_process (void) {
             }
             fpga_reg_set(REG_DD_HEAD_TRACK, p.head_track & ~(DD_HEAD_TRACK_INDEX_LOCK));
             p.head_track = data & DD_HEAD_TRACK_MASK;
+            if ((cmd == DD_CMD_SEEK_WRITE) || ((p.prefetch.index >> 1) != (dd_track_head_block() >> 1))) {
+                dd_prefetch_invalidate();
+            }
         } else {
             switch (cmd) {
                 case DD_CMD_CLEAR_DISK_CHANGE:
@@ -405,6 +727,7 @@ void dd_process (void) {
         scr |= DD_SCR_BM_STOP_CLEAR;
         scr &= ~(DD_SCR_BM_MICRO_ERROR | DD_SCR_BM_TRANSFER_C2 | DD_SCR_BM_TRANSFER_DATA);
         p.bm_running = false;
+        p.block_streaming = false;
     } else if (scr & DD_SCR_BM_START) {
         scr |= DD_SCR_BM_CLEAR | DD_SCR_BM_ACK_CLEAR | DD_SCR_BM_START_CLEAR;
         scr &= ~(DD_SCR_BM_MICRO_ERROR | DD_SCR_BM_TRANSFER_C2 | DD_SCR_BM_TRANSFER_DATA);
@@ -417,6 +740,13 @@ void dd_process (void) {
     } else if (p.bm_running) {
         if (scr & DD_SCR_BM_PENDING) {
             scr |= DD_SCR_BM_CLEAR;
+            if (p.block_streaming) {
+                p.block_streaming = false;
+                p.current_sector = (p.sector_info.sectors_in_block - 4);
+                if (!p.transfer_mode) {
+                    p.state = STATE_BLOCK_WRITE;
+                }
+            }
             if (p.transfer_mode) {
                 if (p.current_sector < (p.sector_info.sectors_in_block - 4)) {
                     p.state = STATE_SECTOR_READ;
@@ -458,6 +788,7 @@ void dd_process (void) {
 
             case STATE_START:
                 p.current_sector = 0;
+                p.block_streaming = false;
                 if (dd_block_read_request()) {
                     p.state = STATE_BLOCK_READ_WAIT;
                 }
@@ -465,7 +796,11 @@ void dd_process (void) {
 
             case STATE_BLOCK_READ_WAIT:
                 if (p.block_ready) {
-                    if (p.transfer_mode) {
+                    if (dd_block_stream_start()) {
+                        p.state = STATE_IDLE;
+                        p.prefetch_pending = (p.sd_mode && p.transfer_mode);
+                        scr |= DD_SCR_BM_TRANSFER_DATA | DD_SCR_BM_BLOCK_START;
+                    } else if (p.transfer_mode) {
                         if (p.block_valid) {
                             p.state = STATE_SECTOR_READ;
                             scr |= DD_SCR_BM_TRANSFER_DATA;
@@ -486,7 +821,7 @@ void dd_process (void) {
 
             case STATE_SECTOR_READ:
                 fpga_mem_copy(
-                    DD_BLOCK_BUFFER_ADDRESS + p.block_offset + (p.current_sector * (p.sector_info.sector_size + 1)),
+                    p.block_buffer_address + p.block_offset + (p.current_sector * (p.sector_info.sector_size + 1)),
                     DD_SECTOR_BUFFER_ADDRESS,
                     p.sector_info.sector_size + 1
                 );
@@ -498,7 +833,7 @@ void dd_process (void) {
             case STATE_SECTOR_WRITE:
                 fpga_mem_copy(
                     DD_SECTOR_BUFFER_ADDRESS,
-                    DD_BLOCK_BUFFER_ADDRESS + p.block_offset + (p.current_sector * (p.sector_info.sector_size + 1)),
+                    p.block_buffer_address + p.block_offset + (p.current_sector * (p.sector_info.sector_size + 1)),
                     p.sector_info.sector_size + 1
                 );
                 p.current_sector += 1;
@@ -544,4 +879,10 @@ void dd_process (void) {
     if (scr != starting_scr) {
         fpga_reg_set(REG_DD_SCR, scr);
     }
+
+    // Load next block while FPGA streams the current one to the N64
+    if (p.prefetch_pending) {
+        p.prefetch_pending = false;
+        dd_block_prefetch();
+    }
 }
@@ -25,6 +25,8 @@ dd_disk_state_t dd_get_disk_state (void);
 bool dd_set_disk_state (dd_disk_state_t state);
 bool dd_get_sd_mode (void);
 void dd_set_sd_mode (bool value);
+bool dd_get_usb_staging (void);
+void dd_set_usb_staging (bool value);
 void dd_set_disk_mapping (uint32_t address, uint32_t length);
 void dd_handle_button (void);
 
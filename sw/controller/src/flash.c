@@ -5,6 +5,36 @@
 #define FLASH_ADDRESS       (0x04000000UL)
 #define FLASH_SIZE          (16 * 1024 * 1024)
 #define ERASE_BLOCK_SIZE    (64 * 1024)
+#define ERASE_BLOCKS        (FLASH_SIZE / ERASE_BLOCK_SIZE)
+
+
+struct process {
+    uint32_t erase_pending[ERASE_BLOCKS / 32];
+    uint32_t erase_count;
+};
+
+
+static struct process p;
+
+
+static void flash_erase_issue (void) {
+    for (int i = 0; i < ERASE_BLOCKS; i++) {
+        uint32_t mask = (1UL << (i % 32));
+        if (p.erase_pending[i / 32] & mask) {
+            p.erase_pending[i / 32] &= ~(mask);
+            p.erase_count -= 1;
+            fpga_reg_set(REG_FLASH_SCR, (i * ERASE_BLOCK_SIZE));
+            return;
+        }
+    }
+}
+
+static void flash_erase_flush (void) {
+    while (p.erase_count > 0) {
+        while (fpga_reg_get(REG_FLASH_SCR) & FLASH_SCR_BUSY);
+        flash_erase_issue();
+    }
+}
 
 
 bool flash_program (uint32_t src, uint32_t dst, uint32_t length) {
@@ -17,6 +47,7 @@ bool flash_program (uint32_t src, uint32_t dst, uint32_t length) {
     if ((dst <= src) && ((dst + length) > src)) {
         return true;
     }
+    flash_erase_flush();
     while (length > 0) {
         uint32_t block = (length > FPGA_MAX_MEM_TRANSFER) ? FPGA_MAX_MEM_TRANSFER : length;
         fpga_mem_copy(src, dst, block);
@@ -27,7 +58,12 @@ bool flash_program (uint32_t src, uint32_t dst, uint32_t length) {
     return false;
 }
 
+uint32_t flash_erase_pending (void) {
+    return p.erase_count;
+}
+
 void flash_wait_busy (void) {
+    flash_erase_flush();
     uint8_t dummy[2];
     fpga_mem_read(FLASH_ADDRESS, 2, dummy);
 }
@@ -39,6 +75,7 @@ bool flash_erase_block (uint32_t address) {
     if ((address < FLASH_ADDRESS) || (address >= (FLASH_ADDRESS + FLASH_SIZE))) {
         return true;
     }
+    flash_erase_flush();
     address &= (FLASH_SIZE - 1);
     for (int i = 0; i < (FLASH_ERASE_BLOCK_SIZE / ERASE_BLOCK_SIZE); i++) {
         fpga_reg_set(REG_FLASH_SCR, address);
@@ -48,3 +85,37 @@ bool flash_erase_block (uint32_t address) {
     flash_wait_busy();
     return false;
 }
+
+bool flash_erase_start (uint32_t address, uint32_t length) {
+    if (((address % FLASH_ERASE_BLOCK_SIZE) != 0) || ((length % FLASH_ERASE_BLOCK_SIZE) != 0)) {
+        return true;
+    }
+    if ((address < FLASH_ADDRESS) || ((address + length) > (FLASH_ADDRESS + FLASH_SIZE))) {
+        return true;
+    }
+    address &= (FLASH_SIZE - 1);
+    for (uint32_t offset = 0; offset < length; offset += ERASE_BLOCK_SIZE) {
+        uint32_t block = ((address + offset) / ERASE_BLOCK_SIZE);
+        uint32_t mask = (1UL << (block % 32));
+        if (!(p.erase_pending[block / 32] & mask)) {
+            p.erase_pending[block / 32] |= mask;
+            p.erase_count += 1;
+        }
+    }
+    return false;
+}
+
+
+void flash_init (void) {
+    for (int i = 0; i < (ERASE_BLOCKS / 32); i++) {
+        p.erase_pending[i] = 0;
+    }
+    p.erase_count = 0;
+}
+
+
+void flash_process (void) {
+    if ((p.erase_count > 0) && !(fpga_reg_get(REG_FLASH_SCR) & FLASH_SCR_BUSY)) {
+        flash_erase_issue();
+    }
+}
@@ -10,8 +10,14 @@
 
 
 bool flash_program (uint32_t src, uint32_t dst, uint32_t length);
+uint32_t flash_erase_pending (void);
 void flash_wait_busy (void);
 bool flash_erase_block (uint32_t address);
+bool flash_erase_start (uint32_t address, uint32_t length);
+
+void flash_init (void);
+
+void flash_process (void);
 
 
 #endif
@@ -3,6 +3,7 @@
 #include "fpga.h"
 #include "hw.h"
 #include "timer.h"
+#include "trace.h"
 
 
 #define FLASHRAM_SIZE               (128 * 1024)
@@ -78,6 +79,8 @@ void flashram_process (void) {
     } else if (op == OP_WRITE_PAGE) {
         uint8_t page_buffer[FLASHRAM_PAGE_SIZE];
 
+        trace_event(TRACE_EVENT_FLASHRAM_START, op);
+
         uint32_t address = (FLASHRAM_ADDRESS + (page * FLASHRAM_PAGE_SIZE));
 
         fpga_mem_read(FLASHRAM_BUFFER_ADDRESS, FLASHRAM_PAGE_SIZE, page_buffer);
@@ -97,6 +100,8 @@ void flashram_process (void) {
             hw_delay_ms(FLASHRAM_WRITE_TIMING_MS);
         }
     } else if ((op == OP_ERASE_SECTOR) || (op == OP_ERASE_ALL)) {        
+        trace_event(TRACE_EVENT_FLASHRAM_START, op);
+
         if (full_emulation) {
             p.pending = true;
             timer_countdown_start(TIMER_ID_FLASHRAM, FLASHRAM_ERASE_TIMING_MS);
@@ -121,4 +126,6 @@ void flashram_process (void) {
     }
 
     fpga_reg_set(REG_FLASHRAM_SCR, FLASHRAM_SCR_DONE);
+
+    trace_event(TRACE_EVENT_FLASHRAM_END, op);
 }
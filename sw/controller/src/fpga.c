@@ -90,6 +90,32 @@ void fpga_mem_copy (uint32_t src, uint32_t dst, size_t length) {
     while (fpga_reg_get(REG_MEM_SCR) & MEM_SCR_BUSY);
 }
 
+uint32_t fpga_mem_test (uint32_t address, size_t length, fpga_mem_test_pattern_t pattern, uint32_t seed, bool verify, uint32_t *error) {
+    uint32_t scr = ((pattern << MEM_TEST_SCR_PATTERN_BIT) & MEM_TEST_SCR_PATTERN_MASK) | MEM_TEST_SCR_START;
+    if (verify) {
+        scr |= MEM_TEST_SCR_VERIFY;
+    }
+
+    fpga_reg_set(REG_MEM_ADDRESS, address);
+    fpga_reg_set(REG_MEM_TEST_LENGTH, length / 2);
+    fpga_reg_set(REG_MEM_TEST_SEED, seed);
+    fpga_reg_set(REG_MEM_TEST_SCR, scr);
+    while (fpga_reg_get(REG_MEM_TEST_SCR) & MEM_TEST_SCR_BUSY);
+
+    if (!verify) {
+        return 0;
+    }
+
+    error[0] = fpga_reg_get(REG_MEM_TEST_ERROR_ADDRESS);
+    error[1] = fpga_reg_get(REG_MEM_TEST_ERROR_DATA);
+
+    return fpga_reg_get(REG_MEM_TEST_ERRORS);
+}
+
+void fpga_mem_fill (uint32_t address, size_t length, uint32_t pattern) {
+    fpga_mem_test(address, length, MEM_TEST_PATTERN_CONSTANT, pattern, false, NULL);
+}
+
 uint8_t fpga_usb_status_get (void) {
     fpga_cmd_t cmd = CMD_USB_STATUS;
     uint8_t status;
@@ -2,6 +2,7 @@
 #define FPGA_H__
 
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -58,8 +59,24 @@ typedef enum {
     REG_CIC_0,
     REG_CIC_1,
     REG_AUX,
+    REG_MEM_TEST_SCR,
+    REG_MEM_TEST_LENGTH,
+    REG_MEM_TEST_SEED,
+    REG_MEM_TEST_ERRORS,
+    REG_MEM_TEST_ERROR_ADDRESS,
+    REG_MEM_TEST_ERROR_DATA,
+    REG_DD_BLOCK_ADDRESS,
+    REG_ISV_SCR,
+    REG_STREAM_SCR,
 } fpga_reg_t;
 
+typedef enum {
+    MEM_TEST_PATTERN_CONSTANT = 0,
+    MEM_TEST_PATTERN_OWN_ADDRESS = 1,
+    MEM_TEST_PATTERN_RANDOM = 2,
+    MEM_TEST_PATTERN_WALKING_ONES = 3,
+} fpga_mem_test_pattern_t;
+
 
 #define ALIGN(value, align)             (((value) + ((typeof(value))(align) - 1)) & ~((typeof(value))(align) - 1))
 #define SWAP32(x)                       (((x) & 0xFF) << 24 | ((x) & 0xFF00) << 8 | ((x) & 0xFF0000) >> 8 | ((x) & 0xFF000000) >> 24)
@@ -77,6 +94,12 @@ typedef enum {
 #define MEM_SCR_BUSY                    (1 << 3)
 #define MEM_SCR_LENGTH_BIT              (4)
 
+#define MEM_TEST_SCR_START              (1 << 0)
+#define MEM_TEST_SCR_VERIFY             (1 << 1)
+#define MEM_TEST_SCR_PATTERN_BIT        (2)
+#define MEM_TEST_SCR_PATTERN_MASK       (0x3 << MEM_TEST_SCR_PATTERN_BIT)
+#define MEM_TEST_SCR_BUSY               (1 << 4)
+
 #define USB_SCR_FIFO_FLUSH              (1 << 0)
 #define USB_SCR_RXNE                    (1 << 1)
 #define USB_SCR_TXE                     (1 << 2)
@@ -186,6 +209,8 @@ typedef enum {
 #define DD_SCR_BM_ACK                   (1 << 17)
 #define DD_SCR_BM_ACK_CLEAR             (1 << 18)
 #define DD_SCR_BM_CLEAR                 (1 << 19)
+#define DD_SCR_BM_BLOCK_ACTIVE          (1 << 20)
+#define DD_SCR_BM_BLOCK_START           (1 << 21)
 
 #define DD_TRACK_MASK                   (0x0FFF)
 #define DD_HEAD_MASK                    (0x1000)
@@ -199,6 +224,14 @@ typedef enum {
 #define CIC_INVALID_REGION_DETECTED     (1 << 27)
 #define CIC_INVALID_REGION_RESET        (1 << 28)
 
+#define ISV_SCR_ADDRESS_MASK            (0x3FFFFFF)
+#define ISV_SCR_PENDING                 (1 << 30)
+#define ISV_SCR_ENABLED                 (1 << 31)
+
+#define STREAM_SCR_ADDRESS_MASK         (0x3FFFFFF)
+#define STREAM_SCR_PENDING              (1 << 30)
+#define STREAM_SCR_ENABLED              (1 << 31)
+
 
 uint8_t fpga_id_get (void);
 uint32_t fpga_reg_get (fpga_reg_t reg);
@@ -206,6 +239,8 @@ void fpga_reg_set (fpga_reg_t reg, uint32_t value);
 void fpga_mem_read (uint32_t address, size_t length, uint8_t *buffer);
 void fpga_mem_write (uint32_t address, size_t length, uint8_t *buffer);
 void fpga_mem_copy (uint32_t src, uint32_t dst, size_t length);
+void fpga_mem_fill (uint32_t address, size_t length, uint32_t pattern);
+uint32_t fpga_mem_test (uint32_t address, size_t length, fpga_mem_test_pattern_t pattern, uint32_t seed, bool verify, uint32_t *error);
 uint8_t fpga_usb_status_get (void);
 uint8_t fpga_usb_pop (void);
 void fpga_usb_push (uint8_t data);
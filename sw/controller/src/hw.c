@@ -118,13 +118,37 @@ void hw_delay_ms (uint32_t delay_ms) {
 
 
 static void (*systick_callback) (void) = NULL;
+static uint32_t systick_period_us = 0;
+static volatile uint32_t systick_ticks = 0;
 
 void hw_systick_config (uint32_t period_ms, void (*callback) (void)) {
     SysTick_Config((CPU_FREQ / 1000) * period_ms);
+    systick_period_us = (period_ms * 1000);
     systick_callback = callback;
 }
 
+uint32_t hw_time_us (void) {
+    uint32_t ticks;
+    uint32_t value;
+    bool pending;
+    do {
+        ticks = systick_ticks;
+        value = SysTick->VAL;
+        // Counter reloaded but interrupt not serviced yet (called with interrupts disabled),
+        // re-read the value so it comes from the same period as the pending tick
+        pending = (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk);
+        if (pending) {
+            value = SysTick->VAL;
+        }
+    } while (ticks != systick_ticks);
+    if (pending) {
+        ticks += 1;
+    }
+    return ((ticks * systick_period_us) + ((SysTick->LOAD - value) / (CPU_FREQ / 1000 / 1000)));
+}
+
 void SysTick_Handler (void) {
+    systick_ticks += 1;
     if (systick_callback) {
         systick_callback();
     }
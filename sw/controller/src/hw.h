@@ -58,6 +58,7 @@ void hw_delay_us (uint32_t delay_us);
 void hw_delay_ms (uint32_t delay_ms);
 
 void hw_systick_config (uint32_t period_ms, void (*callback) (void));
+uint32_t hw_time_us (void);
 
 uint32_t hw_gpio_get (gpio_id_t id);
 void hw_gpio_set (gpio_id_t id);
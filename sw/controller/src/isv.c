@@ -8,6 +8,7 @@
 
 #define ISV_SETUP_TOKEN_ADDRESS     (0x00000100)
 #define ISV_SETUP_OFFSET_ADDRESS    (0x00000104)
+#define ISV_SETUP_SIZE_ADDRESS      (0x00000108)
 #define ISV_SETUP_READY_ADDRESS     (0x0000010C)
 
 #define ISV_TOKEN_OFFSET            (0x00000000)
@@ -15,13 +16,20 @@
 #define ISV_WRITE_POINTER_OFFSET    (0x00000014)
 #define ISV_BUFFER_OFFSET           (0x00000020)
 
-#define ISV_BUFFER_SIZE             ((64 * 1024) - ISV_BUFFER_OFFSET)
+#define ISV_MEMORY_END              (0x04000000)
+#define ISV_MAX_SIZE                (8 * 1024 * 1024)
+#define ISV_CHUNK_LENGTH            (64 * 1024)
+#define ISV_QUEUE_LENGTH            (2)
 
 
 struct process {
-    bool ready;
     uint32_t address;
-    uint32_t next_read_pointer;
+    uint32_t size;
+    bool check;
+    uint32_t queued_pointer;
+    uint8_t queue_head;
+    uint8_t queue_count;
+    uint32_t next_read_pointer[ISV_QUEUE_LENGTH];
 };
 
 
@@ -39,17 +47,35 @@ static uint32_t isv_get_value (uint32_t address) {
     return SWAP32(data);
 }
 
+static uint32_t isv_buffer_length (void) {
+    return (p.size - ISV_BUFFER_OFFSET);
+}
+
+static void isv_update_snoop (bool clear_pending) {
+    uint32_t scr = 0;
+    if (p.address != 0) {
+        scr = (ISV_SCR_ENABLED | ((p.address + ISV_WRITE_POINTER_OFFSET) & ISV_SCR_ADDRESS_MASK));
+    }
+    fpga_reg_set(REG_ISV_SCR, scr | (clear_pending ? ISV_SCR_PENDING : 0));
+}
+
 static void isv_update_read_pointer (void) {
-    p.ready = true;
-    isv_set_value(p.address + ISV_READ_POINTER_OFFSET, p.next_read_pointer);
+    isv_set_value(p.address + ISV_READ_POINTER_OFFSET, p.next_read_pointer[p.queue_head]);
+    p.queue_head = ((p.queue_head + 1) % ISV_QUEUE_LENGTH);
+    p.queue_count -= 1;
 }
 
 
 bool isv_set_address (uint32_t address) {
-    if ((address >= 0x04000000) || (address % 4)) {
+    if ((address >= ISV_MEMORY_END) || (address % 4)) {
+        return true;
+    }
+    if ((address != 0) && ((address + p.size) > ISV_MEMORY_END)) {
         return true;
     }
     p.address = address;
+    p.check = true;
+    isv_update_snoop(true);
     return false;
 }
 
@@ -57,52 +83,100 @@ uint32_t isv_get_address (void) {
     return p.address;
 }
 
+bool isv_set_buffer_size (uint32_t size) {
+    if ((size < ISV_DEFAULT_BUFFER_SIZE) || (size > ISV_MAX_SIZE) || (size % 4)) {
+        return true;
+    }
+    if ((p.address != 0) && ((p.address + size) > ISV_MEMORY_END)) {
+        return true;
+    }
+    p.size = size;
+    p.check = true;
+    return false;
+}
+
+uint32_t isv_get_buffer_size (void) {
+    return p.size;
+}
+
 
 void isv_init (void) {
     p.address = 0;
-    p.ready = true;
+    p.size = ISV_DEFAULT_BUFFER_SIZE;
+    p.check = false;
+    p.queue_head = 0;
+    p.queue_count = 0;
+    isv_update_snoop(true);
 }
 
 
 void isv_process (void) {
-    if ((p.address != 0) && p.ready) {
-        if (isv_get_value(ISV_SETUP_TOKEN_ADDRESS) == ISV_TOKEN) {
-            isv_set_value(ISV_SETUP_TOKEN_ADDRESS, 0);
-            isv_set_value(ISV_SETUP_OFFSET_ADDRESS, (p.address | 0x10000000));
-            isv_set_value(ISV_SETUP_READY_ADDRESS, ISV_TOKEN);
-            return;
-        }
+    if ((p.address == 0) || (p.queue_count >= ISV_QUEUE_LENGTH)) {
+        return;
+    }
 
-        if (isv_get_value(p.address + ISV_TOKEN_OFFSET) != ISV_TOKEN) {
+    // FPGA flags N64 writes to the write pointer and setup token, nothing to do until then
+    if (!p.check) {
+        if (!(fpga_reg_get(REG_ISV_SCR) & ISV_SCR_PENDING)) {
             return;
         }
+        isv_update_snoop(true);
+    }
+    p.check = false;
+
+    if (isv_get_value(ISV_SETUP_TOKEN_ADDRESS) == ISV_TOKEN) {
+        isv_set_value(ISV_SETUP_TOKEN_ADDRESS, 0);
+        isv_set_value(ISV_SETUP_OFFSET_ADDRESS, (p.address | 0x10000000));
+        isv_set_value(ISV_SETUP_SIZE_ADDRESS, p.size);
+        isv_set_value(ISV_SETUP_READY_ADDRESS, ISV_TOKEN);
+        p.check = true;
+        return;
+    }
 
-        uint32_t read_pointer = isv_get_value(p.address + ISV_READ_POINTER_OFFSET);
-        if (read_pointer >= ISV_BUFFER_SIZE) {
-            return;
-        }
+    if (isv_get_value(p.address + ISV_TOKEN_OFFSET) != ISV_TOKEN) {
+        return;
+    }
 
-        uint32_t write_pointer = isv_get_value(p.address + ISV_WRITE_POINTER_OFFSET);
-        if (write_pointer >= ISV_BUFFER_SIZE) {
-            return;
-        }
+    uint32_t buffer_length = isv_buffer_length();
 
-        if (read_pointer == write_pointer) {
-            return;
-        }
+    uint32_t read_pointer = p.queued_pointer;
+    if (p.queue_count == 0) {
+        read_pointer = isv_get_value(p.address + ISV_READ_POINTER_OFFSET);
+    }
+    if (read_pointer >= buffer_length) {
+        return;
+    }
 
-        bool wrap = write_pointer < read_pointer;
-        uint32_t length = (wrap ? ISV_BUFFER_SIZE : write_pointer) - read_pointer;
-        uint32_t offset = p.address + ISV_BUFFER_OFFSET + read_pointer;
-
-        usb_tx_info_t packet_info;
-        usb_create_packet(&packet_info, PACKET_CMD_ISV_OUTPUT);
-        packet_info.dma_length = length;
-        packet_info.dma_address = offset;
-        packet_info.done_callback = isv_update_read_pointer;
-        if (usb_enqueue_packet(&packet_info)) {
-            p.ready = false;
-            p.next_read_pointer = wrap ? 0 : write_pointer;
-        }
+    uint32_t write_pointer = isv_get_value(p.address + ISV_WRITE_POINTER_OFFSET);
+    if (write_pointer >= buffer_length) {
+        return;
+    }
+
+    if (read_pointer == write_pointer) {
+        return;
+    }
+
+    bool wrap = write_pointer < read_pointer;
+    uint32_t length = (wrap ? buffer_length : write_pointer) - read_pointer;
+    uint32_t offset = p.address + ISV_BUFFER_OFFSET + read_pointer;
+
+    if (length > ISV_CHUNK_LENGTH) {
+        length = ISV_CHUNK_LENGTH;
+    }
+
+    uint32_t next_read_pointer = ((read_pointer + length) % buffer_length);
+
+    usb_tx_info_t packet_info;
+    usb_create_packet(&packet_info, PACKET_CMD_ISV_OUTPUT);
+    packet_info.dma_length = length;
+    packet_info.dma_address = offset;
+    packet_info.done_callback = isv_update_read_pointer;
+    if (usb_enqueue_packet(&packet_info)) {
+        p.next_read_pointer[(p.queue_head + p.queue_count) % ISV_QUEUE_LENGTH] = next_read_pointer;
+        p.queue_count += 1;
+        p.queued_pointer = next_read_pointer;
+        p.check = (next_read_pointer != write_pointer);
+    } else {
+        p.check = true;
     }
 }
@@ -6,8 +6,13 @@
 #include <stdint.h>
 
 
+#define ISV_DEFAULT_BUFFER_SIZE     (64 * 1024)
+
+
 bool isv_set_address (uint32_t address);
 uint32_t isv_get_address (void);
+bool isv_set_buffer_size (uint32_t size);
+uint32_t isv_get_buffer_size (void);
 
 void isv_init (void);
 
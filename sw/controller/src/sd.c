@@ -2,6 +2,7 @@
 #include "hw.h"
 #include "sd.h"
 #include "timer.h"
+#include "trace.h"
 
 
 #define SD_INIT_BUFFER_ADDRESS          (0x05002A00UL)
@@ -543,23 +544,31 @@ sd_error_t sd_write_sectors (uint32_t address, uint32_t sector, uint32_t count)
         sector *= SD_SECTOR_SIZE;
     }
 
+    trace_event(TRACE_EVENT_SD_WRITE_START, count);
+
+    sd_error_t error = SD_OK;
+
     while (count > 0) {
         uint32_t blocks = ((count > DAT_BLOCK_MAX_COUNT) ? DAT_BLOCK_MAX_COUNT : count);
         if (sd_cmd(25, sector, RSP_R1, NULL)) {
-            return SD_ERROR_CMD25_IO;
+            error = SD_ERROR_CMD25_IO;
+            break;
         }
         sd_start_write(address, blocks);
         dat_status_t status = sd_sync(TIMEOUT_DATA_MS);
         sd_cmd(12, 0, RSP_R1b, NULL);
         if (status != DAT_OK) {
-            return (status == DAT_ERROR_IO) ? SD_ERROR_CMD25_CRC : SD_ERROR_CMD25_TIMEOUT;
+            error = (status == DAT_ERROR_IO) ? SD_ERROR_CMD25_CRC : SD_ERROR_CMD25_TIMEOUT;
+            break;
         }
         address += (blocks * SD_SECTOR_SIZE);
         sector += (blocks * (p.card_type_block ? 1 : SD_SECTOR_SIZE));
         count -= blocks;
     }
 
-    return false;
+    trace_event(TRACE_EVENT_SD_WRITE_END, error);
+
+    return error;
 }
 
 sd_error_t sd_read_sectors (uint32_t address, uint32_t sector, uint32_t count) {
@@ -579,24 +588,32 @@ sd_error_t sd_read_sectors (uint32_t address, uint32_t sector, uint32_t count) {
         sector *= SD_SECTOR_SIZE;
     }
 
+    trace_event(TRACE_EVENT_SD_READ_START, count);
+
+    sd_error_t error = SD_OK;
+
     while (count > 0) {
         uint32_t blocks = ((count > DAT_BLOCK_MAX_COUNT) ? DAT_BLOCK_MAX_COUNT : count);
         sd_start_read(address, blocks);
         if (sd_cmd(18, sector, RSP_R1, NULL)) {
             sd_abort();
-            return SD_ERROR_CMD18_IO;
+            error = SD_ERROR_CMD18_IO;
+            break;
         }
         dat_status_t status = sd_sync(TIMEOUT_DATA_MS);
         sd_cmd(12, 0, RSP_R1b, NULL);
         if (status != DAT_OK) {
-            return (status == DAT_ERROR_IO) ? SD_ERROR_CMD18_CRC : SD_ERROR_CMD18_TIMEOUT;
+            error = (status == DAT_ERROR_IO) ? SD_ERROR_CMD18_CRC : SD_ERROR_CMD18_TIMEOUT;
+            break;
         }
         address += (blocks * SD_SECTOR_SIZE);
         sector += (blocks * (p.card_type_block ? 1 : SD_SECTOR_SIZE));
         count -= blocks;
     }
 
-    return SD_OK;
+    trace_event(TRACE_EVENT_SD_READ_END, error);
+
+    return error;
 }
 
 
@@ -0,0 +1,151 @@
+#include <stdint.h>
+#include "fpga.h"
+#include "hw.h"
+#include "stream.h"
+#include "usb.h"
+
+
+#define STREAM_WRITE_POINTER_OFFSET     (0x00000000)
+#define STREAM_READ_POINTER_OFFSET      (0x00000004)
+#define STREAM_BUFFER_OFFSET            (STREAM_HEADER_LENGTH)
+
+#define STREAM_MEMORY_END               (0x04000000)
+#define STREAM_CHUNK_LENGTH             (64 * 1024)
+#define STREAM_QUEUE_LENGTH             (2)
+
+
+struct process {
+    bool enabled;
+    uint32_t address;
+    uint32_t length;
+    uint8_t datatype;
+    bool check;
+    uint32_t read_pointer;
+    uint8_t queue_head;
+    uint8_t queue_count;
+    uint32_t next_read_pointer[STREAM_QUEUE_LENGTH];
+};
+
+
+static struct process p;
+
+
+static void stream_set_value (uint32_t address, uint32_t data) {
+    data = SWAP32(data);
+    fpga_mem_write(address, 4, (uint8_t *) (&data));
+}
+
+static uint32_t stream_get_value (uint32_t address) {
+    uint32_t data;
+    fpga_mem_read(address, 4, (uint8_t *) (&data));
+    return SWAP32(data);
+}
+
+static void stream_update_snoop (bool clear_pending) {
+    uint32_t scr = 0;
+    if (p.enabled) {
+        scr = (STREAM_SCR_ENABLED | ((p.address + STREAM_WRITE_POINTER_OFFSET) & STREAM_SCR_ADDRESS_MASK));
+    }
+    fpga_reg_set(REG_STREAM_SCR, scr | (clear_pending ? STREAM_SCR_PENDING : 0));
+}
+
+static void stream_update_read_pointer (void) {
+    if (p.enabled) {
+        stream_set_value(p.address + STREAM_READ_POINTER_OFFSET, p.next_read_pointer[p.queue_head]);
+    }
+    p.queue_head = ((p.queue_head + 1) % STREAM_QUEUE_LENGTH);
+    p.queue_count -= 1;
+}
+
+
+bool stream_set_buffer (uint32_t address, uint32_t length, uint8_t datatype) {
+    if ((address >= STREAM_MEMORY_END) || (address % 4)) {
+        return true;
+    }
+    if ((length == 0) || (length % 4) || ((address + STREAM_HEADER_LENGTH + length) > STREAM_MEMORY_END)) {
+        return true;
+    }
+    p.enabled = true;
+    p.address = address;
+    p.length = length;
+    p.datatype = datatype;
+    p.check = false;
+    p.read_pointer = 0;
+    stream_set_value(p.address + STREAM_WRITE_POINTER_OFFSET, 0);
+    stream_set_value(p.address + STREAM_READ_POINTER_OFFSET, 0);
+    stream_update_snoop(true);
+    return false;
+}
+
+void stream_disable (void) {
+    p.enabled = false;
+    stream_update_snoop(true);
+}
+
+bool stream_busy (void) {
+    return (p.queue_count > 0);
+}
+
+
+void stream_init (void) {
+    p.enabled = false;
+    p.check = false;
+    p.queue_head = 0;
+    p.queue_count = 0;
+    stream_update_snoop(true);
+}
+
+
+void stream_process (void) {
+    if (!p.enabled) {
+        return;
+    }
+
+    // Ring buffer is owned by the running N64 program, stop draining it on reset
+    if (!hw_gpio_get(GPIO_ID_N64_RESET)) {
+        return stream_disable();
+    }
+
+    if (p.queue_count >= STREAM_QUEUE_LENGTH) {
+        return;
+    }
+
+    // FPGA flags N64 writes to the write pointer, nothing to do until then
+    if (!p.check) {
+        if (!(fpga_reg_get(REG_STREAM_SCR) & STREAM_SCR_PENDING)) {
+            return;
+        }
+        stream_update_snoop(true);
+    }
+    p.check = false;
+
+    uint32_t write_pointer = stream_get_value(p.address + STREAM_WRITE_POINTER_OFFSET);
+    if ((write_pointer >= p.length) || (write_pointer == p.read_pointer)) {
+        return;
+    }
+
+    bool wrap = write_pointer < p.read_pointer;
+    uint32_t length = (wrap ? p.length : write_pointer) - p.read_pointer;
+
+    if (length > STREAM_CHUNK_LENGTH) {
+        length = STREAM_CHUNK_LENGTH;
+    }
+
+    uint32_t next_read_pointer = ((p.read_pointer + length) % p.length);
+
+    usb_tx_info_t packet_info;
+    usb_create_packet(&packet_info, PACKET_CMD_DEBUG_OUTPUT);
+    packet_info.data_length = 4;
+    packet_info.data[0] = ((p.datatype << 24) | length);
+    packet_info.dma_length = length;
+    packet_info.dma_address = (p.address + STREAM_BUFFER_OFFSET + p.read_pointer);
+    packet_info.done_callback = stream_update_read_pointer;
+    if (usb_enqueue_packet(&packet_info)) {
+        p.next_read_pointer[(p.queue_head + p.queue_count) % STREAM_QUEUE_LENGTH] = next_read_pointer;
+        p.queue_count += 1;
+        p.read_pointer = next_read_pointer;
+        p.check = (next_read_pointer != write_pointer);
+    } else {
+        p.check = true;
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef STREAM_H__
+#define STREAM_H__
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define STREAM_HEADER_LENGTH    (0x10)
+
+
+bool stream_set_buffer (uint32_t address, uint32_t length, uint8_t datatype);
+void stream_disable (void);
+bool stream_busy (void);
+
+void stream_init (void);
+
+void stream_process (void);
+
+
+#endif
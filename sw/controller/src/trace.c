@@ -0,0 +1,95 @@
+#include "fpga.h"
+#include "hw.h"
+#include "trace.h"
+
+
+#define TRACE_BUFFER_LENGTH     (32)
+#define TRACE_ARG_MASK          (0xFFFFFF)
+#define TRACE_EVENT_BIT         (24)
+
+
+typedef struct {
+    uint32_t timestamp;
+    uint32_t data;
+} trace_entry_t;
+
+struct process {
+    bool enabled;
+    uint8_t head;
+    uint8_t count;
+    uint32_t dropped;
+    trace_entry_t entries[TRACE_BUFFER_LENGTH];
+};
+
+
+static struct process p;
+
+
+void trace_event (trace_event_t event, uint32_t arg) {
+    if (!p.enabled) {
+        return;
+    }
+    if (p.count == TRACE_BUFFER_LENGTH) {
+        p.head = ((p.head + 1) % TRACE_BUFFER_LENGTH);
+        p.count -= 1;
+        p.dropped += 1;
+    }
+    trace_entry_t *entry = &p.entries[(p.head + p.count) % TRACE_BUFFER_LENGTH];
+    entry->timestamp = hw_time_us();
+    entry->data = ((event << TRACE_EVENT_BIT) | (arg & TRACE_ARG_MASK));
+    p.count += 1;
+}
+
+void trace_set_enabled (bool enabled) {
+    if (enabled && !p.enabled) {
+        p.head = 0;
+        p.count = 0;
+        p.dropped = 0;
+    }
+    p.enabled = enabled;
+}
+
+uint32_t trace_read (uint32_t address, uint32_t length, uint32_t *dropped) {
+    uint32_t count = (length / TRACE_ENTRY_LENGTH);
+
+    if (count > p.count) {
+        count = p.count;
+    }
+
+    length = (count * TRACE_ENTRY_LENGTH);
+
+    while (count > 0) {
+        uint32_t part = (TRACE_BUFFER_LENGTH - p.head);
+        if (part > count) {
+            part = count;
+        }
+
+        trace_entry_t *entries = &p.entries[p.head];
+
+        // Entries are consumed, byte swap them in place and send them straight from the ring
+        for (uint32_t i = 0; i < part; i++) {
+            entries[i].timestamp = SWAP32(entries[i].timestamp);
+            entries[i].data = SWAP32(entries[i].data);
+        }
+
+        fpga_mem_write(address, (part * TRACE_ENTRY_LENGTH), (uint8_t *) (entries));
+
+        address += (part * TRACE_ENTRY_LENGTH);
+        p.head = ((p.head + part) % TRACE_BUFFER_LENGTH);
+        p.count -= part;
+        count -= part;
+    }
+
+    *dropped = p.dropped;
+    p.dropped = 0;
+
+    return length;
+}
+
+
+void trace_init (void) {
+    p.enabled = false;
+    p.head = 0;
+    p.count = 0;
+    p.dropped = 0;
+}
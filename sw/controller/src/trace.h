@@ -0,0 +1,40 @@
+#ifndef TRACE_H__
+#define TRACE_H__
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define TRACE_ENTRY_LENGTH      (8)
+#define TRACE_READ_MAX_LENGTH   (256)
+
+
+typedef enum {
+    TRACE_EVENT_USB_COMMAND = 1,
+    TRACE_EVENT_USB_PACKET_ENQUEUE = 2,
+    TRACE_EVENT_USB_TX_START = 3,
+    TRACE_EVENT_USB_TX_END = 4,
+    TRACE_EVENT_CFG_COMMAND_START = 5,
+    TRACE_EVENT_CFG_COMMAND_END = 6,
+    TRACE_EVENT_SD_READ_START = 7,
+    TRACE_EVENT_SD_READ_END = 8,
+    TRACE_EVENT_SD_WRITE_START = 9,
+    TRACE_EVENT_SD_WRITE_END = 10,
+    TRACE_EVENT_DD_BLOCK_REQUEST = 11,
+    TRACE_EVENT_DD_BLOCK_READY = 12,
+    TRACE_EVENT_WRITEBACK_START = 13,
+    TRACE_EVENT_WRITEBACK_END = 14,
+    TRACE_EVENT_FLASHRAM_START = 15,
+    TRACE_EVENT_FLASHRAM_END = 16,
+} trace_event_t;
+
+
+void trace_event (trace_event_t event, uint32_t arg);
+void trace_set_enabled (bool enabled);
+uint32_t trace_read (uint32_t address, uint32_t length, uint32_t *dropped);
+
+void trace_init (void);
+
+
+#endif
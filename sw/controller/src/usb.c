@@ -8,6 +8,7 @@
 #include "rtc.h"
 #include "sd.h"
 #include "timer.h"
+#include "trace.h"
 #include "update.h"
 #include "usb.h"
 #include "version.h"
@@ -18,18 +19,39 @@
 #define BOOTLOADER_LENGTH       (1920 * 1024)
 
 #define MEMORY_LENGTH           (0x05002C80UL)
+#define SDRAM_LENGTH            (64 * 1024 * 1024)
 
 #define RX_FLUSH_ADDRESS        (0x07F00000UL)
 #define RX_FLUSH_LENGTH         (1 * 1024 * 1024)
 
 #define DEBUG_WRITE_TIMEOUT_MS  (1000)
 
+#define CHECKSUM_CHUNK_LENGTH   (256)
+#define CHECKSUM_STEP_LENGTH    (4 * 1024)
+#define CHECKSUM_BUFFER_ADDRESS (0x05002900UL)
+#define CHECKSUM_BUFFER_LENGTH  (256)
+
+#define FILL_STEP_LENGTH        (64 * 1024)
+
+#define TRACE_BUFFER_ADDRESS    (0x05002B00UL)
+
 #define DIAGNOSTIC_DATA_MARKER  (1 << 31)
 #define DIAGNOSTIC_DATA_VERSION (1)
+#define DIAGNOSTIC_TX_SENT_VERSION      (3)
+#define DIAGNOSTIC_TX_DROPPED_VERSION   (4)
+
+#define TX_QUEUE_HIGH_LENGTH    (4)
+#define TX_QUEUE_NORMAL_LENGTH  (2)
+#define TX_QUEUE_LOW_LENGTH     (2)
+#define TX_FAIRNESS_LIMIT       (4)
+
+#define RESPONSE_QUEUE_LENGTH   (4)
+#define PROTOCOL_VERSION_TAGGED (3)
 
 
 enum rx_state {
     RX_STATE_IDLE,
+    RX_STATE_TAG,
     RX_STATE_ARGS,
     RX_STATE_DATA,
     RX_STATE_FLUSH,
@@ -43,6 +65,31 @@ enum tx_state {
     TX_STATE_FLUSH,
 };
 
+enum tx_class {
+    TX_CLASS_HIGH,
+    TX_CLASS_NORMAL,
+    TX_CLASS_LOW,
+    __TX_CLASS_COUNT
+};
+
+
+typedef struct {
+    usb_tx_info_t *entries;
+    uint8_t length;
+    uint8_t head;
+    uint8_t count;
+    uint8_t skipped;
+    uint32_t sent;
+    uint32_t dropped;
+} usb_tx_queue_t;
+
+typedef struct {
+    usb_tx_info_t info;
+    bool error;
+    bool tagged;
+    uint32_t tag;
+} usb_response_t;
+
 
 struct process {
     bool last_reset_state;
@@ -50,14 +97,27 @@ struct process {
     enum rx_state rx_state;
     uint8_t rx_counter;
     uint8_t rx_cmd;
+    bool rx_tagged;
+    uint32_t rx_tag;
     uint32_t rx_args[2];
+    uint32_t rx_data[2];
     bool rx_dma_running;
 
+    bool checksum_running;
+    uint32_t checksum_address;
+    uint32_t checksum_length;
+    uint32_t checksum_value;
+    uint32_t checksum_chunk_length;
+    uint32_t checksum_buffer_length;
+
     enum tx_state tx_state;
     uint8_t tx_counter;
     usb_tx_info_t tx_info;
     uint32_t tx_token;
+    bool tx_tagged;
+    uint32_t tx_tag;
     bool tx_dma_running;
+    bool tx_response_dma;
 
     bool flush_response;
     bool flush_packet;
@@ -66,8 +126,11 @@ struct process {
     bool response_error;
     usb_tx_info_t response_info;
 
-    bool packet_pending;
-    usb_tx_info_t packet_info;
+    usb_response_t response_queue[RESPONSE_QUEUE_LENGTH];
+    uint8_t response_head;
+    uint8_t response_count;
+
+    usb_tx_queue_t tx_queue[__TX_CLASS_COUNT];
 
     bool read_ready;
     uint32_t read_length;
@@ -77,13 +140,80 @@ struct process {
 
 static struct process p;
 
+static usb_tx_info_t tx_queue_high[TX_QUEUE_HIGH_LENGTH];
+static usb_tx_info_t tx_queue_normal[TX_QUEUE_NORMAL_LENGTH];
+static usb_tx_info_t tx_queue_low[TX_QUEUE_LOW_LENGTH];
+
 
 static const char CMD_TOKEN[3] = { 'C', 'M', 'D' };
+static const char CMT_TOKEN[3] = { 'C', 'M', 'T' };
 static const uint32_t CMP_TOKEN = (0x434D5000UL);
 static const uint32_t ERR_TOKEN = (0x45525200UL);
+static const uint32_t CPT_TOKEN = (0x43505400UL);
+static const uint32_t ERT_TOKEN = (0x45525400UL);
 static const uint32_t PKT_TOKEN = (0x504B5400UL);
 
 
+static enum tx_class usb_tx_get_class (uint8_t cmd) {
+    switch (cmd) {
+        case PACKET_CMD_DD_REQUEST:
+        case PACKET_CMD_UPDATE_STATUS:
+        case PACKET_CMD_BUTTON_TRIGGER:
+        case PACKET_CMD_AUX_DATA:
+        case PACKET_CMD_DATA_FLUSHED:
+            return TX_CLASS_HIGH;
+        case PACKET_CMD_SAVE_WRITEBACK:
+            return TX_CLASS_NORMAL;
+        default:
+            return TX_CLASS_LOW;
+    }
+}
+
+static bool usb_tx_dequeue (usb_tx_info_t *info) {
+    int selected = -1;
+
+    // Higher class wins, unless lower one was passed over too many times in a row
+    for (int i = 0; i < __TX_CLASS_COUNT; i++) {
+        usb_tx_queue_t *queue = &p.tx_queue[i];
+        if (queue->count == 0) {
+            continue;
+        }
+        if ((selected < 0) || (queue->skipped >= TX_FAIRNESS_LIMIT)) {
+            selected = i;
+            if (queue->skipped >= TX_FAIRNESS_LIMIT) {
+                break;
+            }
+        }
+    }
+
+    if (selected < 0) {
+        return false;
+    }
+
+    for (int i = 0; i < __TX_CLASS_COUNT; i++) {
+        if ((i != selected) && (p.tx_queue[i].count > 0)) {
+            p.tx_queue[i].skipped += 1;
+        }
+    }
+
+    usb_tx_queue_t *queue = &p.tx_queue[selected];
+    *info = queue->entries[queue->head];
+    queue->head = ((queue->head + 1) % queue->length);
+    queue->count -= 1;
+    queue->skipped = 0;
+
+    return true;
+}
+
+static void usb_tx_queue_clear (void) {
+    for (int i = 0; i < __TX_CLASS_COUNT; i++) {
+        p.tx_queue[i].dropped += p.tx_queue[i].count;
+        p.tx_queue[i].head = 0;
+        p.tx_queue[i].count = 0;
+        p.tx_queue[i].skipped = 0;
+    }
+}
+
 static bool usb_rx_byte (uint8_t *data) {
     if (fpga_usb_status_get() & USB_STATUS_RXNE) {
         *data = fpga_usb_pop();
@@ -132,34 +262,88 @@ static bool usb_tx_word (uint32_t data) {
 }
 
 static uint8_t usb_rx_cmd_counter = 0;
+static bool usb_rx_cmd_tagged = false;
 
-static bool usb_rx_cmd (uint8_t *cmd) {
+static bool usb_rx_cmd (uint8_t *cmd, bool *tagged) {
     uint8_t data;
     while (usb_rx_byte(&data)) {
         if (usb_rx_cmd_counter == 3) {
             *cmd = data;
+            *tagged = usb_rx_cmd_tagged;
             usb_rx_cmd_counter = 0;
             return true;
         }
-        if (data != CMD_TOKEN[usb_rx_cmd_counter++]) {
+        if (data == CMD_TOKEN[usb_rx_cmd_counter]) {
+            usb_rx_cmd_tagged = false;
+        } else if (data == CMT_TOKEN[usb_rx_cmd_counter]) {
+            usb_rx_cmd_tagged = true;
+        } else {
             usb_rx_cmd_counter = 0;
             return false;
         }
+        usb_rx_cmd_counter += 1;
     }
     return false;
 }
 
+static void usb_response_enqueue (void) {
+    usb_response_t *response = &p.response_queue[(p.response_head + p.response_count) % RESPONSE_QUEUE_LENGTH];
+    response->info = p.response_info;
+    response->error = p.response_error;
+    response->tagged = p.rx_tagged;
+    response->tag = p.rx_tag;
+    p.response_count += 1;
+}
+
+static bool usb_response_dma_pending (void) {
+    if (p.tx_response_dma) {
+        return true;
+    }
+    for (int i = 0; i < p.response_count; i++) {
+        if (p.response_queue[(p.response_head + i) % RESPONSE_QUEUE_LENGTH].info.dma_length > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool usb_rx_cmd_writes_memory (uint8_t cmd) {
+    switch (cmd) {
+        case 'M':
+        case 'K':
+        case 'l':
+        case 'Q':
+        case 'U':
+        case 'i':
+        case 's':
+        case 'P':
+        case 'E':
+        case 'f':
+        case 'g':
+            return true;
+        default:
+            return false;
+    }
+}
+
 static void usb_reset (void) {
     fpga_reg_set(REG_USB_DMA_SCR, DMA_SCR_STOP);
     while (fpga_reg_get(REG_USB_DMA_SCR) & DMA_SCR_BUSY);
     fpga_reg_set(REG_USB_SCR, USB_SCR_FIFO_FLUSH);
     while (fpga_reg_get(REG_USB_SCR) & USB_SCR_FIFO_FLUSH_BUSY);
 
+    if ((p.tx_state != TX_STATE_IDLE) && (p.tx_token == PKT_TOKEN)) {
+        p.tx_queue[usb_tx_get_class(p.tx_info.cmd)].dropped += 1;
+    }
+
     p.rx_state = RX_STATE_IDLE;
     p.tx_state = TX_STATE_IDLE;
 
     p.response_pending = false;
-    p.packet_pending = false;
+    p.response_head = 0;
+    p.response_count = 0;
+    p.tx_response_dma = false;
+    usb_tx_queue_clear();
 
     p.read_ready = true;
     p.read_length = 0;
@@ -169,12 +353,26 @@ static void usb_reset (void) {
     usb_rx_word_buffer = 0;
     usb_tx_word_counter = 0;
     usb_rx_cmd_counter = 0;
+    usb_rx_cmd_tagged = false;
 }
 
 static void usb_flush_packet (void) {
-    if (p.packet_pending && p.packet_info.done_callback) {
-        p.packet_pending = false;
-        p.packet_info.done_callback();
+    // Only packets waiting for completion are aborted here, the rest stays queued until USB reset discards it
+    for (int i = 0; i < __TX_CLASS_COUNT; i++) {
+        usb_tx_queue_t *queue = &p.tx_queue[i];
+        uint8_t count = queue->count;
+        for (uint8_t n = 0; n < count; n++) {
+            usb_tx_info_t info = queue->entries[queue->head];
+            queue->head = ((queue->head + 1) % queue->length);
+            queue->count -= 1;
+            if (info.done_callback) {
+                info.done_callback();
+                queue->dropped += 1;
+            } else {
+                queue->entries[(queue->head + queue->count) % queue->length] = info;
+                queue->count += 1;
+            }
+        }
     }
     if (p.tx_state != TX_STATE_IDLE && p.tx_info.done_callback) {
         p.tx_info.done_callback();
@@ -220,12 +418,60 @@ static bool usb_validate_address_length (uint32_t address, uint32_t length, bool
     return false;
 }
 
+static void usb_memory_checksum_start (uint32_t address, uint32_t length) {
+    hw_crc32_reset();
+    p.checksum_address = address;
+    p.checksum_length = length;
+    p.checksum_value = 0;
+}
+
+static bool usb_memory_checksum_step (void) {
+    uint8_t buffer[CHECKSUM_CHUNK_LENGTH];
+    uint32_t step_length = 0;
+
+    // Bounded amount of work per call, SPI transfer rate is the limit here
+    while ((p.checksum_length > 0) && (step_length < CHECKSUM_STEP_LENGTH)) {
+        uint32_t chunk_length = (p.checksum_length > CHECKSUM_CHUNK_LENGTH) ? CHECKSUM_CHUNK_LENGTH : p.checksum_length;
+        fpga_mem_read(p.checksum_address, chunk_length, buffer);
+        p.checksum_value = hw_crc32_calculate(buffer, chunk_length);
+        p.checksum_address += chunk_length;
+        p.checksum_length -= chunk_length;
+        step_length += chunk_length;
+    }
+
+    return (p.checksum_length == 0);
+}
+
+static void usb_memory_chunk_checksum_start (void) {
+    uint32_t length = (p.rx_args[1] > p.checksum_chunk_length) ? p.checksum_chunk_length : p.rx_args[1];
+    usb_memory_checksum_start(p.rx_args[0], length);
+    p.rx_args[0] += length;
+    p.rx_args[1] -= length;
+}
+
+static bool usb_memory_chunk_checksums_step (void) {
+    if (!usb_memory_checksum_step()) {
+        return false;
+    }
+    uint32_t checksum = SWAP32(p.checksum_value);
+    fpga_mem_write(CHECKSUM_BUFFER_ADDRESS + p.checksum_buffer_length, sizeof(checksum), (uint8_t *) (&checksum));
+    p.checksum_buffer_length += sizeof(checksum);
+    if (p.rx_args[1] == 0) {
+        return true;
+    }
+    usb_memory_chunk_checksum_start();
+    return false;
+}
+
 static void usb_rx_process (void) {
     if (p.rx_state == RX_STATE_IDLE) {
-        if (!p.response_pending && usb_rx_cmd(&p.rx_cmd)) {
-            p.rx_state = RX_STATE_ARGS;
+        if ((p.response_count < RESPONSE_QUEUE_LENGTH) && usb_rx_cmd(&p.rx_cmd, &p.rx_tagged)) {
+            trace_event(TRACE_EVENT_USB_COMMAND, p.rx_cmd);
+            p.rx_state = p.rx_tagged ? RX_STATE_TAG : RX_STATE_ARGS;
             p.rx_counter = 0;
+            p.rx_tag = 0;
             p.rx_dma_running = false;
+            p.checksum_running = false;
             p.flush_response = false;
             p.flush_packet = false;
             p.response_error = false;
@@ -236,6 +482,12 @@ static void usb_rx_process (void) {
         }
     }
 
+    if (p.rx_state == RX_STATE_TAG) {
+        if (usb_rx_word(&p.rx_tag)) {
+            p.rx_state = RX_STATE_ARGS;
+        }
+    }
+
     if (p.rx_state == RX_STATE_ARGS) {
         while (usb_rx_word(&p.rx_args[p.rx_counter])) {
             p.rx_counter += 1;
@@ -251,13 +503,18 @@ static void usb_rx_process (void) {
         }
     }
 
-    if (p.rx_state == RX_STATE_DATA) {
+    // Commands modifying memory must not overtake queued responses still going to read it
+    if ((p.rx_state == RX_STATE_DATA) && !(usb_rx_cmd_writes_memory(p.rx_cmd) && usb_response_dma_pending())) {
         switch (p.rx_cmd) {
             case 'v':
                 p.rx_state = RX_STATE_IDLE;
                 p.response_pending = true;
                 p.response_info.data_length = 4;
                 p.response_info.data[0] = cfg_get_identifier();
+                if (p.rx_args[0] >= PROTOCOL_VERSION_TAGGED) {
+                    p.response_info.data_length = 8;
+                    p.response_info.data[1] = ((PROTOCOL_VERSION_TAGGED << 16) | RESPONSE_QUEUE_LENGTH);
+                }
                 break;
 
             case 'V':
@@ -354,6 +611,128 @@ static void usb_rx_process (void) {
                 }
                 break;
 
+            case 'k':
+                if (!p.checksum_running) {
+                    if (usb_validate_address_length(p.rx_args[0], p.rx_args[1], false)) {
+                        p.rx_state = RX_STATE_IDLE;
+                        p.response_pending = true;
+                        p.response_error = true;
+                        break;
+                    }
+                    led_activity_on();
+                    usb_memory_checksum_start(p.rx_args[0], p.rx_args[1]);
+                    p.checksum_running = true;
+                }
+                if (usb_memory_checksum_step()) {
+                    led_activity_off();
+                    p.checksum_running = false;
+                    p.rx_state = RX_STATE_IDLE;
+                    p.response_pending = true;
+                    p.response_info.data_length = 4;
+                    p.response_info.data[0] = p.checksum_value;
+                }
+                break;
+
+            case 'K':
+                if (!p.checksum_running) {
+                    if (!usb_rx_word(&p.checksum_chunk_length)) {
+                        break;
+                    }
+                    bool error = usb_validate_address_length(p.rx_args[0], p.rx_args[1], false);
+                    if (!error && ((p.checksum_chunk_length == 0) || (p.rx_args[1] == 0))) {
+                        error = true;
+                    }
+                    if (!error && ((((p.rx_args[1] - 1) / p.checksum_chunk_length) + 1) > (CHECKSUM_BUFFER_LENGTH / sizeof(uint32_t)))) {
+                        error = true;
+                    }
+                    if (error) {
+                        p.rx_state = RX_STATE_IDLE;
+                        p.response_pending = true;
+                        p.response_error = true;
+                        break;
+                    }
+                    led_activity_on();
+                    p.checksum_buffer_length = 0;
+                    usb_memory_chunk_checksum_start();
+                    p.checksum_running = true;
+                }
+                if (usb_memory_chunk_checksums_step()) {
+                    led_activity_off();
+                    p.checksum_running = false;
+                    p.rx_state = RX_STATE_IDLE;
+                    p.response_pending = true;
+                    p.response_info.dma_address = CHECKSUM_BUFFER_ADDRESS;
+                    p.response_info.dma_length = p.checksum_buffer_length;
+                }
+                break;
+
+            case 'l':
+                if (p.rx_counter == 0) {
+                    if (!usb_rx_word(&p.rx_data[0])) {
+                        break;
+                    }
+                    p.rx_counter = 1;
+                    if (
+                        usb_validate_address_length(p.rx_args[0], p.rx_args[1], true) ||
+                        ((p.rx_args[0] % 4) != 0) ||
+                        ((p.rx_args[1] % 4) != 0)
+                    ) {
+                        p.rx_state = RX_STATE_IDLE;
+                        p.response_pending = true;
+                        p.response_error = true;
+                        break;
+                    }
+                    led_activity_on();
+                }
+                // Filled in bounded steps so the rest of the main loop keeps running during big fills
+                if (p.rx_args[1] > 0) {
+                    uint32_t length = (p.rx_args[1] > FILL_STEP_LENGTH) ? FILL_STEP_LENGTH : p.rx_args[1];
+                    fpga_mem_fill(p.rx_args[0], length, p.rx_data[0]);
+                    p.rx_args[0] += length;
+                    p.rx_args[1] -= length;
+                }
+                if (p.rx_args[1] == 0) {
+                    led_activity_off();
+                    p.rx_state = RX_STATE_IDLE;
+                    p.response_pending = true;
+                }
+                break;
+
+            case 'Q': {
+                while ((p.rx_counter < 2) && usb_rx_word(&p.rx_data[p.rx_counter])) {
+                    p.rx_counter += 1;
+                }
+                if (p.rx_counter < 2) {
+                    break;
+                }
+                fpga_mem_test_pattern_t pattern = (fpga_mem_test_pattern_t) (p.rx_data[0] >> 8);
+                bool fill = (p.rx_data[0] & (1 << 0));
+                bool verify = (p.rx_data[0] & (1 << 1));
+                p.rx_state = RX_STATE_IDLE;
+                p.response_pending = true;
+                if ((p.rx_args[1] == 0) || ((p.rx_args[0] + p.rx_args[1]) > SDRAM_LENGTH) || (p.rx_args[1] > SDRAM_LENGTH)) {
+                    p.response_error = true;
+                } else if (((p.rx_args[0] % 4) != 0) || ((p.rx_args[1] % 4) != 0)) {
+                    p.response_error = true;
+                } else if (pattern > MEM_TEST_PATTERN_WALKING_ONES) {
+                    p.response_error = true;
+                } else {
+                    led_activity_on();
+                    if (fill) {
+                        fpga_mem_test(p.rx_args[0], p.rx_args[1], pattern, p.rx_data[1], false, NULL);
+                    }
+                    p.response_info.data[0] = 0;
+                    p.response_info.data[1] = 0;
+                    p.response_info.data[2] = 0;
+                    if (verify) {
+                        p.response_info.data[0] = fpga_mem_test(p.rx_args[0], p.rx_args[1], pattern, p.rx_data[1], true, &p.response_info.data[1]);
+                    }
+                    p.response_info.data_length = 12;
+                    led_activity_off();
+                }
+                break;
+            }
+
             case 'U':
                 if (p.rx_args[1] == 0) {
                     p.rx_state = RX_STATE_IDLE;
@@ -517,12 +896,19 @@ static void usb_rx_process (void) {
 
             case 'p':
                 if (p.rx_args[0]) {
+                    if (flash_erase_pending() > 0) {
+                        break;
+                    }
                     flash_wait_busy();
                 }
                 p.rx_state = RX_STATE_IDLE;
                 p.response_pending = true;
                 p.response_info.data_length = 4;
                 p.response_info.data[0] = FLASH_ERASE_BLOCK_SIZE;
+                if (p.rx_args[1]) {
+                    p.response_info.data_length = 8;
+                    p.response_info.data[1] = flash_erase_pending();
+                }
                 break;
 
             case 'P':
@@ -535,6 +921,16 @@ static void usb_rx_process (void) {
                 p.response_pending = true;
                 break;
 
+            case 'E':
+                if (usb_validate_address_length(p.rx_args[0], p.rx_args[1], true)) {
+                    p.response_error = true;
+                } else {
+                    p.response_error = flash_erase_start(p.rx_args[0], p.rx_args[1]);
+                }
+                p.rx_state = RX_STATE_IDLE;
+                p.response_pending = true;
+                break;
+
             case 'f':
                 cfg_set_rom_write_enable(false);
                 p.response_info.data[0] = update_backup(p.rx_args[0], &p.response_info.data[1]);
@@ -565,17 +961,47 @@ static void usb_rx_process (void) {
                 p.response_info.data[1] = fpga_reg_get(REG_DEBUG_1);
                 break;
 
+            case 'g': {
+                p.rx_state = RX_STATE_IDLE;
+                p.response_pending = true;
+                if (p.rx_args[0]) {
+                    trace_set_enabled(true);
+                }
+                uint32_t dropped;
+                p.response_info.data_length = 8;
+                p.response_info.dma_address = TRACE_BUFFER_ADDRESS;
+                p.response_info.dma_length = trace_read(TRACE_BUFFER_ADDRESS, TRACE_READ_MAX_LENGTH, &dropped);
+                p.response_info.data[0] = dropped;
+                p.response_info.data[1] = hw_time_us();
+                if (!p.rx_args[0]) {
+                    trace_set_enabled(false);
+                }
+                break;
+            }
+
             case '%': {
-                uint16_t voltage;
-                int16_t temperature;
-                hw_adc_read_voltage_temperature(&voltage, &temperature);
                 p.rx_state = RX_STATE_IDLE;
                 p.response_pending = true;
                 p.response_info.data_length = 16;
-                p.response_info.data[0] = (DIAGNOSTIC_DATA_MARKER | DIAGNOSTIC_DATA_VERSION);
-                p.response_info.data[1] = (uint32_t) (voltage);
-                p.response_info.data[2] = (uint32_t) (temperature);
-                p.response_info.data[3] = 0;
+                if (p.rx_args[0] == 1) {
+                    p.response_info.data[0] = (DIAGNOSTIC_DATA_MARKER | DIAGNOSTIC_TX_SENT_VERSION);
+                    for (int i = 0; i < __TX_CLASS_COUNT; i++) {
+                        p.response_info.data[1 + i] = p.tx_queue[i].sent;
+                    }
+                } else if (p.rx_args[0] == 2) {
+                    p.response_info.data[0] = (DIAGNOSTIC_DATA_MARKER | DIAGNOSTIC_TX_DROPPED_VERSION);
+                    for (int i = 0; i < __TX_CLASS_COUNT; i++) {
+                        p.response_info.data[1 + i] = p.tx_queue[i].dropped;
+                    }
+                } else {
+                    uint16_t voltage;
+                    int16_t temperature;
+                    hw_adc_read_voltage_temperature(&voltage, &temperature);
+                    p.response_info.data[0] = (DIAGNOSTIC_DATA_MARKER | DIAGNOSTIC_DATA_VERSION);
+                    p.response_info.data[1] = (uint32_t) (voltage);
+                    p.response_info.data[2] = (uint32_t) (temperature);
+                    p.response_info.data[3] = 0;
+                }
                 break;
             }
 
@@ -621,24 +1047,39 @@ static void usb_rx_process (void) {
             }
         }
     }
+
+    if (p.response_pending) {
+        p.response_pending = false;
+        usb_response_enqueue();
+    }
 }
 
 static void usb_tx_process (void) {
     if (p.tx_state == TX_STATE_IDLE) {
-        if (p.response_pending) {
-            p.response_pending = false;
+        if (p.response_count > 0) {
+            usb_response_t *response = &p.response_queue[p.response_head];
+            p.response_head = ((p.response_head + 1) % RESPONSE_QUEUE_LENGTH);
+            p.response_count -= 1;
             p.tx_state = TX_STATE_TOKEN;
             p.tx_counter = 0;
-            p.tx_info = p.response_info;
-            p.tx_token = p.response_error ? ERR_TOKEN : CMP_TOKEN;
+            p.tx_info = response->info;
+            if (response->tagged) {
+                p.tx_token = response->error ? ERT_TOKEN : CPT_TOKEN;
+            } else {
+                p.tx_token = response->error ? ERR_TOKEN : CMP_TOKEN;
+            }
+            p.tx_tagged = response->tagged;
+            p.tx_tag = response->tag;
             p.tx_dma_running = false;
-        } else if (p.packet_pending) {
-            p.packet_pending = false;
+            p.tx_response_dma = (p.tx_info.dma_length > 0);
+            trace_event(TRACE_EVENT_USB_TX_START, p.tx_info.cmd);
+        } else if (usb_tx_dequeue(&p.tx_info)) {
             p.tx_state = TX_STATE_TOKEN;
             p.tx_counter = 0;
-            p.tx_info = p.packet_info;
             p.tx_token = PKT_TOKEN;
+            p.tx_tagged = false;
             p.tx_dma_running = false;
+            trace_event(TRACE_EVENT_USB_TX_START, p.tx_info.cmd);
         }
     }
 
@@ -649,6 +1090,13 @@ static void usb_tx_process (void) {
             }
         }
         if (p.tx_counter == 1) {
+            if (!p.tx_tagged) {
+                p.tx_counter += 1;
+            } else if (usb_tx_word(p.tx_tag)) {
+                p.tx_counter += 1;
+            }
+        }
+        if (p.tx_counter == 2) {
             if (usb_tx_word(p.tx_info.data_length + p.tx_info.dma_length)) {
                 p.tx_state = TX_STATE_DATA;
                 p.tx_counter = 0;
@@ -690,9 +1138,14 @@ static void usb_tx_process (void) {
 
     if (p.tx_state == TX_STATE_FLUSH) {
         fpga_reg_set(REG_USB_SCR, USB_SCR_WRITE_FLUSH);
+        trace_event(TRACE_EVENT_USB_TX_END, p.tx_info.cmd);
+        if (p.tx_token == PKT_TOKEN) {
+            p.tx_queue[usb_tx_get_class(p.tx_info.cmd)].sent += 1;
+        }
         if (p.tx_info.done_callback) {
             p.tx_info.done_callback();
         }
+        p.tx_response_dma = false;
         p.tx_state = TX_STATE_IDLE;
     }
 }
@@ -710,11 +1163,13 @@ void usb_create_packet (usb_tx_info_t *info, usb_packet_cmd_e cmd) {
 }
 
 bool usb_enqueue_packet (usb_tx_info_t *info) {
-    if (p.packet_pending) {
+    usb_tx_queue_t *queue = &p.tx_queue[usb_tx_get_class(info->cmd)];
+    if (queue->count >= queue->length) {
         return false;
     }
-    p.packet_pending = true;
-    p.packet_info = *info;
+    queue->entries[(queue->head + queue->count) % queue->length] = *info;
+    queue->count += 1;
+    trace_event(TRACE_EVENT_USB_PACKET_ENQUEUE, info->cmd);
     return true;
 }
 
@@ -744,6 +1199,16 @@ void usb_get_read_info (uint32_t *args) {
 
 void usb_init (void) {
     p.last_reset_state = false;
+    p.tx_queue[TX_CLASS_HIGH].entries = tx_queue_high;
+    p.tx_queue[TX_CLASS_HIGH].length = TX_QUEUE_HIGH_LENGTH;
+    p.tx_queue[TX_CLASS_NORMAL].entries = tx_queue_normal;
+    p.tx_queue[TX_CLASS_NORMAL].length = TX_QUEUE_NORMAL_LENGTH;
+    p.tx_queue[TX_CLASS_LOW].entries = tx_queue_low;
+    p.tx_queue[TX_CLASS_LOW].length = TX_QUEUE_LOW_LENGTH;
+    for (int i = 0; i < __TX_CLASS_COUNT; i++) {
+        p.tx_queue[i].sent = 0;
+        p.tx_queue[i].dropped = 0;
+    }
     usb_reset();
 }
 
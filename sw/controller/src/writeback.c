@@ -3,6 +3,7 @@
 #include "led.h"
 #include "sd.h"
 #include "timer.h"
+#include "trace.h"
 #include "usb.h"
 #include "writeback.h"
 
@@ -176,6 +177,7 @@ void writeback_process (void) {
     }
 
     if (p.pending && timer_countdown_elapsed(TIMER_ID_WRITEBACK)) {
+        trace_event(TRACE_EVENT_WRITEBACK_START, p.mode);
         switch (p.mode) {
             case WRITEBACK_SD:
                 writeback_save_to_sd();
@@ -192,5 +194,6 @@ void writeback_process (void) {
                 writeback_disable();
                 break;
         }
+        trace_event(TRACE_EVENT_WRITEBACK_END, p.pending);
     }
 }
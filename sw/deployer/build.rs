@@ -7,6 +7,9 @@ fn main() -> Result<(), Box<dyn std::error::Error>> {
         .file("../bootloader/src/fatfs/ff.c")
         .file("../bootloader/src/fatfs/ffsystem.c")
         .file("../bootloader/src/fatfs/ffunicode.c")
+        .define("FF_USE_EXPAND", "1")
+        .define("FF_USE_CHMOD", "1")
+        .define("FF_VOLUMES", "8")
         .compile("fatfs");
 
     bindgen::Builder::default()
@@ -0,0 +1,391 @@
+use crate::sc64::{self, SdCardResult};
+use std::{
+    io::Cursor,
+    time::{Duration, Instant},
+};
+
+const MIB_DIVIDER: f64 = 1024.0 * 1024.0;
+
+const LATENCY_SAMPLES: usize = 100;
+const USB_CHUNK_LENGTHS: [usize; 4] = [4 * 1024, 64 * 1024, 1024 * 1024, 8 * 1024 * 1024];
+const USB_TEST_LENGTH: usize = 8 * 1024 * 1024;
+const SD_SEQUENTIAL_LENGTH: usize = 4 * 1024 * 1024;
+const SD_RANDOM_LENGTH: usize = 4 * 1024;
+const SD_RANDOM_SAMPLES: usize = 64;
+const SD_RANDOM_MAX_SECTORS: u64 = 8 * 1024 * 1024;
+const FLASH_TEST_LENGTH: usize = 1024 * 1024;
+const DD_BLOCK_SAMPLES: usize = 100;
+const DD_REQUEST_TIMEOUT: Duration = Duration::from_secs(10);
+const ROM_TEST_LENGTH: usize = 64 * 1024 * 1024;
+
+pub struct Options {
+    pub repeat: usize,
+    pub warmup: usize,
+    pub sd: bool,
+    pub sd_write: bool,
+    pub flash: bool,
+    pub dd: bool,
+}
+
+struct Measurement {
+    name: &'static str,
+    parameters: Vec<(&'static str, String)>,
+    unit: &'static str,
+    samples: Vec<f64>,
+}
+
+impl Measurement {
+    fn to_json(&self) -> String {
+        let mut sorted = self.samples.clone();
+        sorted.sort_by(|a, b| a.total_cmp(b));
+        let mean = sorted.iter().sum::<f64>() / sorted.len().max(1) as f64;
+
+        let parameters: Vec<String> = self
+            .parameters
+            .iter()
+            .map(|(key, value)| format!("\"{key}\": {}", json_string(value)))
+            .collect();
+        let samples: Vec<String> = self.samples.iter().map(|v| json_number(*v)).collect();
+
+        format!(
+            "{{\"name\": {}, \"parameters\": {{{}}}, \"unit\": {}, \"samples\": [{}], \"min\": {}, \"max\": {}, \"mean\": {}, \"p50\": {}, \"p90\": {}, \"p99\": {}}}",
+            json_string(self.name),
+            parameters.join(", "),
+            json_string(self.unit),
+            samples.join(", "),
+            json_number(sorted.first().copied().unwrap_or_default()),
+            json_number(sorted.last().copied().unwrap_or_default()),
+            json_number(mean),
+            json_number(percentile(&sorted, 50.0)),
+            json_number(percentile(&sorted, 90.0)),
+            json_number(percentile(&sorted, 99.0)),
+        )
+    }
+}
+
+pub struct Report {
+    header: Vec<(&'static str, String)>,
+    measurements: Vec<Measurement>,
+}
+
+impl Report {
+    pub fn to_json(&self) -> String {
+        let header: Vec<String> = self
+            .header
+            .iter()
+            .map(|(key, value)| format!("  \"{key}\": {value},\n"))
+            .collect();
+        let measurements: Vec<String> = self
+            .measurements
+            .iter()
+            .map(|measurement| format!("    {}", measurement.to_json()))
+            .collect();
+        format!(
+            "{{\n{}  \"results\": [\n{}\n  ]\n}}\n",
+            header.concat(),
+            measurements.join(",\n")
+        )
+    }
+}
+
+pub fn run(
+    sc64: &mut sc64::SC64,
+    options: &Options,
+    header: Vec<(&'static str, String)>,
+    progress: impl Fn(&str),
+) -> Result<Report, sc64::Error> {
+    let mut header = header;
+    header.push(("repeat", options.repeat.to_string()));
+    header.push(("warmup", options.warmup.to_string()));
+
+    let mut measurements = Vec::new();
+
+    for command in [
+        sc64::LatencyTestCommand::IdentifierGet,
+        sc64::LatencyTestCommand::ConfigGet,
+    ] {
+        progress(&format!("Measuring '{command}' command round-trip latency"));
+        let mut samples = Vec::new();
+        for iteration in 0..((options.warmup + options.repeat) * LATENCY_SAMPLES) {
+            let latency = sc64.bench_command_latency(&command)?;
+            if iteration >= (options.warmup * LATENCY_SAMPLES) {
+                samples.push(as_micros(latency));
+            }
+        }
+        measurements.push(Measurement {
+            name: "command_latency",
+            parameters: vec![("command", command.to_string())],
+            unit: "us",
+            samples,
+        });
+    }
+
+    for (name, direction) in [
+        ("usb_read", sc64::SpeedTestDirection::Read),
+        ("usb_write", sc64::SpeedTestDirection::Write),
+    ] {
+        for chunk_length in USB_CHUNK_LENGTHS {
+            progress(&format!(
+                "Measuring USB {} throughput with {} kiB chunks",
+                if name == "usb_read" { "read" } else { "write" },
+                chunk_length / 1024
+            ));
+            let samples = sample(options, || {
+                let elapsed = sc64.bench_usb_transfer(&direction, chunk_length, USB_TEST_LENGTH)?;
+                Ok(as_throughput(USB_TEST_LENGTH, elapsed))
+            })?;
+            measurements.push(Measurement {
+                name,
+                parameters: vec![("chunk_length", chunk_length.to_string())],
+                unit: "MiB/s",
+                samples,
+            });
+        }
+    }
+
+    if options.sd {
+        progress("Measuring SD card performance");
+        check_sd_result(sc64.init_sd_card()?, "Init SD card failed")?;
+        let result = bench_sd_card(sc64, options, &mut measurements);
+        check_sd_result(sc64.deinit_sd_card()?, "Deinit SD card failed")?;
+        result?;
+    }
+
+    if options.flash {
+        progress("Measuring flash erase, program and read rates");
+        let backup = sc64.bench_flash_backup(FLASH_TEST_LENGTH)?;
+        let result = bench_flash(sc64, options, &mut measurements);
+        sc64.bench_flash_restore(&backup)?;
+        result?;
+    }
+
+    if options.dd {
+        progress("Measuring 64DD block request round-trip time");
+        sc64.configure_64dd(sc64::DdMode::Full, Some(sc64::DdDriveType::Retail))?;
+        sc64.set_64dd_disk_state(sc64::DdDiskState::Inserted)?;
+        let result = bench_64dd(sc64, options, &mut measurements);
+        sc64.set_64dd_disk_state(sc64::DdDiskState::Ejected)?;
+        sc64.configure_64dd(sc64::DdMode::None, None)?;
+        result?;
+    }
+
+    progress("Measuring end-to-end ROM upload time");
+    let mut rom = synthetic_rom(ROM_TEST_LENGTH);
+    let mut revision = 0u32;
+    let samples = sample(options, || {
+        // Typical edit-upload cycle, only the last flash block differs from the previous upload
+        revision += 1;
+        rom[(ROM_TEST_LENGTH - 4)..].copy_from_slice(&revision.to_be_bytes());
+        let time = Instant::now();
+        sc64.upload_rom(&mut Cursor::new(&rom), ROM_TEST_LENGTH, false)?;
+        Ok(time.elapsed().as_secs_f64())
+    })?;
+    measurements.push(Measurement {
+        name: "rom_upload",
+        parameters: vec![("length", ROM_TEST_LENGTH.to_string())],
+        unit: "s",
+        samples,
+    });
+
+    Ok(Report {
+        header,
+        measurements,
+    })
+}
+
+fn bench_sd_card(
+    sc64: &mut sc64::SC64,
+    options: &Options,
+    measurements: &mut Vec<Measurement>,
+) -> Result<(), sc64::Error> {
+    let mut data = vec![0u8; SD_SEQUENTIAL_LENGTH];
+
+    let samples = sample(options, || {
+        let time = Instant::now();
+        check_sd_result(sc64.read_sd_card(&mut data, 0)?, "Read SD card failed")?;
+        Ok(as_throughput(SD_SEQUENTIAL_LENGTH, time.elapsed()))
+    })?;
+    measurements.push(Measurement {
+        name: "sd_read_sequential",
+        parameters: vec![("length", SD_SEQUENTIAL_LENGTH.to_string())],
+        unit: "MiB/s",
+        samples,
+    });
+
+    if options.sd_write {
+        // Sectors are written back with the contents read above, card data stays unchanged
+        let samples = sample(options, || {
+            let time = Instant::now();
+            check_sd_result(sc64.write_sd_card(&data, 0)?, "Write SD card failed")?;
+            Ok(as_throughput(SD_SEQUENTIAL_LENGTH, time.elapsed()))
+        })?;
+        measurements.push(Measurement {
+            name: "sd_write_sequential",
+            parameters: vec![("length", SD_SEQUENTIAL_LENGTH.to_string())],
+            unit: "MiB/s",
+            samples,
+        });
+    }
+
+    let sectors = sc64.get_sd_card_info()?.sectors.min(SD_RANDOM_MAX_SECTORS);
+    let block_sectors = (SD_RANDOM_LENGTH / sc64::SD_CARD_SECTOR_SIZE) as u64;
+    let mut block = vec![0u8; SD_RANDOM_LENGTH];
+    let mut seed = 0x1234_5678u64;
+    let samples = sample(options, || {
+        let time = Instant::now();
+        for _ in 0..SD_RANDOM_SAMPLES {
+            seed = seed
+                .wrapping_mul(6364136223846793005)
+                .wrapping_add(1442695040888963407);
+            let sector = ((seed >> 33) % (sectors / block_sectors)) * block_sectors;
+            check_sd_result(
+                sc64.read_sd_card(&mut block, sector as u32)?,
+                "Read SD card failed",
+            )?;
+        }
+        Ok(SD_RANDOM_SAMPLES as f64 / time.elapsed().as_secs_f64())
+    })?;
+    measurements.push(Measurement {
+        name: "sd_read_random",
+        parameters: vec![("length", SD_RANDOM_LENGTH.to_string())],
+        unit: "IOPS",
+        samples,
+    });
+
+    Ok(())
+}
+
+fn bench_flash(
+    sc64: &mut sc64::SC64,
+    options: &Options,
+    measurements: &mut Vec<Measurement>,
+) -> Result<(), sc64::Error> {
+    let mut erase_samples = Vec::new();
+    let mut program_samples = Vec::new();
+    let mut read_samples = Vec::new();
+    for iteration in 0..(options.warmup + options.repeat) {
+        let (erase, program, read) = sc64.bench_flash(FLASH_TEST_LENGTH)?;
+        if iteration >= options.warmup {
+            erase_samples.push(as_throughput(FLASH_TEST_LENGTH, erase));
+            program_samples.push(as_throughput(FLASH_TEST_LENGTH, program));
+            read_samples.push(as_throughput(FLASH_TEST_LENGTH, read));
+        }
+    }
+    for (name, samples) in [
+        ("flash_erase", erase_samples),
+        ("flash_program", program_samples),
+        ("flash_read", read_samples),
+    ] {
+        measurements.push(Measurement {
+            name,
+            parameters: vec![("length", FLASH_TEST_LENGTH.to_string())],
+            unit: "MiB/s",
+            samples,
+        });
+    }
+    Ok(())
+}
+
+fn bench_64dd(
+    sc64: &mut sc64::SC64,
+    options: &Options,
+    measurements: &mut Vec<Measurement>,
+) -> Result<(), sc64::Error> {
+    // Requests are issued by the N64, round-trip spans from one request arriving to the next one,
+    // service time covers only the reply (block data upload and block ready notification)
+    let mut service_samples = Vec::new();
+    let mut round_trip_samples = Vec::new();
+    let mut previous_request: Option<Instant> = None;
+    let first_sample = options.warmup * DD_BLOCK_SAMPLES;
+    for iteration in 0..=((options.warmup + options.repeat) * DD_BLOCK_SAMPLES) {
+        let mut disk_packet = sc64.bench_64dd_request(DD_REQUEST_TIMEOUT)?;
+        let time = Instant::now();
+        if let Some(previous) = previous_request.replace(time) {
+            if iteration > first_sample {
+                round_trip_samples.push(as_micros(time - previous));
+            }
+        }
+        if let sc64::DiskPacketKind::Read = disk_packet.kind {
+            disk_packet.info.set_data(&[0u8; sc64::DD_BLOCK_MAX_LENGTH]);
+        }
+        sc64.reply_disk_packet(Some(disk_packet))?;
+        if iteration > first_sample {
+            service_samples.push(as_micros(time.elapsed()));
+        }
+    }
+    for (name, samples) in [
+        ("64dd_block_service", service_samples),
+        ("64dd_block_round_trip", round_trip_samples),
+    ] {
+        measurements.push(Measurement {
+            name,
+            parameters: vec![],
+            unit: "us",
+            samples,
+        });
+    }
+    Ok(())
+}
+
+fn sample(
+    options: &Options,
+    mut measure: impl FnMut() -> Result<f64, sc64::Error>,
+) -> Result<Vec<f64>, sc64::Error> {
+    for _ in 0..options.warmup {
+        measure()?;
+    }
+    (0..options.repeat).map(|_| measure()).collect()
+}
+
+fn check_sd_result(result: SdCardResult, message: &str) -> Result<(), sc64::Error> {
+    match result {
+        SdCardResult::OK => Ok(()),
+        result => Err(sc64::Error::new(format!("{message}: {result}").as_str())),
+    }
+}
+
+fn synthetic_rom(length: usize) -> Vec<u8> {
+    let mut rom: Vec<u8> = (0..length)
+        .map(|i| ((i ^ (i >> 8) ^ (i >> 16)) & 0xFF) as u8)
+        .collect();
+    rom[0..4].copy_from_slice(&[0x80, 0x37, 0x12, 0x40]);
+    rom
+}
+
+fn as_micros(duration: Duration) -> f64 {
+    duration.as_secs_f64() * 1_000_000.0
+}
+
+fn as_throughput(length: usize, duration: Duration) -> f64 {
+    (length as f64 / MIB_DIVIDER) / duration.as_secs_f64()
+}
+
+fn percentile(sorted: &[f64], percentile: f64) -> f64 {
+    if sorted.is_empty() {
+        return 0.0;
+    }
+    let rank = ((percentile / 100.0) * sorted.len() as f64).ceil() as usize;
+    sorted[rank.clamp(1, sorted.len()) - 1]
+}
+
+fn json_number(value: f64) -> String {
+    if value.is_finite() {
+        format!("{value:.3}")
+    } else {
+        "null".to_string()
+    }
+}
+
+pub fn json_string(value: &str) -> String {
+    let mut result = String::from("\"");
+    for c in value.chars() {
+        match c {
+            '"' => result.push_str("\\\""),
+            '\\' => result.push_str("\\\\"),
+            c if (c as u32) < 0x20 => result.push_str(&format!("\\u{:04x}", c as u32)),
+            c => result.push(c),
+        }
+    }
+    result.push('"');
+    result
+}
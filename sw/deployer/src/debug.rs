@@ -4,10 +4,10 @@ use colored::Colorize;
 use encoding_rs::EUC_JP;
 use std::{
     fs::File,
-    io::{stdin, Read, Write},
+    io::{stdin, BufWriter, Read, Write},
     path::PathBuf,
-    sync::mpsc::{channel, Receiver, Sender},
-    thread::spawn,
+    sync::mpsc::{channel, sync_channel, Receiver, Sender, SyncSender, TrySendError},
+    thread::{spawn, JoinHandle},
 };
 
 pub enum Encoding {
@@ -20,6 +20,27 @@ pub struct Handler {
     line_rx: Receiver<String>,
     external_line_tx: Sender<String>,
     encoding: Encoding,
+    stream: Option<Stream>,
+    capture: Option<Capture>,
+    capture_stopped: bool,
+}
+
+struct Stream {
+    datatype: u8,
+    writer: BufWriter<File>,
+    length: usize,
+}
+
+pub enum CaptureFormat {
+    Y4m,
+    Rgba,
+}
+
+struct Capture {
+    assembler: FrameAssembler,
+    frame_tx: SyncSender<Frame>,
+    worker: JoinHandle<CaptureStats>,
+    dropped: usize,
 }
 
 enum DataType {
@@ -28,6 +49,7 @@ enum DataType {
     Header,
     Screenshot,
     Heartbeat,
+    Frame,
     Unknown,
 }
 
@@ -39,6 +61,7 @@ impl From<u8> for DataType {
             0x03 => Self::Header,
             0x04 => Self::Screenshot,
             0x05 => Self::Heartbeat,
+            0x06 => Self::Frame,
             _ => Self::Unknown,
         }
     }
@@ -52,6 +75,7 @@ impl From<DataType> for u8 {
             DataType::Header => 0x03,
             DataType::Screenshot => 0x04,
             DataType::Heartbeat => 0x05,
+            DataType::Frame => 0x06,
             DataType::Unknown => 0xFF,
         }
     }
@@ -118,6 +142,189 @@ impl TryFrom<Vec<u8>> for ScreenshotMetadata {
     }
 }
 
+fn decode_pixel(format: ScreenshotPixelFormat, p: &[u8]) -> [u8; 4] {
+    match format {
+        ScreenshotPixelFormat::Rgba16 => {
+            let r = ((p[0] >> 3) & 0x1F) << 3;
+            let g = (((p[0] & 0x07) << 2) | ((p[1] >> 6) & 0x03)) << 3;
+            let b = ((p[1] >> 1) & 0x1F) << 3;
+            let a = ((p[1]) & 0x01) * 255;
+            [r, g, b, a]
+        }
+        ScreenshotPixelFormat::Rgba32 => [p[0], p[1], p[2], p[3]],
+    }
+}
+
+struct Frame {
+    number: u32,
+    format: ScreenshotPixelFormat,
+    width: u32,
+    height: u32,
+    data: Vec<u8>,
+}
+
+// Frame header: datatype (0x06), frame number, pixel format, width, height, all big endian u32
+const FRAME_HEADER_LENGTH: usize = 20;
+
+struct FrameAssembler {
+    buffer: Vec<u8>,
+}
+
+impl FrameAssembler {
+    fn new() -> Self {
+        FrameAssembler { buffer: vec![] }
+    }
+
+    fn push(&mut self, data: &[u8]) -> Result<Vec<Frame>, String> {
+        self.buffer.extend_from_slice(data);
+        let mut frames = vec![];
+        while self.buffer.len() >= FRAME_HEADER_LENGTH {
+            let header = &self.buffer[0..FRAME_HEADER_LENGTH];
+            let word = |i: usize| u32::from_be_bytes(header[i..(i + 4)].try_into().unwrap());
+            if word(0) != DataType::Frame.into() {
+                self.buffer.clear();
+                return Err("Invalid frame header, discarding buffered frame data".into());
+            }
+            let number = word(4);
+            let format: ScreenshotPixelFormat = match word(8).try_into() {
+                Ok(format) => format,
+                Err(error) => {
+                    self.buffer.clear();
+                    return Err(error);
+                }
+            };
+            let width = word(12);
+            let height = word(16);
+            if width == 0 || height == 0 || width > 4096 || height > 4096 {
+                self.buffer.clear();
+                return Err("Invalid width or height in frame header".into());
+            }
+            let length = (u32::from(format) * width * height) as usize;
+            if self.buffer.len() < (FRAME_HEADER_LENGTH + length) {
+                break;
+            }
+            let data = self.buffer[FRAME_HEADER_LENGTH..(FRAME_HEADER_LENGTH + length)].to_vec();
+            self.buffer.drain(0..(FRAME_HEADER_LENGTH + length));
+            frames.push(Frame {
+                number,
+                format,
+                width,
+                height,
+                data,
+            });
+        }
+        Ok(frames)
+    }
+}
+
+#[derive(Default)]
+struct CaptureStats {
+    written: usize,
+    repeated: usize,
+    skipped: usize,
+    error: Option<String>,
+}
+
+const CAPTURE_QUEUE_LENGTH: usize = 8;
+
+fn capture_thread(
+    frame_rx: Receiver<Frame>,
+    file: File,
+    format: CaptureFormat,
+    fps: u32,
+) -> CaptureStats {
+    let mut writer = BufWriter::new(file);
+    let mut stats = CaptureStats::default();
+    let mut size: Option<(u32, u32)> = None;
+    let mut previous: Option<(u32, Vec<u8>)> = None;
+
+    for frame in frame_rx {
+        if let Some((width, height)) = size {
+            if (frame.width, frame.height) != (width, height) {
+                stats.skipped += 1;
+                continue;
+            }
+        } else {
+            if let CaptureFormat::Y4m = format {
+                let header = format!(
+                    "YUV4MPEG2 W{} H{} F{fps}:1 Ip A1:1 C444\n",
+                    frame.width, frame.height
+                );
+                if let Err(error) = writer.write_all(header.as_bytes()) {
+                    stats.error = Some(error.to_string());
+                    break;
+                }
+            }
+            size = Some((frame.width, frame.height));
+        }
+
+        let converted = convert_frame(&frame, &format);
+
+        // Frames missing from the numbering are filled with the previous one to keep output timing
+        let mut repeat = 0;
+        if let Some((number, data)) = &previous {
+            let missing = frame.number.wrapping_sub(*number).wrapping_sub(1);
+            if missing < 0x80000000 {
+                repeat = missing.min(fps) as usize;
+            }
+            for _ in 0..repeat {
+                if let Err(error) = write_frame(&mut writer, &format, data) {
+                    stats.error = Some(error.to_string());
+                    return stats;
+                }
+            }
+        }
+        stats.repeated += repeat;
+
+        if let Err(error) = write_frame(&mut writer, &format, &converted) {
+            stats.error = Some(error.to_string());
+            break;
+        }
+        stats.written += 1;
+
+        previous = Some((frame.number, converted));
+    }
+
+    if let Err(error) = writer.flush() {
+        stats.error.get_or_insert(error.to_string());
+    }
+
+    stats
+}
+
+fn convert_frame(frame: &Frame, format: &CaptureFormat) -> Vec<u8> {
+    let format_size = u32::from(frame.format) as usize;
+    let pixels = frame
+        .data
+        .chunks_exact(format_size)
+        .map(|p| decode_pixel(frame.format, p));
+    match format {
+        CaptureFormat::Rgba => pixels.flatten().collect(),
+        CaptureFormat::Y4m => {
+            let count = (frame.width * frame.height) as usize;
+            let mut planes = vec![0u8; count * 3];
+            for (i, [r, g, b, _]) in pixels.enumerate() {
+                let (r, g, b) = (r as i32, g as i32, b as i32);
+                planes[i] = (16 + ((66 * r + 129 * g + 25 * b + 128) >> 8)) as u8;
+                planes[count + i] = (128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8)) as u8;
+                planes[(count * 2) + i] = (128 + ((112 * r - 94 * g - 18 * b + 128) >> 8)) as u8;
+            }
+            planes
+        }
+    }
+}
+
+fn write_frame(
+    writer: &mut BufWriter<File>,
+    format: &CaptureFormat,
+    data: &[u8],
+) -> std::io::Result<()> {
+    if let CaptureFormat::Y4m = format {
+        writer.write_all(b"FRAME\n")?;
+    }
+    writer.write_all(data)
+}
+
 struct Heartbeat {
     usb_protocol: u16,
     version: u16,
@@ -177,6 +384,9 @@ impl Handler {
             line_rx,
             external_line_tx,
             encoding: Encoding::UTF8,
+            stream: None,
+            capture: None,
+            capture_stopped: false,
         }
     }
 
@@ -184,6 +394,56 @@ impl Handler {
         self.encoding = encoding;
     }
 
+    pub fn set_stream_output(&mut self, file: File, datatype: u8) {
+        self.stream = Some(Stream {
+            datatype,
+            writer: BufWriter::new(file),
+            length: 0,
+        });
+    }
+
+    pub fn finish_stream_output(&mut self) -> Option<usize> {
+        let mut stream = self.stream.take()?;
+        if let Err(error) = stream.writer.flush() {
+            error!("Couldn't write stream data: {error}");
+        }
+        Some(stream.length)
+    }
+
+    pub fn set_capture_output(&mut self, file: File, format: CaptureFormat, fps: u32) {
+        let (frame_tx, frame_rx) = sync_channel::<Frame>(CAPTURE_QUEUE_LENGTH);
+        let worker = spawn(move || capture_thread(frame_rx, file, format, fps));
+        self.capture = Some(Capture {
+            assembler: FrameAssembler::new(),
+            frame_tx,
+            worker,
+            dropped: 0,
+        });
+    }
+
+    pub fn finish_capture_output(&mut self) -> Option<String> {
+        let Capture {
+            frame_tx,
+            worker,
+            dropped,
+            ..
+        } = self.capture.take()?;
+        drop(frame_tx);
+        let stats = match worker.join() {
+            Ok(stats) => stats,
+            Err(_) => return Some("Capture thread panicked".into()),
+        };
+        if let Some(error) = stats.error {
+            error!("Couldn't write capture data: {error}");
+        }
+        Some(format!(
+            "Wrote [{}] frames, [{}] repeated for missing frames, [{dropped}] dropped by host, [{}] skipped after size change",
+            stats.written + stats.repeated,
+            stats.repeated,
+            stats.skipped
+        ))
+    }
+
     pub fn send_external_input(&self, input: &str) {
         self.external_line_tx.send(input.to_string()).unwrap();
     }
@@ -269,12 +529,18 @@ impl Handler {
 
     pub fn handle_debug_packet(&mut self, debug_packet: sc64::DebugPacket) {
         let sc64::DebugPacket { datatype, data } = debug_packet;
+        if let Some(stream) = self.stream.as_mut() {
+            if stream.datatype == datatype {
+                return self.handle_stream_data(&data);
+            }
+        }
         match datatype.into() {
             DataType::Text => self.handle_datatype_text(&data),
             DataType::RawBinary => self.handle_datatype_raw_binary(&data),
             DataType::Header => self.handle_datatype_header(&data),
             DataType::Screenshot => self.handle_datatype_screenshot(&data),
             DataType::Heartbeat => self.handle_datatype_heartbeat(&data),
+            DataType::Frame => self.handle_datatype_frame(&data),
             _ => error!("Received unknown debug packet datatype: 0x{datatype:02X}"),
         }
     }
@@ -309,6 +575,17 @@ impl Handler {
         error!("Debug data write dropped due to timeout");
     }
 
+    fn handle_stream_data(&mut self, data: &[u8]) {
+        if let Some(stream) = self.stream.as_mut() {
+            if let Err(error) = stream.writer.write_all(data) {
+                error!("Couldn't write stream data: {error}");
+                self.stream = None;
+            } else {
+                stream.length += data.len();
+            }
+        }
+    }
+
     fn handle_datatype_text(&self, data: &[u8]) {
         self.print_text(data);
     }
@@ -351,17 +628,7 @@ impl Handler {
         let mut image = image::RgbaImage::new(width, height);
         for (x, y, pixel) in image.enumerate_pixels_mut() {
             let location = ((x + (y * width)) * format_size) as usize;
-            let p = &data[location..location + format_size as usize];
-            pixel.0 = match format {
-                ScreenshotPixelFormat::Rgba16 => {
-                    let r = ((p[0] >> 3) & 0x1F) << 3;
-                    let g = (((p[0] & 0x07) << 2) | ((p[1] >> 6) & 0x03)) << 3;
-                    let b = ((p[1] >> 1) & 0x1F) << 3;
-                    let a = ((p[1]) & 0x01) * 255;
-                    [r, g, b, a]
-                }
-                ScreenshotPixelFormat::Rgba32 => [p[0], p[1], p[2], p[3]],
-            }
+            pixel.0 = decode_pixel(format, &data[location..location + format_size as usize]);
         }
         let filename = &generate_filename("screenshot", "png");
         if let Some(error) = image.save(filename).err() {
@@ -370,6 +637,31 @@ impl Handler {
         success!("Wrote {width}x{height} pixels to [{filename}]");
     }
 
+    fn handle_datatype_frame(&mut self, data: &[u8]) {
+        let capture = match self.capture.as_mut() {
+            Some(capture) => capture,
+            None if self.capture_stopped => return,
+            None => return error!("Got frame packet without capture output enabled"),
+        };
+        let frames = match capture.assembler.push(data) {
+            Ok(frames) => frames,
+            Err(error) => return error!("{error}"),
+        };
+        for frame in frames {
+            match capture.frame_tx.try_send(frame) {
+                Ok(()) => {}
+                Err(TrySendError::Full(_)) => capture.dropped += 1,
+                Err(TrySendError::Disconnected(_)) => {
+                    if let Some(summary) = self.finish_capture_output() {
+                        success!("Capture stopped: {summary}");
+                    }
+                    self.capture_stopped = true;
+                    return;
+                }
+            }
+        }
+    }
+
     fn handle_datatype_heartbeat(&mut self, data: &[u8]) {
         let Heartbeat {
             usb_protocol,
@@ -0,0 +1,46 @@
+use crate::sc64;
+use std::{env, fs, path::PathBuf};
+
+// Checksums of the ROM chunks last uploaded to the device, SDRAM contents are
+// compared against them to find out which chunks need to be sent again
+pub struct Cache {
+    path: PathBuf,
+}
+
+impl Cache {
+    pub fn new(device_id: &str) -> Self {
+        let name: String = device_id
+            .chars()
+            .map(|c| if c.is_ascii_alphanumeric() { c } else { '_' })
+            .collect();
+        Self {
+            path: env::temp_dir()
+                .join("sc64deployer")
+                .join(format!("delta_{name}.txt")),
+        }
+    }
+
+    pub fn load(&self) -> Vec<u32> {
+        let Ok(contents) = fs::read_to_string(&self.path) else {
+            return Vec::new();
+        };
+        contents
+            .lines()
+            .map(|line| u32::from_str_radix(line, 16))
+            .collect::<Result<Vec<u32>, _>>()
+            .unwrap_or_default()
+    }
+
+    pub fn store(&self, checksums: &[u32]) -> Result<(), sc64::Error> {
+        if let Some(parent) = self.path.parent() {
+            fs::create_dir_all(parent)?;
+        }
+        let contents: String = checksums.iter().map(|c| format!("{c:08X}\n")).collect();
+        fs::write(&self.path, contents)?;
+        Ok(())
+    }
+
+    pub fn clear(&self) {
+        fs::remove_file(&self.path).ok();
+    }
+}
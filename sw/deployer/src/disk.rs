@@ -1,4 +1,4 @@
-use crate::sc64::Error;
+use crate::sc64::{Error, DD_STAGING_SLOTS};
 use std::{
     collections::HashMap,
     fs::File,
@@ -9,6 +9,7 @@ const BLOCKS_PER_TRACK: usize = 2;
 const SECTORS_PER_BLOCK: usize = 85;
 const SYSTEM_SECTOR_LENGTH: usize = 232;
 const BAD_TRACKS_PER_ZONE: usize = 12;
+const TRACKS_PER_HEAD: u32 = 1175;
 
 #[derive(Clone, Copy, PartialEq)]
 pub enum Format {
@@ -98,6 +99,7 @@ struct Mapping {
 
 pub struct Disk {
     file: File,
+    image: Vec<u8>,
     format: Format,
     mapping: HashMap<usize, Mapping>,
 }
@@ -125,10 +127,8 @@ impl Disk {
     ) -> Result<Option<Vec<u8>>, Error> {
         let location = track << 2 | head << 1 | block;
         if let Some(block) = self.mapping.get(&(location as usize)) {
-            let mut data = vec![0u8; block.length];
-            self.file.seek(SeekFrom::Start(block.offset as u64))?;
-            self.file.read_exact(&mut data)?;
-            return Ok(Some(data));
+            let data = &self.image[block.offset..(block.offset + block.length)];
+            return Ok(Some(data.to_vec()));
         }
         Ok(None)
     }
@@ -145,6 +145,7 @@ impl Disk {
             if block.length == data.len() && block.writable {
                 self.file.seek(SeekFrom::Start(block.offset as u64))?;
                 self.file.write_all(data)?;
+                self.image[block.offset..(block.offset + block.length)].copy_from_slice(data);
                 return Ok(Some(()));
             }
         }
@@ -155,8 +156,19 @@ impl Disk {
 pub fn open(path: &str) -> Result<Disk, Error> {
     let mut file = File::options().read(true).write(true).open(path)?;
     let (format, mapping) = load_ndd(&mut file)?;
+    // Whole image is kept in memory, block reads don't touch the file anymore
+    let mut image = Vec::new();
+    file.seek(SeekFrom::Start(0))?;
+    file.read_to_end(&mut image)?;
+    if mapping
+        .values()
+        .any(|block| (block.offset + block.length) > image.len())
+    {
+        return Err(Error::new("64DD disk file is truncated"));
+    }
     Ok(Disk {
         file,
+        image,
         format,
         mapping,
     })
@@ -174,6 +186,114 @@ pub fn open_multiple(paths: &[String]) -> Result<Vec<Disk>, Error> {
     Ok(disks)
 }
 
+pub fn next_block_location(location: u32, previous: Option<u32>) -> Option<u32> {
+    let track = location >> 2;
+
+    // Blocks on a track are read in pairs, starting block alternates between consecutive tracks
+    if Some(location ^ 1) != previous {
+        return Some(location ^ 1);
+    }
+
+    // Head 0 tracks are laid out outwards, head 1 tracks inwards
+    let track = if (location & (1 << 1)) != 0 {
+        track.checked_sub(1)?
+    } else if (track + 1) < TRACKS_PER_HEAD {
+        track + 1
+    } else {
+        return None;
+    };
+
+    Some((track << 2) | (location & 0x3))
+}
+
+pub struct Staging {
+    slots: [Option<u32>; DD_STAGING_SLOTS],
+    current: Option<usize>,
+    location: Option<u32>,
+    previous: Option<u32>,
+}
+
+impl Staging {
+    pub fn new() -> Self {
+        Self {
+            slots: [None; DD_STAGING_SLOTS],
+            current: None,
+            location: None,
+            previous: None,
+        }
+    }
+
+    pub fn clear(&mut self) {
+        *self = Self::new();
+    }
+
+    fn access(&mut self, location: u32) {
+        if self.location != Some(location) {
+            self.previous = self.location;
+            self.location = Some(location);
+        }
+    }
+
+    pub fn requested(&mut self, location: u32) {
+        self.current = None;
+        self.access(location);
+    }
+
+    pub fn consumed(&mut self, slot: usize, location: u32) {
+        // Flashcart clears the tag itself and keeps using the slot until the next request
+        self.slots[slot] = None;
+        self.current = Some(slot);
+        self.access(location);
+    }
+
+    pub fn find(&self, location: u32) -> Option<usize> {
+        self.slots.iter().position(|&slot| slot == Some(location))
+    }
+
+    pub fn set(&mut self, slot: usize, location: Option<u32>) {
+        self.slots[slot] = location;
+    }
+
+    fn predict(&self) -> Vec<u32> {
+        let mut predicted = Vec::new();
+        let (mut location, mut previous) = match self.location {
+            Some(location) => (location, self.previous),
+            None => return predicted,
+        };
+        while predicted.len() < (DD_STAGING_SLOTS - 1) {
+            match next_block_location(location, previous) {
+                Some(next) => {
+                    predicted.push(next);
+                    previous = Some(location);
+                    location = next;
+                }
+                None => break,
+            }
+        }
+        predicted
+    }
+
+    pub fn stale(&self) -> Vec<usize> {
+        let predicted = self.predict();
+        (0..DD_STAGING_SLOTS)
+            .filter(|&slot| match self.slots[slot] {
+                Some(location) => !predicted.contains(&location),
+                None => false,
+            })
+            .collect()
+    }
+
+    pub fn plan(&self) -> Vec<(usize, u32)> {
+        let mut free = (0..DD_STAGING_SLOTS)
+            .filter(|&slot| self.slots[slot].is_none() && self.current != Some(slot));
+        self.predict()
+            .into_iter()
+            .filter(|&location| self.find(location).is_none())
+            .map_while(|location| free.next().map(|slot| (slot, location)))
+            .collect()
+    }
+}
+
 fn load_ndd(file: &mut File) -> Result<(Format, HashMap<usize, Mapping>), Error> {
     let mut disk_format: Option<Format> = None;
     let mut disk_type: usize = 0;
@@ -0,0 +1,111 @@
+use crate::sc64;
+use colored::Colorize;
+use panic_message::panic_message;
+use std::{
+    panic::{catch_unwind, AssertUnwindSafe},
+    sync::mpsc::channel,
+    thread,
+    time::{Duration, Instant},
+};
+
+pub struct Device {
+    pub port: String,
+    pub serial: String,
+}
+
+pub struct Log {
+    lines: Vec<String>,
+}
+
+impl Log {
+    pub fn println(&mut self, line: String) {
+        self.lines.push(line);
+    }
+
+    pub fn log_wait<F: FnOnce() -> Result<T, E>, T, E>(
+        &mut self,
+        message: String,
+        operation: F,
+    ) -> Result<T, E> {
+        let result = operation();
+        let status = if result.is_ok() {
+            "done".bold().bright_green()
+        } else {
+            "error!".bold().bright_red()
+        };
+        self.lines.push(format!("{message}... {status}"));
+        result
+    }
+}
+
+pub struct Report {
+    pub device: Device,
+    pub lines: Vec<String>,
+    pub result: Result<(), sc64::Error>,
+    pub elapsed: Duration,
+}
+
+pub fn find_devices(serials: &[String]) -> Result<Vec<Device>, sc64::Error> {
+    let devices: Vec<Device> = sc64::list_local_devices()?
+        .into_iter()
+        .map(|d| Device {
+            port: d.port,
+            serial: d.serial,
+        })
+        .collect();
+
+    if serials.is_empty() {
+        return Ok(devices);
+    }
+
+    for serial in serials {
+        if !devices.iter().any(|d| &d.serial == serial) {
+            return Err(sc64::Error::new(
+                format!("No SC64 device with serial number [{serial}] found").as_str(),
+            ));
+        }
+    }
+
+    Ok(devices
+        .into_iter()
+        .filter(|d| serials.contains(&d.serial))
+        .collect())
+}
+
+pub fn run<F, R>(devices: Vec<Device>, task: F, mut on_finished: R) -> Vec<Report>
+where
+    F: Fn(&Device, &mut Log) -> Result<(), sc64::Error> + Sync,
+    R: FnMut(&Report),
+{
+    let (report_sender, report_receiver) = channel();
+
+    thread::scope(|scope| {
+        for device in devices {
+            let report_sender = report_sender.clone();
+            let task = &task;
+            scope.spawn(move || {
+                let start = Instant::now();
+                let mut log = Log { lines: Vec::new() };
+                let result = catch_unwind(AssertUnwindSafe(|| task(&device, &mut log)))
+                    .unwrap_or_else(|payload| Err(sc64::Error::new(&panic_message(&payload))));
+                report_sender
+                    .send(Report {
+                        device,
+                        lines: log.lines,
+                        result,
+                        elapsed: start.elapsed(),
+                    })
+                    .ok();
+            });
+        }
+        drop(report_sender);
+
+        report_receiver
+            .iter()
+            .map(|report| {
+                on_finished(&report);
+                report
+            })
+            .collect()
+    })
+}
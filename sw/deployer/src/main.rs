@@ -1,23 +1,32 @@
+mod bench;
 mod debug;
+mod delta;
 mod disk;
+mod fleet;
 mod n64;
 mod sc64;
+mod sd;
+mod trace;
+mod watch;
 
 use chrono::Local;
 use clap::{Args, Parser, Subcommand, ValueEnum};
 use clap_num::{maybe_hex, maybe_hex_range};
-use colored::Colorize;
+use colored::{ColoredString, Colorize};
 use panic_message::panic_message;
 use std::{
     fs::File,
-    io::{stdin, stdout, Read, Write},
+    io::{stdin, stdout, Cursor, Read, Write},
     panic,
     path::PathBuf,
     process,
     sync::{
         atomic::{AtomicBool, Ordering},
+        mpsc::{channel, Sender},
         Arc,
     },
+    thread::{self, JoinHandle},
+    time::{Duration, Instant},
 };
 
 #[derive(Parser)]
@@ -55,11 +64,11 @@ struct Cli {
     #[command(subcommand)]
     command: Commands,
 
-    /// Connect to SC64 device on provided local port
+    /// Connect to SC64 device on provided local port (use "emu://[sd=<path>,latency=<us>,bandwidth=<MiB/s>]" for a software emulated device)
     #[arg(short, long)]
     port: Option<String>,
 
-    /// Connect to SC64 device on provided remote address
+    /// Connect to SC64 device on provided remote address (append /SERIAL to select a device)
     #[arg(short, long, conflicts_with = "port")]
     remote: Option<String>,
 }
@@ -114,8 +123,17 @@ enum Commands {
     /// Test SC64 hardware
     Test,
 
+    /// Benchmark SC64 performance and print results as JSON
+    Bench(BenchArgs),
+
+    /// Record controller event trace and save it as Chrome trace JSON (viewable in Perfetto)
+    Trace(TraceArgs),
+
     /// Expose SC64 device over network
     Server(ServerArgs),
+
+    /// Run command on multiple connected SC64 devices in parallel
+    Fleet(FleetArgs),
 }
 
 #[derive(Args)]
@@ -150,6 +168,18 @@ struct UploadArgs {
     /// Force CIC seed
     #[arg(long, value_parser = |s: &str| maybe_hex::<u8>(s))]
     cic_seed: Option<u8>,
+
+    /// Send only ROM parts that changed since the previous upload to this device
+    #[arg(long)]
+    delta: bool,
+
+    /// Verify uploaded ROM against the flashcart memory contents
+    #[arg(long)]
+    verify: bool,
+
+    /// Keep running, reload changed parts of the ROM (and save) on file modification and print debug output
+    #[arg(long, conflicts_with = "delta")]
+    watch: bool,
 }
 
 #[derive(Subcommand)]
@@ -199,6 +229,10 @@ struct _64DDArgs {
     /// Force CIC seed
     #[arg(long, value_parser = |s: &str| maybe_hex::<u8>(s))]
     cic_seed: Option<u8>,
+
+    /// Disable pushing predicted disk blocks to SC64 ahead of 64DD requests
+    #[arg(long)]
+    no_push_ahead: bool,
 }
 
 #[derive(Args)]
@@ -211,6 +245,35 @@ struct DebugArgs {
     #[arg(long, value_name = "offset", value_parser = |s: &str| maybe_hex_range::<u32>(s, 0x00000004, 0x03FF0000))]
     isv: Option<u32>,
 
+    /// Set IS-Viewer64 ring buffer length, software running on the N64 must use the same length
+    #[arg(long, value_name = "length", default_value_t = sc64::ISV_BUFFER_LENGTH, value_parser = |s: &str| maybe_hex_range::<usize>(s, sc64::ISV_BUFFER_LENGTH, sc64::ISV_MAX_BUFFER_LENGTH))]
+    isv_length: usize,
+
+    /// Write data streamed by the N64 through the USB stream ring buffer to a file
+    #[arg(long, value_name = "file")]
+    stream_to: Option<PathBuf>,
+
+    /// Debug packet datatype used by the N64 for stream data
+    #[arg(long, value_name = "datatype", default_value_t = 0x02, requires = "stream_to", value_parser = |s: &str| maybe_hex::<u8>(s))]
+    stream_datatype: u8,
+
+    /// Write frames sent by the N64 (frame datatype) to a file or a named pipe
+    #[arg(long, value_name = "path")]
+    capture: Option<PathBuf>,
+
+    /// Output format of the captured frames
+    #[arg(
+        long,
+        value_name = "format",
+        default_value = "y4m",
+        requires = "capture"
+    )]
+    capture_format: CaptureFormat,
+
+    /// Frame rate of the captured video, missing frames are filled with the previous one
+    #[arg(long, value_name = "fps", default_value_t = 60, requires = "capture", value_parser = |s: &str| maybe_hex_range::<u32>(s, 1, 240))]
+    capture_fps: u32,
+
     /// Use EUC-JP encoding for text printing
     #[arg(long)]
     euc_jp: bool,
@@ -298,11 +361,51 @@ enum SDCommands {
         dst: Option<PathBuf>,
     },
 
+    /// Synchronize a directory on the PC with a directory on the SD card
+    #[command(name = "sync")]
+    Sync {
+        /// Path to the directory on the PC
+        src: PathBuf,
+
+        /// Path to the directory on the SD card
+        dst: PathBuf,
+
+        /// Compare contents of files with equal size (SD card data is read back for checksumming)
+        #[arg(short, long)]
+        checksum: bool,
+
+        /// Only display changes without modifying the SD card
+        #[arg(short = 'n', long)]
+        dry_run: bool,
+    },
+
+    /// Backup or restore an image of the SD card
+    #[command(name = "image")]
+    Image {
+        #[command(subcommand)]
+        command: SDImageCommands,
+    },
+
     /// Format the SD card
     #[command(name = "mkfs")]
     Format,
 }
 
+#[derive(Subcommand)]
+enum SDImageCommands {
+    /// Save allocated areas of the SD card to a sparse image file on the PC
+    Backup {
+        /// Path to the image file
+        path: PathBuf,
+    },
+
+    /// Write allocated areas of an image file on the PC to the SD card
+    Restore {
+        /// Path to the image file
+        path: PathBuf,
+    },
+}
+
 #[derive(Subcommand)]
 enum SetCommands {
     /// Synchronize real time clock (RTC) on the SC64 with local system time
@@ -343,6 +446,111 @@ struct FirmwareUpdateArgs {
     use_flash_memory: bool,
 }
 
+#[derive(Args)]
+struct FleetArgs {
+    /// Use only SC64 device with provided serial number (can be specified multiple times)
+    #[arg(short, long)]
+    serial: Vec<String>,
+
+    #[command(subcommand)]
+    command: FleetCommands,
+}
+
+#[derive(Subcommand)]
+enum FleetCommands {
+    /// Upload ROM (and save) to every SC64
+    Upload(UploadArgs),
+
+    /// Perform operations on the SD card of every SC64
+    SD {
+        #[command(subcommand)]
+        command: FleetSDCommands,
+    },
+
+    /// Print information about every SC64 device
+    Info,
+
+    /// Update persistent settings on every SC64 device
+    Set {
+        #[command(subcommand)]
+        command: SetCommands,
+    },
+
+    /// Update firmware of every SC64 device
+    Firmware {
+        #[command(subcommand)]
+        command: FleetFirmwareCommands,
+    },
+}
+
+#[derive(Subcommand)]
+enum FleetSDCommands {
+    /// Synchronize a directory on the PC with a directory on the SD card
+    #[command(name = "sync")]
+    Sync {
+        /// Path to the directory on the PC
+        src: PathBuf,
+
+        /// Path to the directory on the SD card
+        dst: PathBuf,
+
+        /// Compare contents of files with equal size (SD card data is read back for checksumming)
+        #[arg(short, long)]
+        checksum: bool,
+    },
+}
+
+#[derive(Subcommand)]
+enum FleetFirmwareCommands {
+    /// Update SC64 firmware from provided file
+    Update(FirmwareUpdateArgs),
+}
+
+#[derive(Args)]
+struct BenchArgs {
+    /// Number of measured repetitions of each benchmark
+    #[arg(short = 'n', long, default_value = "5")]
+    repeat: usize,
+
+    /// Number of discarded repetitions performed before measuring
+    #[arg(short, long, default_value = "1")]
+    warmup: usize,
+
+    /// Skip SD card benchmarks
+    #[arg(long)]
+    no_sd: bool,
+
+    /// Benchmark SD card writes (sectors at the start of the card are rewritten with their current contents)
+    #[arg(long, conflicts_with = "no_sd")]
+    sd_write: bool,
+
+    /// Benchmark flash erase and program (flash memory used by ROMs bigger than 64 MiB is rewritten and restored afterwards)
+    #[arg(long)]
+    flash: bool,
+
+    /// Benchmark 64DD block requests (N64 has to run software reading from the disk, served blocks are zero-filled)
+    #[arg(long)]
+    dd: bool,
+
+    /// Write JSON results to the provided file instead of the standard output
+    #[arg(short, long)]
+    output: Option<PathBuf>,
+}
+
+#[derive(Args)]
+struct TraceArgs {
+    /// Path to the output trace JSON file
+    path: PathBuf,
+
+    /// Stop recording after provided number of seconds (records until Ctrl-C when not provided)
+    #[arg(short, long)]
+    duration: Option<u64>,
+
+    /// Delay in milliseconds between reads of the controller trace buffer
+    #[arg(short, long, default_value = "5", value_parser = clap::value_parser!(u64).range(1..=1000))]
+    interval: u64,
+}
+
 #[derive(Args)]
 struct ServerArgs {
     /// Listen on provided address:port
@@ -408,6 +616,23 @@ impl From<TvType> for sc64::TvType {
     }
 }
 
+#[derive(Clone, ValueEnum)]
+enum CaptureFormat {
+    /// YUV4MPEG2 video with 4:4:4 chroma
+    Y4m,
+    /// Raw RGBA 8888 frames without any headers
+    Rgba,
+}
+
+impl From<CaptureFormat> for debug::CaptureFormat {
+    fn from(value: CaptureFormat) -> Self {
+        match value {
+            CaptureFormat::Y4m => Self::Y4m,
+            CaptureFormat::Rgba => Self::Rgba,
+        }
+    }
+}
+
 enum Connection {
     Local(Option<String>),
     Remote(String),
@@ -452,7 +677,10 @@ fn handle_command(command: &Commands, port: Option<String>, remote: Option<Strin
         Commands::Set { command } => handle_set_command(connection, command),
         Commands::Firmware { command } => handle_firmware_command(connection, command),
         Commands::Test => handle_test_command(connection),
+        Commands::Bench(args) => handle_bench_command(connection, args),
+        Commands::Trace(args) => handle_trace_command(connection, args),
         Commands::Server(args) => handle_server_command(connection, args),
+        Commands::Fleet(args) => handle_fleet_command(connection, args),
     };
     match result {
         Ok(()) => {}
@@ -478,6 +706,8 @@ fn handle_list_command() -> Result<(), sc64::Error> {
 }
 
 fn handle_upload_command(connection: Connection, args: &UploadArgs) -> Result<(), sc64::Error> {
+    let delta_cache = get_device_id(&connection).map(|id| delta::Cache::new(&id));
+
     let mut sc64 = init_sc64(connection, true)?;
 
     if args.reboot && !sc64.try_notify_via_aux(sc64::AuxMessage::Halt)? {
@@ -490,10 +720,47 @@ fn handle_upload_command(connection: Connection, args: &UploadArgs) -> Result<()
     sc64.reset_state()?;
 
     let (mut rom_file, rom_name, rom_length) = open_file(&args.rom)?;
-
-    log_wait(format!("Uploading ROM [{rom_name}]"), || {
-        sc64.upload_rom(&mut rom_file, rom_length, args.no_shadow)
-    })?;
+    let mut rom_image = Vec::new();
+
+    if args.delta {
+        let delta_cache = delta_cache?;
+        let previous_checksums = delta_cache.load();
+        delta_cache.clear();
+        let (checksums, uploaded_length) = log_wait(format!("Uploading ROM [{rom_name}]"), || {
+            sc64.upload_rom_delta(
+                &mut rom_file,
+                rom_length,
+                args.no_shadow,
+                &previous_checksums,
+            )
+        })?;
+        println!("Sent [{} kiB] of changed ROM data", uploaded_length / 1024);
+        if args.verify {
+            log_wait(format!("Verifying ROM [{rom_name}]"), || {
+                sc64.verify_rom(&mut rom_file, rom_length, args.no_shadow)
+            })?;
+        }
+        delta_cache.store(&checksums)?;
+    } else {
+        if let Ok(delta_cache) = delta_cache {
+            delta_cache.clear();
+        }
+        if args.watch {
+            let (image, _) = log_wait(format!("Uploading ROM [{rom_name}]"), || {
+                sc64.upload_rom_diff(&mut rom_file, rom_length, args.no_shadow, &[])
+            })?;
+            rom_image = image;
+        } else {
+            log_wait(format!("Uploading ROM [{rom_name}]"), || {
+                sc64.upload_rom(&mut rom_file, rom_length, args.no_shadow)
+            })?;
+        }
+        if args.verify {
+            log_wait(format!("Verifying ROM [{rom_name}]"), || {
+                sc64.verify_rom(&mut rom_file, rom_length, args.no_shadow)
+            })?;
+        }
+    }
 
     let save: SaveType = if let Some(save_type) = args.save_type.clone() {
         save_type
@@ -530,7 +797,24 @@ fn handle_upload_command(connection: Connection, args: &UploadArgs) -> Result<()
         sc64.set_tv_type(tv_type)?;
     }
 
-    let (seed, checksum, matched) = sc64.calculate_cic_parameters(args.cic_seed)?;
+    update_cic_parameters(&mut sc64, args.cic_seed)?;
+
+    if args.reboot && !sc64.try_notify_via_aux(sc64::AuxMessage::Reboot)? {
+        println!(
+            "{}",
+            "Warning: no response for [Reboot] AUX message".bright_yellow()
+        );
+    }
+
+    if args.watch {
+        handle_upload_watch(sc64, args, rom_image)?;
+    }
+
+    Ok(())
+}
+
+fn update_cic_parameters(sc64: &mut sc64::SC64, cic_seed: Option<u8>) -> Result<(), sc64::Error> {
+    let (seed, checksum, matched) = sc64.calculate_cic_parameters(cic_seed)?;
     if !matched {
         println!(
             "{}",
@@ -540,8 +824,115 @@ fn handle_upload_command(connection: Connection, args: &UploadArgs) -> Result<()
         println!("IPL3 has been automatically signed with the parameters listed below:");
         println!("[seed = 0x{seed:02X} | checksum = 0x{checksum:012X}]");
     }
+    Ok(())
+}
 
-    if args.reboot && !sc64.try_notify_via_aux(sc64::AuxMessage::Reboot)? {
+fn handle_upload_watch(
+    mut sc64: sc64::SC64,
+    args: &UploadArgs,
+    mut rom_image: Vec<u8>,
+) -> Result<(), sc64::Error> {
+    const POLL_INTERVAL: Duration = Duration::from_millis(250);
+
+    sc64.acquire_lease(sc64::ServerLease::Stream)?;
+
+    let mut debug_handler = debug::Handler::new();
+    let mut rom_watch = watch::FileWatch::new(&args.rom);
+    let mut save_watch = args.save.as_ref().map(watch::FileWatch::new);
+
+    println!(
+        "{}: Waiting for file changes, press Ctrl-C to exit",
+        "[Watch]".bold()
+    );
+
+    let exit = setup_exit_flag();
+    let mut last_poll = Instant::now();
+    while !exit.load(Ordering::Relaxed) {
+        if last_poll.elapsed() >= POLL_INTERVAL {
+            last_poll = Instant::now();
+            let rom_changed = rom_watch.poll();
+            let save_changed = save_watch.as_mut().is_some_and(|watch| watch.poll());
+            if rom_changed || save_changed {
+                let start = Instant::now();
+                match reload_upload(&mut sc64, args, &mut rom_image, rom_changed, save_changed) {
+                    Ok(()) => println!(
+                        "{}: Reloaded in {:.2}s",
+                        "[Watch]".bold(),
+                        start.elapsed().as_secs_f32()
+                    ),
+                    Err(error) => println!(
+                        "{}: {}",
+                        "[Watch]".bold(),
+                        format!("Reload failed: {error}").bright_red()
+                    ),
+                }
+            }
+        }
+        if let Some(data_packet) = sc64.receive_data_packet()? {
+            match data_packet {
+                sc64::DataPacket::DebugData(debug_packet) => {
+                    debug_handler.handle_debug_packet(debug_packet);
+                }
+                sc64::DataPacket::IsViewer64(message) => {
+                    debug_handler.handle_is_viewer_64(&message);
+                }
+                sc64::DataPacket::DataFlushed => {
+                    debug_handler.handle_data_flushed();
+                }
+                _ => {}
+            }
+        } else if let Some(user_input) = debug_handler.process_user_input() {
+            match user_input {
+                debug::UserInput::Packet(debug_packet) => sc64.send_debug_packet(debug_packet)?,
+                debug::UserInput::EOF => break,
+            }
+        }
+    }
+
+    println!("{}: Stopped", "[Watch]".bold());
+
+    Ok(())
+}
+
+fn reload_upload(
+    sc64: &mut sc64::SC64,
+    args: &UploadArgs,
+    rom_image: &mut Vec<u8>,
+    rom_changed: bool,
+    save_changed: bool,
+) -> Result<(), sc64::Error> {
+    if !sc64.try_notify_via_aux(sc64::AuxMessage::Halt)? {
+        println!(
+            "{}",
+            "Warning: no response for [Halt] AUX message".bright_yellow()
+        );
+    }
+
+    if rom_changed {
+        let (mut rom_file, rom_name, rom_length) = open_file(&args.rom)?;
+        // Device contents are unknown if the transfer gets interrupted, start over next time
+        let previous_image = std::mem::take(rom_image);
+        let (image, uploaded_length) = log_wait(format!("Reloading ROM [{rom_name}]"), || {
+            sc64.upload_rom_diff(&mut rom_file, rom_length, args.no_shadow, &previous_image)
+        })?;
+        *rom_image = image;
+        println!("Sent [{} kiB] of changed ROM data", uploaded_length / 1024);
+        if args.verify {
+            log_wait(format!("Verifying ROM [{rom_name}]"), || {
+                sc64.verify_rom(&mut rom_file, rom_length, args.no_shadow)
+            })?;
+        }
+        update_cic_parameters(sc64, args.cic_seed)?;
+    }
+
+    if let (true, Some(save)) = (save_changed, &args.save) {
+        let (mut save_file, save_name, save_length) = open_file(save)?;
+        log_wait(format!("Reloading save [{save_name}]"), || {
+            sc64.upload_save(&mut save_file, save_length)
+        })?;
+    }
+
+    if !sc64.try_notify_via_aux(sc64::AuxMessage::Reboot)? {
         println!(
             "{}",
             "Warning: no response for [Reboot] AUX message".bright_yellow()
@@ -573,7 +964,12 @@ fn handle_download_command(
 fn handle_64dd_command(connection: Connection, args: &_64DDArgs) -> Result<(), sc64::Error> {
     const MAX_ROM_LENGTH: usize = 32 * 1024 * 1024;
 
+    if let Ok(delta_cache) = get_device_id(&connection).map(|id| delta::Cache::new(&id)) {
+        delta_cache.clear();
+    }
+
     let mut sc64 = init_sc64(connection, true)?;
+    sc64.acquire_lease(sc64::ServerLease::Stream)?;
 
     let mut debug_handler = debug::Handler::new();
 
@@ -719,6 +1115,12 @@ fn handle_64dd_command(connection: Connection, args: &_64DDArgs) -> Result<(), s
         );
     }
 
+    // Older firmware doesn't know about staging, requests then always go through USB
+    let push_ahead = !args.no_push_ahead && sc64.set_64dd_usb_staging(true).is_ok();
+    let mut staging = disk::Staging::new();
+
+    let (log, log_thread) = spawn_disk_logger();
+
     let exit = setup_exit_flag();
     while !exit.load(Ordering::Relaxed) {
         if let Some(data_packet) = sc64.receive_data_packet()? {
@@ -727,57 +1129,95 @@ fn handle_64dd_command(connection: Connection, args: &_64DDArgs) -> Result<(), s
                     let track = disk_packet.info.track;
                     let head = disk_packet.info.head;
                     let block = disk_packet.info.block;
+                    let location = track << 2 | head << 1 | block;
                     if let Some(ref mut disk) = selected_disk {
                         let (reply_packet, rw) = match disk_packet.kind {
-                            sc64::DiskPacketKind::Read => (
-                                disk.read_block(track, head, block)?.map(|data| {
-                                    disk_packet.info.set_data(&data);
-                                    disk_packet
-                                }),
-                                "[R]".bright_blue(),
-                            ),
-                            sc64::DiskPacketKind::Write => (
-                                disk.write_block(track, head, block, &disk_packet.info.data)?
-                                    .map(|_| disk_packet),
-                                "[W]".bright_yellow(),
-                            ),
-                        };
-                        let lba = if let Some(lba) = disk.get_lba(track, head, block) {
-                            format!("{lba}")
-                        } else {
-                            "Invalid".to_string()
+                            sc64::DiskPacketKind::Read => {
+                                // Flashcart waits for the reply, stale slots can't be picked up meanwhile
+                                staging.requested(location);
+                                for slot in staging.stale() {
+                                    sc64.invalidate_64dd_staging_slot(slot)?;
+                                    staging.set(slot, None);
+                                }
+                                (
+                                    disk.read_block(track, head, block)?.map(|data| {
+                                        disk_packet.info.set_data(&data);
+                                        disk_packet
+                                    }),
+                                    "[R]".bright_blue(),
+                                )
+                            }
+                            sc64::DiskPacketKind::Write => {
+                                if let Some(slot) = staging.find(location) {
+                                    sc64.invalidate_64dd_staging_slot(slot)?;
+                                    staging.set(slot, None);
+                                }
+                                (
+                                    disk.write_block(track, head, block, &disk_packet.info.data)?
+                                        .map(|_| disk_packet),
+                                    "[W]".bright_yellow(),
+                                )
+                            }
+                            sc64::DiskPacketKind::Staged => {
+                                // Block was already served from the staging area, nothing to reply with
+                                if let Some(slot) =
+                                    sc64.get_64dd_staging_slot(disk_packet.info.address)
+                                {
+                                    staging.consumed(slot, location);
+                                }
+                                (Some(disk_packet), "[S]".bright_cyan())
+                            }
                         };
-                        let message = format!("{track:4}:{head}:{block} | LBA: {lba}");
-                        if reply_packet.is_some() {
-                            println!("{}: {} {}", "[64DD]".bold(), rw, message.green());
-                        } else {
-                            println!("{}: {} {}", "[64DD]".bold(), rw, message.red());
-                        }
+                        let lba = disk.get_lba(track, head, block);
+                        log.send(DiskLogEntry::Block(
+                            rw,
+                            track,
+                            head,
+                            block,
+                            lba,
+                            reply_packet.is_some(),
+                        ))
+                        .ok();
                         sc64.reply_disk_packet(reply_packet)?;
-                    } else {
+                        if push_ahead {
+                            for (slot, location) in staging.plan() {
+                                let data = disk.read_block(
+                                    location >> 2,
+                                    (location >> 1) & 1,
+                                    location & 1,
+                                )?;
+                                if let Some(data) = data {
+                                    sc64.stage_64dd_block(slot, location, &data)?;
+                                    staging.set(slot, Some(location));
+                                }
+                            }
+                        }
+                    } else if !matches!(disk_packet.kind, sc64::DiskPacketKind::Staged) {
                         sc64.reply_disk_packet(None)?;
                     }
                 }
                 sc64::DataPacket::Button => {
+                    if push_ahead {
+                        sc64.clear_64dd_staging()?;
+                        staging.clear();
+                    }
                     if selected_disk.is_some() {
                         sc64.set_64dd_disk_state(sc64::DdDiskState::Ejected)?;
                         selected_disk = None;
-                        println!(
-                            "{}: Disk ejected [{}]",
-                            "[64DD]".bold(),
-                            disk_names[selected_disk_index].green()
-                        );
+                        log.send(DiskLogEntry::Ejected(
+                            disk_names[selected_disk_index].clone(),
+                        ))
+                        .ok();
                     } else {
                         selected_disk_index += 1;
                         if selected_disk_index >= disks.len() {
                             selected_disk_index = 0;
                         }
                         selected_disk = Some(&mut disks[selected_disk_index]);
-                        println!(
-                            "{}: Disk inserted [{}]",
-                            "[64DD]".bold(),
-                            disk_names[selected_disk_index].bright_green()
-                        );
+                        log.send(DiskLogEntry::Inserted(
+                            disk_names[selected_disk_index].clone(),
+                        ))
+                        .ok();
                         sc64.set_64dd_disk_state(sc64::DdDiskState::Inserted)?;
                     }
                 }
@@ -800,6 +1240,9 @@ fn handle_64dd_command(connection: Connection, args: &_64DDArgs) -> Result<(), s
         }
     }
 
+    drop(log);
+    log_thread.join().ok();
+
     sc64.reset_state()?;
 
     Ok(())
@@ -807,6 +1250,7 @@ fn handle_64dd_command(connection: Connection, args: &_64DDArgs) -> Result<(), s
 
 fn handle_debug_command(connection: Connection, args: &DebugArgs) -> Result<(), sc64::Error> {
     let mut sc64 = init_sc64(connection, true)?;
+    sc64.acquire_lease(sc64::ServerLease::Stream)?;
 
     let mut debug_handler = debug::Handler::new();
 
@@ -814,8 +1258,34 @@ fn handle_debug_command(connection: Connection, args: &DebugArgs) -> Result<(),
         debug_handler.set_text_encoding(debug::Encoding::EUCJP);
     }
 
+    if let Some(path) = &args.stream_to {
+        let (file, name) = create_file(path)?;
+        debug_handler.set_stream_output(file, args.stream_datatype);
+        println!(
+            "{}: Writing datatype [{}] to [{}]",
+            "[Stream]".bold(),
+            format!("0x{:02X}", args.stream_datatype).bright_blue(),
+            name.bright_green()
+        );
+    }
+
+    if let Some(path) = &args.capture {
+        let (file, name) = create_file(path)?;
+        debug_handler.set_capture_output(
+            file,
+            args.capture_format.clone().into(),
+            args.capture_fps,
+        );
+        println!(
+            "{}: Writing frames at [{}] fps to [{}]",
+            "[Capture]".bold(),
+            args.capture_fps,
+            name.bright_green()
+        );
+    }
+
     if args.isv.is_some() {
-        sc64.configure_is_viewer_64(args.isv)?;
+        sc64.configure_is_viewer_64(args.isv, args.isv_length)?;
         println!(
             "{}: Listening on ROM offset [{}]",
             "[IS-Viewer 64]".bold(),
@@ -867,9 +1337,15 @@ fn handle_debug_command(connection: Connection, args: &DebugArgs) -> Result<(),
         sc64.set_save_writeback(false)?;
     }
     if args.isv.is_some() {
-        sc64.configure_is_viewer_64(None)?;
+        sc64.configure_is_viewer_64(None, args.isv_length)?;
         println!("{}: Stopped listening", "[IS-Viewer 64]".bold());
     }
+    if let Some(length) = debug_handler.finish_stream_output() {
+        println!("{}: Wrote [{}] bytes", "[Stream]".bold(), length);
+    }
+    if let Some(summary) = debug_handler.finish_capture_output() {
+        println!("{}: {}", "[Capture]".bold(), summary);
+    }
 
     println!("{}: Stopped", "[Debug]".bold());
 
@@ -894,6 +1370,7 @@ fn handle_dump_command(connection: Connection, args: &DumpArgs) -> Result<(), sc
 
 fn handle_sd_command(connection: Connection, command: &SDCommands) -> Result<(), sc64::Error> {
     let mut sc64 = init_sc64(connection, true)?;
+    sc64.acquire_lease(sc64::ServerLease::Exclusive)?;
 
     match sc64.init_sd_card()? {
         sc64::SdCardResult::OK => {}
@@ -923,6 +1400,13 @@ fn handle_sd_command(connection: Connection, command: &SDCommands) -> Result<(),
 
     sc64.reset_state()?;
 
+    if let SDCommands::Image {
+        command: SDImageCommands::Restore { path },
+    } = command
+    {
+        return handle_sd_image_restore(&mut sc64, path);
+    }
+
     let mut ff = sc64::ff::FatFs::new(sc64)?;
 
     match command {
@@ -1007,27 +1491,61 @@ fn handle_sd_command(connection: Connection, command: &SDCommands) -> Result<(),
                     .map(PathBuf::from)
                     .ok_or(sc64::ff::Error::InvalidParameter)?,
             );
-            let mut src_file = std::fs::File::open(src)?;
-            let mut dst_file = ff.create(dst)?;
-            let mut buffer = vec![0; 128 * 1024];
             log_wait(
                 format!(
                     "Uploading {} to {}",
                     src.to_str().unwrap_or_default().bright_green(),
                     dst.to_str().unwrap_or_default().bright_green()
                 ),
-                || loop {
-                    match src_file.read(&mut buffer)? {
-                        0 => return Ok(()),
-                        bytes => {
-                            if let Err(e) = dst_file.write_all(&buffer[0..bytes]) {
-                                return Err(e);
-                            }
-                        }
-                    }
-                },
+                || sd::upload(&mut ff, src, dst),
+            )?;
+        }
+        SDCommands::Sync {
+            src,
+            dst,
+            checksum,
+            dry_run,
+        } => {
+            let plan = log_wait(
+                format!(
+                    "Comparing {} with {}",
+                    src.to_str().unwrap_or_default().bright_green(),
+                    dst.to_str().unwrap_or_default().bright_green()
+                ),
+                || sd::plan_sync(&mut ff, src, dst, *checksum),
             )?;
+            for action in plan.actions.iter() {
+                if *dry_run {
+                    println!("{action}");
+                } else {
+                    log_wait(format!("{action}"), || {
+                        sd::execute_sync_action(&mut ff, action)
+                    })?;
+                }
+            }
+            println!(
+                "{} {} changes, {} files unchanged",
+                if *dry_run { "Pending" } else { "Applied" },
+                plan.actions.len(),
+                plan.unchanged
+            );
         }
+        SDCommands::Image { command } => match command {
+            SDImageCommands::Backup { path } => {
+                let map = log_wait(format!("Reading SD card allocation map"), || {
+                    ff.allocation_map()
+                })?;
+                log_wait(
+                    format!(
+                        "Saving {:.1} MiB of allocated data to {}",
+                        sd_image_size_mib(map.allocated_sectors()),
+                        path.to_str().unwrap_or_default().bright_green()
+                    ),
+                    || sd::backup_image(&mut ff, &map, path),
+                )?;
+            }
+            SDImageCommands::Restore { path: _ } => unreachable!(),
+        },
         SDCommands::Format => {
             let answer = prompt(format!(
                 "{}",
@@ -1044,42 +1562,98 @@ fn handle_sd_command(connection: Connection, command: &SDCommands) -> Result<(),
     Ok(())
 }
 
+fn handle_sd_image_restore(sc64: &mut sc64::SC64, path: &PathBuf) -> Result<(), sc64::Error> {
+    let result = sd_image_restore(sc64, path);
+    // SD card is left initialized by the caller, release it on every exit path
+    let deinit_result = sc64.deinit_sd_card();
+    result?;
+    deinit_result?;
+    Ok(())
+}
+
+fn sd_image_restore(sc64: &mut sc64::SC64, path: &PathBuf) -> Result<(), sc64::Error> {
+    let map = log_wait(
+        format!(
+            "Reading allocation map of {}",
+            path.to_str().unwrap_or_default().bright_green()
+        ),
+        || sd::image_allocation_map(path),
+    )?;
+
+    if map.sectors > sc64.get_sd_card_info()?.sectors {
+        return Err(sc64::Error::new("Image file is larger than the SD card"));
+    }
+
+    let answer = prompt(format!(
+        "{}",
+        "Do you really want to overwrite the SD card contents? [y/N] ".bold()
+    ));
+    if answer.to_ascii_lowercase() != "y" {
+        println!("{}", "Restore operation aborted".red());
+        return Ok(());
+    }
+
+    log_wait(
+        format!(
+            "Writing {:.1} MiB of allocated data to the SD card",
+            sd_image_size_mib(map.allocated_sectors())
+        ),
+        || sd::restore_image(sc64, &map, path),
+    )?;
+
+    Ok(())
+}
+
+fn sd_image_size_mib(sectors: u64) -> f64 {
+    (sectors * sc64::SD_CARD_SECTOR_SIZE as u64) as f64 / (1024.0 * 1024.0)
+}
+
 fn handle_info_command(connection: Connection) -> Result<(), sc64::Error> {
     let mut sc64 = init_sc64(connection, true)?;
 
+    for line in get_info_lines(&mut sc64)? {
+        println!("{line}");
+    }
+
+    Ok(())
+}
+
+fn get_info_lines(sc64: &mut sc64::SC64) -> Result<Vec<String>, sc64::Error> {
     let (major, minor, revision) = sc64.check_firmware_version()?;
     let state = sc64.get_device_state()?;
 
-    println!("{}", "SummerCart64 state information:".bold());
-    println!(" Firmware version:  v{}.{}.{}", major, minor, revision);
-    println!(" RTC datetime:      {}", state.datetime);
-    println!(" Boot mode:         {}", state.boot_mode);
-    println!(" Save type:         {}", state.save_type);
-    println!(" CIC seed:          {}", state.cic_seed);
-    println!(" TV type:           {}", state.tv_type);
-    println!(" Bootloader switch: {}", state.bootloader_switch);
-    println!(" ROM write:         {}", state.rom_write_enable);
-    println!(" ROM shadow:        {}", state.rom_shadow_enable);
-    println!(" ROM extended:      {}", state.rom_extended_enable);
-    println!(" 64DD mode:         {}", state.dd_mode);
-    println!(" 64DD SD card mode: {}", state.dd_sd_enable);
-    println!(" 64DD drive type:   {}", state.dd_drive_type);
-    println!(" 64DD disk state:   {}", state.dd_disk_state);
-    println!(" Button mode:       {}", state.button_mode);
-    println!(" Button state:      {}", state.button_state);
-    println!(" LED blink:         {}", state.led_enable);
-    println!(" IS-Viewer 64:      {}", state.isviewer);
-    println!(" SD card status:    {}", state.sd_card_status);
-    println!("{}", "SummerCart64 diagnostic information:".bold());
-    println!(" PI I/O access:     {}", state.fpga_debug_data.pi_io_access);
-    println!(
-        " PI FIFO flags:     {}",
-        state.fpga_debug_data.pi_fifo_flags
-    );
-    println!(" Current CIC step:  {}", state.fpga_debug_data.cic_step);
-    println!(" Diagnostic data:   {}", state.diagnostic_data);
-
-    Ok(())
+    Ok(vec![
+        format!("{}", "SummerCart64 state information:".bold()),
+        format!(" Firmware version:  v{}.{}.{}", major, minor, revision),
+        format!(" RTC datetime:      {}", state.datetime),
+        format!(" Boot mode:         {}", state.boot_mode),
+        format!(" Save type:         {}", state.save_type),
+        format!(" CIC seed:          {}", state.cic_seed),
+        format!(" TV type:           {}", state.tv_type),
+        format!(" Bootloader switch: {}", state.bootloader_switch),
+        format!(" ROM write:         {}", state.rom_write_enable),
+        format!(" ROM shadow:        {}", state.rom_shadow_enable),
+        format!(" ROM extended:      {}", state.rom_extended_enable),
+        format!(" 64DD mode:         {}", state.dd_mode),
+        format!(" 64DD SD card mode: {}", state.dd_sd_enable),
+        format!(" 64DD drive type:   {}", state.dd_drive_type),
+        format!(" 64DD disk state:   {}", state.dd_disk_state),
+        format!(" Button mode:       {}", state.button_mode),
+        format!(" Button state:      {}", state.button_state),
+        format!(" LED blink:         {}", state.led_enable),
+        format!(" IS-Viewer 64:      {}", state.isviewer),
+        format!(" SD card status:    {}", state.sd_card_status),
+        format!("{}", "SummerCart64 diagnostic information:".bold()),
+        format!(" PI I/O access:     {}", state.fpga_debug_data.pi_io_access),
+        format!(
+            " PI FIFO flags:     {}",
+            state.fpga_debug_data.pi_fifo_flags
+        ),
+        format!(" Current CIC step:  {}", state.fpga_debug_data.cic_step),
+        format!(" Diagnostic data:   {}", state.diagnostic_data),
+        format!(" USB TX sent:       {}", state.usb_tx_sent_data),
+        format!(" USB TX dropped:    {}", state.usb_tx_dropped_data),
+    ])
 }
 
 fn handle_reset_command(connection: Connection) -> Result<(), sc64::Error> {
@@ -1095,31 +1669,38 @@ fn handle_reset_command(connection: Connection) -> Result<(), sc64::Error> {
 fn handle_set_command(connection: Connection, command: &SetCommands) -> Result<(), sc64::Error> {
     let mut sc64 = init_sc64(connection, true)?;
 
+    println!("{}", apply_setting(&mut sc64, command)?);
+
+    Ok(())
+}
+
+fn apply_setting(sc64: &mut sc64::SC64, command: &SetCommands) -> Result<String, sc64::Error> {
     match command {
         SetCommands::Rtc => {
             let datetime = Local::now().naive_local();
             sc64.set_datetime(datetime)?;
-            println!(
+            Ok(format!(
                 "SC64 RTC datetime synchronized to: {}",
                 datetime.format("%Y-%m-%d %H:%M:%S").to_string().green()
-            );
+            ))
         }
 
         SetCommands::BlinkOn => {
             sc64.set_led_blink(true)?;
-            println!(
+            Ok(format!(
                 "SC64 LED I/O activity blinking set to {}",
                 "enabled".green()
-            );
+            ))
         }
 
         SetCommands::BlinkOff => {
             sc64.set_led_blink(false)?;
-            println!("SC64 LED I/O activity blinking set to {}", "disabled".red());
+            Ok(format!(
+                "SC64 LED I/O activity blinking set to {}",
+                "disabled".red()
+            ))
         }
     }
-
-    Ok(())
 }
 
 fn handle_firmware_command(
@@ -1161,6 +1742,7 @@ fn handle_firmware_command(
 
         FirmwareCommands::Update(args) => {
             let mut sc64 = init_sc64(connection, false)?;
+            sc64.acquire_lease(sc64::ServerLease::Exclusive)?;
 
             let (mut update_file, update_name, update_length) = open_file(&args.firmware)?;
 
@@ -1236,6 +1818,8 @@ fn handle_test_command(connection: Connection) -> Result<(), sc64::Error> {
         (sc64::MemoryTestPattern::Random, None),
         (sc64::MemoryTestPattern::Random, None),
         (sc64::MemoryTestPattern::Random, None),
+        (sc64::MemoryTestPattern::WalkingOnes(false), None),
+        (sc64::MemoryTestPattern::WalkingOnes(true), None),
         (sc64::MemoryTestPattern::Custom(0x00010001), None),
         (sc64::MemoryTestPattern::Custom(0xFFFEFFFE), None),
         (sc64::MemoryTestPattern::Custom(0x00020002), None),
@@ -1294,7 +1878,7 @@ fn handle_test_command(connection: Connection) -> Result<(), sc64::Error> {
             println!("{}", "error!".bright_red());
             println!("  Found a mismatch at address 0x{address:08X}",);
             println!("   0x{written:08X} (W) != 0x{read:08X} (R)");
-            println!("   Total errors found: {}", result.all_errors.len());
+            println!("   Total errors found: {}", result.errors);
         } else {
             println!("{}", "ok".bright_green());
         }
@@ -1312,6 +1896,102 @@ fn handle_test_command(connection: Connection) -> Result<(), sc64::Error> {
     Ok(())
 }
 
+fn handle_bench_command(connection: Connection, args: &BenchArgs) -> Result<(), sc64::Error> {
+    let device_id = get_device_id(&connection).unwrap_or_default();
+
+    // ROM upload benchmark overwrites SDRAM contents
+    delta::Cache::new(&device_id).clear();
+
+    let mut sc64 = init_sc64(connection, true)?;
+
+    let (major, minor, revision) = sc64.check_firmware_version()?;
+
+    sc64.reset_state()?;
+
+    let header = vec![
+        ("device", bench::json_string(&device_id)),
+        (
+            "deployer_version",
+            bench::json_string(env!("CARGO_PKG_VERSION")),
+        ),
+        (
+            "firmware_version",
+            bench::json_string(&format!("{major}.{minor}.{revision}")),
+        ),
+        ("timestamp", bench::json_string(&Local::now().to_rfc3339())),
+    ];
+
+    let options = bench::Options {
+        repeat: args.repeat,
+        warmup: args.warmup,
+        sd: !args.no_sd,
+        sd_write: args.sd_write,
+        flash: args.flash,
+        dd: args.dd,
+    };
+
+    let report = bench::run(&mut sc64, &options, header, |message| {
+        eprintln!("{}: {message}", "[Bench]".bold())
+    })?;
+
+    sc64.reset_state()?;
+
+    if let Some(path) = &args.output {
+        std::fs::write(path, report.to_json())?;
+        eprintln!(
+            "{}: Results written to [{}]",
+            "[Bench]".bold(),
+            path.to_string_lossy().bright_green()
+        );
+    } else {
+        print!("{}", report.to_json());
+    }
+
+    Ok(())
+}
+
+fn handle_trace_command(connection: Connection, args: &TraceArgs) -> Result<(), sc64::Error> {
+    let mut sc64 = init_sc64(connection, true)?;
+
+    let (mut file, name) = create_file(&args.path)?;
+
+    let exit = setup_exit_flag();
+    let duration = args.duration.map(Duration::from_secs);
+    let interval = Duration::from_millis(args.interval);
+    let start = Instant::now();
+
+    println!(
+        "{}: Recording controller trace, press Ctrl-C to stop",
+        "[Trace]".bold()
+    );
+
+    let mut recorder = trace::Recorder::new();
+
+    while !exit.load(Ordering::Relaxed) && duration.map_or(true, |d| start.elapsed() < d) {
+        let data = sc64.read_trace(true)?;
+        let full = data.entries.len() >= trace::READ_MAX_ENTRIES;
+        recorder.push(data);
+        if !full {
+            thread::sleep(interval);
+        }
+    }
+
+    // Last read disables tracing and returns everything recorded until then
+    recorder.push(sc64.read_trace(false)?);
+
+    file.write_all(recorder.to_json().as_bytes())?;
+
+    println!(
+        "{}: Recorded {} events ({} dropped) to [{}]",
+        "[Trace]".bold(),
+        recorder.entries(),
+        recorder.dropped(),
+        name.bright_green()
+    );
+
+    Ok(())
+}
+
 fn handle_server_command(connection: Connection, args: &ServerArgs) -> Result<(), sc64::Error> {
     let port = if let Connection::Local(port) = connection {
         port
@@ -1320,6 +2000,13 @@ fn handle_server_command(connection: Connection, args: &ServerArgs) -> Result<()
     };
 
     sc64::server::run(port, args.address.clone(), |event| match event {
+        sc64::ServerEvent::Device(serial) => {
+            println!(
+                "{}: Exposing device [{}]",
+                "[Server]".bold(),
+                serial.bright_blue()
+            )
+        }
         sc64::ServerEvent::Listening(address) => {
             println!(
                 "{}: Listening on address [{}]",
@@ -1353,6 +2040,391 @@ fn handle_server_command(connection: Connection, args: &ServerArgs) -> Result<()
     Ok(())
 }
 
+struct FleetUpload {
+    rom: Vec<u8>,
+    rom_name: String,
+    save: Option<(Vec<u8>, String)>,
+    save_type: SaveType,
+    cic_parameters: Option<(u8, u64, bool)>,
+}
+
+fn handle_fleet_command(connection: Connection, args: &FleetArgs) -> Result<(), sc64::Error> {
+    if !matches!(connection, Connection::Local(None)) {
+        return Err(sc64::Error::new(
+            "Fleet mode uses all local devices, select them with --serial instead",
+        ));
+    }
+
+    let devices = fleet::find_devices(&args.serial)?;
+    println!(
+        "{}",
+        format!("Running on {} SC64 devices", devices.len()).bold()
+    );
+
+    let reports = match &args.command {
+        FleetCommands::Upload(args) => {
+            if args.watch {
+                return Err(sc64::Error::new(
+                    "Watch mode is not supported in fleet mode",
+                ));
+            }
+            let upload = log_wait(format!("Preparing ROM [{}]", args.rom.display()), || {
+                prepare_fleet_upload(args)
+            })?;
+            fleet::run(
+                devices,
+                |device, log| handle_fleet_upload(device, log, args, &upload),
+                print_fleet_report,
+            )
+        }
+
+        FleetCommands::SD { command } => match command {
+            FleetSDCommands::Sync { src, dst, checksum } => fleet::run(
+                devices,
+                |device, log| handle_fleet_sd_sync(device, log, src, dst, *checksum),
+                print_fleet_report,
+            ),
+        },
+
+        FleetCommands::Info => fleet::run(
+            devices,
+            |device, log| {
+                let mut sc64 = init_sc64(Connection::Local(Some(device.port.clone())), true)?;
+                for line in get_info_lines(&mut sc64)? {
+                    log.println(line);
+                }
+                Ok(())
+            },
+            print_fleet_report,
+        ),
+
+        FleetCommands::Set { command } => fleet::run(
+            devices,
+            |device, log| {
+                let mut sc64 = init_sc64(Connection::Local(Some(device.port.clone())), true)?;
+                log.println(apply_setting(&mut sc64, command)?);
+                Ok(())
+            },
+            print_fleet_report,
+        ),
+
+        FleetCommands::Firmware { command } => match command {
+            FleetFirmwareCommands::Update(args) => {
+                let (mut update_file, update_name, update_length) = open_file(&args.firmware)?;
+
+                let mut firmware = vec![0u8; update_length as usize];
+                update_file.read_exact(&mut firmware)?;
+
+                let metadata = sc64::firmware::verify(&firmware)?;
+                println!("{}", "Firmware metadata:".bold());
+                println!("{}", format!("{}", metadata).bright_blue().to_string());
+                println!("{}", "Firmware file verification was successful".green());
+                if args.use_flash_memory {
+                    println!(
+                        "{}",
+                        "Warning: using Flash memory to perform firmware update".yellow()
+                    );
+                }
+                let answer = prompt(format!(
+                    "{}",
+                    format!(
+                        "Continue with update process on {} devices? [y/N] ",
+                        devices.len()
+                    )
+                    .bold()
+                ));
+                if answer.to_ascii_lowercase() != "y" {
+                    println!("{}", "Firmware update process aborted".red());
+                    return Ok(());
+                }
+                println!(
+                    "{}",
+                    "Do not unplug any SC64 from the computer, doing so might brick your device"
+                        .yellow()
+                );
+
+                fleet::run(
+                    devices,
+                    |device, log| {
+                        let mut sc64 =
+                            init_sc64(Connection::Local(Some(device.port.clone())), false)?;
+                        log.log_wait(format!("Updating firmware [{update_name}]"), || {
+                            sc64.update_firmware(&firmware, args.use_flash_memory)
+                        })
+                    },
+                    print_fleet_report,
+                )
+            }
+        },
+    };
+
+    let failed: Vec<&fleet::Report> = reports.iter().filter(|r| r.result.is_err()).collect();
+
+    println!("{}", "Fleet summary:".bold());
+    println!(
+        " {} succeeded, {} failed",
+        (reports.len() - failed.len()).to_string().bright_green(),
+        failed.len().to_string().bright_red()
+    );
+    for report in failed.iter() {
+        if let Err(error) = &report.result {
+            println!(
+                " [{}] at port [{}]: {}",
+                report.device.serial.bold(),
+                report.device.port.bold(),
+                error.to_string().bright_red()
+            );
+        }
+    }
+
+    if failed.len() > 0 {
+        return Err(sc64::Error::new(
+            format!("Command failed on {} devices", failed.len()).as_str(),
+        ));
+    }
+
+    Ok(())
+}
+
+fn prepare_fleet_upload(args: &UploadArgs) -> Result<FleetUpload, sc64::Error> {
+    let (mut rom_file, rom_name, rom_length) = open_file(&args.rom)?;
+    let mut rom = vec![0u8; rom_length];
+    rom_file.read_exact(&mut rom)?;
+    n64::convert_to_big_endian(&mut rom);
+
+    let save_type = if let Some(save_type) = args.save_type.clone() {
+        save_type
+    } else {
+        let (save_type, _) = n64::guess_save_type(&mut Cursor::new(&rom))?;
+        save_type.into()
+    };
+
+    let save = if let Some(path) = &args.save {
+        let (mut save_file, save_name, save_length) = open_file(path)?;
+        let mut save = vec![0u8; save_length];
+        save_file.read_exact(&mut save)?;
+        Some((save, save_name))
+    } else {
+        None
+    };
+
+    // In direct boot mode IPL3 comes from the ROM itself, sign it once for every device
+    let cic_parameters = if args.direct {
+        Some(sc64::sign_rom_ipl3(&rom, args.cic_seed)?)
+    } else {
+        None
+    };
+
+    Ok(FleetUpload {
+        rom,
+        rom_name,
+        save,
+        save_type,
+        cic_parameters,
+    })
+}
+
+fn handle_fleet_upload(
+    device: &fleet::Device,
+    log: &mut fleet::Log,
+    args: &UploadArgs,
+    upload: &FleetUpload,
+) -> Result<(), sc64::Error> {
+    let mut sc64 = init_sc64(Connection::Local(Some(device.port.clone())), true)?;
+
+    if args.reboot && !sc64.try_notify_via_aux(sc64::AuxMessage::Halt)? {
+        log.println(format!(
+            "{}",
+            "Warning: no response for [Halt] AUX message".bright_yellow()
+        ));
+    }
+
+    sc64.reset_state()?;
+
+    let delta_cache = delta::Cache::new(&device.serial);
+    let previous_checksums = delta_cache.load();
+    delta_cache.clear();
+
+    if args.delta {
+        let (checksums, uploaded_length) =
+            log.log_wait(format!("Uploading ROM [{}]", upload.rom_name), || {
+                sc64.upload_rom_delta(
+                    &mut Cursor::new(&upload.rom),
+                    upload.rom.len(),
+                    args.no_shadow,
+                    &previous_checksums,
+                )
+            })?;
+        log.println(format!(
+            "Sent [{} kiB] of changed ROM data",
+            uploaded_length / 1024
+        ));
+        if args.verify {
+            log.log_wait(format!("Verifying ROM [{}]", upload.rom_name), || {
+                sc64.verify_rom(
+                    &mut Cursor::new(&upload.rom),
+                    upload.rom.len(),
+                    args.no_shadow,
+                )
+            })?;
+        }
+        delta_cache.store(&checksums)?;
+    } else {
+        log.log_wait(format!("Uploading ROM [{}]", upload.rom_name), || {
+            sc64.upload_rom(
+                &mut Cursor::new(&upload.rom),
+                upload.rom.len(),
+                args.no_shadow,
+            )
+        })?;
+        if args.verify {
+            log.log_wait(format!("Verifying ROM [{}]", upload.rom_name), || {
+                sc64.verify_rom(
+                    &mut Cursor::new(&upload.rom),
+                    upload.rom.len(),
+                    args.no_shadow,
+                )
+            })?;
+        }
+    }
+
+    let save_type: sc64::SaveType = upload.save_type.clone().into();
+    log.println(format!("Save type set to [{save_type}]"));
+    sc64.set_save_type(save_type)?;
+
+    if let Some((save, save_name)) = &upload.save {
+        log.log_wait(format!("Uploading save [{save_name}]"), || {
+            sc64.upload_save(&mut Cursor::new(save), save.len())
+        })?;
+    }
+
+    let boot_mode = if args.direct {
+        sc64::BootMode::DirectRom
+    } else {
+        sc64::BootMode::Rom
+    };
+    log.println(format!("Boot mode set to [{boot_mode}]"));
+    sc64.set_boot_mode(boot_mode)?;
+
+    if let Some(tv) = args.tv.clone() {
+        let tv_type: sc64::TvType = tv.into();
+        log.println(format!("TV type set to [{tv_type}]"));
+        sc64.set_tv_type(tv_type)?;
+    }
+
+    let (seed, checksum, matched) = if let Some((seed, checksum, matched)) = upload.cic_parameters {
+        sc64.set_cic_parameters(seed, checksum)?;
+        (seed, checksum, matched)
+    } else {
+        sc64.calculate_cic_parameters(args.cic_seed)?
+    };
+    if !matched {
+        log.println(format!(
+            "{}",
+            "Warning: IPL3 in the ROM does not match any known variant. It may fail to boot."
+                .bright_yellow(),
+        ));
+        log.println(format!(
+            "IPL3 has been automatically signed with [seed = 0x{seed:02X} | checksum = 0x{checksum:012X}]"
+        ));
+    }
+
+    if args.reboot && !sc64.try_notify_via_aux(sc64::AuxMessage::Reboot)? {
+        log.println(format!(
+            "{}",
+            "Warning: no response for [Reboot] AUX message".bright_yellow()
+        ));
+    }
+
+    Ok(())
+}
+
+fn handle_fleet_sd_sync(
+    device: &fleet::Device,
+    log: &mut fleet::Log,
+    src: &PathBuf,
+    dst: &PathBuf,
+    checksum: bool,
+) -> Result<(), sc64::Error> {
+    let mut sc64 = init_sc64(Connection::Local(Some(device.port.clone())), true)?;
+
+    match sc64.init_sd_card()? {
+        sc64::SdCardResult::OK => {}
+        error => {
+            return Err(sc64::Error::new(
+                format!("Couldn't init the SD card: {error}").as_str(),
+            ))
+        }
+    }
+
+    if sc64.is_console_powered_on()? {
+        sc64.deinit_sd_card()?;
+        return Err(sc64::Error::new(
+            "The console is powered on, SD card access skipped to avoid data corruption",
+        ));
+    }
+
+    sc64.reset_state()?;
+
+    let mut ff = sc64::ff::FatFs::new(sc64)?;
+
+    let plan = log.log_wait(
+        format!(
+            "Comparing {} with {}",
+            src.to_str().unwrap_or_default().bright_green(),
+            dst.to_str().unwrap_or_default().bright_green()
+        ),
+        || sd::plan_sync(&mut ff, src, dst, checksum),
+    )?;
+    for action in plan.actions.iter() {
+        log.log_wait(format!("{action}"), || {
+            sd::execute_sync_action(&mut ff, action)
+        })?;
+    }
+    log.println(format!(
+        "Applied {} changes, {} files unchanged",
+        plan.actions.len(),
+        plan.unchanged
+    ));
+
+    Ok(())
+}
+
+fn print_fleet_report(report: &fleet::Report) {
+    let status = if report.result.is_ok() {
+        "done".bold().bright_green()
+    } else {
+        "error!".bold().bright_red()
+    };
+    println!(
+        "{}: [{}] at port [{}] {status} ({:.1} s)",
+        "[Fleet]".bold(),
+        report.device.serial.bold(),
+        report.device.port.bold(),
+        report.elapsed.as_secs_f32()
+    );
+    for line in report.lines.iter() {
+        println!(" {line}");
+    }
+    if let Err(error) = &report.result {
+        println!(" {}", error.to_string().bright_red());
+    }
+}
+
+fn get_device_id(connection: &Connection) -> Result<String, sc64::Error> {
+    Ok(match connection {
+        Connection::Local(port) => match port {
+            Some(port) => sc64::list_local_devices()
+                .unwrap_or_default()
+                .into_iter()
+                .find(|device| &device.port == port)
+                .map_or(port.clone(), |device| device.serial),
+            None => sc64::list_local_devices()?[0].serial.clone(),
+        },
+        Connection::Remote(remote) => remote.clone(),
+    })
+}
+
 fn init_sc64(connection: Connection, check_firmware: bool) -> Result<sc64::SC64, sc64::Error> {
     let mut sc64 = match connection {
         Connection::Local(port) => sc64::SC64::open_local(port),
@@ -1399,6 +2471,47 @@ fn create_file(path: &PathBuf) -> Result<(File, String), sc64::Error> {
     Ok((file, name))
 }
 
+enum DiskLogEntry {
+    Block(ColoredString, u32, u32, u32, Option<usize>, bool),
+    Inserted(String),
+    Ejected(String),
+}
+
+fn spawn_disk_logger() -> (Sender<DiskLogEntry>, JoinHandle<()>) {
+    // Printing every block can stall the request loop on slow terminals, keep it on its own thread
+    let (sender, receiver) = channel::<DiskLogEntry>();
+    let thread = thread::spawn(move || {
+        for entry in receiver {
+            match entry {
+                DiskLogEntry::Block(rw, track, head, block, lba, ok) => {
+                    let lba = if let Some(lba) = lba {
+                        format!("{lba}")
+                    } else {
+                        "Invalid".to_string()
+                    };
+                    let message = format!("{track:4}:{head}:{block} | LBA: {lba}");
+                    if ok {
+                        println!("{}: {} {}", "[64DD]".bold(), rw, message.green());
+                    } else {
+                        println!("{}: {} {}", "[64DD]".bold(), rw, message.red());
+                    }
+                }
+                DiskLogEntry::Inserted(name) => {
+                    println!(
+                        "{}: Disk inserted [{}]",
+                        "[64DD]".bold(),
+                        name.bright_green()
+                    );
+                }
+                DiskLogEntry::Ejected(name) => {
+                    println!("{}: Disk ejected [{}]", "[64DD]".bold(), name.green());
+                }
+            }
+        }
+    });
+    (sender, thread)
+}
+
 fn setup_exit_flag() -> Arc<AtomicBool> {
     let exit_flag = Arc::new(AtomicBool::new(false));
     let handler_exit_flag = exit_flag.clone();
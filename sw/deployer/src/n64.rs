@@ -86,3 +86,14 @@ pub fn guess_save_type<T: Read + Seek>(
 
     Ok((SaveType::None, None))
 }
+
+pub fn convert_to_big_endian(rom: &mut [u8]) {
+    match rom.get(0..4) {
+        Some([0x37, 0x80, 0x40, 0x12]) => rom.chunks_exact_mut(2).for_each(|c| c.swap(0, 1)),
+        Some([0x40, 0x12, 0x37, 0x80]) => rom.chunks_exact_mut(4).for_each(|c| {
+            c.swap(0, 3);
+            c.swap(1, 2)
+        }),
+        _ => {}
+    }
+}
@@ -0,0 +1,667 @@
+use super::{
+    time::{convert_from_datetime, convert_to_datetime},
+    walking_ones_word, SUPPORTED_MAJOR_VERSION, SUPPORTED_MINOR_VERSION,
+};
+use chrono::{Local, NaiveDateTime, TimeDelta};
+use std::{
+    collections::VecDeque,
+    fs::{File, OpenOptions},
+    io::{Read, Seek, SeekFrom, Write},
+    time::{Duration, Instant},
+};
+
+const IDENTIFIER: &[u8; 4] = b"SCv2";
+const REVISION: u32 = 0;
+
+const SDRAM_LENGTH: usize = 64 * 1024 * 1024;
+const FLASH_ADDRESS: usize = 0x0400_0000;
+const FLASH_LENGTH: usize = 16 * 1024 * 1024;
+const FLASH_ERASE_BLOCK_SIZE: usize = 64 * 1024;
+const BOOTLOADER_ADDRESS: usize = 0x04E0_0000;
+const BOOTLOADER_LENGTH: usize = 1920 * 1024;
+const CHECKSUM_BUFFER_ADDRESS: usize = 0x0500_2900;
+const CHECKSUM_BUFFER_LENGTH: usize = 256;
+const MEMORY_LENGTH: usize = 0x0500_2C80;
+
+const CONFIG_COUNT: usize = 15;
+const CONFIG_DD_MODE: usize = 3;
+const CONFIG_CIC_SEED: usize = 7;
+const CONFIG_DD_DISK_STATE: usize = 11;
+const CIC_SEED_AUTO: u32 = 0xFFFF;
+const SETTING_COUNT: usize = 1;
+
+const SD_SECTOR_SIZE: usize = 512;
+const SD_MAX_SECTOR_COUNT: u32 = 0x80_0000;
+const SD_CARD_INFO_LENGTH: usize = 32;
+
+const SD_OK: u32 = 0;
+const SD_ERROR_NO_CARD_IN_SLOT: u32 = 1;
+const SD_ERROR_NOT_INITIALIZED: u32 = 2;
+const SD_ERROR_INVALID_ARGUMENT: u32 = 3;
+const SD_ERROR_INVALID_ADDRESS: u32 = 4;
+const SD_ERROR_INVALID_OPERATION: u32 = 5;
+const SD_ERROR_CMD18_IO: u32 = 20;
+const SD_ERROR_CMD25_IO: u32 = 23;
+
+const MEMORY_TEST_MODE_OWN_ADDRESS: u32 = 1;
+const MEMORY_TEST_MODE_RANDOM: u32 = 2;
+const MEMORY_TEST_MODE_WALKING_ONES: u32 = 3;
+
+const DD_BLOCK_BUFFER_ADDRESS: u32 = 0x03BB_B000;
+const DD_LOCATION_COUNT: u32 = 1175 << 2;
+const DD_REQUEST_READ: u32 = 1;
+
+const HEADER_LENGTH: usize = 12;
+const POLL_TIMEOUT: Duration = Duration::from_millis(5);
+
+// Software model of the SC64 as seen from the USB side, used for testing and benchmarking
+// the deployer without hardware. N64 side of the cartridge is not emulated, apart from
+// an optional 64DD driver reading consecutive disk blocks.
+pub struct EmulatedDevice {
+    memory: Vec<u8>,
+    config: [u32; CONFIG_COUNT],
+    settings: [u32; SETTING_COUNT],
+    time_offset: TimeDelta,
+    sd_card: Option<File>,
+    sd_card_sectors: u64,
+    sd_card_initialized: bool,
+    sd_card_byte_swap: bool,
+    latency: Duration,
+    bandwidth: Option<f64>,
+    busy_until: Instant,
+    dd_request_period: Option<Duration>,
+    dd_request_pending: bool,
+    dd_location: u32,
+    input: Vec<u8>,
+    output: VecDeque<(Instant, Vec<u8>)>,
+    output_position: usize,
+    dtr: bool,
+}
+
+impl EmulatedDevice {
+    // Options are provided as comma separated list of key=value pairs:
+    //  sd=<path>           - file used as the SD card image
+    //  latency=<us>        - time added to every command round-trip
+    //  bandwidth=<MiB/s>   - transfer speed of the link in both directions
+    //  dd=<us>             - N64 requests next 64DD block this long after the previous one was served
+    pub fn open(options: &str) -> std::io::Result<Self> {
+        let mut device = Self {
+            memory: vec![0u8; MEMORY_LENGTH],
+            config: Self::default_config(),
+            settings: [0; SETTING_COUNT],
+            time_offset: TimeDelta::zero(),
+            sd_card: None,
+            sd_card_sectors: 0,
+            sd_card_initialized: false,
+            sd_card_byte_swap: false,
+            latency: Duration::ZERO,
+            bandwidth: None,
+            busy_until: Instant::now(),
+            dd_request_period: None,
+            dd_request_pending: false,
+            dd_location: 0,
+            input: Vec::new(),
+            output: VecDeque::new(),
+            output_position: 0,
+            dtr: false,
+        };
+
+        device.memory[FLASH_ADDRESS..(FLASH_ADDRESS + FLASH_LENGTH)].fill(0xFF);
+
+        for option in options.split(',').filter(|option| !option.is_empty()) {
+            let invalid_option = || {
+                std::io::Error::new(
+                    std::io::ErrorKind::InvalidInput,
+                    format!("Invalid emulator option: {option}"),
+                )
+            };
+            match option.split_once('=') {
+                Some(("sd", path)) => {
+                    let file = OpenOptions::new().read(true).write(true).open(path)?;
+                    device.sd_card_sectors = file.metadata()?.len() / SD_SECTOR_SIZE as u64;
+                    device.sd_card = Some(file);
+                }
+                Some(("latency", value)) => {
+                    let latency: u64 = value.parse().map_err(|_| invalid_option())?;
+                    device.latency = Duration::from_micros(latency);
+                }
+                Some(("bandwidth", value)) => {
+                    let bandwidth: f64 = value.parse().map_err(|_| invalid_option())?;
+                    if bandwidth <= 0.0 {
+                        return Err(invalid_option());
+                    }
+                    device.bandwidth = Some(bandwidth * 1024.0 * 1024.0);
+                }
+                Some(("dd", value)) => {
+                    let period: u64 = value.parse().map_err(|_| invalid_option())?;
+                    device.dd_request_period = Some(Duration::from_micros(period));
+                }
+                _ => return Err(invalid_option()),
+            }
+        }
+
+        Ok(device)
+    }
+
+    fn default_config() -> [u32; CONFIG_COUNT] {
+        let mut config = [0; CONFIG_COUNT];
+        config[CONFIG_CIC_SEED] = CIC_SEED_AUTO;
+        config
+    }
+
+    pub fn read(&mut self, buffer: &mut [u8]) -> std::io::Result<usize> {
+        let Some((ready, data)) = self.output.front() else {
+            std::thread::sleep(POLL_TIMEOUT);
+            return Err(std::io::ErrorKind::TimedOut.into());
+        };
+
+        let now = Instant::now();
+        if *ready > now {
+            std::thread::sleep(POLL_TIMEOUT.min(*ready - now));
+            if *ready > Instant::now() {
+                return Err(std::io::ErrorKind::TimedOut.into());
+            }
+        }
+
+        let length = buffer.len().min(data.len() - self.output_position);
+        buffer[..length]
+            .copy_from_slice(&data[self.output_position..(self.output_position + length)]);
+        self.output_position += length;
+        if self.output_position == data.len() {
+            self.output.pop_front();
+            self.output_position = 0;
+        }
+
+        Ok(length)
+    }
+
+    pub fn write_all(&mut self, buffer: &[u8]) -> std::io::Result<()> {
+        self.input.extend_from_slice(buffer);
+        while let Some(length) = self.get_command_length()? {
+            let command: Vec<u8> = self.input.drain(..length).collect();
+            self.execute_command(&command);
+        }
+        Ok(())
+    }
+
+    pub fn flush(&mut self) -> std::io::Result<()> {
+        Ok(())
+    }
+
+    pub fn discard_input(&mut self) -> std::io::Result<()> {
+        self.output.clear();
+        self.output_position = 0;
+        Ok(())
+    }
+
+    pub fn discard_output(&mut self) -> std::io::Result<()> {
+        self.input.clear();
+        Ok(())
+    }
+
+    pub fn set_dtr(&mut self, value: bool) -> std::io::Result<()> {
+        if value {
+            self.input.clear();
+            self.output.clear();
+            self.output_position = 0;
+            self.busy_until = Instant::now();
+        }
+        self.dtr = value;
+        Ok(())
+    }
+
+    pub fn read_dsr(&mut self) -> std::io::Result<bool> {
+        Ok(self.dtr)
+    }
+
+    fn get_command_length(&self) -> std::io::Result<Option<usize>> {
+        if self.input.len() < HEADER_LENGTH {
+            return Ok(None);
+        }
+        if &self.input[0..3] != b"CMD" {
+            return Err(std::io::ErrorKind::InvalidData.into());
+        }
+        let arg1 = u32::from_be_bytes(self.input[8..12].try_into().unwrap()) as usize;
+        let data_length = match self.input[3] {
+            b'M' | b'U' => arg1,
+            b'K' | b'l' | b's' | b'S' => 4,
+            b'Q' => 8,
+            _ => 0,
+        };
+        let length = HEADER_LENGTH + data_length;
+        Ok((self.input.len() >= length).then_some(length))
+    }
+
+    fn execute_command(&mut self, command: &[u8]) {
+        let id = command[3];
+        let args = [
+            u32::from_be_bytes(command[4..8].try_into().unwrap()),
+            u32::from_be_bytes(command[8..12].try_into().unwrap()),
+        ];
+        let data = &command[HEADER_LENGTH..];
+
+        let response = self.process_command(id, args, data);
+
+        let mut packet = Vec::new();
+        if let Some((error, data)) = &response {
+            packet.extend_from_slice(if *error { b"ERR" } else { b"CMP" });
+            packet.push(id);
+            packet.extend_from_slice(&(data.len() as u32).to_be_bytes());
+            packet.extend_from_slice(data);
+        }
+
+        // Responses are delivered in order, each one after the link transferred both
+        // the command and the response and the configured latency has passed
+        let mut cost = self.latency;
+        if let Some(bandwidth) = self.bandwidth {
+            cost += Duration::from_secs_f64((command.len() + packet.len()) as f64 / bandwidth);
+        }
+        let ready = self.busy_until.max(Instant::now()) + cost;
+        self.busy_until = ready;
+
+        if response.is_some() {
+            self.output.push_back((ready, packet));
+        }
+
+        self.process_dd_request(id, ready);
+    }
+
+    fn process_dd_request(&mut self, id: u8, ready: Instant) {
+        let Some(period) = self.dd_request_period else {
+            return;
+        };
+
+        if (id == b'D') && self.dd_request_pending {
+            self.dd_request_pending = false;
+            self.dd_location = (self.dd_location + 1) % DD_LOCATION_COUNT;
+        }
+
+        let disk_inserted =
+            (self.config[CONFIG_DD_MODE] != 0) && (self.config[CONFIG_DD_DISK_STATE] != 0);
+        if !disk_inserted {
+            self.dd_request_pending = false;
+            return;
+        }
+
+        if !self.dd_request_pending {
+            self.dd_request_pending = true;
+            let data = [DD_REQUEST_READ, DD_BLOCK_BUFFER_ADDRESS, self.dd_location];
+            let mut packet = Vec::new();
+            packet.extend_from_slice(b"PKT");
+            packet.push(b'D');
+            packet.extend_from_slice(&((data.len() * 4) as u32).to_be_bytes());
+            packet.extend(data.iter().flat_map(|word| word.to_be_bytes()));
+            self.output.push_back((ready + period, packet));
+        }
+    }
+
+    fn process_command(&mut self, id: u8, args: [u32; 2], data: &[u8]) -> Option<(bool, Vec<u8>)> {
+        let ok = |data: Vec<u8>| Some((false, data));
+        let error = || Some((true, vec![]));
+        let words = |words: &[u32]| {
+            words
+                .iter()
+                .flat_map(|w| w.to_be_bytes())
+                .collect::<Vec<u8>>()
+        };
+
+        let address = args[0] as usize;
+        let length = args[1] as usize;
+
+        match id {
+            b'v' => ok(IDENTIFIER.to_vec()),
+
+            b'V' => {
+                let version =
+                    ((SUPPORTED_MAJOR_VERSION as u32) << 16) | (SUPPORTED_MINOR_VERSION as u32);
+                ok(words(&[version, REVISION]))
+            }
+
+            b'R' => {
+                self.config = Self::default_config();
+                ok(vec![])
+            }
+
+            b'B' | b'X' | b'D' | b'W' => ok(vec![]),
+
+            b'c' => match self.config.get(address) {
+                Some(value) => ok(words(&[*value])),
+                None => error(),
+            },
+
+            b'C' => match self.config.get_mut(address) {
+                Some(value) => {
+                    *value = args[1];
+                    ok(vec![])
+                }
+                None => error(),
+            },
+
+            b'a' => match self.settings.get(address) {
+                Some(value) => ok(words(&[*value])),
+                None => error(),
+            },
+
+            b'A' => match self.settings.get_mut(address) {
+                Some(value) => {
+                    *value = args[1];
+                    ok(vec![])
+                }
+                None => error(),
+            },
+
+            b't' => ok(words(&convert_from_datetime(self.get_datetime()))),
+
+            b'T' => match convert_to_datetime(&words(&args).try_into().unwrap()) {
+                Ok(datetime) => {
+                    self.time_offset = datetime - Local::now().naive_local();
+                    ok(vec![])
+                }
+                Err(_) => error(),
+            },
+
+            b'm' => {
+                if Self::validate_address_length(address, length, false) {
+                    return error();
+                }
+                ok(self.memory[address..(address + length)].to_vec())
+            }
+
+            b'M' => {
+                if Self::validate_address_length(address, length, true) {
+                    return error();
+                }
+                self.write_memory(address, data);
+                ok(vec![])
+            }
+
+            b'k' => {
+                if Self::validate_address_length(address, length, false) {
+                    return error();
+                }
+                ok(words(&[crc32fast::hash(
+                    &self.memory[address..(address + length)],
+                )]))
+            }
+
+            b'K' => {
+                let chunk_length = u32::from_be_bytes(data[0..4].try_into().unwrap()) as usize;
+                if Self::validate_address_length(address, length, false) || (chunk_length == 0) {
+                    return error();
+                }
+                let checksums: Vec<u32> = self.memory[address..(address + length)]
+                    .chunks(chunk_length)
+                    .map(crc32fast::hash)
+                    .collect();
+                let checksums = words(&checksums);
+                if checksums.len() > CHECKSUM_BUFFER_LENGTH {
+                    return error();
+                }
+                self.memory[CHECKSUM_BUFFER_ADDRESS..(CHECKSUM_BUFFER_ADDRESS + checksums.len())]
+                    .copy_from_slice(&checksums);
+                ok(checksums)
+            }
+
+            b'l' => {
+                if Self::validate_address_length(address, length, true)
+                    || (address % 4 != 0)
+                    || (length % 4 != 0)
+                {
+                    return error();
+                }
+                let pattern: Vec<u8> = data[0..4].repeat(length / 4);
+                self.write_memory(address, &pattern);
+                ok(vec![])
+            }
+
+            b'Q' => {
+                let mode = u32::from_be_bytes(data[0..4].try_into().unwrap());
+                let seed = u32::from_be_bytes(data[4..8].try_into().unwrap());
+                if (length == 0)
+                    || ((address + length) > SDRAM_LENGTH)
+                    || (address % 4 != 0)
+                    || (length % 4 != 0)
+                    || ((mode >> 8) > MEMORY_TEST_MODE_WALKING_ONES)
+                {
+                    return error();
+                }
+                ok(words(&self.memory_test(address, length, mode, seed)))
+            }
+
+            b'U' => None,
+
+            b'i' => {
+                let result = self.sd_card_operation(address, args[1]);
+                Some((result != SD_OK, words(&[result, self.get_sd_card_status()])))
+            }
+
+            b's' | b'S' => {
+                let sector = u32::from_be_bytes(data[0..4].try_into().unwrap()) as u64;
+                let result = if args[1] >= SD_MAX_SECTOR_COUNT {
+                    SD_ERROR_INVALID_ARGUMENT
+                } else if Self::validate_address_length(address, length * SD_SECTOR_SIZE, true) {
+                    SD_ERROR_INVALID_ADDRESS
+                } else if !self.sd_card_initialized {
+                    SD_ERROR_NOT_INITIALIZED
+                } else if id == b's' {
+                    self.sd_card_read(address, sector, length)
+                } else {
+                    self.sd_card_write(address, sector, length)
+                };
+                Some((result != SD_OK, words(&[result])))
+            }
+
+            b'p' => {
+                if args[1] != 0 {
+                    ok(words(&[FLASH_ERASE_BLOCK_SIZE as u32, 0]))
+                } else {
+                    ok(words(&[FLASH_ERASE_BLOCK_SIZE as u32]))
+                }
+            }
+
+            b'P' => {
+                if Self::validate_address_length(address, FLASH_ERASE_BLOCK_SIZE, true)
+                    || !self.flash_erase(address, FLASH_ERASE_BLOCK_SIZE)
+                {
+                    return error();
+                }
+                ok(vec![])
+            }
+
+            b'E' => {
+                if Self::validate_address_length(address, length, true)
+                    || !self.flash_erase(address, length)
+                {
+                    return error();
+                }
+                ok(vec![])
+            }
+
+            b'?' => ok(vec![0; 8]),
+
+            b'%' => ok(vec![0; 16]),
+
+            _ => error(),
+        }
+    }
+
+    fn validate_address_length(address: usize, length: usize, exclude_bootloader: bool) -> bool {
+        if (length == 0) || (address >= MEMORY_LENGTH) || (length > (MEMORY_LENGTH - address)) {
+            return true;
+        }
+        if exclude_bootloader
+            && ((address + length) > BOOTLOADER_ADDRESS)
+            && (address < (BOOTLOADER_ADDRESS + BOOTLOADER_LENGTH))
+        {
+            return true;
+        }
+        false
+    }
+
+    fn write_memory(&mut self, address: usize, data: &[u8]) {
+        let flash = FLASH_ADDRESS..(FLASH_ADDRESS + FLASH_LENGTH);
+        for (offset, value) in data.iter().enumerate() {
+            let byte = &mut self.memory[address + offset];
+            // Programming flash can only clear bits, erase is required to set them back
+            if flash.contains(&(address + offset)) {
+                *byte &= *value;
+            } else {
+                *byte = *value;
+            }
+        }
+    }
+
+    fn flash_erase(&mut self, address: usize, length: usize) -> bool {
+        if (address < FLASH_ADDRESS) || ((address + length) > (FLASH_ADDRESS + FLASH_LENGTH)) {
+            return false;
+        }
+        let start = address - (address % FLASH_ERASE_BLOCK_SIZE);
+        let end = (address + length).next_multiple_of(FLASH_ERASE_BLOCK_SIZE);
+        self.memory[start..end].fill(0xFF);
+        true
+    }
+
+    fn memory_test(&mut self, address: usize, length: usize, mode: u32, seed: u32) -> [u32; 3] {
+        let pattern = mode >> 8;
+        let fill = (mode & (1 << 0)) != 0;
+        let verify = (mode & (1 << 1)) != 0;
+
+        let generate = |state: &mut u32, address: usize| match pattern {
+            MEMORY_TEST_MODE_OWN_ADDRESS => (address as u32) ^ seed,
+            MEMORY_TEST_MODE_RANDOM => {
+                let value = *state;
+                *state = (value >> 1) ^ if (value & 1) != 0 { 0xD0000001 } else { 0 };
+                value
+            }
+            MEMORY_TEST_MODE_WALKING_ONES => walking_ones_word(address as u32) ^ seed,
+            _ => seed,
+        };
+
+        if fill {
+            let mut state = seed;
+            for offset in (0..length).step_by(4) {
+                let word = generate(&mut state, address + offset);
+                self.memory[(address + offset)..(address + offset + 4)]
+                    .copy_from_slice(&word.to_be_bytes());
+            }
+        }
+
+        let mut result = [0u32; 3];
+        if verify {
+            let mut state = seed;
+            for offset in (0..length).step_by(4) {
+                let expected = generate(&mut state, address + offset).to_be_bytes();
+                for half in [0, 2] {
+                    let index = address + offset + half;
+                    let expected = u16::from_be_bytes([expected[half], expected[half + 1]]);
+                    let read = u16::from_be_bytes([self.memory[index], self.memory[index + 1]]);
+                    if expected != read {
+                        if result[0] == 0 {
+                            result[1] = index as u32;
+                            result[2] = ((expected as u32) << 16) | (read as u32);
+                        }
+                        result[0] += 1;
+                    }
+                }
+            }
+        }
+
+        result
+    }
+
+    fn get_datetime(&self) -> NaiveDateTime {
+        Local::now().naive_local() + self.time_offset
+    }
+
+    fn get_sd_card_status(&self) -> u32 {
+        let mut status = 0;
+        if self.sd_card.is_some() {
+            status |= 1 << 0;
+        }
+        if self.sd_card_initialized {
+            status |= (1 << 1) | (1 << 2) | (1 << 3);
+        }
+        if self.sd_card_byte_swap {
+            status |= 1 << 4;
+        }
+        status
+    }
+
+    fn sd_card_operation(&mut self, address: usize, operation: u32) -> u32 {
+        match operation {
+            0 => {
+                self.sd_card_initialized = false;
+                self.sd_card_byte_swap = false;
+                SD_OK
+            }
+            1 => {
+                if self.sd_card.is_none() {
+                    return SD_ERROR_NO_CARD_IN_SLOT;
+                }
+                self.sd_card_initialized = true;
+                SD_OK
+            }
+            2 => SD_OK,
+            3 => {
+                if Self::validate_address_length(address, SD_CARD_INFO_LENGTH, true) {
+                    return SD_ERROR_INVALID_ADDRESS;
+                }
+                if !self.sd_card_initialized {
+                    return SD_ERROR_NOT_INITIALIZED;
+                }
+                // CSD version 2.0, capacity in 512 kiB units
+                let c_size = (self.sd_card_sectors / 1024).saturating_sub(1) as u128;
+                let csd = (1u128 << 126) | ((c_size & 0x3F_FFFF) << 48);
+                let mut info = [0u8; SD_CARD_INFO_LENGTH];
+                info[0..16].copy_from_slice(&csd.to_be_bytes());
+                self.write_memory(address, &info);
+                SD_OK
+            }
+            4 | 5 => {
+                if !self.sd_card_initialized {
+                    return SD_ERROR_NOT_INITIALIZED;
+                }
+                self.sd_card_byte_swap = operation == 4;
+                SD_OK
+            }
+            _ => SD_ERROR_INVALID_OPERATION,
+        }
+    }
+
+    fn sd_card_read(&mut self, address: usize, sector: u64, count: usize) -> u32 {
+        let length = count * SD_SECTOR_SIZE;
+        let mut data = vec![0u8; length];
+        let result = match self.sd_card.as_mut() {
+            Some(file) if (sector + count as u64) <= self.sd_card_sectors => file
+                .seek(SeekFrom::Start(sector * SD_SECTOR_SIZE as u64))
+                .and_then(|_| file.read_exact(&mut data)),
+            _ => Err(std::io::ErrorKind::InvalidInput.into()),
+        };
+        if result.is_err() {
+            return SD_ERROR_CMD18_IO;
+        }
+        if self.sd_card_byte_swap {
+            data.chunks_exact_mut(2).for_each(|c| c.swap(0, 1));
+        }
+        self.write_memory(address, &data);
+        SD_OK
+    }
+
+    fn sd_card_write(&mut self, address: usize, sector: u64, count: usize) -> u32 {
+        let length = count * SD_SECTOR_SIZE;
+        let mut data = self.memory[address..(address + length)].to_vec();
+        if self.sd_card_byte_swap {
+            data.chunks_exact_mut(2).for_each(|c| c.swap(0, 1));
+        }
+        let result = match self.sd_card.as_mut() {
+            Some(file) if (sector + count as u64) <= self.sd_card_sectors => file
+                .seek(SeekFrom::Start(sector * SD_SECTOR_SIZE as u64))
+                .and_then(|_| file.write_all(&data)),
+            _ => Err(std::io::ErrorKind::InvalidInput.into()),
+        };
+        if result.is_err() {
+            return SD_ERROR_CMD25_IO;
+        }
+        SD_OK
+    }
+}
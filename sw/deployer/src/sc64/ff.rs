@@ -108,9 +108,13 @@ mod fatfs {
         }
     }
 
-    pub fn path<P: AsRef<std::path::Path>>(path: P) -> Result<std::ffi::CString, Error> {
+    pub fn path<P: AsRef<std::path::Path>>(
+        volume: BYTE,
+        path: P,
+    ) -> Result<std::ffi::CString, Error> {
         match path.as_ref().to_str() {
-            Some(path) => Ok(std::ffi::CString::new(path).map_err(|_| Error::InvalidParameter)?),
+            Some(path) => Ok(std::ffi::CString::new(format!("{volume}:{path}"))
+                .map_err(|_| Error::InvalidParameter)?),
             None => Err(Error::InvalidParameter),
         }
     }
@@ -118,19 +122,29 @@ mod fatfs {
 
 pub type Error = fatfs::Error;
 
-static mut DRIVER: std::sync::Mutex<Option<Box<dyn FFDriver>>> = std::sync::Mutex::new(None);
+// Each FatFs instance mounts its own logical drive, so SD cards of multiple devices can be
+// accessed from separate threads at once. Must match FF_VOLUMES defined in the build script
+const VOLUMES: usize = 8;
 
-fn install_driver(driver: impl FFDriver + 'static) -> Result<(), Error> {
-    let mut d = unsafe { DRIVER.lock().unwrap() };
-    if d.is_some() {
-        return Err(Error::DriverInstalled);
+static mut DRIVERS: [std::sync::Mutex<Option<Box<dyn FFDriver>>>; VOLUMES] =
+    [const { std::sync::Mutex::new(None) }; VOLUMES];
+
+// FatFs is re-entrant only for operations on different volumes, (un)mounting touches shared state
+static MOUNT_LOCK: std::sync::Mutex<()> = std::sync::Mutex::new(());
+
+fn install_driver(driver: impl FFDriver + 'static) -> Result<fatfs::BYTE, Error> {
+    for (volume, slot) in unsafe { DRIVERS.iter() }.enumerate() {
+        let mut d = slot.lock().unwrap();
+        if d.is_none() {
+            d.replace(Box::new(driver));
+            return Ok(volume as fatfs::BYTE);
+        }
     }
-    d.replace(Box::new(driver));
-    Ok(())
+    Err(Error::DriverInstalled)
 }
 
-fn uninstall_driver() -> Result<(), Error> {
-    let mut d = unsafe { DRIVER.lock().unwrap() };
+fn uninstall_driver(volume: fatfs::BYTE) -> Result<(), Error> {
+    let mut d = unsafe { DRIVERS[volume as usize].lock().unwrap() };
     if d.is_none() {
         return Err(Error::DriverNotInstalled);
     }
@@ -138,15 +152,26 @@ fn uninstall_driver() -> Result<(), Error> {
     Ok(())
 }
 
+fn with_driver<T>(
+    volume: fatfs::BYTE,
+    operation: impl FnOnce(&mut Box<dyn FFDriver>) -> T,
+) -> Option<T> {
+    let slot = unsafe { DRIVERS.get(volume as usize) }?;
+    slot.lock().unwrap().as_mut().map(operation)
+}
+
 pub struct FatFs {
     fs: Box<fatfs::FATFS>,
+    volume: fatfs::BYTE,
 }
 
 impl FatFs {
     pub fn new(driver: impl FFDriver + 'static) -> Result<Self, Error> {
-        install_driver(driver)?;
+        let _lock = MOUNT_LOCK.lock().unwrap_or_else(|e| e.into_inner());
+        let volume = install_driver(driver)?;
         let mut ff = Self {
             fs: Box::new(unsafe { std::mem::zeroed() }),
+            volume,
         };
         ff.mount(false)?;
         Ok(ff)
@@ -154,14 +179,21 @@ impl FatFs {
 
     fn mount(&mut self, force: bool) -> Result<(), Error> {
         let opt = if force { 1 } else { 0 };
-        match unsafe { fatfs::f_mount(&mut *self.fs, fatfs::path("")?.as_ptr(), opt) } {
+        match unsafe { fatfs::f_mount(&mut *self.fs, fatfs::path(self.volume, "")?.as_ptr(), opt) }
+        {
             fatfs::FRESULT_FR_OK => Ok(()),
             error => Err(error.into()),
         }
     }
 
     fn unmount(&mut self) -> Result<(), Error> {
-        match unsafe { fatfs::f_mount(std::ptr::null_mut(), fatfs::path("")?.as_ptr(), 0) } {
+        match unsafe {
+            fatfs::f_mount(
+                std::ptr::null_mut(),
+                fatfs::path(self.volume, "")?.as_ptr(),
+                0,
+            )
+        } {
             fatfs::FRESULT_FR_OK => Ok(()),
             error => Err(error.into()),
         }
@@ -169,6 +201,7 @@ impl FatFs {
 
     pub fn open<P: AsRef<std::path::Path>>(&mut self, path: P) -> Result<File, Error> {
         File::open(
+            self.volume,
             path,
             fatfs::FA_OPEN_EXISTING | fatfs::FA_READ | fatfs::FA_WRITE,
         )
@@ -176,6 +209,7 @@ impl FatFs {
 
     pub fn create<P: AsRef<std::path::Path>>(&mut self, path: P) -> Result<File, Error> {
         File::open(
+            self.volume,
             path,
             fatfs::FA_CREATE_ALWAYS | fatfs::FA_READ | fatfs::FA_WRITE,
         )
@@ -183,14 +217,46 @@ impl FatFs {
 
     pub fn stat<P: AsRef<std::path::Path>>(&mut self, path: P) -> Result<Entry, Error> {
         let mut fno = unsafe { std::mem::zeroed() };
-        match unsafe { fatfs::f_stat(fatfs::path(path)?.as_ptr(), &mut fno) } {
+        match unsafe { fatfs::f_stat(fatfs::path(self.volume, path)?.as_ptr(), &mut fno) } {
             fatfs::FRESULT_FR_OK => Ok(fno.into()),
             error => Err(error.into()),
         }
     }
 
+    pub fn set_datetime<P: AsRef<std::path::Path>>(
+        &mut self,
+        path: P,
+        datetime: chrono::NaiveDateTime,
+    ) -> Result<(), Error> {
+        let mut fno: fatfs::FILINFO = unsafe { std::mem::zeroed() };
+        fno.fdate = ((((datetime.year() - 1980) as u32) << 9)
+            | (datetime.month() << 5)
+            | datetime.day()) as fatfs::WORD;
+        fno.ftime = ((datetime.hour() << 11) | (datetime.minute() << 5) | (datetime.second() / 2))
+            as fatfs::WORD;
+        match unsafe { fatfs::f_utime(fatfs::path(self.volume, path)?.as_ptr(), &fno) } {
+            fatfs::FRESULT_FR_OK => Ok(()),
+            error => Err(error.into()),
+        }
+    }
+
+    pub fn checksum<P: AsRef<std::path::Path>>(&mut self, path: P) -> Result<u32, Error> {
+        let mut file = File::open(self.volume, path, fatfs::FA_OPEN_EXISTING | fatfs::FA_READ)?;
+        let mut hasher = crc32fast::Hasher::new();
+        for (sector, length) in file.sector_runs()? {
+            let checksum = with_driver(self.volume, |d| d.checksum(sector, length))
+                .ok_or(Error::DriverNotInstalled)?
+                .ok_or(Error::DiskErr)?;
+            hasher.combine(&crc32fast::Hasher::new_with_initial_len(
+                checksum,
+                length as u64,
+            ));
+        }
+        Ok(hasher.finalize())
+    }
+
     pub fn opendir<P: AsRef<std::path::Path>>(&mut self, path: P) -> Result<Directory, Error> {
-        Directory::open(path)
+        Directory::open(self.volume, path)
     }
 
     pub fn list<P: AsRef<std::path::Path>>(&mut self, path: P) -> Result<Vec<Entry>, Error> {
@@ -208,31 +274,130 @@ impl FatFs {
     }
 
     pub fn mkdir<P: AsRef<std::path::Path>>(&mut self, path: P) -> Result<(), Error> {
-        match unsafe { fatfs::f_mkdir(fatfs::path(path)?.as_ptr()) } {
+        match unsafe { fatfs::f_mkdir(fatfs::path(self.volume, path)?.as_ptr()) } {
             fatfs::FRESULT_FR_OK => Ok(()),
             error => Err(error.into()),
         }
     }
 
     pub fn delete<P: AsRef<std::path::Path>>(&mut self, path: P) -> Result<(), Error> {
-        match unsafe { fatfs::f_unlink(fatfs::path(path)?.as_ptr()) } {
+        match unsafe { fatfs::f_unlink(fatfs::path(self.volume, path)?.as_ptr()) } {
             fatfs::FRESULT_FR_OK => Ok(()),
             error => Err(error.into()),
         }
     }
 
     pub fn rename<P: AsRef<std::path::Path>>(&mut self, old: P, new: P) -> Result<(), Error> {
-        match unsafe { fatfs::f_rename(fatfs::path(old)?.as_ptr(), fatfs::path(new)?.as_ptr()) } {
+        match unsafe {
+            fatfs::f_rename(
+                fatfs::path(self.volume, old)?.as_ptr(),
+                fatfs::path(self.volume, new)?.as_ptr(),
+            )
+        } {
             fatfs::FRESULT_FR_OK => Ok(()),
             error => Err(error.into()),
         }
     }
 
+    pub fn read_sectors(&mut self, buffer: &mut [u8], sector: fatfs::LBA_t) -> Result<(), Error> {
+        match with_driver(self.volume, |d| d.read(buffer, sector)) {
+            Some(fatfs::DRESULT_RES_OK) => Ok(()),
+            Some(_) => Err(Error::DiskErr),
+            None => Err(Error::DriverNotInstalled),
+        }
+    }
+
+    pub fn write_sectors(&mut self, buffer: &[u8], sector: fatfs::LBA_t) -> Result<(), Error> {
+        match with_driver(self.volume, |d| d.write(buffer, sector)) {
+            Some(fatfs::DRESULT_RES_OK) => Ok(()),
+            Some(_) => Err(Error::DiskErr),
+            None => Err(Error::DriverNotInstalled),
+        }
+    }
+
+    pub fn allocation_map(&mut self) -> Result<AllocationMap, Error> {
+        // Opening the root directory forces the volume to be mounted
+        drop(self.opendir("/")?);
+
+        let fs_type = self.fs.fs_type as u32;
+        let volbase = self.fs.volbase;
+        let fatbase = self.fs.fatbase;
+        let bitbase = self.fs.bitbase;
+        let database = self.fs.database;
+        let csize = self.fs.csize as fatfs::LBA_t;
+        let clusters = (self.fs.n_fatent - 2) as usize;
+
+        let mut boot_sector = vec![0u8; SD_CARD_SECTOR_SIZE];
+        self.read_sectors(&mut boot_sector, volbase)?;
+        let volume_sectors = if fs_type == fatfs::FS_EXFAT {
+            u64::from_le_bytes(boot_sector[72..80].try_into().unwrap())
+        } else {
+            match u16::from_le_bytes(boot_sector[19..21].try_into().unwrap()) {
+                0 => u32::from_le_bytes(boot_sector[32..36].try_into().unwrap()) as u64,
+                sectors => sectors as u64,
+            }
+        };
+
+        let (table_base, bits_per_cluster) = match fs_type {
+            fatfs::FS_FAT16 => (fatbase, 16),
+            fatfs::FS_FAT32 => (fatbase, 32),
+            fatfs::FS_EXFAT => (bitbase, 1),
+            _ => (0, 0),
+        };
+
+        let mut allocated = vec![bits_per_cluster == 0; clusters];
+        if bits_per_cluster > 0 {
+            const TABLE_CHUNK_SECTORS: usize = 512;
+            let table_length = ((clusters + 2) * bits_per_cluster).div_ceil(8);
+            let table_sectors = table_length.div_ceil(SD_CARD_SECTOR_SIZE);
+            let mut table = vec![0u8; table_sectors * SD_CARD_SECTOR_SIZE];
+            for (index, chunk) in table
+                .chunks_mut(TABLE_CHUNK_SECTORS * SD_CARD_SECTOR_SIZE)
+                .enumerate()
+            {
+                let sector = table_base + (index * TABLE_CHUNK_SECTORS) as fatfs::LBA_t;
+                self.read_sectors(chunk, sector)?;
+            }
+            for (cluster, allocated) in allocated.iter_mut().enumerate() {
+                *allocated = match bits_per_cluster {
+                    1 => (table[cluster / 8] & (1 << (cluster % 8))) != 0,
+                    16 => {
+                        let offset = (cluster + 2) * 2;
+                        u16::from_le_bytes(table[offset..offset + 2].try_into().unwrap()) != 0
+                    }
+                    _ => {
+                        let offset = (cluster + 2) * 4;
+                        let entry =
+                            u32::from_le_bytes(table[offset..offset + 4].try_into().unwrap());
+                        (entry & 0x0FFF_FFFF) != 0
+                    }
+                };
+            }
+        }
+
+        let mut extents: Vec<(fatfs::LBA_t, fatfs::LBA_t)> = vec![(0, database)];
+        for (cluster, allocated) in allocated.into_iter().enumerate() {
+            if !allocated {
+                continue;
+            }
+            let sector = database + (cluster as fatfs::LBA_t) * csize;
+            match extents.last_mut() {
+                Some((start, count)) if (*start + *count) == sector => *count += csize,
+                _ => extents.push((sector, csize)),
+            }
+        }
+
+        Ok(AllocationMap {
+            extents,
+            sectors: volbase + volume_sectors,
+        })
+    }
+
     pub fn mkfs(&mut self) -> Result<(), Error> {
         let mut work = [0u8; 16 * 1024];
         match unsafe {
             fatfs::f_mkfs(
-                fatfs::path("")?.as_ptr(),
+                fatfs::path(self.volume, "")?.as_ptr(),
                 std::ptr::null(),
                 work.as_mut_ptr().cast(),
                 size_of_val(&work) as u32,
@@ -246,8 +411,20 @@ impl FatFs {
 
 impl Drop for FatFs {
     fn drop(&mut self) {
+        let _lock = MOUNT_LOCK.lock().unwrap_or_else(|e| e.into_inner());
         self.unmount().ok();
-        uninstall_driver().ok();
+        uninstall_driver(self.volume).ok();
+    }
+}
+
+pub struct AllocationMap {
+    pub extents: Vec<(u64, u64)>,
+    pub sectors: u64,
+}
+
+impl AllocationMap {
+    pub fn allocated_sectors(&self) -> u64 {
+        self.extents.iter().map(|(_, count)| count).sum()
     }
 }
 
@@ -266,6 +443,7 @@ pub trait FFDriver {
     fn read(&mut self, buffer: &mut [u8], sector: fatfs::LBA_t) -> fatfs::DRESULT;
     fn write(&mut self, buffer: &[u8], sector: fatfs::LBA_t) -> fatfs::DRESULT;
     fn ioctl(&mut self, ioctl: &mut IOCtl) -> fatfs::DRESULT;
+    fn checksum(&mut self, sector: fatfs::LBA_t, length: usize) -> Option<u32>;
 }
 
 impl FFDriver for SC64 {
@@ -328,28 +506,88 @@ impl FFDriver for SC64 {
         }
         fatfs::DRESULT_RES_OK
     }
+
+    fn checksum(&mut self, sector: fatfs::LBA_t, length: usize) -> Option<u32> {
+        let sectors = length.div_ceil(SD_CARD_SECTOR_SIZE) as fatfs::LBA_t;
+        if (sector + sectors) > 0x1_0000_0000 {
+            return None;
+        }
+        self.checksum_sd_card(sector as u32, length).ok()
+    }
 }
 
-#[no_mangle]
-unsafe extern "C" fn disk_status(pdrv: fatfs::BYTE) -> fatfs::DSTATUS {
-    if pdrv != 0 {
-        return fatfs::DSTATUS_STA_NOINIT;
+impl FFDriver for std::fs::File {
+    fn init(&mut self) -> fatfs::DSTATUS {
+        fatfs::DSTATUS_STA_OK
+    }
+
+    fn deinit(&mut self) {}
+
+    fn status(&mut self) -> fatfs::DSTATUS {
+        fatfs::DSTATUS_STA_OK
+    }
+
+    fn read(&mut self, buffer: &mut [u8], sector: fatfs::LBA_t) -> fatfs::DRESULT {
+        use std::io::{Read, Seek};
+        let offset = sector * (SD_CARD_SECTOR_SIZE as u64);
+        if self.seek(std::io::SeekFrom::Start(offset)).is_err() {
+            return fatfs::DRESULT_RES_ERROR;
+        }
+        if self.read_exact(buffer).is_err() {
+            return fatfs::DRESULT_RES_ERROR;
+        }
+        fatfs::DRESULT_RES_OK
     }
-    if let Some(d) = DRIVER.lock().unwrap().as_mut() {
-        return d.status();
+
+    fn write(&mut self, buffer: &[u8], sector: fatfs::LBA_t) -> fatfs::DRESULT {
+        use std::io::{Seek, Write};
+        let offset = sector * (SD_CARD_SECTOR_SIZE as u64);
+        if self.seek(std::io::SeekFrom::Start(offset)).is_err() {
+            return fatfs::DRESULT_RES_ERROR;
+        }
+        if self.write_all(buffer).is_err() {
+            return fatfs::DRESULT_RES_WRPRT;
+        }
+        fatfs::DRESULT_RES_OK
     }
-    fatfs::DSTATUS_STA_NOINIT
+
+    fn ioctl(&mut self, ioctl: &mut IOCtl) -> fatfs::DRESULT {
+        match ioctl {
+            IOCtl::Sync => {}
+            IOCtl::GetSectorCount(_) => match self.metadata() {
+                Ok(metadata) => {
+                    *ioctl = IOCtl::GetSectorCount(metadata.len() / (SD_CARD_SECTOR_SIZE as u64))
+                }
+                Err(_) => return fatfs::DRESULT_RES_ERROR,
+            },
+            IOCtl::GetSectorSize(_) => {
+                *ioctl = IOCtl::GetSectorSize(SD_CARD_SECTOR_SIZE as fatfs::WORD)
+            }
+            IOCtl::GetBlockSize(_) => {
+                *ioctl = IOCtl::GetBlockSize(1);
+            }
+            IOCtl::Trim => {}
+        }
+        fatfs::DRESULT_RES_OK
+    }
+
+    fn checksum(&mut self, sector: fatfs::LBA_t, length: usize) -> Option<u32> {
+        let mut buffer = vec![0u8; length.next_multiple_of(SD_CARD_SECTOR_SIZE)];
+        if FFDriver::read(self, &mut buffer, sector) != fatfs::DRESULT_RES_OK {
+            return None;
+        }
+        Some(crc32fast::hash(&buffer[0..length]))
+    }
+}
+
+#[no_mangle]
+unsafe extern "C" fn disk_status(pdrv: fatfs::BYTE) -> fatfs::DSTATUS {
+    with_driver(pdrv, |d| d.status()).unwrap_or(fatfs::DSTATUS_STA_NOINIT)
 }
 
 #[no_mangle]
 unsafe extern "C" fn disk_initialize(pdrv: fatfs::BYTE) -> fatfs::DSTATUS {
-    if pdrv != 0 {
-        return fatfs::DSTATUS_STA_NOINIT;
-    }
-    if let Some(d) = DRIVER.lock().unwrap().as_mut() {
-        return d.init();
-    }
-    fatfs::DSTATUS_STA_NOINIT
+    with_driver(pdrv, |d| d.init()).unwrap_or(fatfs::DSTATUS_STA_NOINIT)
 }
 
 #[no_mangle]
@@ -359,16 +597,9 @@ unsafe extern "C" fn disk_read(
     sector: fatfs::LBA_t,
     count: fatfs::UINT,
 ) -> fatfs::DRESULT {
-    if pdrv != 0 {
-        return fatfs::DRESULT_RES_PARERR;
-    }
-    if let Some(d) = DRIVER.lock().unwrap().as_mut() {
-        return d.read(
-            &mut *std::ptr::slice_from_raw_parts_mut(buff, (count as usize) * SD_CARD_SECTOR_SIZE),
-            sector,
-        );
-    }
-    fatfs::DRESULT_RES_NOTRDY
+    let buffer =
+        &mut *std::ptr::slice_from_raw_parts_mut(buff, (count as usize) * SD_CARD_SECTOR_SIZE);
+    with_driver(pdrv, |d| d.read(buffer, sector)).unwrap_or(fatfs::DRESULT_RES_NOTRDY)
 }
 
 #[no_mangle]
@@ -378,16 +609,8 @@ unsafe extern "C" fn disk_write(
     sector: fatfs::LBA_t,
     count: fatfs::UINT,
 ) -> fatfs::DRESULT {
-    if pdrv != 0 {
-        return fatfs::DRESULT_RES_PARERR;
-    }
-    if let Some(d) = DRIVER.lock().unwrap().as_mut() {
-        return d.write(
-            &*std::ptr::slice_from_raw_parts(buff, (count as usize) * SD_CARD_SECTOR_SIZE),
-            sector,
-        );
-    }
-    fatfs::DRESULT_RES_NOTRDY
+    let buffer = &*std::ptr::slice_from_raw_parts(buff, (count as usize) * SD_CARD_SECTOR_SIZE);
+    with_driver(pdrv, |d| d.write(buffer, sector)).unwrap_or(fatfs::DRESULT_RES_NOTRDY)
 }
 
 #[no_mangle]
@@ -396,9 +619,6 @@ unsafe extern "C" fn disk_ioctl(
     cmd: fatfs::BYTE,
     buff: *mut std::os::raw::c_void,
 ) -> fatfs::DRESULT {
-    if pdrv != 0 {
-        return fatfs::DRESULT_RES_PARERR;
-    }
     let mut ioctl = match cmd {
         fatfs::CTRL_SYNC => IOCtl::Sync,
         fatfs::GET_SECTOR_COUNT => IOCtl::GetSectorCount(0),
@@ -407,8 +627,7 @@ unsafe extern "C" fn disk_ioctl(
         fatfs::CTRL_TRIM => IOCtl::Trim,
         _ => return fatfs::DRESULT_RES_PARERR,
     };
-    if let Some(d) = DRIVER.lock().unwrap().as_mut() {
-        let result = d.ioctl(&mut ioctl);
+    if let Some(result) = with_driver(pdrv, |d| d.ioctl(&mut ioctl)) {
         if result == fatfs::DRESULT_RES_OK {
             match ioctl {
                 IOCtl::GetSectorCount(count) => {
@@ -532,9 +751,9 @@ pub struct Directory {
 }
 
 impl Directory {
-    fn open<P: AsRef<std::path::Path>>(path: P) -> Result<Self, Error> {
+    fn open<P: AsRef<std::path::Path>>(volume: fatfs::BYTE, path: P) -> Result<Self, Error> {
         let mut dir = unsafe { std::mem::zeroed() };
-        match unsafe { fatfs::f_opendir(&mut dir, fatfs::path(path)?.as_ptr()) } {
+        match unsafe { fatfs::f_opendir(&mut dir, fatfs::path(volume, path)?.as_ptr()) } {
             fatfs::FRESULT_FR_OK => Ok(Self { dir }),
             error => Err(error.into()),
         }
@@ -566,13 +785,78 @@ pub struct File {
 }
 
 impl File {
-    fn open<P: AsRef<std::path::Path>>(path: P, mode: u32) -> Result<File, Error> {
+    fn open<P: AsRef<std::path::Path>>(
+        volume: fatfs::BYTE,
+        path: P,
+        mode: u32,
+    ) -> Result<File, Error> {
         let mut fil = unsafe { std::mem::zeroed() };
-        match unsafe { fatfs::f_open(&mut fil, fatfs::path(path)?.as_ptr(), mode as u8) } {
+        match unsafe { fatfs::f_open(&mut fil, fatfs::path(volume, path)?.as_ptr(), mode as u8) } {
             fatfs::FRESULT_FR_OK => Ok(File { fil }),
             error => Err(error.into()),
         }
     }
+
+    pub fn expand(&mut self, size: u64) -> Result<(), Error> {
+        match unsafe { fatfs::f_expand(&mut self.fil, size, 1) } {
+            fatfs::FRESULT_FR_OK => Ok(()),
+            error => Err(error.into()),
+        }
+    }
+
+    pub fn truncate(&mut self, size: u64) -> Result<(), Error> {
+        match unsafe { fatfs::f_lseek(&mut self.fil, size) } {
+            fatfs::FRESULT_FR_OK => {}
+            error => return Err(error.into()),
+        }
+        match unsafe { fatfs::f_truncate(&mut self.fil) } {
+            fatfs::FRESULT_FR_OK => Ok(()),
+            error => Err(error.into()),
+        }
+    }
+
+    fn sector_runs(&mut self) -> Result<Vec<(fatfs::LBA_t, usize)>, Error> {
+        let mut runs: Vec<(fatfs::LBA_t, usize)> = vec![];
+        let size = self.fil.obj.objsize;
+        if size == 0 {
+            return Ok(runs);
+        }
+        let fs = unsafe { &*self.fil.obj.fs };
+        let cluster_length = (fs.csize as u64) * (SD_CARD_SECTOR_SIZE as u64);
+        let mut offset = 0;
+        while offset < size {
+            // Seeking to the end of a cluster leaves it loaded in the file object
+            let end = size.min(offset + cluster_length);
+            match unsafe { fatfs::f_lseek(&mut self.fil, end) } {
+                fatfs::FRESULT_FR_OK => {}
+                error => return Err(error.into()),
+            }
+            let sector =
+                fs.database + ((self.fil.clust - 2) as fatfs::LBA_t) * (fs.csize as fatfs::LBA_t);
+            let length = (end - offset) as usize;
+            match runs.last_mut() {
+                Some((start, run_length))
+                    if (*start + (*run_length / SD_CARD_SECTOR_SIZE) as fatfs::LBA_t) == sector =>
+                {
+                    *run_length += length
+                }
+                _ => runs.push((sector, length)),
+            }
+            offset = end;
+        }
+        match unsafe { fatfs::f_lseek(&mut self.fil, 0) } {
+            fatfs::FRESULT_FR_OK => Ok(runs),
+            error => Err(error.into()),
+        }
+    }
+
+    pub fn start_sector(&self) -> Option<fatfs::LBA_t> {
+        if self.fil.obj.fs.is_null() || self.fil.obj.sclust < 2 {
+            return None;
+        }
+        let fs = unsafe { &*self.fil.obj.fs };
+        Some(fs.database + ((self.fil.obj.sclust - 2) as fatfs::LBA_t) * (fs.csize as fatfs::LBA_t))
+    }
 }
 
 impl std::io::Read for File {
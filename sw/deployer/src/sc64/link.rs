@@ -1,4 +1,5 @@
-use super::{error::Error, ftdi::FtdiDevice, serial::SerialDevice};
+use super::{emulator::EmulatedDevice, error::Error, ftdi::FtdiDevice, serial::SerialDevice};
+use flate2::{read::DeflateDecoder, write::DeflateEncoder, Compression};
 use std::{
     collections::VecDeque,
     fmt::Display,
@@ -12,6 +13,7 @@ pub enum DataType {
     Response,
     Packet,
     KeepAlive,
+    Session,
 }
 
 impl From<DataType> for u32 {
@@ -21,6 +23,7 @@ impl From<DataType> for u32 {
             DataType::Response => 2,
             DataType::Packet => 3,
             DataType::KeepAlive => 0xCAFEBEEF,
+            DataType::Session => 4,
         }
     }
 }
@@ -33,6 +36,7 @@ impl TryFrom<u32> for DataType {
             2 => Self::Response,
             3 => Self::Packet,
             0xCAFEBEEF => Self::KeepAlive,
+            4 => Self::Session,
             _ => return Err(Error::new("Unknown data type")),
         })
     }
@@ -42,6 +46,7 @@ pub struct Response {
     pub id: u8,
     pub data: Vec<u8>,
     pub error: bool,
+    pub tag: Option<u32>,
 }
 
 pub struct AsynchronousPacket {
@@ -54,8 +59,87 @@ pub enum UsbPacket {
     AsynchronousPacket(AsynchronousPacket),
 }
 
+pub const SESSION_SELECT_DEVICE: u8 = b'S';
+pub const SESSION_LIST_DEVICES: u8 = b'L';
+pub const SESSION_ACQUIRE_EXCLUSIVE: u8 = b'E';
+pub const SESSION_RELEASE_EXCLUSIVE: u8 = b'e';
+pub const SESSION_ACQUIRE_STREAM: u8 = b'P';
+pub const SESSION_RELEASE_STREAM: u8 = b'p';
+
+// Not a valid SC64 command ID, a server that doesn't recognize it forwards it to the device,
+// which responds with an error and the link stays in the uncompressed mode without sessions
+pub const SERVER_CAPABILITIES_ID: u8 = 0xFE;
+pub const CAPABILITY_COMPRESSION: u32 = 1 << 0;
+pub const CAPABILITY_SESSION: u32 = 1 << 1;
+
+const COMPRESSED_PAYLOAD_FLAG: u32 = 1 << 31;
+const COMPRESSION_THRESHOLD: usize = 4 * 1024;
+
+pub enum ServerLease {
+    Exclusive,
+    Stream,
+}
+
+fn compress_payload(data: &[u8]) -> std::io::Result<Option<Vec<u8>>> {
+    if data.len() < COMPRESSION_THRESHOLD {
+        return Ok(None);
+    }
+    let mut encoder = DeflateEncoder::new(
+        (data.len() as u32).to_be_bytes().to_vec(),
+        Compression::fast(),
+    );
+    encoder.write_all(data)?;
+    let compressed = encoder.finish()?;
+    if compressed.len() >= data.len() {
+        return Ok(None);
+    }
+    Ok(Some(compressed))
+}
+
+pub fn write_payload<W: Write>(
+    writer: &mut W,
+    data: &[u8],
+    compression: bool,
+) -> std::io::Result<()> {
+    let compressed = if compression {
+        compress_payload(data)?
+    } else {
+        None
+    };
+    if let Some(compressed) = compressed {
+        writer.write_all(&((compressed.len() as u32) | COMPRESSED_PAYLOAD_FLAG).to_be_bytes())?;
+        writer.write_all(&compressed)
+    } else {
+        writer.write_all(&(data.len() as u32).to_be_bytes())?;
+        writer.write_all(data)
+    }
+}
+
+pub fn payload_length(length: u32) -> usize {
+    (length & !COMPRESSED_PAYLOAD_FLAG) as usize
+}
+
+pub fn decode_payload(length: u32, payload: Vec<u8>) -> std::io::Result<Vec<u8>> {
+    if (length & COMPRESSED_PAYLOAD_FLAG) == 0 {
+        return Ok(payload);
+    }
+    if payload.len() < 4 {
+        return Err(std::io::ErrorKind::InvalidData.into());
+    }
+    let data_length = u32::from_be_bytes(payload[0..4].try_into().unwrap()) as usize;
+    let mut data = Vec::with_capacity(data_length);
+    DeflateDecoder::new(&payload[4..])
+        .take(data_length as u64)
+        .read_to_end(&mut data)?;
+    if data.len() != data_length {
+        return Err(std::io::ErrorKind::InvalidData.into());
+    }
+    Ok(data)
+}
+
 const SERIAL_PREFIX: &str = "serial://";
 const FTDI_PREFIX: &str = "ftdi://";
+const EMULATOR_PREFIX: &str = "emu://";
 
 const RESET_TIMEOUT: Duration = Duration::from_secs(1);
 const POLL_TIMEOUT: Duration = Duration::from_millis(5);
@@ -86,6 +170,25 @@ pub trait Backend {
 
     fn close(&mut self) {}
 
+    fn tagged_commands(&self) -> bool {
+        true
+    }
+
+    fn set_capabilities(&mut self, _capabilities: u32) {}
+
+    fn sessions(&self) -> bool {
+        false
+    }
+
+    fn session_request(
+        &mut self,
+        _op: u8,
+        _payload: &[u8],
+        _packets: &mut VecDeque<AsynchronousPacket>,
+    ) -> std::io::Result<Option<Response>> {
+        Ok(None)
+    }
+
     fn reset(&mut self) -> std::io::Result<()> {
         self.discard_output()?;
 
@@ -174,6 +277,27 @@ pub trait Backend {
         Ok(())
     }
 
+    fn send_tagged_command(
+        &mut self,
+        id: u8,
+        tag: u32,
+        args: [u32; 2],
+        data: &[u8],
+    ) -> std::io::Result<()> {
+        self.write_all(b"CMT")?;
+        self.write_all(&id.to_be_bytes())?;
+        self.write_all(&tag.to_be_bytes())?;
+
+        self.write_all(&args[0].to_be_bytes())?;
+        self.write_all(&args[1].to_be_bytes())?;
+
+        self.write_all(data)?;
+
+        self.flush()?;
+
+        Ok(())
+    }
+
     fn process_incoming_data(
         &mut self,
         data_type: DataType,
@@ -182,16 +306,25 @@ pub trait Backend {
         let block = matches!(data_type, DataType::Response);
 
         while let Some(header) = self.try_read_header(block)? {
-            let (packet_token, error) = match &header[0..3] {
-                b"CMP" => (false, false),
-                b"PKT" => (true, false),
-                b"ERR" => (false, true),
+            let (packet_token, error, tagged) = match &header[0..3] {
+                b"CMP" => (false, false, false),
+                b"PKT" => (true, false, false),
+                b"ERR" => (false, true, false),
+                b"CPT" => (false, false, true),
+                b"ERT" => (false, true, true),
                 _ => return Err(std::io::ErrorKind::InvalidData.into()),
             };
             let id = header[3];
 
             let mut buffer = [0u8; 4];
 
+            let tag = if tagged {
+                self.read_exact(&mut buffer)?;
+                Some(u32::from_be_bytes(buffer))
+            } else {
+                None
+            };
+
             self.read_exact(&mut buffer)?;
             let length = u32::from_be_bytes(buffer) as usize;
 
@@ -204,7 +337,12 @@ pub trait Backend {
                     break;
                 }
             } else {
-                return Ok(Some(Response { id, error, data }));
+                return Ok(Some(Response {
+                    id,
+                    error,
+                    data,
+                    tag,
+                }));
             }
         }
 
@@ -292,10 +430,52 @@ fn new_ftdi_backend(port: &str) -> std::io::Result<FtdiBackend> {
     })
 }
 
+struct EmulatorBackend {
+    device: EmulatedDevice,
+}
+
+impl Backend for EmulatorBackend {
+    fn read(&mut self, buffer: &mut [u8]) -> std::io::Result<usize> {
+        self.device.read(buffer)
+    }
+
+    fn write_all(&mut self, buffer: &[u8]) -> std::io::Result<()> {
+        self.device.write_all(buffer)
+    }
+
+    fn flush(&mut self) -> std::io::Result<()> {
+        self.device.flush()
+    }
+
+    fn discard_input(&mut self) -> std::io::Result<()> {
+        self.device.discard_input()
+    }
+
+    fn discard_output(&mut self) -> std::io::Result<()> {
+        self.device.discard_output()
+    }
+
+    fn set_dtr(&mut self, value: bool) -> std::io::Result<()> {
+        self.device.set_dtr(value)
+    }
+
+    fn read_dsr(&mut self) -> std::io::Result<bool> {
+        self.device.read_dsr()
+    }
+}
+
+fn new_emulator_backend(options: &str) -> std::io::Result<EmulatorBackend> {
+    Ok(EmulatorBackend {
+        device: EmulatedDevice::open(options)?,
+    })
+}
+
 struct TcpBackend {
     stream: TcpStream,
     reader: BufReader<TcpStream>,
     writer: BufWriter<TcpStream>,
+    compression: bool,
+    sessions: bool,
 }
 
 impl Backend for TcpBackend {
@@ -315,6 +495,19 @@ impl Backend for TcpBackend {
         self.stream.shutdown(std::net::Shutdown::Both).ok();
     }
 
+    fn tagged_commands(&self) -> bool {
+        false
+    }
+
+    fn set_capabilities(&mut self, capabilities: u32) {
+        self.compression = (capabilities & CAPABILITY_COMPRESSION) != 0;
+        self.sessions = (capabilities & CAPABILITY_SESSION) != 0;
+    }
+
+    fn sessions(&self) -> bool {
+        self.sessions
+    }
+
     fn send_command(&mut self, id: u8, args: [u32; 2], data: &[u8]) -> std::io::Result<()> {
         let payload_data_type: u32 = DataType::Command.into();
         self.write_all(&payload_data_type.to_be_bytes())?;
@@ -323,15 +516,33 @@ impl Backend for TcpBackend {
         self.write_all(&args[0].to_be_bytes())?;
         self.write_all(&args[1].to_be_bytes())?;
 
-        let command_data_length = data.len() as u32;
-        self.write_all(&command_data_length.to_be_bytes())?;
-        self.write_all(data)?;
+        write_payload(&mut self.writer, data, self.compression)?;
 
         self.flush()?;
 
         Ok(())
     }
 
+    fn session_request(
+        &mut self,
+        op: u8,
+        payload: &[u8],
+        packets: &mut VecDeque<AsynchronousPacket>,
+    ) -> std::io::Result<Option<Response>> {
+        let payload_data_type: u32 = DataType::Session.into();
+        self.write_all(&payload_data_type.to_be_bytes())?;
+
+        self.write_all(&op.to_be_bytes())?;
+
+        let payload_length = payload.len() as u32;
+        self.write_all(&payload_length.to_be_bytes())?;
+        self.write_all(payload)?;
+
+        self.flush()?;
+
+        self.process_incoming_data(DataType::Response, packets)
+    }
+
     fn process_incoming_data(
         &mut self,
         data_type: DataType,
@@ -344,20 +555,22 @@ impl Backend for TcpBackend {
                 .map_err(|_| std::io::ErrorKind::InvalidData)?;
             let mut buffer = [0u8; 4];
             match payload_data_type {
-                DataType::Response => {
+                DataType::Response | DataType::Session => {
                     let mut response_info = vec![0u8; 2];
                     self.read_exact(&mut response_info)?;
 
                     self.read_exact(&mut buffer)?;
-                    let response_data_length = u32::from_be_bytes(buffer) as usize;
+                    let response_data_length = u32::from_be_bytes(buffer);
 
-                    let mut data = vec![0u8; response_data_length];
+                    let mut data = vec![0u8; payload_length(response_data_length)];
                     self.read_exact(&mut data)?;
+                    let data = decode_payload(response_data_length, data)?;
 
                     return Ok(Some(Response {
                         id: response_info[0],
                         error: response_info[1] != 0,
                         data,
+                        tag: None,
                     }));
                 }
                 DataType::Packet => {
@@ -365,10 +578,11 @@ impl Backend for TcpBackend {
                     self.read_exact(&mut packet_info)?;
 
                     self.read_exact(&mut buffer)?;
-                    let packet_data_length = u32::from_be_bytes(buffer) as usize;
+                    let packet_data_length = u32::from_be_bytes(buffer);
 
-                    let mut data = vec![0u8; packet_data_length];
+                    let mut data = vec![0u8; payload_length(packet_data_length)];
                     self.read_exact(&mut data)?;
+                    let data = decode_payload(packet_data_length, data)?;
 
                     packets.push_back(AsynchronousPacket {
                         id: packet_info[0],
@@ -399,6 +613,8 @@ fn new_tcp_backend(address: &str) -> Result<TcpBackend, Error> {
         stream,
         reader,
         writer,
+        compression: false,
+        sessions: false,
     })
 }
 
@@ -411,6 +627,10 @@ fn new_local_backend(port: &str) -> Result<Box<dyn Backend>, Error> {
         Box::new(new_ftdi_backend(
             port.strip_prefix(FTDI_PREFIX).unwrap_or_default(),
         )?)
+    } else if port.starts_with(EMULATOR_PREFIX) {
+        Box::new(new_emulator_backend(
+            port.strip_prefix(EMULATOR_PREFIX).unwrap_or_default(),
+        )?)
     } else {
         return Err(Error::new("Invalid port prefix provided"));
     };
@@ -425,6 +645,9 @@ fn new_remote_backend(address: &str) -> Result<Box<dyn Backend>, Error> {
 pub struct Link {
     backend: Box<dyn Backend>,
     packets: VecDeque<AsynchronousPacket>,
+    pipeline_depth: usize,
+    next_tag: u32,
+    outstanding: VecDeque<(u8, Option<u32>)>,
 }
 
 impl Link {
@@ -445,14 +668,102 @@ impl Link {
         no_response: bool,
         ignore_error: bool,
     ) -> Result<Vec<u8>, Error> {
-        self.backend.send_command(id, args, data)?;
+        self.discard_outstanding();
+        let tag = self.send_command(id, args, data)?;
         if no_response {
             return Ok(vec![]);
         }
         let response = self.receive_response()?;
+        Self::check_response(response, id, tag, ignore_error)
+    }
+
+    pub fn execute_command_checked(
+        &mut self,
+        id: u8,
+        args: [u32; 2],
+        data: &[u8],
+    ) -> Result<Option<Vec<u8>>, Error> {
+        self.discard_outstanding();
+        let tag = self.send_command(id, args, data)?;
+        let response = self.receive_response()?;
+        let error = response.error;
+        let data = Self::check_response(response, id, tag, true)?;
+        Ok(if error { None } else { Some(data) })
+    }
+
+    pub fn enable_tagged_commands(&mut self, depth: usize) -> bool {
+        if !self.backend.tagged_commands() || depth == 0 {
+            return false;
+        }
+        self.pipeline_depth = depth;
+        true
+    }
+
+    pub fn pipeline_depth(&self) -> usize {
+        self.pipeline_depth.max(1)
+    }
+
+    pub fn submit_command(
+        &mut self,
+        id: u8,
+        args: [u32; 2],
+        data: &[u8],
+    ) -> Result<Option<Vec<u8>>, Error> {
+        let completed = if self.outstanding.len() >= self.pipeline_depth() {
+            self.complete_command()?
+        } else {
+            None
+        };
+        let tag = self.send_command(id, args, data)?;
+        self.outstanding.push_back((id, tag));
+        Ok(completed)
+    }
+
+    pub fn complete_command(&mut self) -> Result<Option<Vec<u8>>, Error> {
+        let (id, tag) = match self.outstanding.pop_front() {
+            Some(outstanding) => outstanding,
+            None => return Ok(None),
+        };
+        let result = self
+            .receive_response()
+            .and_then(|response| Self::check_response(response, id, tag, false));
+        if result.is_err() {
+            self.discard_outstanding();
+        }
+        result.map(Some)
+    }
+
+    fn discard_outstanding(&mut self) {
+        while self.outstanding.pop_front().is_some() {
+            if self.receive_response().is_err() {
+                self.outstanding.clear();
+            }
+        }
+    }
+
+    fn send_command(&mut self, id: u8, args: [u32; 2], data: &[u8]) -> Result<Option<u32>, Error> {
+        if self.pipeline_depth == 0 {
+            self.backend.send_command(id, args, data)?;
+            return Ok(None);
+        }
+        let tag = self.next_tag;
+        self.next_tag = self.next_tag.wrapping_add(1);
+        self.backend.send_tagged_command(id, tag, args, data)?;
+        Ok(Some(tag))
+    }
+
+    fn check_response(
+        response: Response,
+        id: u8,
+        tag: Option<u32>,
+        ignore_error: bool,
+    ) -> Result<Vec<u8>, Error> {
         if id != response.id {
             return Err(Error::new("Command response ID didn't match"));
         }
+        if tag != response.tag {
+            return Err(Error::new("Command response tag didn't match"));
+        }
         if !ignore_error && response.error {
             return Err(Error::new("Command response error"));
         }
@@ -486,6 +797,61 @@ impl Link {
         Ok(self.packets.pop_front())
     }
 
+    fn negotiate_capabilities(&mut self) -> Result<(), Error> {
+        self.backend.send_command(
+            SERVER_CAPABILITIES_ID,
+            [CAPABILITY_COMPRESSION | CAPABILITY_SESSION, 0],
+            &[],
+        )?;
+        let response = self.receive_response()?;
+        if response.id == SERVER_CAPABILITIES_ID && !response.error && response.data.len() >= 4 {
+            let capabilities = u32::from_be_bytes(response.data[0..4].try_into().unwrap());
+            self.backend.set_capabilities(capabilities);
+        }
+        Ok(())
+    }
+
+    pub fn acquire_lease(&mut self, lease: ServerLease) -> Result<(), Error> {
+        let op = match lease {
+            ServerLease::Exclusive => SESSION_ACQUIRE_EXCLUSIVE,
+            ServerLease::Stream => SESSION_ACQUIRE_STREAM,
+        };
+        if !self.backend.sessions() {
+            // Local device or a server predating sessions, which serves only one client
+            // at a time, so the lease is implicitly held
+            return Ok(());
+        }
+        self.session_request(op, &[])?;
+        Ok(())
+    }
+
+    fn session_request(&mut self, op: u8, payload: &[u8]) -> Result<Vec<u8>, Error> {
+        // Session reply shares the stream with responses, receive pipelined ones first
+        self.discard_outstanding();
+        let response = match self.backend.session_request(op, payload, &mut self.packets) {
+            Ok(Some(response)) => response,
+            Ok(None) => return Ok(vec![]),
+            Err(error) => {
+                return Err(Error::new(
+                    format!("Server session error: {error}").as_str(),
+                ))
+            }
+        };
+        if op != response.id {
+            return Err(Error::new("Server session response ID didn't match"));
+        }
+        if response.error {
+            return Err(Error::new(
+                format!(
+                    "Server session error: {}",
+                    String::from_utf8_lossy(&response.data)
+                )
+                .as_str(),
+            ));
+        }
+        Ok(response.data)
+    }
+
     pub fn receive_response_or_packet(&mut self) -> Result<Option<UsbPacket>, Error> {
         let response = self
             .backend
@@ -510,14 +876,34 @@ pub fn new_local(port: &str) -> Result<Link, Error> {
     Ok(Link {
         backend: new_local_backend(port)?,
         packets: VecDeque::new(),
+        pipeline_depth: 0,
+        next_tag: 0,
+        outstanding: VecDeque::new(),
     })
 }
 
 pub fn new_remote(address: &str) -> Result<Link, Error> {
-    Ok(Link {
+    let (address, serial) = match address.split_once('/') {
+        Some((address, serial)) => (address, Some(serial)),
+        None => (address, None),
+    };
+    let mut link = Link {
         backend: new_remote_backend(address)?,
         packets: VecDeque::new(),
-    })
+        pipeline_depth: 0,
+        next_tag: 0,
+        outstanding: VecDeque::new(),
+    };
+    link.negotiate_capabilities()?;
+    if let Some(serial) = serial {
+        if !link.backend.sessions() {
+            return Err(Error::new(
+                "Server doesn't support selecting a device, update the server",
+            ));
+        }
+        link.session_request(SESSION_SELECT_DEVICE, serial.as_bytes())?;
+    }
+    Ok(link)
 }
 
 pub enum BackendType {
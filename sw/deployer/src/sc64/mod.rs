@@ -1,4 +1,5 @@
 mod cic;
+mod emulator;
 mod error;
 pub mod ff;
 pub mod firmware;
@@ -11,14 +12,14 @@ mod types;
 
 pub use self::{
     error::Error,
-    link::list_local_devices,
+    link::{list_local_devices, ServerLease},
     server::ServerEvent,
     types::{
         AuxMessage, BootMode, ButtonMode, ButtonState, CicSeed, CicStep, DataPacket, DdDiskState,
         DdDriveType, DdMode, DebugPacket, DiagnosticData, DiskPacket, DiskPacketKind,
-        FpgaDebugData, ISViewer, MemoryTestPattern, MemoryTestPatternResult, SaveType,
-        SaveWriteback, SdCardInfo, SdCardOpPacket, SdCardResult, SdCardStatus, SpeedTestDirection,
-        Switch, TvType,
+        FpgaDebugData, ISViewer, LatencyTestCommand, MemoryTestPattern, MemoryTestPatternResult,
+        SaveType, SaveWriteback, SdCardInfo, SdCardOpPacket, SdCardResult, SdCardStatus,
+        SpeedTestDirection, Switch, TraceData, TraceEntry, TvType,
     },
 };
 
@@ -27,15 +28,16 @@ use self::{
     link::Link,
     time::{convert_from_datetime, convert_to_datetime},
     types::{
-        get_config, get_setting, Config, ConfigId, FirmwareStatus, SdCardOp, Setting, SettingId,
-        UpdateStatus,
+        get_config, get_setting, next_config, Config, ConfigId, FirmwareStatus, SdCardOp, Setting,
+        SettingId, UpdateStatus,
     },
 };
 use chrono::NaiveDateTime;
-use rand::Rng;
+use rand::RngCore;
 use std::{
-    cmp::min,
-    io::{Read, Seek, Write},
+    cmp::{max, min},
+    collections::VecDeque,
+    io::{Read, Seek, SeekFrom, Write},
     thread::sleep,
     time::{Duration, Instant},
 };
@@ -65,6 +67,8 @@ pub struct DeviceState {
     pub datetime: NaiveDateTime,
     pub fpga_debug_data: FpgaDebugData,
     pub diagnostic_data: DiagnosticData,
+    pub usb_tx_sent_data: DiagnosticData,
+    pub usb_tx_dropped_data: DiagnosticData,
 }
 
 const SC64_V2_IDENTIFIER: &[u8; 4] = b"SCv2";
@@ -72,6 +76,8 @@ const SC64_V2_IDENTIFIER: &[u8; 4] = b"SCv2";
 const SUPPORTED_MAJOR_VERSION: u16 = 2;
 const SUPPORTED_MINOR_VERSION: u16 = 20;
 
+const PROTOCOL_VERSION_TAGGED: u32 = 3;
+
 const SDRAM_ADDRESS: u32 = 0x0000_0000;
 const SDRAM_LENGTH: usize = 64 * 1024 * 1024;
 
@@ -105,23 +111,55 @@ pub const SD_CARD_SECTOR_SIZE: usize = 512;
 
 const FIRMWARE_ADDRESS_SDRAM: u32 = 0x0010_0000; // Arbitrary offset in SDRAM memory
 const FIRMWARE_ADDRESS_FLASH: u32 = 0x0410_0000; // Arbitrary offset in Flash memory
+const FLASH_BENCH_ADDRESS: u32 = FIRMWARE_ADDRESS_FLASH;
 const FIRMWARE_UPDATE_TIMEOUT: Duration = Duration::from_secs(90);
 
-const ISV_BUFFER_LENGTH: usize = 64 * 1024;
+const FLASH_ERASE_POLL_PERIOD: Duration = Duration::from_millis(100);
+
+pub const ISV_BUFFER_LENGTH: usize = 64 * 1024;
+pub const ISV_MAX_BUFFER_LENGTH: usize = 8 * 1024 * 1024;
+const ISV_MEMORY_END: u32 = 0x0400_0000;
+
+const DD_BLOCK_BUFFER_ADDRESS: u32 = 0x03BB_B000;
+pub const DD_BLOCK_MAX_LENGTH: usize = 232 * 85;
+const DD_BLOCK_BUFFER_LENGTH: u32 = 0x5000;
+pub const DD_STAGING_SLOTS: usize = 4;
+const DD_STAGING_BUFFER_ADDRESS: u32 =
+    DD_BLOCK_BUFFER_ADDRESS - ((1 + DD_STAGING_SLOTS as u32) * DD_BLOCK_BUFFER_LENGTH);
+const DD_STAGING_TAGS_ADDRESS: u32 = DD_STAGING_BUFFER_ADDRESS - (DD_STAGING_SLOTS as u32 * 8);
+const DD_STAGING_TAG_VALID: u32 = 1 << 31;
 
 pub const MEMORY_LENGTH: usize = 0x0500_2C80;
 
 const MEMORY_CHUNK_LENGTH: usize = 1 * 1024 * 1024;
+const MEMORY_FILL_THRESHOLD: usize = 64 * 1024;
+
+const CHECKSUM_BUFFER_LENGTH: usize = 256;
+const CHECKSUM_CHUNK_LENGTH: usize = 64 * 1024;
+const CHECKSUM_MAX_BATCH_LENGTH: usize = 4 * 1024 * 1024;
+
+const DIFF_BLOCK_LENGTH: usize = 512;
+const DIFF_MERGE_DISTANCE: usize = 4 * 1024;
 
 impl SC64 {
-    fn command_identifier_get(&mut self) -> Result<[u8; 4], Error> {
-        let data = self.link.execute_command(b'v', [0, 0], &[])?;
-        if data.len() != 4 {
-            return Err(Error::new(
-                "Invalid data length received for identifier get command",
-            ));
-        }
-        Ok(data[0..4].try_into().unwrap())
+    fn command_identifier_get(&mut self) -> Result<([u8; 4], Option<(u32, usize)>), Error> {
+        let data = self
+            .link
+            .execute_command(b'v', [PROTOCOL_VERSION_TAGGED, 0], &[])?;
+        // Older firmware ignores the requested protocol version and returns only the identifier
+        let protocol = match data.len() {
+            4 => None,
+            8 => {
+                let protocol = u32::from_be_bytes(data[4..8].try_into().unwrap());
+                Some((protocol >> 16, (protocol & 0xFFFF) as usize))
+            }
+            _ => {
+                return Err(Error::new(
+                    "Invalid data length received for identifier get command",
+                ))
+            }
+        };
+        Ok((data[0..4].try_into().unwrap(), protocol))
     }
 
     fn command_version_get(&mut self) -> Result<(u16, u16, u32), Error> {
@@ -171,6 +209,32 @@ impl SC64 {
         Ok((config_id, value).try_into()?)
     }
 
+    fn command_config_get_batch(&mut self, config_ids: &[ConfigId]) -> Result<Vec<Config>, Error> {
+        let mut responses = Vec::with_capacity(config_ids.len());
+        for config_id in config_ids {
+            if let Some(data) = self
+                .link
+                .submit_command(b'c', [(*config_id).into(), 0], &[])?
+            {
+                responses.push(data);
+            }
+        }
+        while let Some(data) = self.link.complete_command()? {
+            responses.push(data);
+        }
+        let mut configs = Vec::with_capacity(config_ids.len());
+        for (config_id, data) in config_ids.iter().zip(responses) {
+            if data.len() != 4 {
+                return Err(Error::new(
+                    "Invalid data length received for config get command",
+                ));
+            }
+            let value = u32::from_be_bytes(data[0..4].try_into().unwrap());
+            configs.push((*config_id, value).try_into()?);
+        }
+        Ok(configs)
+    }
+
     fn command_config_set(&mut self, config: Config) -> Result<(), Error> {
         self.link.execute_command(b'C', config.into(), &[])?;
         Ok(())
@@ -228,6 +292,64 @@ impl SC64 {
         Ok(())
     }
 
+    fn command_memory_chunk_checksums(
+        &mut self,
+        address: u32,
+        length: usize,
+        chunk_length: usize,
+    ) -> Result<Vec<u32>, Error> {
+        let data = self.link.execute_command(
+            b'K',
+            [address, length as u32],
+            &(chunk_length as u32).to_be_bytes(),
+        )?;
+        if data.len() != (length.div_ceil(chunk_length) * 4) {
+            return Err(Error::new(
+                "Invalid data length received for memory chunk checksums command",
+            ));
+        }
+        Ok(data
+            .chunks_exact(4)
+            .map(|c| u32::from_be_bytes(c.try_into().unwrap()))
+            .collect())
+    }
+
+    fn command_memory_fill(
+        &mut self,
+        address: u32,
+        length: usize,
+        pattern: u32,
+    ) -> Result<bool, Error> {
+        Ok(self
+            .link
+            .execute_command_checked(b'l', [address, length as u32], &pattern.to_be_bytes())?
+            .is_some())
+    }
+
+    fn command_memory_test(
+        &mut self,
+        address: u32,
+        length: usize,
+        generator: &MemoryTestGenerator,
+        fill: bool,
+        verify: bool,
+    ) -> Result<(u32, u32), Error> {
+        let mode =
+            (generator.mode << 8) | if verify { 1 << 1 } else { 0 } | if fill { 1 << 0 } else { 0 };
+        let args = [mode.to_be_bytes(), generator.seed.to_be_bytes()].concat();
+        let data = self
+            .link
+            .execute_command(b'Q', [address, length as u32], &args)?;
+        if data.len() != 12 {
+            return Err(Error::new(
+                "Invalid data length received for memory test command",
+            ));
+        }
+        let errors = u32::from_be_bytes(data[0..4].try_into().unwrap());
+        let first_error_address = u32::from_be_bytes(data[4..8].try_into().unwrap());
+        Ok((errors, first_error_address))
+    }
+
     fn command_usb_write(&mut self, datatype: u8, data: &[u8]) -> Result<(), Error> {
         self.link.execute_command_raw(
             b'U',
@@ -312,11 +434,31 @@ impl SC64 {
         Ok(erase_block_size)
     }
 
+    fn command_flash_erase_pending(&mut self) -> Result<Option<u32>, Error> {
+        let data = self
+            .link
+            .execute_command(b'p', [false as u32, true as u32], &[])?;
+        // Older firmware ignores the status request and returns only the erase block size
+        match data.len() {
+            4 => Ok(None),
+            8 => Ok(Some(u32::from_be_bytes(data[4..8].try_into().unwrap()))),
+            _ => Err(Error::new(
+                "Invalid data length received for flash wait busy command",
+            )),
+        }
+    }
+
     fn command_flash_erase_block(&mut self, address: u32) -> Result<(), Error> {
         self.link.execute_command(b'P', [address, 0], &[])?;
         Ok(())
     }
 
+    fn command_flash_erase_start(&mut self, address: u32, length: usize) -> Result<(), Error> {
+        self.link
+            .execute_command(b'E', [address, length as u32], &[])?;
+        Ok(())
+    }
+
     fn command_firmware_backup(&mut self, address: u32) -> Result<(FirmwareStatus, u32), Error> {
         let data = self
             .link
@@ -352,8 +494,13 @@ impl SC64 {
         Ok(data.try_into()?)
     }
 
-    fn command_diagnostic_data_get(&mut self) -> Result<DiagnosticData, Error> {
-        let data = self.link.execute_command(b'%', [0, 0], &[])?;
+    fn command_diagnostic_data_get(&mut self, page: u32) -> Result<DiagnosticData, Error> {
+        let data = self.link.execute_command(b'%', [page, 0], &[])?;
+        Ok(data.try_into()?)
+    }
+
+    fn command_trace_read(&mut self, enable: bool) -> Result<TraceData, Error> {
+        let data = self.link.execute_command(b'g', [enable as u32, 0], &[])?;
         Ok(data.try_into()?)
     }
 }
@@ -365,63 +512,172 @@ impl SC64 {
         length: usize,
         no_shadow: bool,
     ) -> Result<(), Error> {
-        if length > MAX_ROM_LENGTH {
-            return Err(Error::new("ROM length too big"));
-        }
+        self.upload_rom_layout(
+            reader,
+            length,
+            no_shadow,
+            |sc64, reader, length, transform| {
+                sc64.memory_write_sparse_chunked(reader, SDRAM_ADDRESS, length, Some(transform))
+            },
+        )
+    }
 
-        let mut pi_config = vec![0u8; 4];
+    pub fn upload_rom_delta<T: Read + Seek>(
+        &mut self,
+        reader: &mut T,
+        length: usize,
+        no_shadow: bool,
+        previous_checksums: &[u32],
+    ) -> Result<(Vec<u32>, usize), Error> {
+        self.upload_rom_layout(
+            reader,
+            length,
+            no_shadow,
+            |sc64, reader, length, transform| {
+                sc64.memory_write_delta(
+                    reader,
+                    SDRAM_ADDRESS,
+                    length,
+                    transform,
+                    previous_checksums,
+                )
+            },
+        )
+    }
 
-        reader.rewind()?;
-        reader.read_exact(&mut pi_config)?;
-        reader.rewind()?;
+    pub fn upload_rom_diff<T: Read + Seek>(
+        &mut self,
+        reader: &mut T,
+        length: usize,
+        no_shadow: bool,
+        previous_image: &[u8],
+    ) -> Result<(Vec<u8>, usize), Error> {
+        self.upload_rom_layout(
+            reader,
+            length,
+            no_shadow,
+            |sc64, reader, length, transform| {
+                sc64.memory_write_diff(reader, SDRAM_ADDRESS, length, transform, previous_image)
+            },
+        )
+    }
 
-        let endian_swapper = match &pi_config[0..4] {
-            [0x37, 0x80, 0x40, 0x12] => {
-                |b: &mut [u8]| b.chunks_exact_mut(2).for_each(|c| c.swap(0, 1))
+    pub fn verify_rom<T: Read + Seek>(
+        &mut self,
+        reader: &mut T,
+        length: usize,
+        no_shadow: bool,
+    ) -> Result<(), Error> {
+        let endian_swapper = get_rom_endian_swapper(reader)?;
+        let layout = get_rom_layout(length, no_shadow)?;
+
+        let mut mismatched_chunks = 0;
+        let mut first_mismatch = None;
+
+        for (address, length) in [
+            (SDRAM_ADDRESS, layout.sdram_length),
+            (ROM_SHADOW_ADDRESS, layout.rom_shadow_length),
+            (ROM_EXTENDED_ADDRESS, layout.rom_extended_length),
+        ] {
+            let mut data = vec![0u8; length];
+            reader.read_exact(&mut data)?;
+            endian_swapper(&mut data);
+            let device_checksums =
+                self.memory_chunk_checksums(address, length, CHECKSUM_CHUNK_LENGTH)?;
+            for (index, chunk) in data.chunks(CHECKSUM_CHUNK_LENGTH).enumerate() {
+                if crc32fast::hash(chunk) != device_checksums[index] {
+                    mismatched_chunks += 1;
+                    first_mismatch.get_or_insert(address + (index * CHECKSUM_CHUNK_LENGTH) as u32);
+                }
             }
-            [0x40, 0x12, 0x37, 0x80] => |b: &mut [u8]| {
-                b.chunks_exact_mut(4).for_each(|c| {
-                    c.swap(0, 3);
-                    c.swap(1, 2)
-                })
-            },
-            _ => |_: &mut [u8]| {},
-        };
+        }
 
-        let rom_shadow_enabled = !no_shadow && length > (SDRAM_LENGTH - ROM_SHADOW_LENGTH);
-        let rom_extended_enabled = length > SDRAM_LENGTH;
+        if let Some(address) = first_mismatch {
+            return Err(Error::new(
+                format!(
+                    "ROM verification failed, {mismatched_chunks} chunk(s) differ (first at address 0x{address:08X})"
+                )
+                .as_str(),
+            ));
+        }
 
-        let sdram_length = if rom_shadow_enabled {
-            min(length, SDRAM_LENGTH - ROM_SHADOW_LENGTH)
-        } else {
-            min(length, SDRAM_LENGTH)
-        };
+        Ok(())
+    }
 
-        self.memory_write_chunked(reader, SDRAM_ADDRESS, sdram_length, Some(endian_swapper))?;
+    fn upload_rom_layout<T: Read + Seek, R>(
+        &mut self,
+        reader: &mut T,
+        length: usize,
+        no_shadow: bool,
+        sdram_write: impl FnOnce(&mut Self, &mut T, usize, fn(&mut [u8])) -> Result<R, Error>,
+    ) -> Result<R, Error> {
+        let endian_swapper = get_rom_endian_swapper(reader)?;
+        let layout = get_rom_layout(length, no_shadow)?;
+
+        let mut flash_writes = Vec::new();
+        if (layout.rom_shadow_length > 0) || (layout.rom_extended_length > 0) {
+            let erase_block_size = self.command_flash_wait_busy(false)? as usize;
+            reader.seek(SeekFrom::Start(layout.sdram_length as u64))?;
+            for (address, length) in [
+                (ROM_SHADOW_ADDRESS, layout.rom_shadow_length),
+                (ROM_EXTENDED_ADDRESS, layout.rom_extended_length),
+            ] {
+                let mut data = vec![0u8; length];
+                reader.read_exact(&mut data)?;
+                endian_swapper(&mut data);
+                let ranges = self.flash_find_changed_ranges(address, &data, erase_block_size)?;
+                flash_writes.push((address, data, ranges));
+            }
+            reader.rewind()?;
+        }
 
-        self.command_config_set(Config::RomShadowEnable(rom_shadow_enabled.into()))?;
-        if rom_shadow_enabled {
-            let rom_shadow_length = min(length - sdram_length, ROM_SHADOW_LENGTH);
-            self.flash_program(
-                reader,
-                ROM_SHADOW_ADDRESS,
-                rom_shadow_length,
-                Some(endian_swapper),
-            )?;
+        // Erase is the slowest part of the flash programming, newer firmware can perform it
+        // in the background while SDRAM part of the ROM is being transferred
+        let mut background_erase = true;
+        for (address, _, ranges) in flash_writes.iter() {
+            for (start, end) in ranges.iter() {
+                if background_erase
+                    && self
+                        .command_flash_erase_start(address + *start as u32, end - start)
+                        .is_err()
+                {
+                    background_erase = false;
+                }
+            }
         }
 
+        let result = sdram_write(self, reader, layout.sdram_length, endian_swapper)?;
+
+        let rom_shadow_enabled = layout.rom_shadow_length > 0;
+        self.command_config_set(Config::RomShadowEnable(rom_shadow_enabled.into()))?;
+        let rom_extended_enabled = layout.rom_extended_length > 0;
         self.command_config_set(Config::RomExtendedEnable(rom_extended_enabled.into()))?;
-        if rom_extended_enabled {
-            let rom_extended_length = min(length - SDRAM_LENGTH, ROM_EXTENDED_LENGTH);
-            self.flash_program(
-                reader,
-                ROM_EXTENDED_ADDRESS,
-                rom_extended_length,
-                Some(endian_swapper),
-            )?;
+
+        if !flash_writes.is_empty() {
+            for (address, _, ranges) in flash_writes.iter() {
+                for (start, end) in ranges.iter() {
+                    if !background_erase {
+                        self.flash_erase(address + *start as u32, end - start)?;
+                    }
+                }
+            }
+            self.flash_wait_erase()?;
+            for (address, data, ranges) in flash_writes.iter() {
+                for (start, end) in ranges.iter() {
+                    let end = min(*end, data.len());
+                    for offset in (*start..end).step_by(MEMORY_CHUNK_LENGTH) {
+                        let chunk_end = min(offset + MEMORY_CHUNK_LENGTH, end);
+                        self.command_memory_write(
+                            address + offset as u32,
+                            &data[offset..chunk_end],
+                        )?;
+                    }
+                }
+            }
+            self.command_flash_wait_busy(true)?;
         }
 
-        Ok(())
+        Ok(result)
     }
 
     pub fn upload_ddipl<T: Read>(&mut self, reader: &mut T, length: usize) -> Result<(), Error> {
@@ -508,6 +764,10 @@ impl SC64 {
         Ok((seed, checksum, matched))
     }
 
+    pub fn set_cic_parameters(&mut self, seed: u8, checksum: u64) -> Result<(), Error> {
+        self.command_cic_params_set(false, seed, checksum)
+    }
+
     pub fn set_boot_mode(&mut self, boot_mode: BootMode) -> Result<(), Error> {
         self.command_config_set(Config::BootMode(boot_mode))
     }
@@ -533,27 +793,55 @@ impl SC64 {
     }
 
     pub fn get_device_state(&mut self) -> Result<DeviceState, Error> {
+        let mut configs = self
+            .command_config_get_batch(&[
+                ConfigId::BootloaderSwitch,
+                ConfigId::RomWriteEnable,
+                ConfigId::RomShadowEnable,
+                ConfigId::DdMode,
+                ConfigId::ISViewer,
+                ConfigId::BootMode,
+                ConfigId::SaveType,
+                ConfigId::CicSeed,
+                ConfigId::TvType,
+                ConfigId::DdSdEnable,
+                ConfigId::DdDriveType,
+                ConfigId::DdDiskState,
+                ConfigId::ButtonState,
+                ConfigId::ButtonMode,
+                ConfigId::RomExtendedEnable,
+            ])?
+            .into_iter();
         Ok(DeviceState {
-            bootloader_switch: get_config!(self, BootloaderSwitch)?,
-            rom_write_enable: get_config!(self, RomWriteEnable)?,
-            rom_shadow_enable: get_config!(self, RomShadowEnable)?,
-            dd_mode: get_config!(self, DdMode)?,
-            isviewer: get_config!(self, ISViewer)?,
-            boot_mode: get_config!(self, BootMode)?,
-            save_type: get_config!(self, SaveType)?,
-            cic_seed: get_config!(self, CicSeed)?,
-            tv_type: get_config!(self, TvType)?,
-            dd_sd_enable: get_config!(self, DdSdEnable)?,
-            dd_drive_type: get_config!(self, DdDriveType)?,
-            dd_disk_state: get_config!(self, DdDiskState)?,
-            button_state: get_config!(self, ButtonState)?,
-            button_mode: get_config!(self, ButtonMode)?,
-            rom_extended_enable: get_config!(self, RomExtendedEnable)?,
+            bootloader_switch: next_config!(configs, BootloaderSwitch)?,
+            rom_write_enable: next_config!(configs, RomWriteEnable)?,
+            rom_shadow_enable: next_config!(configs, RomShadowEnable)?,
+            dd_mode: next_config!(configs, DdMode)?,
+            isviewer: next_config!(configs, ISViewer)?,
+            boot_mode: next_config!(configs, BootMode)?,
+            save_type: next_config!(configs, SaveType)?,
+            cic_seed: next_config!(configs, CicSeed)?,
+            tv_type: next_config!(configs, TvType)?,
+            dd_sd_enable: next_config!(configs, DdSdEnable)?,
+            dd_drive_type: next_config!(configs, DdDriveType)?,
+            dd_disk_state: next_config!(configs, DdDiskState)?,
+            button_state: next_config!(configs, ButtonState)?,
+            button_mode: next_config!(configs, ButtonMode)?,
+            rom_extended_enable: next_config!(configs, RomExtendedEnable)?,
             led_enable: get_setting!(self, LedEnable)?,
             sd_card_status: self.get_sd_card_status()?,
             datetime: self.get_datetime()?,
             fpga_debug_data: self.command_fpga_debug_data_get()?,
-            diagnostic_data: self.command_diagnostic_data_get()?,
+            diagnostic_data: self.command_diagnostic_data_get(0)?,
+            // Older firmware ignores the page and always returns the default one
+            usb_tx_sent_data: match self.command_diagnostic_data_get(1)? {
+                data @ DiagnosticData::V3(_) => data,
+                _ => DiagnosticData::Unknown,
+            },
+            usb_tx_dropped_data: match self.command_diagnostic_data_get(2)? {
+                data @ DiagnosticData::V4(_) => data,
+                _ => DiagnosticData::Unknown,
+            },
         })
     }
 
@@ -576,10 +864,62 @@ impl SC64 {
         self.command_config_set(Config::DdDiskState(disk_state))
     }
 
-    pub fn configure_is_viewer_64(&mut self, offset: Option<u32>) -> Result<(), Error> {
+    pub fn set_64dd_usb_staging(&mut self, enabled: bool) -> Result<(), Error> {
+        self.clear_64dd_staging()?;
+        self.command_config_set(Config::DdUsbStagingEnable(enabled.into()))
+    }
+
+    pub fn clear_64dd_staging(&mut self) -> Result<(), Error> {
+        self.command_memory_write(DD_STAGING_TAGS_ADDRESS, &[0u8; DD_STAGING_SLOTS * 8])
+    }
+
+    pub fn invalidate_64dd_staging_slot(&mut self, slot: usize) -> Result<(), Error> {
+        self.command_memory_write(DD_STAGING_TAGS_ADDRESS + (slot as u32 * 8), &[0u8; 8])
+    }
+
+    pub fn stage_64dd_block(
+        &mut self,
+        slot: usize,
+        location: u32,
+        data: &[u8],
+    ) -> Result<(), Error> {
+        // Tag is written last, flashcart treats the slot as complete as soon as the tag matches
+        let slot_address = DD_STAGING_BUFFER_ADDRESS + (slot as u32 * DD_BLOCK_BUFFER_LENGTH);
+        self.invalidate_64dd_staging_slot(slot)?;
+        self.command_memory_write(slot_address, data)?;
+        let tag = [
+            (DD_STAGING_TAG_VALID | location).to_be_bytes(),
+            (data.len() as u32).to_be_bytes(),
+        ]
+        .concat();
+        self.command_memory_write(DD_STAGING_TAGS_ADDRESS + (slot as u32 * 8), &tag)
+    }
+
+    pub fn get_64dd_staging_slot(&self, address: u32) -> Option<usize> {
+        let offset = address.checked_sub(DD_STAGING_BUFFER_ADDRESS)?;
+        let slot = (offset / DD_BLOCK_BUFFER_LENGTH) as usize;
+        if (offset % DD_BLOCK_BUFFER_LENGTH) != 0 || slot >= DD_STAGING_SLOTS {
+            return None;
+        }
+        Some(slot)
+    }
+
+    pub fn configure_is_viewer_64(
+        &mut self,
+        offset: Option<u32>,
+        buffer_length: usize,
+    ) -> Result<(), Error> {
         if let Some(offset) = offset {
+            if (offset as usize + buffer_length) > ISV_MEMORY_END as usize {
+                return Err(Error::new(
+                    format!(
+                        "IS-Viewer 64 buffer at offset 0x{offset:08X} doesn't fit in the ROM space"
+                    )
+                    .as_str(),
+                ));
+            }
             if get_config!(self, RomShadowEnable)?.into() {
-                if offset > (SAVE_ADDRESS - ISV_BUFFER_LENGTH as u32) {
+                if offset > (SAVE_ADDRESS - buffer_length as u32) {
                     return Err(Error::new(
                         format!(
                             "ROM shadow is enabled, IS-Viewer 64 at offset 0x{offset:08X} won't work"
@@ -588,6 +928,14 @@ impl SC64 {
                     ));
                 }
             }
+            self.command_config_set(Config::ISViewer(ISViewer::Disabled))?;
+            // Older firmware supports only the default buffer length
+            match self.command_config_set(Config::IsvBufferSize(buffer_length as u32)) {
+                Err(_) if buffer_length == ISV_BUFFER_LENGTH => {}
+                result => result.map_err(|_| {
+                    Error::new("IS-Viewer 64 buffer length not supported by the firmware")
+                })?,
+            }
             self.command_config_set(Config::RomWriteEnable(Switch::On))?;
             self.command_config_set(Config::ISViewer(ISViewer::Enabled(offset)))?;
         } else {
@@ -621,6 +969,7 @@ impl SC64 {
                     self.command_memory_write(packet.info.address, &packet.info.data)?;
                 }
                 DiskPacketKind::Write => {}
+                DiskPacketKind::Staged => return Ok(()),
             }
             self.command_dd_set_block_ready(false)?;
         } else {
@@ -745,13 +1094,48 @@ impl SC64 {
         Ok(SdCardResult::OK)
     }
 
+    pub fn checksum_sd_card(&mut self, sector: u32, length: usize) -> Result<u32, Error> {
+        let mut current_sector = sector;
+        let mut remaining = length;
+        let mut hasher = crc32fast::Hasher::new();
+
+        while remaining > 0 {
+            let chunk_length = min(remaining, SD_CARD_BUFFER_LENGTH);
+            let sectors = chunk_length.div_ceil(SD_CARD_SECTOR_SIZE) as u32;
+            match self.command_sd_card_read(SD_CARD_BUFFER_ADDRESS, current_sector, sectors)? {
+                SdCardResult::OK => {}
+                result => {
+                    return Err(Error::new(
+                        format!("Couldn't read SD card sectors: {result}").as_str(),
+                    ))
+                }
+            }
+            // Reading data back over USB is faster than checksumming it on the SC64, controller
+            // can only access memory through its SPI link to the FPGA
+            hasher.update(&self.command_memory_read(SD_CARD_BUFFER_ADDRESS, chunk_length)?);
+            current_sector += sectors;
+            remaining -= chunk_length;
+        }
+
+        Ok(hasher.finalize())
+    }
+
+    pub fn acquire_lease(&mut self, lease: ServerLease) -> Result<(), Error> {
+        self.link.acquire_lease(lease)
+    }
+
     pub fn check_device(&mut self) -> Result<(), Error> {
-        let identifier = self.command_identifier_get().map_err(|e| {
+        let (identifier, protocol) = self.command_identifier_get().map_err(|e| {
             Error::new(format!("Couldn't get SC64 device identifier: {e}").as_str())
         })?;
         if &identifier != SC64_V2_IDENTIFIER {
             return Err(Error::new("Unknown identifier received, not a SC64 device"));
         }
+        if let Some((version, depth)) = protocol {
+            if version >= PROTOCOL_VERSION_TAGGED {
+                self.link.enable_tagged_commands(depth);
+            }
+        }
         Ok(())
     }
 
@@ -773,6 +1157,10 @@ impl SC64 {
         self.command_state_reset()
     }
 
+    pub fn read_trace(&mut self, enable: bool) -> Result<TraceData, Error> {
+        self.command_trace_read(enable)
+    }
+
     pub fn is_console_powered_on(&mut self) -> Result<bool, Error> {
         let debug_data = self.command_fpga_debug_data_get()?;
         Ok(match debug_data.cic_step {
@@ -925,63 +1313,182 @@ impl SC64 {
         Ok((TEST_LENGTH as f64 / MIB_DIVIDER) / elapsed.as_secs_f64())
     }
 
-    pub fn test_sdram_pattern(
+    pub fn bench_command_latency(
         &mut self,
-        pattern: MemoryTestPattern,
-        fade: Option<u64>,
-    ) -> Result<MemoryTestPatternResult, Error> {
-        let item_size = std::mem::size_of::<u32>();
-        let mut test_data = vec![0u32; SDRAM_LENGTH / item_size];
-
-        match pattern {
-            MemoryTestPattern::OwnAddress(inverted) => {
-                for (index, item) in test_data.iter_mut().enumerate() {
-                    let mut value = (index * item_size) as u32;
-                    if inverted {
-                        value ^= 0xFFFFFFFFu32;
-                    }
-                    *item = value;
+        command: &LatencyTestCommand,
+    ) -> Result<Duration, Error> {
+        let time = Instant::now();
+
+        match command {
+            LatencyTestCommand::IdentifierGet => {
+                self.command_identifier_get()?;
+            }
+            LatencyTestCommand::ConfigGet => {
+                self.command_config_get(ConfigId::BootMode)?;
+            }
+        }
+
+        Ok(time.elapsed())
+    }
+
+    pub fn bench_usb_transfer(
+        &mut self,
+        direction: &SpeedTestDirection,
+        chunk_length: usize,
+        length: usize,
+    ) -> Result<Duration, Error> {
+        let data = vec![0x00; chunk_length];
+
+        let time = Instant::now();
+
+        for offset in (0..length).step_by(chunk_length) {
+            let address = SDRAM_ADDRESS + offset as u32;
+            match direction {
+                SpeedTestDirection::Read => {
+                    self.command_memory_read(address, chunk_length)?;
+                }
+                SpeedTestDirection::Write => {
+                    self.command_memory_write(address, &data)?;
                 }
             }
-            MemoryTestPattern::AllZeros => test_data.fill(0x00000000u32),
-            MemoryTestPattern::AllOnes => test_data.fill(0xFFFFFFFFu32),
-            MemoryTestPattern::Custom(pattern) => test_data.fill(pattern),
-            MemoryTestPattern::Random => rand::thread_rng().fill(&mut test_data[..]),
-        };
+        }
 
-        let raw_test_data: Vec<u8> = test_data.iter().flat_map(|v| v.to_be_bytes()).collect();
-        let mut writer: &[u8] = &raw_test_data;
-        self.memory_write_chunked(&mut writer, SDRAM_ADDRESS, SDRAM_LENGTH, None)?;
+        Ok(time.elapsed())
+    }
 
-        if let Some(fade) = fade {
-            sleep(Duration::from_secs(fade));
+    pub fn bench_flash(&mut self, length: usize) -> Result<(Duration, Duration, Duration), Error> {
+        // Avoid 0xFF bytes, programming them could be skipped by the flash chip
+        let data: Vec<u8> = (0..length).map(|i| ((i ^ (i >> 8)) & 0x7F) as u8).collect();
+
+        let time = Instant::now();
+        self.flash_erase(FLASH_BENCH_ADDRESS, length)?;
+        self.command_flash_wait_busy(true)?;
+        let erase = time.elapsed();
+
+        let time = Instant::now();
+        self.bench_flash_program(&data)?;
+        let program = time.elapsed();
+
+        let mut check_data = Vec::with_capacity(length);
+        let time = Instant::now();
+        self.memory_read_chunked(&mut check_data, FLASH_BENCH_ADDRESS, length)?;
+        let read = time.elapsed();
+
+        if check_data != data {
+            return Err(Error::new("Flash benchmark data verification failed"));
         }
 
-        let mut raw_check_data = vec![0u8; SDRAM_LENGTH];
-        let mut reader: &mut [u8] = &mut raw_check_data;
-        self.memory_read_chunked(&mut reader, SDRAM_ADDRESS, SDRAM_LENGTH)?;
-        let check_data = raw_check_data
-            .chunks(4)
-            .map(|a| u32::from_be_bytes(a[0..4].try_into().unwrap()));
+        Ok((erase, program, read))
+    }
 
-        let all_errors: Vec<(usize, (u32, u32))> = test_data
-            .into_iter()
-            .zip(check_data)
-            .enumerate()
-            .filter(|(_, (a, b))| a != b)
-            .map(|(i, (a, b))| (i * item_size, (a, b)))
-            .collect();
+    pub fn bench_flash_backup(&mut self, length: usize) -> Result<Vec<u8>, Error> {
+        let mut data = Vec::with_capacity(length);
+        self.memory_read_chunked(&mut data, FLASH_BENCH_ADDRESS, length)?;
+        Ok(data)
+    }
+
+    pub fn bench_flash_restore(&mut self, data: &[u8]) -> Result<(), Error> {
+        self.flash_erase(FLASH_BENCH_ADDRESS, data.len())?;
+        self.command_flash_wait_busy(true)?;
+        self.bench_flash_program(data)
+    }
+
+    fn bench_flash_program(&mut self, data: &[u8]) -> Result<(), Error> {
+        for (index, chunk) in data.chunks(MEMORY_CHUNK_LENGTH).enumerate() {
+            let address = FLASH_BENCH_ADDRESS + (index * MEMORY_CHUNK_LENGTH) as u32;
+            self.command_memory_write(address, chunk)?;
+        }
+        self.command_flash_wait_busy(true)?;
+        Ok(())
+    }
+
+    pub fn bench_64dd_request(&mut self, timeout: Duration) -> Result<DiskPacket, Error> {
+        let time = Instant::now();
+        while time.elapsed() < timeout {
+            if let Some(DataPacket::DiskRequest(disk_packet)) = self.receive_data_packet()? {
+                return Ok(disk_packet);
+            }
+        }
+        Err(Error::new(
+            "No 64DD block request received, N64 has to run software reading from the disk",
+        ))
+    }
 
-        let first_error = if all_errors.len() > 0 {
-            Some(all_errors.get(0).copied().unwrap())
+    pub fn test_sdram_pattern(
+        &mut self,
+        pattern: MemoryTestPattern,
+        fade: Option<u64>,
+    ) -> Result<MemoryTestPatternResult, Error> {
+        let generator = MemoryTestGenerator::new(pattern);
+
+        // Pattern is generated and checked by the FPGA, host only receives the results,
+        // older firmware without this command falls back to streaming through USB
+        let device_result = self
+            .command_memory_test(SDRAM_ADDRESS, SDRAM_LENGTH, &generator, true, false)
+            .and_then(|_| {
+                if let Some(fade) = fade {
+                    sleep(Duration::from_secs(fade));
+                }
+                self.command_memory_test(SDRAM_ADDRESS, SDRAM_LENGTH, &generator, false, true)
+            });
+
+        let (errors, first_error_address) = match device_result {
+            Ok(result) => result,
+            Err(_) => self.memory_test_streaming(&generator, fade)?,
+        };
+
+        let first_error = if errors > 0 {
+            let address = first_error_address & !3;
+            let data = self.command_memory_read(address, 4)?;
+            let read = u32::from_be_bytes(data[0..4].try_into().unwrap());
+            Some((address as usize, (generator.word_at(address), read)))
         } else {
             None
         };
 
-        return Ok(MemoryTestPatternResult {
+        Ok(MemoryTestPatternResult {
             first_error,
-            all_errors,
-        });
+            errors: errors as usize,
+        })
+    }
+
+    fn memory_test_streaming(
+        &mut self,
+        generator: &MemoryTestGenerator,
+        fade: Option<u64>,
+    ) -> Result<(u32, u32), Error> {
+        let mut expected = vec![0u8; MEMORY_CHUNK_LENGTH];
+
+        let mut state = generator.start();
+        for offset in (0..SDRAM_LENGTH).step_by(MEMORY_CHUNK_LENGTH) {
+            let address = SDRAM_ADDRESS + offset as u32;
+            generator.fill(&mut state, address, &mut expected);
+            self.command_memory_write(address, &expected)?;
+        }
+
+        if let Some(fade) = fade {
+            sleep(Duration::from_secs(fade));
+        }
+
+        let mut errors = 0u32;
+        let mut first_error_address = 0u32;
+
+        let mut state = generator.start();
+        for offset in (0..SDRAM_LENGTH).step_by(MEMORY_CHUNK_LENGTH) {
+            let address = SDRAM_ADDRESS + offset as u32;
+            generator.fill(&mut state, address, &mut expected);
+            let data = self.command_memory_read(address, MEMORY_CHUNK_LENGTH)?;
+            for (index, (a, b)) in expected.chunks(2).zip(data.chunks(2)).enumerate() {
+                if a != b {
+                    if errors == 0 {
+                        first_error_address = address + (index * 2) as u32;
+                    }
+                    errors += 1;
+                }
+            }
+        }
+
+        Ok((errors, first_error_address))
     }
 
     fn memory_read_chunked(
@@ -992,13 +1499,31 @@ impl SC64 {
     ) -> Result<(), Error> {
         let mut memory_address = address;
         let mut bytes_left = length;
+        let mut lengths = VecDeque::new();
+        let mut write_chunk = |data: Vec<u8>, lengths: &mut VecDeque<usize>| {
+            if Some(data.len()) != lengths.pop_front() {
+                return Err(Error::new(
+                    "Invalid data length received for memory read command",
+                ));
+            }
+            writer.write_all(&data)?;
+            Ok(())
+        };
         while bytes_left > 0 {
             let bytes = min(MEMORY_CHUNK_LENGTH, bytes_left);
-            let data = self.command_memory_read(memory_address, bytes)?;
-            writer.write_all(&data)?;
+            let completed = self
+                .link
+                .submit_command(b'm', [memory_address, bytes as u32], &[])?;
+            lengths.push_back(bytes);
+            if let Some(data) = completed {
+                write_chunk(data, &mut lengths)?;
+            }
             memory_address += bytes as u32;
             bytes_left -= bytes;
         }
+        while let Some(data) = self.link.complete_command()? {
+            write_chunk(data, &mut lengths)?;
+        }
         Ok(())
     }
 
@@ -1020,38 +1545,257 @@ impl SC64 {
             if let Some(transform) = transform {
                 transform(&mut data[0..bytes]);
             }
-            self.command_memory_write(memory_address, &data[0..bytes])?;
+            self.link
+                .submit_command(b'M', [memory_address, bytes as u32], &data[0..bytes])?;
             memory_address += bytes as u32;
         }
+        while self.link.complete_command()?.is_some() {}
         Ok(())
     }
 
-    fn flash_erase(&mut self, address: u32, length: usize) -> Result<(), Error> {
-        let erase_block_size = self.command_flash_wait_busy(false)?;
-        for offset in (0..length as u32).step_by(erase_block_size as usize) {
-            self.command_flash_erase_block(address + offset)?;
+    fn memory_write_delta(
+        &mut self,
+        reader: &mut dyn Read,
+        address: u32,
+        length: usize,
+        transform: fn(&mut [u8]),
+        previous_checksums: &[u32],
+    ) -> Result<(Vec<u32>, usize), Error> {
+        let mut data = vec![0u8; length];
+        reader.read_exact(&mut data)?;
+        transform(&mut data);
+
+        let checksums: Vec<u32> = data
+            .chunks(CHECKSUM_CHUNK_LENGTH)
+            .map(crc32fast::hash)
+            .collect();
+        let mut changed: Vec<bool> = checksums
+            .iter()
+            .enumerate()
+            .map(|(index, checksum)| previous_checksums.get(index) != Some(checksum))
+            .collect();
+
+        // Memory contents could have been modified since the previous upload (power cycle,
+        // menu or game with ROM writes enabled, other hosts), check every chunk expected to be
+        // unchanged and upload the mismatched ones too
+        let mut index = 0;
+        while index < changed.len() {
+            if changed[index] {
+                index += 1;
+                continue;
+            }
+            let start = index;
+            while index < changed.len() && !changed[index] {
+                index += 1;
+            }
+            let offset = start * CHECKSUM_CHUNK_LENGTH;
+            let end = min(index * CHECKSUM_CHUNK_LENGTH, length);
+            let device_checksums = self.memory_chunk_checksums(
+                address + offset as u32,
+                end - offset,
+                CHECKSUM_CHUNK_LENGTH,
+            )?;
+            for (chunk, device_checksum) in device_checksums.iter().enumerate() {
+                if *device_checksum != checksums[start + chunk] {
+                    changed[start + chunk] = true;
+                }
+            }
         }
-        Ok(())
+
+        let mut uploaded_length = 0;
+        let mut index = 0;
+        while index < changed.len() {
+            if !changed[index] {
+                index += 1;
+                continue;
+            }
+            let start = index;
+            while index < changed.len()
+                && changed[index]
+                && ((index - start) * CHECKSUM_CHUNK_LENGTH) < MEMORY_CHUNK_LENGTH
+            {
+                index += 1;
+            }
+            let offset = start * CHECKSUM_CHUNK_LENGTH;
+            let end = min(index * CHECKSUM_CHUNK_LENGTH, length);
+            self.command_memory_write(address + offset as u32, &data[offset..end])?;
+            uploaded_length += end - offset;
+        }
+
+        Ok((checksums, uploaded_length))
+    }
+
+    fn memory_write_diff(
+        &mut self,
+        reader: &mut dyn Read,
+        address: u32,
+        length: usize,
+        transform: fn(&mut [u8]),
+        previous_data: &[u8],
+    ) -> Result<(Vec<u8>, usize), Error> {
+        let mut data = vec![0u8; length];
+        reader.read_exact(&mut data)?;
+        transform(&mut data);
+
+        let mut uploaded_length = 0;
+        for (start, end) in find_changed_ranges(&data, previous_data) {
+            for offset in (start..end).step_by(MEMORY_CHUNK_LENGTH) {
+                let chunk_end = min(offset + MEMORY_CHUNK_LENGTH, end);
+                self.command_memory_write(address + offset as u32, &data[offset..chunk_end])?;
+            }
+            uploaded_length += end - start;
+        }
+
+        Ok((data, uploaded_length))
+    }
+
+    fn memory_chunk_checksums(
+        &mut self,
+        address: u32,
+        length: usize,
+        chunk_length: usize,
+    ) -> Result<Vec<u32>, Error> {
+        // Controller reads memory at roughly 1 MiB/s, keep each command well within IO timeout
+        let max_chunks = min(
+            CHECKSUM_BUFFER_LENGTH / 4,
+            max(CHECKSUM_MAX_BATCH_LENGTH / chunk_length, 1),
+        );
+        let max_batch_length = max_chunks * chunk_length;
+        let mut checksums = Vec::new();
+        let mut offset = 0;
+        while offset < length {
+            let batch_length = min(length - offset, max_batch_length);
+            checksums.append(&mut self.command_memory_chunk_checksums(
+                address + offset as u32,
+                batch_length,
+                chunk_length,
+            )?);
+            offset += batch_length;
+        }
+        Ok(checksums)
     }
 
-    fn flash_program(
+    fn memory_write_sparse_chunked(
         &mut self,
         reader: &mut dyn Read,
         address: u32,
         length: usize,
         transform: Option<fn(&mut [u8])>,
     ) -> Result<(), Error> {
-        self.flash_erase(address, length)?;
-        self.memory_write_chunked(reader, address, length, transform)?;
+        let mut limited_reader = reader.take(length as u64);
+        let mut memory_address = address;
+        let mut data: Vec<u8> = vec![0u8; MEMORY_CHUNK_LENGTH];
+        let mut fill_supported: Option<bool> = None;
+        loop {
+            let bytes = limited_reader.read(&mut data)?;
+            if bytes == 0 {
+                break;
+            }
+            if let Some(transform) = transform {
+                transform(&mut data[0..bytes]);
+            }
+            let mut offset = 0;
+            for (start, end, pattern) in find_constant_runs(&data[0..bytes], MEMORY_FILL_THRESHOLD)
+            {
+                if start > offset {
+                    self.command_memory_write(
+                        memory_address + offset as u32,
+                        &data[offset..start],
+                    )?;
+                }
+                let fill_address = memory_address + start as u32;
+                // Older firmware rejects the fill command, only the first attempt falls back to regular write
+                let filled = match fill_supported {
+                    None => {
+                        let filled =
+                            self.command_memory_fill(fill_address, end - start, pattern)?;
+                        fill_supported = Some(filled);
+                        filled
+                    }
+                    Some(true) => {
+                        if !self.command_memory_fill(fill_address, end - start, pattern)? {
+                            return Err(Error::new("Command response error"));
+                        }
+                        true
+                    }
+                    Some(false) => false,
+                };
+                if !filled {
+                    self.command_memory_write(fill_address, &data[start..end])?;
+                }
+                offset = end;
+            }
+            if bytes > offset {
+                self.command_memory_write(memory_address + offset as u32, &data[offset..bytes])?;
+            }
+            memory_address += bytes as u32;
+        }
+        Ok(())
+    }
+
+    fn flash_erase(&mut self, address: u32, length: usize) -> Result<(), Error> {
+        let erase_block_size = self.command_flash_wait_busy(false)?;
+        for offset in (0..length as u32).step_by(erase_block_size as usize) {
+            self.command_flash_erase_block(address + offset)?;
+        }
+        Ok(())
+    }
+
+    fn flash_wait_erase(&mut self) -> Result<(), Error> {
+        // Erasing whole ROM extended region takes longer than command response timeout,
+        // wait for the background erase queue to drain before waiting for the flash itself
+        while let Some(pending) = self.command_flash_erase_pending()? {
+            if pending == 0 {
+                break;
+            }
+            sleep(FLASH_ERASE_POLL_PERIOD);
+        }
         self.command_flash_wait_busy(true)?;
         Ok(())
     }
+
+    fn flash_find_changed_ranges(
+        &mut self,
+        address: u32,
+        data: &[u8],
+        erase_block_size: usize,
+    ) -> Result<Vec<(usize, usize)>, Error> {
+        if data.is_empty() {
+            return Ok(Vec::new());
+        }
+        // Older firmware doesn't support chunk checksums, consider every block as changed then
+        let supported = self
+            .command_memory_chunk_checksums(address, erase_block_size, erase_block_size)
+            .is_ok();
+        let device_checksums = if supported {
+            self.memory_chunk_checksums(address, data.len(), erase_block_size)?
+        } else {
+            Vec::new()
+        };
+        let mut ranges: Vec<(usize, usize)> = Vec::new();
+        for (index, block) in data.chunks(erase_block_size).enumerate() {
+            if device_checksums.get(index) == Some(&crc32fast::hash(block)) {
+                continue;
+            }
+            let start = index * erase_block_size;
+            let end = start + erase_block_size;
+            match ranges.last_mut() {
+                Some((_, last_end)) if *last_end == start => *last_end = end,
+                _ => ranges.push((start, end)),
+            }
+        }
+        Ok(ranges)
+    }
 }
 
 impl SC64 {
     pub fn open_local(port: Option<String>) -> Result<Self, Error> {
+        let port = match port {
+            Some(port) => port,
+            None => list_local_devices()?[0].port.clone(),
+        };
         let mut sc64 = SC64 {
-            link: link::new_local(&port.unwrap_or(list_local_devices()?[0].port.clone()))?,
+            link: link::new_local(&port)?,
         };
         sc64.check_device()?;
         Ok(sc64)
@@ -1065,3 +1809,176 @@ impl SC64 {
         Ok(sc64)
     }
 }
+
+struct MemoryTestGenerator {
+    mode: u32,
+    seed: u32,
+}
+
+impl MemoryTestGenerator {
+    const MODE_CONSTANT: u32 = 0;
+    const MODE_OWN_ADDRESS: u32 = 1;
+    const MODE_RANDOM: u32 = 2;
+    const MODE_WALKING_ONES: u32 = 3;
+
+    fn new(pattern: MemoryTestPattern) -> Self {
+        let (mode, seed) = match pattern {
+            MemoryTestPattern::OwnAddress(inverted) => (
+                Self::MODE_OWN_ADDRESS,
+                if inverted { 0xFFFFFFFF } else { 0x00000000 },
+            ),
+            MemoryTestPattern::AllZeros => (Self::MODE_CONSTANT, 0x00000000),
+            MemoryTestPattern::AllOnes => (Self::MODE_CONSTANT, 0xFFFFFFFF),
+            MemoryTestPattern::Custom(pattern) => (Self::MODE_CONSTANT, pattern),
+            MemoryTestPattern::WalkingOnes(inverted) => (
+                Self::MODE_WALKING_ONES,
+                if inverted { 0xFFFFFFFF } else { 0x00000000 },
+            ),
+            MemoryTestPattern::Random => {
+                // LFSR would get stuck at zero
+                let seed = max(rand::thread_rng().next_u32(), 1);
+                (Self::MODE_RANDOM, seed)
+            }
+        };
+        Self { mode, seed }
+    }
+
+    fn start(&self) -> u32 {
+        self.seed
+    }
+
+    fn word(&self, state: &mut u32, address: u32) -> u32 {
+        match self.mode {
+            Self::MODE_OWN_ADDRESS => address ^ self.seed,
+            Self::MODE_RANDOM => {
+                let value = *state;
+                *state = (value >> 1) ^ if (value & 1) != 0 { 0xD0000001 } else { 0 };
+                value
+            }
+            Self::MODE_WALKING_ONES => walking_ones_word(address) ^ self.seed,
+            _ => self.seed,
+        }
+    }
+
+    fn fill(&self, state: &mut u32, address: u32, buffer: &mut [u8]) {
+        for (index, chunk) in buffer.chunks_mut(4).enumerate() {
+            let word = self.word(state, address + (index * 4) as u32);
+            chunk.copy_from_slice(&word.to_be_bytes());
+        }
+    }
+
+    fn word_at(&self, address: u32) -> u32 {
+        let mut state = self.start();
+        if self.mode == Self::MODE_RANDOM {
+            for _ in 0..((address - SDRAM_ADDRESS) / 4) {
+                self.word(&mut state, 0);
+            }
+        }
+        self.word(&mut state, address)
+    }
+}
+
+// Every 16-bit word has a single bit set, all data lines are walked through every 32 bytes
+fn walking_ones_word(address: u32) -> u32 {
+    let bit = (address >> 1) & 0xE;
+    ((1 << bit) << 16) | (1 << (bit + 1))
+}
+
+struct RomLayout {
+    sdram_length: usize,
+    rom_shadow_length: usize,
+    rom_extended_length: usize,
+}
+
+fn get_rom_layout(length: usize, no_shadow: bool) -> Result<RomLayout, Error> {
+    if length > MAX_ROM_LENGTH {
+        return Err(Error::new("ROM length too big"));
+    }
+
+    let rom_shadow_enabled = !no_shadow && length > (SDRAM_LENGTH - ROM_SHADOW_LENGTH);
+    let rom_extended_enabled = length > SDRAM_LENGTH;
+
+    let sdram_length = if rom_shadow_enabled {
+        min(length, SDRAM_LENGTH - ROM_SHADOW_LENGTH)
+    } else {
+        min(length, SDRAM_LENGTH)
+    };
+
+    Ok(RomLayout {
+        sdram_length,
+        rom_shadow_length: if rom_shadow_enabled {
+            min(length - sdram_length, ROM_SHADOW_LENGTH)
+        } else {
+            0
+        },
+        rom_extended_length: if rom_extended_enabled {
+            min(length - SDRAM_LENGTH, ROM_EXTENDED_LENGTH)
+        } else {
+            0
+        },
+    })
+}
+
+fn get_rom_endian_swapper<T: Read + Seek>(reader: &mut T) -> Result<fn(&mut [u8]), Error> {
+    let mut pi_config = vec![0u8; 4];
+
+    reader.rewind()?;
+    reader.read_exact(&mut pi_config)?;
+    reader.rewind()?;
+
+    Ok(match &pi_config[0..4] {
+        [0x37, 0x80, 0x40, 0x12] => |b: &mut [u8]| b.chunks_exact_mut(2).for_each(|c| c.swap(0, 1)),
+        [0x40, 0x12, 0x37, 0x80] => |b: &mut [u8]| {
+            b.chunks_exact_mut(4).for_each(|c| {
+                c.swap(0, 3);
+                c.swap(1, 2)
+            })
+        },
+        _ => |_: &mut [u8]| {},
+    })
+}
+
+fn find_changed_ranges(data: &[u8], previous_data: &[u8]) -> Vec<(usize, usize)> {
+    let mut ranges: Vec<(usize, usize)> = Vec::new();
+    for (index, block) in data.chunks(DIFF_BLOCK_LENGTH).enumerate() {
+        let start = index * DIFF_BLOCK_LENGTH;
+        let end = start + block.len();
+        if previous_data.get(start..end) == Some(block) {
+            continue;
+        }
+        // Sending few unchanged bytes is cheaper than issuing another write command
+        match ranges.last_mut() {
+            Some((_, last_end)) if (start - *last_end) <= DIFF_MERGE_DISTANCE => *last_end = end,
+            _ => ranges.push((start, end)),
+        }
+    }
+    ranges
+}
+
+fn find_constant_runs(data: &[u8], threshold: usize) -> Vec<(usize, usize, u32)> {
+    let word =
+        |index: usize| u32::from_be_bytes(data[(index * 4)..(index * 4 + 4)].try_into().unwrap());
+    let words = data.len() / 4;
+    let mut runs = Vec::new();
+    let mut start = 0;
+    while start < words {
+        let pattern = word(start);
+        let mut end = start + 1;
+        while end < words && word(end) == pattern {
+            end += 1;
+        }
+        if ((end - start) * 4) >= threshold {
+            runs.push((start * 4, end * 4, pattern));
+        }
+        start = end;
+    }
+    runs
+}
+
+pub fn sign_rom_ipl3(rom: &[u8], custom_seed: Option<u8>) -> Result<(u8, u64, bool), Error> {
+    let offset = IPL3_OFFSET as usize;
+    if rom.len() < (offset + IPL3_LENGTH) {
+        return Err(Error::new("ROM length too small to contain IPL3"));
+    }
+    sign_ipl3(&rom[offset..(offset + IPL3_LENGTH)], custom_seed)
+}
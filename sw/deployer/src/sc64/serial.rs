@@ -8,6 +8,7 @@ pub struct SerialDevice {
     serial: serial2::SerialPort,
     writer: std::io::BufWriter<serial2::SerialPort>,
     unclog_buffer: std::collections::VecDeque<u8>,
+    dtr_loopback: Option<bool>,
     poll_timeout: std::time::Duration,
     io_timeout: std::time::Duration,
 }
@@ -29,6 +30,7 @@ impl SerialDevice {
             serial,
             writer,
             unclog_buffer: std::collections::VecDeque::new(),
+            dtr_loopback: None,
             poll_timeout: poll_timeout.unwrap_or(Self::DEFAULT_POLL_TIMEOUT),
             io_timeout: io_timeout.unwrap_or(Self::DEFAULT_RW_TIMEOUT),
         };
@@ -58,13 +60,33 @@ impl SerialDevice {
     }
 
     pub fn set_dtr(&mut self, value: bool) -> std::io::Result<()> {
-        self.serial.set_dtr(value)
+        if self.dtr_loopback.is_some() {
+            self.dtr_loopback = Some(value);
+            return Ok(());
+        }
+        match self.serial.set_dtr(value) {
+            Ok(()) => Ok(()),
+            Err(error) if Self::is_missing_modem_lines(&error) => {
+                self.dtr_loopback = Some(value);
+                Ok(())
+            }
+            Err(error) => Err(error),
+        }
     }
 
     pub fn read_dsr(&mut self) -> std::io::Result<bool> {
+        if let Some(value) = self.dtr_loopback {
+            return Ok(value);
+        }
         self.serial.read_dsr()
     }
 
+    fn is_missing_modem_lines(error: &std::io::Error) -> bool {
+        // Pseudo terminals (e.g. the FPGA co-simulation) reject modem control requests with ENOTTY
+        const ENOTTY: i32 = 25;
+        cfg!(unix) && error.raw_os_error() == Some(ENOTTY)
+    }
+
     pub fn discard_input(&mut self) -> std::io::Result<()> {
         let timeout = std::time::Instant::now();
         self.serial.discard_input_buffer()?;
@@ -1,170 +1,507 @@
 use super::{
     error::Error,
-    link::{list_local_devices, new_local, AsynchronousPacket, DataType, Response, UsbPacket},
+    link::{
+        decode_payload, list_local_devices, new_local, payload_length, write_payload,
+        AsynchronousPacket, DataType, Link, Response, UsbPacket, CAPABILITY_COMPRESSION,
+        CAPABILITY_SESSION, SERVER_CAPABILITIES_ID, SESSION_ACQUIRE_EXCLUSIVE,
+        SESSION_ACQUIRE_STREAM, SESSION_LIST_DEVICES, SESSION_RELEASE_EXCLUSIVE,
+        SESSION_RELEASE_STREAM, SESSION_SELECT_DEVICE,
+    },
+};
+use std::{
+    collections::{HashMap, VecDeque},
+    io::{BufReader, BufWriter, Read, Write},
+    net::{Shutdown, TcpListener, TcpStream},
+    sync::{
+        atomic::{AtomicBool, Ordering},
+        mpsc::{channel, sync_channel, Receiver, RecvTimeoutError, Sender, SyncSender},
+        Arc,
+    },
+    thread,
 };
-use std::io::{Read, Write};
 
 pub enum ServerEvent {
     Listening(String),
+    Device(String),
     Connected(String),
     Disconnected(String),
     Err(String),
 }
 
-struct StreamHandler {
-    stream: std::net::TcpStream,
-    reader: std::io::BufReader<std::net::TcpStream>,
-    writer: std::io::BufWriter<std::net::TcpStream>,
-}
-
-const READ_TIMEOUT: std::time::Duration = std::time::Duration::from_secs(10);
 const WRITE_TIMEOUT: std::time::Duration = std::time::Duration::from_secs(10);
 const KEEPALIVE_PERIOD: std::time::Duration = std::time::Duration::from_secs(5);
+const CLIENT_QUEUE_LENGTH: usize = 1024;
 
-impl StreamHandler {
-    fn new(stream: std::net::TcpStream) -> std::io::Result<StreamHandler> {
-        let reader = std::io::BufReader::new(stream.try_clone()?);
-        let writer = std::io::BufWriter::new(stream.try_clone()?);
-        stream.set_read_timeout(Some(READ_TIMEOUT))?;
-        stream.set_write_timeout(Some(WRITE_TIMEOUT))?;
-        Ok(StreamHandler {
-            stream,
-            reader,
-            writer,
-        })
-    }
+enum Frame {
+    Response(Response),
+    Packet(AsynchronousPacket),
+    Session(Response),
+}
 
-    fn try_read_header(&mut self) -> std::io::Result<Option<[u8; 4]>> {
-        self.stream.set_nonblocking(true)?;
-        let mut header = [0u8; 4];
-        let result = match self.reader.read_exact(&mut header) {
-            Ok(()) => Ok(Some(header)),
-            Err(error) => match error.kind() {
-                std::io::ErrorKind::WouldBlock => Ok(None),
-                _ => Err(error),
-            },
-        };
-        self.stream.set_nonblocking(false)?;
-        result
-    }
+enum ClientRequest {
+    Command(u8, [u32; 2], Vec<u8>),
+    Session(u8, Vec<u8>),
+}
 
-    fn receive_command(&mut self) -> std::io::Result<Option<(u8, [u32; 2], Vec<u8>)>> {
-        if let Some(header) = self.try_read_header()? {
-            if let Ok(data_type) = TryInto::<DataType>::try_into(u32::from_be_bytes(header)) {
-                if !matches!(data_type, DataType::Command) {
-                    return Err(std::io::Error::other(
-                        "Received data type was not a command data type",
-                    ));
-                }
-            }
+struct Client {
+    frames: SyncSender<Frame>,
+    stream: TcpStream,
+}
 
-            let mut buffer = [0u8; 4];
-            let mut id_buffer = [0u8; 1];
-            let mut args = [0u32; 2];
+enum DeviceRequest {
+    Attach(usize, Client),
+    Detach(usize),
+    Command(usize, u8, [u32; 2], Vec<u8>),
+    Session(usize, u8),
+}
 
-            self.reader.read_exact(&mut id_buffer)?;
-            let id = id_buffer[0];
+struct Device {
+    serial: String,
+    requests: Sender<DeviceRequest>,
+}
 
-            self.reader.read_exact(&mut buffer)?;
-            args[0] = u32::from_be_bytes(buffer);
-            self.reader.read_exact(&mut buffer)?;
-            args[1] = u32::from_be_bytes(buffer);
+// Commands from all attached clients are forwarded to the device in order of arrival,
+// responses are routed back to the issuing client in the same order. Replies generated
+// by the server itself wait in the same queue so they never overtake device responses.
+// Asynchronous packets go to the client holding the stream lease, or to every attached
+// client when nobody holds it. While a client holds the exclusive lease, commands from
+// other clients are rejected with an error response.
+enum Pending {
+    Device(usize),
+    Reply(usize, Frame),
+}
+
+struct DeviceWorker {
+    link: Link,
+    clients: HashMap<usize, Client>,
+    pending: VecDeque<Pending>,
+    exclusive: Option<usize>,
+    stream: Option<usize>,
+}
 
-            self.reader.read_exact(&mut buffer)?;
-            let command_data_length = u32::from_be_bytes(buffer) as usize;
-            let mut data = vec![0u8; command_data_length];
-            self.reader.read_exact(&mut data)?;
+impl DeviceWorker {
+    fn run(&mut self, requests: Receiver<DeviceRequest>) -> Result<(), Error> {
+        loop {
+            while let Ok(request) = requests.try_recv() {
+                self.handle_request(request)?;
+            }
 
-            Ok(Some((id, args, data)))
-        } else {
-            Ok(None)
+            match self.link.receive_response_or_packet()? {
+                Some(UsbPacket::Response(response)) => {
+                    if let Some(Pending::Device(id)) = self.pending.pop_front() {
+                        self.send(id, Frame::Response(response));
+                    }
+                    self.send_replies();
+                }
+                Some(UsbPacket::AsynchronousPacket(packet)) => {
+                    if let Some(owner) = self.stream {
+                        self.send(owner, Frame::Packet(packet));
+                    } else {
+                        let ids: Vec<usize> = self.clients.keys().copied().collect();
+                        for id in ids {
+                            let packet = AsynchronousPacket {
+                                id: packet.id,
+                                data: packet.data.clone(),
+                            };
+                            self.send(id, Frame::Packet(packet));
+                        }
+                    }
+                }
+                None => {}
+            }
         }
     }
 
-    fn send_response(&mut self, response: Response) -> std::io::Result<()> {
-        self.writer
-            .write_all(&u32::to_be_bytes(DataType::Response.into()))?;
-        self.writer.write_all(&[response.id])?;
-        self.writer.write_all(&[response.error as u8])?;
-        self.writer
-            .write_all(&(response.data.len() as u32).to_be_bytes())?;
-        self.writer.write_all(&response.data)?;
-        self.writer.flush()?;
+    fn handle_request(&mut self, request: DeviceRequest) -> Result<(), Error> {
+        match request {
+            DeviceRequest::Attach(id, client) => {
+                self.clients.insert(id, client);
+            }
+            DeviceRequest::Detach(id) => self.remove_client(id),
+            DeviceRequest::Command(id, command, args, data) => {
+                let response = command_has_response(command);
+                if self.exclusive.is_some_and(|owner| owner != id) {
+                    if response {
+                        let response = Response {
+                            id: command,
+                            error: true,
+                            data: vec![],
+                            tag: None,
+                        };
+                        self.pending
+                            .push_back(Pending::Reply(id, Frame::Response(response)));
+                        self.send_replies();
+                    }
+                } else {
+                    self.link
+                        .execute_command_raw(command, args, &data, true, true)?;
+                    if response {
+                        self.pending.push_back(Pending::Device(id));
+                    }
+                }
+            }
+            DeviceRequest::Session(id, op) => {
+                let result = match op {
+                    SESSION_ACQUIRE_EXCLUSIVE => Self::acquire(&mut self.exclusive, id),
+                    SESSION_RELEASE_EXCLUSIVE => Self::release(&mut self.exclusive, id),
+                    SESSION_ACQUIRE_STREAM => Self::acquire(&mut self.stream, id),
+                    SESSION_RELEASE_STREAM => Self::release(&mut self.stream, id),
+                    _ => Err("Unknown session operation"),
+                };
+                let response = Response {
+                    id: op,
+                    error: result.is_err(),
+                    data: result.err().unwrap_or_default().as_bytes().to_vec(),
+                    tag: None,
+                };
+                self.pending
+                    .push_back(Pending::Reply(id, Frame::Session(response)));
+                self.send_replies();
+            }
+        }
         Ok(())
     }
 
-    fn send_packet(&mut self, packet: AsynchronousPacket) -> std::io::Result<()> {
-        self.writer
-            .write_all(&u32::to_be_bytes(DataType::Packet.into()))?;
-        self.writer.write_all(&[packet.id])?;
-        self.writer
-            .write_all(&(packet.data.len() as u32).to_be_bytes())?;
-        self.writer.write_all(&packet.data)?;
-        self.writer.flush()?;
-        Ok(())
+    fn acquire(lease: &mut Option<usize>, id: usize) -> Result<(), &'static str> {
+        match lease {
+            Some(owner) if *owner != id => Err("Lease is held by another client"),
+            _ => {
+                lease.replace(id);
+                Ok(())
+            }
+        }
     }
 
-    fn send_keepalive(&mut self) -> std::io::Result<()> {
-        self.writer
-            .write_all(&u32::to_be_bytes(DataType::KeepAlive.into()))?;
-        self.writer.flush()?;
+    fn release(lease: &mut Option<usize>, id: usize) -> Result<(), &'static str> {
+        if *lease == Some(id) {
+            lease.take();
+        }
         Ok(())
     }
+
+    fn send_replies(&mut self) {
+        while let Some(Pending::Reply(..)) = self.pending.front() {
+            if let Some(Pending::Reply(id, frame)) = self.pending.pop_front() {
+                self.send(id, frame);
+            }
+        }
+    }
+
+    fn send(&mut self, id: usize, frame: Frame) {
+        if let Some(client) = self.clients.get(&id) {
+            if client.frames.try_send(frame).is_err() {
+                // Client can't keep up with the device, drop it instead of stalling the others
+                client.stream.shutdown(Shutdown::Both).ok();
+                self.remove_client(id);
+            }
+        }
+    }
+
+    fn remove_client(&mut self, id: usize) {
+        self.clients.remove(&id);
+        Self::release(&mut self.exclusive, id).ok();
+        Self::release(&mut self.stream, id).ok();
+    }
 }
 
-fn server_accept_connection(port: String, connection: &mut StreamHandler) -> Result<(), Error> {
-    let mut link = new_local(&port)?;
+// USB write command is the only one the controller doesn't respond to
+fn command_has_response(command: u8) -> bool {
+    command != b'U'
+}
+
+fn read_request(reader: &mut BufReader<TcpStream>) -> std::io::Result<ClientRequest> {
+    let mut buffer = [0u8; 4];
+    let mut id_buffer = [0u8; 1];
+
+    reader.read_exact(&mut buffer)?;
+    let data_type: DataType = u32::from_be_bytes(buffer)
+        .try_into()
+        .map_err(|_| std::io::Error::other("Received unknown data type"))?;
+
+    reader.read_exact(&mut id_buffer)?;
+    let id = id_buffer[0];
 
-    let mut keepalive = std::time::Instant::now();
+    match data_type {
+        DataType::Command => {
+            let mut args = [0u32; 2];
+            reader.read_exact(&mut buffer)?;
+            args[0] = u32::from_be_bytes(buffer);
+            reader.read_exact(&mut buffer)?;
+            args[1] = u32::from_be_bytes(buffer);
+
+            reader.read_exact(&mut buffer)?;
+            let length = u32::from_be_bytes(buffer);
+            let mut data = vec![0u8; payload_length(length)];
+            reader.read_exact(&mut data)?;
 
+            Ok(ClientRequest::Command(
+                id,
+                args,
+                decode_payload(length, data)?,
+            ))
+        }
+        DataType::Session => {
+            reader.read_exact(&mut buffer)?;
+            let mut payload = vec![0u8; u32::from_be_bytes(buffer) as usize];
+            reader.read_exact(&mut payload)?;
+
+            Ok(ClientRequest::Session(id, payload))
+        }
+        _ => Err(std::io::Error::other(
+            "Received data type was not a command or session data type",
+        )),
+    }
+}
+
+fn write_frame(
+    writer: &mut BufWriter<TcpStream>,
+    frame: Frame,
+    compression: bool,
+) -> std::io::Result<()> {
+    let (data_type, response) = match frame {
+        Frame::Response(response) => (DataType::Response, response),
+        Frame::Session(response) => (DataType::Session, response),
+        Frame::Packet(packet) => {
+            writer.write_all(&u32::to_be_bytes(DataType::Packet.into()))?;
+            writer.write_all(&[packet.id])?;
+            write_payload(writer, &packet.data, compression)?;
+            return writer.flush();
+        }
+    };
+    writer.write_all(&u32::to_be_bytes(data_type.into()))?;
+    writer.write_all(&[response.id])?;
+    writer.write_all(&[response.error as u8])?;
+    write_payload(writer, &response.data, compression)?;
+    writer.flush()
+}
+
+fn client_writer(stream: TcpStream, frames: Receiver<Frame>, compression: Arc<AtomicBool>) {
+    let mut writer = BufWriter::new(stream);
     loop {
-        match connection.receive_command() {
-            Ok(Some((id, args, data))) => {
-                link.execute_command_raw(id, args, &data, true, true)?;
-            }
-            Ok(None) => {}
+        let result = match frames.recv_timeout(KEEPALIVE_PERIOD) {
+            Ok(frame) => write_frame(&mut writer, frame, compression.load(Ordering::Relaxed)),
+            Err(RecvTimeoutError::Timeout) => writer
+                .write_all(&u32::to_be_bytes(DataType::KeepAlive.into()))
+                .and_then(|_| writer.flush()),
+            Err(RecvTimeoutError::Disconnected) => break,
+        };
+        if result.is_err() {
+            break;
+        }
+    }
+    writer.get_ref().shutdown(Shutdown::Both).ok();
+}
+
+fn server_accept_connection(stream: TcpStream, id: usize, devices: &[Device]) -> Result<(), Error> {
+    stream.set_write_timeout(Some(WRITE_TIMEOUT))?;
+
+    let (frames, frames_receiver) = sync_channel(CLIENT_QUEUE_LENGTH);
+    let compression = Arc::new(AtomicBool::new(false));
+    let writer_stream = stream.try_clone()?;
+    let writer_compression = compression.clone();
+    thread::spawn(move || client_writer(writer_stream, frames_receiver, writer_compression));
+
+    let attach = |device: &Device| {
+        device
+            .requests
+            .send(DeviceRequest::Attach(
+                id,
+                Client {
+                    frames: frames.clone(),
+                    stream: stream.try_clone()?,
+                },
+            ))
+            .map_err(|_| {
+                Error::new(format!("Device [{}] is not available", device.serial).as_str())
+            })
+    };
+
+    let mut device = &devices[0];
+    attach(device)?;
+
+    let mut reader = BufReader::new(stream.try_clone()?);
+
+    let result = loop {
+        let request = match read_request(&mut reader) {
+            Ok(request) => request,
             Err(error) => match error.kind() {
-                std::io::ErrorKind::UnexpectedEof => return Ok(()),
-                _ => return Err(error.into()),
+                std::io::ErrorKind::UnexpectedEof => break Ok(()),
+                _ => break Err(error.into()),
             },
         };
-
-        if let Some(usb_packet) = link.receive_response_or_packet()? {
-            match usb_packet {
-                UsbPacket::Response(response) => connection.send_response(response)?,
-                UsbPacket::AsynchronousPacket(packet) => connection.send_packet(packet)?,
+        let forwarded = match request {
+            ClientRequest::Command(SERVER_CAPABILITIES_ID, args, _) => {
+                let capabilities = args[0] & (CAPABILITY_COMPRESSION | CAPABILITY_SESSION);
+                let response = Response {
+                    id: SERVER_CAPABILITIES_ID,
+                    error: false,
+                    data: capabilities.to_be_bytes().to_vec(),
+                    tag: None,
+                };
+                compression.store(
+                    (capabilities & CAPABILITY_COMPRESSION) != 0,
+                    Ordering::Relaxed,
+                );
+                frames.send(Frame::Response(response)).is_ok()
+            }
+            ClientRequest::Command(command, args, data) => device
+                .requests
+                .send(DeviceRequest::Command(id, command, args, data))
+                .is_ok(),
+            ClientRequest::Session(SESSION_SELECT_DEVICE, payload) => {
+                let serial = String::from_utf8_lossy(&payload);
+                let (error, data) = match devices.iter().find(|d| d.serial == serial) {
+                    Some(selected) => {
+                        device.requests.send(DeviceRequest::Detach(id)).ok();
+                        device = selected;
+                        (false, vec![])
+                    }
+                    None => (true, format!("Device [{serial}] not found").into_bytes()),
+                };
+                let response = Response {
+                    id: SESSION_SELECT_DEVICE,
+                    error,
+                    data,
+                    tag: None,
+                };
+                frames.send(Frame::Session(response)).ok();
+                error || attach(device).is_ok()
+            }
+            ClientRequest::Session(SESSION_LIST_DEVICES, _) => {
+                let serials: Vec<&str> = devices.iter().map(|d| d.serial.as_str()).collect();
+                let response = Response {
+                    id: SESSION_LIST_DEVICES,
+                    error: false,
+                    data: serials.join("\n").into_bytes(),
+                    tag: None,
+                };
+                frames.send(Frame::Session(response)).is_ok()
+            }
+            ClientRequest::Session(op, _) => {
+                device.requests.send(DeviceRequest::Session(id, op)).is_ok()
             }
+        };
+        if !forwarded {
+            break Err(Error::new(
+                format!("Device [{}] is no longer available", device.serial).as_str(),
+            ));
         }
+    };
+
+    device.requests.send(DeviceRequest::Detach(id)).ok();
+    stream.shutdown(Shutdown::Both).ok();
+
+    result
+}
+
+type LinkOpener = Box<dyn FnOnce() -> Result<Link, Error> + Send>;
+
+fn spawn_device_worker(
+    serial: String,
+    open: LinkOpener,
+    event_callback: fn(ServerEvent),
+) -> Result<Device, Error> {
+    let (requests, requests_receiver) = channel();
+    let (opened, opened_receiver) = channel();
+    let device_serial = serial.clone();
 
-        if keepalive.elapsed() > KEEPALIVE_PERIOD {
-            keepalive = std::time::Instant::now();
-            connection.send_keepalive().ok();
+    // Link is tied to the thread it was opened on, worker opens it by itself
+    thread::spawn(move || {
+        let mut worker = match open() {
+            Ok(link) => {
+                opened.send(Ok(())).ok();
+                DeviceWorker {
+                    link,
+                    clients: HashMap::new(),
+                    pending: VecDeque::new(),
+                    exclusive: None,
+                    stream: None,
+                }
+            }
+            Err(error) => {
+                opened.send(Err(error)).ok();
+                return;
+            }
+        };
+        if let Err(error) = worker.run(requests_receiver) {
+            for client in worker.clients.values() {
+                client.stream.shutdown(Shutdown::Both).ok();
+            }
+            event_callback(ServerEvent::Err(format!("[{device_serial}] {error}")));
         }
-    }
+    });
+
+    opened_receiver
+        .recv()
+        .unwrap_or(Err(Error::new("Device worker stopped unexpectedly")))?;
+
+    Ok(Device { serial, requests })
 }
 
-pub fn run(
-    port: Option<String>,
-    address: String,
+fn serve(
+    listener: TcpListener,
+    links: Vec<(String, LinkOpener)>,
     event_callback: fn(ServerEvent),
 ) -> Result<(), Error> {
-    let port = port.unwrap_or(list_local_devices()?[0].port.clone());
-    let listener = std::net::TcpListener::bind(address)?;
-    let listening_address = listener.local_addr()?;
+    if links.is_empty() {
+        return Err(Error::new("No SC64 devices to expose"));
+    }
+
+    let mut devices = Vec::new();
+    for (serial, open) in links {
+        devices.push(spawn_device_worker(serial.clone(), open, event_callback)?);
+        event_callback(ServerEvent::Device(serial));
+    }
+    let devices = Arc::new(devices);
 
-    event_callback(ServerEvent::Listening(listening_address.to_string()));
+    event_callback(ServerEvent::Listening(listener.local_addr()?.to_string()));
 
-    for incoming in listener.incoming() {
+    for (id, incoming) in listener.incoming().enumerate() {
         let stream = incoming?;
         let peer = stream.peer_addr()?.to_string();
+        let devices = devices.clone();
 
         event_callback(ServerEvent::Connected(peer.clone()));
 
-        match server_accept_connection(port.clone(), &mut StreamHandler::new(stream)?) {
-            Ok(()) => event_callback(ServerEvent::Disconnected(peer.clone())),
-            Err(error) => event_callback(ServerEvent::Err(error.to_string())),
-        }
+        thread::spawn(
+            move || match server_accept_connection(stream, id, &devices) {
+                Ok(()) => event_callback(ServerEvent::Disconnected(peer)),
+                Err(error) => event_callback(ServerEvent::Err(error.to_string())),
+            },
+        );
     }
 
     Ok(())
 }
+
+pub fn run(
+    port: Option<String>,
+    address: String,
+    event_callback: fn(ServerEvent),
+) -> Result<(), Error> {
+    let ports: Vec<(String, String)> = match port {
+        Some(port) => {
+            // Explicitly provided port (e.g. emulator) doesn't have to be on the device list
+            let serial = list_local_devices()
+                .unwrap_or_default()
+                .into_iter()
+                .find(|d| d.port == port)
+                .map_or(port.clone(), |d| d.serial);
+            vec![(serial, port)]
+        }
+        None => list_local_devices()?
+            .into_iter()
+            .map(|d| (d.serial, d.port))
+            .collect(),
+    };
+
+    let links: Vec<(String, LinkOpener)> = ports
+        .into_iter()
+        .map(|(serial, port)| {
+            let open: LinkOpener = Box::new(move || new_local(&port));
+            (serial, open)
+        })
+        .collect();
+
+    serve(std::net::TcpListener::bind(address)?, links, event_callback)
+}
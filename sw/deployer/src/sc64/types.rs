@@ -18,6 +18,8 @@ pub enum ConfigId {
     ButtonState,
     ButtonMode,
     RomExtendedEnable,
+    DdUsbStagingEnable,
+    IsvBufferSize,
 }
 
 pub enum Config {
@@ -36,6 +38,8 @@ pub enum Config {
     ButtonState(ButtonState),
     ButtonMode(ButtonMode),
     RomExtendedEnable(Switch),
+    DdUsbStagingEnable(Switch),
+    IsvBufferSize(u32),
 }
 
 impl From<ConfigId> for u32 {
@@ -56,6 +60,8 @@ impl From<ConfigId> for u32 {
             ConfigId::ButtonState => 12,
             ConfigId::ButtonMode => 13,
             ConfigId::RomExtendedEnable => 14,
+            ConfigId::DdUsbStagingEnable => 15,
+            ConfigId::IsvBufferSize => 16,
         }
     }
 }
@@ -80,6 +86,8 @@ impl TryFrom<(ConfigId, u32)> for Config {
             ConfigId::ButtonState => Self::ButtonState(config.try_into()?),
             ConfigId::ButtonMode => Self::ButtonMode(config.try_into()?),
             ConfigId::RomExtendedEnable => Self::RomExtendedEnable(config.try_into()?),
+            ConfigId::DdUsbStagingEnable => Self::DdUsbStagingEnable(config.try_into()?),
+            ConfigId::IsvBufferSize => Self::IsvBufferSize(config),
         })
     }
 }
@@ -102,6 +110,8 @@ impl From<Config> for [u32; 2] {
             Config::ButtonState(val) => [ConfigId::ButtonState.into(), val.into()],
             Config::ButtonMode(val) => [ConfigId::ButtonMode.into(), val.into()],
             Config::RomExtendedEnable(val) => [ConfigId::RomExtendedEnable.into(), val.into()],
+            Config::DdUsbStagingEnable(val) => [ConfigId::DdUsbStagingEnable.into(), val.into()],
+            Config::IsvBufferSize(val) => [ConfigId::IsvBufferSize.into(), val],
         }
     }
 }
@@ -704,6 +714,7 @@ impl TryFrom<Vec<u8>> for DebugPacket {
 pub enum DiskPacketKind {
     Read,
     Write,
+    Staged,
 }
 
 pub struct DiskPacket {
@@ -736,6 +747,10 @@ impl TryFrom<Vec<u8>> for DiskPacket {
                 kind: DiskPacketKind::Write,
                 info: disk_block,
             },
+            3 => DiskPacket {
+                kind: DiskPacketKind::Staged,
+                info: disk_block,
+            },
             _ => return Err(Error::new("Unknown disk packet command code")),
         })
     }
@@ -1271,9 +1286,17 @@ pub struct DiagnosticDataV1 {
     pub temperature: f32,
 }
 
+pub struct UsbTxClassCounters {
+    pub high: u32,
+    pub normal: u32,
+    pub low: u32,
+}
+
 pub enum DiagnosticData {
     V0(DiagnosticDataV0),
     V1(DiagnosticDataV1),
+    V3(UsbTxClassCounters),
+    V4(UsbTxClassCounters),
     Unknown,
 }
 
@@ -1311,6 +1334,21 @@ impl TryFrom<Vec<u8>> for DiagnosticData {
                     temperature: raw_temperature / 10.0,
                 }))
             }
+            3 | 4 => {
+                if value.len() != 16 {
+                    return Err(Error::new("Invalid data length for USB TX diagnostic data"));
+                }
+                let counters = UsbTxClassCounters {
+                    high: u32::from_be_bytes(value[4..8].try_into().unwrap()),
+                    normal: u32::from_be_bytes(value[8..12].try_into().unwrap()),
+                    low: u32::from_be_bytes(value[12..16].try_into().unwrap()),
+                };
+                Ok(if version == 3 {
+                    DiagnosticData::V3(counters)
+                } else {
+                    DiagnosticData::V4(counters)
+                })
+            }
             _ => Ok(DiagnosticData::Unknown),
         }
     }
@@ -1332,27 +1370,83 @@ impl Display for DiagnosticData {
                 "{:.03} V / {:.01} °C",
                 d.voltage, d.temperature
             )),
+            DiagnosticData::V3(d) | DiagnosticData::V4(d) => f.write_fmt(format_args!(
+                "high {}, normal {}, low {}",
+                d.high, d.normal, d.low
+            )),
             DiagnosticData::Unknown => f.write_str("Unknown"),
         }
     }
 }
 
+pub struct TraceEntry {
+    pub timestamp: u32,
+    pub event: u8,
+    pub arg: u32,
+}
+
+pub struct TraceData {
+    pub dropped: u32,
+    pub time: u32,
+    pub entries: Vec<TraceEntry>,
+}
+
+impl TryFrom<Vec<u8>> for TraceData {
+    type Error = Error;
+    fn try_from(value: Vec<u8>) -> Result<Self, Self::Error> {
+        if value.len() < 8 || (value.len() % 8) != 0 {
+            return Err(Error::new("Invalid data length for trace data"));
+        }
+        let entries = value[8..]
+            .chunks_exact(8)
+            .map(|chunk| {
+                let data = u32::from_be_bytes(chunk[4..8].try_into().unwrap());
+                TraceEntry {
+                    timestamp: u32::from_be_bytes(chunk[0..4].try_into().unwrap()),
+                    event: (data >> 24) as u8,
+                    arg: data & 0xFFFFFF,
+                }
+            })
+            .collect();
+        Ok(TraceData {
+            dropped: u32::from_be_bytes(value[0..4].try_into().unwrap()),
+            time: u32::from_be_bytes(value[4..8].try_into().unwrap()),
+            entries,
+        })
+    }
+}
+
 pub enum SpeedTestDirection {
     Read,
     Write,
 }
 
+pub enum LatencyTestCommand {
+    IdentifierGet,
+    ConfigGet,
+}
+
+impl Display for LatencyTestCommand {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.write_str(match self {
+            Self::IdentifierGet => "v",
+            Self::ConfigGet => "c",
+        })
+    }
+}
+
 pub enum MemoryTestPattern {
     OwnAddress(bool),
     AllZeros,
     AllOnes,
     Random,
+    WalkingOnes(bool),
     Custom(u32),
 }
 
 pub struct MemoryTestPatternResult {
     pub first_error: Option<(usize, (u32, u32))>,
-    pub all_errors: Vec<(usize, (u32, u32))>,
+    pub errors: usize,
 }
 
 impl Display for MemoryTestPattern {
@@ -1365,6 +1459,11 @@ impl Display for MemoryTestPattern {
             MemoryTestPattern::AllZeros => f.write_str("All zeros"),
             MemoryTestPattern::AllOnes => f.write_str("All ones"),
             MemoryTestPattern::Random => f.write_str("Random"),
+            MemoryTestPattern::WalkingOnes(inverted) => f.write_str(if *inverted {
+                "Walking zeros"
+            } else {
+                "Walking ones"
+            }),
             MemoryTestPattern::Custom(pattern) => {
                 f.write_fmt(format_args!("Pattern 0x{pattern:08X}"))
             }
@@ -1382,6 +1481,16 @@ macro_rules! get_config {
     }};
 }
 
+macro_rules! next_config {
+    ($configs:ident, $config:ident) => {{
+        if let Some(Config::$config(value)) = $configs.next() {
+            Ok(value)
+        } else {
+            Err(Error::new("Unexpected config type"))
+        }
+    }};
+}
+
 macro_rules! get_setting {
     ($sc64:ident, $setting:ident) => {{
         // NOTE: remove 'allow(irrefutable_let_patterns)' below when more settings are added
@@ -1396,3 +1505,4 @@ macro_rules! get_setting {
 
 pub(crate) use get_config;
 pub(crate) use get_setting;
+pub(crate) use next_config;
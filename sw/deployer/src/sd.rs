@@ -0,0 +1,486 @@
+use crate::sc64::{
+    self,
+    ff::{AllocationMap, Entry, EntryInfo, FatFs},
+    Error, SdCardResult, SC64, SD_CARD_SECTOR_SIZE,
+};
+use chrono::{Datelike, NaiveDateTime};
+use colored::Colorize;
+use std::{
+    collections::BTreeMap,
+    fmt::Display,
+    fs::File,
+    io::{Read, Seek, SeekFrom, Write},
+    path::{Path, PathBuf},
+    sync::mpsc::{sync_channel, Receiver},
+    thread,
+};
+
+const UPLOAD_CHUNK_LENGTH: usize = 1 * 1024 * 1024;
+const UPLOAD_QUEUE_DEPTH: usize = 4;
+
+const DATETIME_TOLERANCE_SECONDS: i64 = 2;
+
+const IMAGE_CHUNK_SECTORS: u64 = 2048;
+const IMAGE_QUEUE_DEPTH: usize = 4;
+
+pub fn upload(ff: &mut FatFs, src: &Path, dst: &Path) -> Result<(), Error> {
+    let src_file = File::open(src)?;
+    let src_length = src_file.metadata()?.len();
+    let mut dst_file = ff.create(dst)?;
+
+    let start_sector = if src_length > 0 {
+        match dst_file.expand(src_length) {
+            Ok(()) => dst_file.start_sector(),
+            Err(sc64::ff::Error::Denied) => None,
+            Err(e) => return Err(e.into()),
+        }
+    } else {
+        None
+    };
+
+    // Reader never goes past the length sampled above, sectors after the expanded range belong to other files
+    let chunks = spawn_reader(src_file.take(src_length), UPLOAD_CHUNK_LENGTH);
+
+    if let Some(mut sector) = start_sector {
+        let mut written = 0;
+        let write_chunks = || -> Result<(), Error> {
+            for chunk in chunks {
+                let mut chunk = chunk?;
+                let length = chunk.len() as u64;
+                chunk.resize(chunk.len().next_multiple_of(SD_CARD_SECTOR_SIZE), 0);
+                ff.write_sectors(&chunk, sector)?;
+                sector += (chunk.len() / SD_CARD_SECTOR_SIZE) as u64;
+                written += length;
+            }
+            if written != src_length {
+                return Err(Error::new("Source file was truncated during upload"));
+            }
+            Ok(())
+        };
+        let result = write_chunks();
+        if result.is_err() {
+            // File already has its full expanded size, drop the part that was never written
+            dst_file.truncate(written).ok();
+        }
+        dst_file.flush()?;
+        result?;
+    } else {
+        for chunk in chunks {
+            dst_file.write_all(&chunk?)?;
+        }
+    }
+
+    Ok(())
+}
+
+fn spawn_reader<R: Read + Send + 'static>(
+    mut file: R,
+    chunk_length: usize,
+) -> Receiver<std::io::Result<Vec<u8>>> {
+    let (sender, receiver) = sync_channel(UPLOAD_QUEUE_DEPTH);
+    thread::spawn(move || loop {
+        let mut chunk = Vec::with_capacity(chunk_length);
+        match (&mut file)
+            .take(chunk_length as u64)
+            .read_to_end(&mut chunk)
+        {
+            Ok(0) => break,
+            Ok(_) => {
+                if sender.send(Ok(chunk)).is_err() {
+                    break;
+                }
+            }
+            Err(e) => {
+                sender.send(Err(e)).ok();
+                break;
+            }
+        }
+    });
+    receiver
+}
+
+#[derive(Clone, Copy)]
+enum Node {
+    Directory,
+    File { size: u64, datetime: NaiveDateTime },
+}
+
+pub enum SyncAction {
+    CreateDirectory(PathBuf),
+    Rename {
+        src: PathBuf,
+        dst: PathBuf,
+    },
+    Delete(PathBuf),
+    Upload {
+        src: PathBuf,
+        dst: PathBuf,
+        datetime: NaiveDateTime,
+    },
+    UpdateDatetime {
+        path: PathBuf,
+        datetime: NaiveDateTime,
+    },
+}
+
+impl Display for SyncAction {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        let path = |path: &PathBuf| path.to_str().unwrap_or_default().bright_green();
+        match self {
+            Self::CreateDirectory(dst) => write!(f, "Creating directory {}", path(dst)),
+            Self::Rename { src, dst } => write!(f, "Renaming {} to {}", path(src), path(dst)),
+            Self::Delete(dst) => write!(f, "Removing {}", path(dst)),
+            Self::Upload { src, dst, .. } => {
+                write!(f, "Uploading {} to {}", path(src), path(dst))
+            }
+            Self::UpdateDatetime { path: dst, .. } => {
+                write!(f, "Updating timestamp of {}", path(dst))
+            }
+        }
+    }
+}
+
+#[derive(Default)]
+pub struct SyncPlan {
+    pub actions: Vec<SyncAction>,
+    pub unchanged: usize,
+}
+
+pub fn plan_sync(
+    ff: &mut FatFs,
+    local: &Path,
+    remote: &Path,
+    checksum: bool,
+) -> Result<SyncPlan, Error> {
+    if !local.is_dir() {
+        return Err(Error::new(
+            format!("{} is not a directory", local.to_string_lossy()).as_str(),
+        ));
+    }
+
+    let mut plan = SyncPlan::default();
+
+    let mut local_tree = BTreeMap::new();
+    walk_local(local, PathBuf::new(), &mut local_tree)?;
+
+    let mut remote_tree = BTreeMap::new();
+    match ff.list(remote) {
+        Ok(entries) => walk_remote(ff, remote, PathBuf::new(), entries, &mut remote_tree)?,
+        Err(sc64::ff::Error::NoPath) | Err(sc64::ff::Error::NoFile) => {
+            plan.actions
+                .push(SyncAction::CreateDirectory(remote.to_path_buf()));
+        }
+        Err(e) => return Err(e.into()),
+    }
+
+    // Remote entries standing in the way of a different kind of local entry are removed first
+    let mut conflicts = vec![];
+    for (path, node) in remote_tree.iter() {
+        let conflict = match (node, local_tree.get(path)) {
+            (Node::Directory, Some(Node::File { .. })) => true,
+            (Node::File { .. }, Some(Node::Directory)) => true,
+            _ => false,
+        };
+        if conflict && !conflicts.iter().any(|c: &PathBuf| path.starts_with(c)) {
+            conflicts.push(path.clone());
+        }
+    }
+    for conflict in conflicts.iter() {
+        let subtree: Vec<PathBuf> = remote_tree
+            .keys()
+            .filter(|path| path.starts_with(conflict))
+            .cloned()
+            .collect();
+        for path in subtree.iter().rev() {
+            remote_tree.remove(path);
+            plan.actions.push(SyncAction::Delete(remote.join(path)));
+        }
+    }
+
+    for (path, node) in local_tree.iter() {
+        if let Node::Directory = node {
+            if !remote_tree.contains_key(path) {
+                plan.actions
+                    .push(SyncAction::CreateDirectory(remote.join(path)));
+            }
+        }
+    }
+
+    let mut uploads = vec![];
+    let mut datetime_updates = vec![];
+    for (path, node) in local_tree.iter() {
+        let Node::File { size, datetime } = *node else {
+            continue;
+        };
+        let upload = match remote_tree.get(path) {
+            Some(Node::File {
+                size: remote_size,
+                datetime: remote_datetime,
+            }) if *remote_size == size => {
+                let same_datetime = datetime_matches(datetime, *remote_datetime);
+                if checksum {
+                    if compare_checksum(ff, &local.join(path), &remote.join(path))? {
+                        if !same_datetime {
+                            datetime_updates.push(path.clone());
+                        }
+                        false
+                    } else {
+                        true
+                    }
+                } else {
+                    !same_datetime
+                }
+            }
+            _ => true,
+        };
+        if upload {
+            uploads.push(path.clone());
+        } else if !datetime_updates.contains(path) {
+            plan.unchanged += 1;
+        }
+    }
+
+    let mut deletes: Vec<PathBuf> = remote_tree
+        .keys()
+        .filter(|path| !local_tree.contains_key(*path))
+        .cloned()
+        .collect();
+
+    // Files that disappeared from one place and showed up in another are moved instead of uploaded again
+    let mut renames = vec![];
+    for path in uploads.iter() {
+        if remote_tree.contains_key(path) {
+            continue;
+        }
+        let Some(Node::File { size, datetime }) = local_tree.get(path).copied() else {
+            continue;
+        };
+        let candidates: Vec<&PathBuf> = deletes
+            .iter()
+            .filter(|candidate| match remote_tree.get(*candidate) {
+                Some(Node::File {
+                    size: remote_size,
+                    datetime: remote_datetime,
+                }) => *remote_size == size && datetime_matches(datetime, *remote_datetime),
+                _ => false,
+            })
+            .collect();
+        if candidates.len() != 1 {
+            continue;
+        }
+        let candidate = candidates[0].clone();
+        if checksum && !compare_checksum(ff, &local.join(path), &remote.join(&candidate))? {
+            continue;
+        }
+        deletes.retain(|path| path != &candidate);
+        renames.push((candidate, path.clone()));
+    }
+    uploads.retain(|path| !renames.iter().any(|(_, dst)| dst == path));
+
+    for (src, dst) in renames.into_iter() {
+        plan.actions.push(SyncAction::Rename {
+            src: remote.join(src),
+            dst: remote.join(dst),
+        });
+    }
+
+    for path in deletes.iter().rev() {
+        plan.actions.push(SyncAction::Delete(remote.join(path)));
+    }
+
+    for path in uploads.into_iter() {
+        if let Some(Node::File { datetime, .. }) = local_tree.get(&path) {
+            plan.actions.push(SyncAction::Upload {
+                src: local.join(&path),
+                dst: remote.join(&path),
+                datetime: *datetime,
+            });
+        }
+    }
+
+    for path in datetime_updates.into_iter() {
+        if let Some(Node::File { datetime, .. }) = local_tree.get(&path) {
+            plan.actions.push(SyncAction::UpdateDatetime {
+                path: remote.join(&path),
+                datetime: *datetime,
+            });
+        }
+    }
+
+    Ok(plan)
+}
+
+pub fn execute_sync_action(ff: &mut FatFs, action: &SyncAction) -> Result<(), Error> {
+    match action {
+        SyncAction::CreateDirectory(path) => ff.mkdir(path)?,
+        SyncAction::Rename { src, dst } => ff.rename(src, dst)?,
+        SyncAction::Delete(path) => ff.delete(path)?,
+        SyncAction::Upload { src, dst, datetime } => {
+            upload(ff, src, dst)?;
+            set_datetime(ff, dst, *datetime)?;
+        }
+        SyncAction::UpdateDatetime { path, datetime } => set_datetime(ff, path, *datetime)?,
+    }
+    Ok(())
+}
+
+fn set_datetime(ff: &mut FatFs, path: &Path, datetime: NaiveDateTime) -> Result<(), Error> {
+    if (1980..2108).contains(&datetime.year()) {
+        ff.set_datetime(path, datetime)?;
+    }
+    Ok(())
+}
+
+fn datetime_matches(local: NaiveDateTime, remote: NaiveDateTime) -> bool {
+    (local - remote).num_seconds().abs() <= DATETIME_TOLERANCE_SECONDS
+}
+
+fn compare_checksum(ff: &mut FatFs, local: &Path, remote: &Path) -> Result<bool, Error> {
+    let local = local.to_path_buf();
+    let local_checksum = thread::spawn(move || -> std::io::Result<u32> {
+        let mut hasher = crc32fast::Hasher::new();
+        for chunk in spawn_reader(File::open(local)?, UPLOAD_CHUNK_LENGTH) {
+            hasher.update(&chunk?);
+        }
+        Ok(hasher.finalize())
+    });
+    let remote_checksum = ff.checksum(remote)?;
+    let local_checksum = local_checksum
+        .join()
+        .map_err(|_| Error::new("Couldn't calculate local file checksum"))??;
+    Ok(local_checksum == remote_checksum)
+}
+
+fn walk_local(root: &Path, path: PathBuf, tree: &mut BTreeMap<PathBuf, Node>) -> Result<(), Error> {
+    for entry in std::fs::read_dir(root.join(&path))? {
+        let entry = entry?;
+        let metadata = std::fs::metadata(entry.path())?;
+        let entry_path = path.join(entry.file_name());
+        if metadata.is_dir() {
+            tree.insert(entry_path.clone(), Node::Directory);
+            walk_local(root, entry_path, tree)?;
+        } else if metadata.is_file() {
+            let datetime = chrono::DateTime::<chrono::Local>::from(metadata.modified()?);
+            tree.insert(
+                entry_path,
+                Node::File {
+                    size: metadata.len(),
+                    datetime: datetime.naive_local(),
+                },
+            );
+        }
+    }
+    Ok(())
+}
+
+fn walk_remote(
+    ff: &mut FatFs,
+    root: &Path,
+    path: PathBuf,
+    entries: Vec<Entry>,
+    tree: &mut BTreeMap<PathBuf, Node>,
+) -> Result<(), Error> {
+    for entry in entries {
+        let entry_path = path.join(&entry.name);
+        match entry.info {
+            EntryInfo::Directory => {
+                tree.insert(entry_path.clone(), Node::Directory);
+                let entries = ff.list(root.join(&entry_path))?;
+                walk_remote(ff, root, entry_path, entries, tree)?;
+            }
+            EntryInfo::File { size } => {
+                tree.insert(
+                    entry_path,
+                    Node::File {
+                        size,
+                        datetime: entry.datetime,
+                    },
+                );
+            }
+        }
+    }
+    Ok(())
+}
+
+pub fn image_allocation_map(path: &Path) -> Result<AllocationMap, Error> {
+    let mut ff = FatFs::new(File::open(path)?)?;
+    Ok(ff.allocation_map()?)
+}
+
+fn image_chunks(map: &AllocationMap) -> impl Iterator<Item = (u64, usize)> + Send + '_ {
+    map.extents.iter().flat_map(|(start, count)| {
+        (0..*count)
+            .step_by(IMAGE_CHUNK_SECTORS as usize)
+            .map(move |offset| {
+                let sectors = IMAGE_CHUNK_SECTORS.min(count - offset);
+                (start + offset, (sectors as usize) * SD_CARD_SECTOR_SIZE)
+            })
+    })
+}
+
+pub fn backup_image(ff: &mut FatFs, map: &AllocationMap, dst: &Path) -> Result<(), Error> {
+    let mut file = File::create(dst)?;
+    file.set_len(map.sectors * (SD_CARD_SECTOR_SIZE as u64))?;
+
+    let (sender, receiver) = sync_channel::<(u64, Vec<u8>)>(IMAGE_QUEUE_DEPTH);
+    let writer = thread::spawn(move || -> std::io::Result<()> {
+        for (sector, data) in receiver {
+            file.seek(SeekFrom::Start(sector * (SD_CARD_SECTOR_SIZE as u64)))?;
+            file.write_all(&data)?;
+        }
+        file.flush()
+    });
+
+    let mut result = Ok(());
+    for (sector, length) in image_chunks(map) {
+        let mut data = vec![0u8; length];
+        if let Err(e) = ff.read_sectors(&mut data, sector) {
+            result = Err(e.into());
+            break;
+        }
+        if sender.send((sector, data)).is_err() {
+            break;
+        }
+    }
+    drop(sender);
+
+    writer
+        .join()
+        .map_err(|_| Error::new("Couldn't write SD card image"))??;
+
+    result
+}
+
+pub fn restore_image(sc64: &mut SC64, map: &AllocationMap, src: &Path) -> Result<(), Error> {
+    let mut file = File::open(src)?;
+    let chunks: Vec<(u64, usize)> = image_chunks(map).collect();
+
+    let (sender, receiver) = sync_channel::<std::io::Result<(u64, Vec<u8>)>>(IMAGE_QUEUE_DEPTH);
+    thread::spawn(move || {
+        for (sector, length) in chunks {
+            let mut data = vec![0u8; length];
+            let result = file
+                .seek(SeekFrom::Start(sector * (SD_CARD_SECTOR_SIZE as u64)))
+                .and_then(|_| file.read_exact(&mut data))
+                .map(|_| (sector, data));
+            let failed = result.is_err();
+            if sender.send(result).is_err() || failed {
+                break;
+            }
+        }
+    });
+
+    for chunk in receiver {
+        let (sector, data) = chunk?;
+        match sc64.write_sd_card(&data, sector as u32)? {
+            SdCardResult::OK => {}
+            error => {
+                return Err(Error::new(
+                    format!("Couldn't write the SD card: {error}").as_str(),
+                ))
+            }
+        }
+    }
+
+    Ok(())
+}
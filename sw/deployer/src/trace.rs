@@ -0,0 +1,229 @@
+use crate::{
+    bench::json_string,
+    sc64::{TraceData, TraceEntry},
+};
+
+pub const READ_MAX_ENTRIES: usize = 32;
+
+const PID: u32 = 1;
+
+#[derive(Clone, Copy, PartialEq)]
+enum Lane {
+    UsbRx = 1,
+    UsbTx,
+    N64Command,
+    Sd,
+    Dd,
+    Writeback,
+    Flashram,
+}
+
+const LANES: [(Lane, &str); 7] = [
+    (Lane::UsbRx, "USB RX"),
+    (Lane::UsbTx, "USB TX"),
+    (Lane::N64Command, "N64 commands"),
+    (Lane::Sd, "SD card"),
+    (Lane::Dd, "64DD"),
+    (Lane::Writeback, "Save writeback"),
+    (Lane::Flashram, "FlashRAM"),
+];
+
+enum Kind {
+    Instant(String),
+    Begin(String),
+    End,
+}
+
+struct OpenSpan {
+    timestamp: u64,
+    name: String,
+    begin_arg: u32,
+}
+
+pub struct Recorder {
+    events: Vec<String>,
+    open: Vec<(Lane, OpenSpan)>,
+    time_base: u64,
+    last_timestamp: Option<u32>,
+    first_timestamp: Option<u64>,
+    entries: usize,
+    dropped: u32,
+}
+
+impl Recorder {
+    pub fn new() -> Self {
+        Self {
+            events: Vec::new(),
+            open: Vec::new(),
+            time_base: 0,
+            last_timestamp: None,
+            first_timestamp: None,
+            entries: 0,
+            dropped: 0,
+        }
+    }
+
+    pub fn entries(&self) -> usize {
+        self.entries
+    }
+
+    pub fn dropped(&self) -> u32 {
+        self.dropped
+    }
+
+    pub fn push(&mut self, data: TraceData) {
+        for entry in data.entries.iter() {
+            self.push_entry(entry);
+        }
+        if data.dropped > 0 {
+            // Overwritten entries are gone, mark the moment they were noticed and forget any
+            // spans that might never receive their end event
+            let timestamp = self.unwrap_timestamp(data.time);
+            self.events.push(format!(
+                "{{\"name\": \"dropped\", \"ph\": \"i\", \"s\": \"p\", \"ts\": {timestamp}, \"pid\": {PID}, \"tid\": 0, \"args\": {{\"count\": {}}}}}",
+                data.dropped
+            ));
+            self.open.clear();
+            self.dropped += data.dropped;
+        }
+    }
+
+    pub fn to_json(&self) -> String {
+        let mut events = vec![format!(
+            "{{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": {PID}, \"args\": {{\"name\": \"SC64 controller\"}}}}"
+        )];
+        for (lane, name) in LANES {
+            events.push(format!(
+                "{{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": {PID}, \"tid\": {}, \"args\": {{\"name\": {}}}}}",
+                lane as u32,
+                json_string(name)
+            ));
+        }
+        events.extend(self.events.iter().cloned());
+        format!(
+            "{{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n  {}\n]}}\n",
+            events.join(",\n  ")
+        )
+    }
+
+    fn unwrap_timestamp(&mut self, timestamp: u32) -> u64 {
+        if let Some(last) = self.last_timestamp {
+            if timestamp < last {
+                self.time_base += 1 << 32;
+            }
+        }
+        self.last_timestamp = Some(timestamp);
+        let absolute = self.time_base + timestamp as u64;
+        absolute - *self.first_timestamp.get_or_insert(absolute)
+    }
+
+    fn push_entry(&mut self, entry: &TraceEntry) {
+        let Some((lane, kind)) = decode_event(entry) else {
+            return;
+        };
+        let timestamp = self.unwrap_timestamp(entry.timestamp);
+        self.entries += 1;
+        match kind {
+            Kind::Instant(name) => self.events.push(format!(
+                "{{\"name\": {}, \"ph\": \"i\", \"s\": \"t\", \"ts\": {timestamp}, \"pid\": {PID}, \"tid\": {}}}",
+                json_string(&name),
+                lane as u32
+            )),
+            Kind::Begin(name) => {
+                // Repeated start (e.g. retried transfer) keeps the original one
+                if !self.open.iter().any(|(open_lane, _)| *open_lane == lane) {
+                    self.open.push((
+                        lane,
+                        OpenSpan {
+                            timestamp,
+                            name,
+                            begin_arg: entry.arg,
+                        },
+                    ));
+                }
+            }
+            Kind::End => {
+                let Some(index) = self.open.iter().position(|(open_lane, _)| *open_lane == lane)
+                else {
+                    return;
+                };
+                let (_, span) = self.open.remove(index);
+                self.events.push(format!(
+                    "{{\"name\": {}, \"ph\": \"X\", \"ts\": {}, \"dur\": {}, \"pid\": {PID}, \"tid\": {}, \"args\": {{\"begin\": {}, \"end\": {}}}}}",
+                    json_string(&span.name),
+                    span.timestamp,
+                    timestamp - span.timestamp,
+                    lane as u32,
+                    span.begin_arg,
+                    entry.arg
+                ));
+            }
+        }
+    }
+}
+
+fn command_name(cmd: u32) -> String {
+    let cmd = (cmd & 0xFF) as u8;
+    if cmd.is_ascii_graphic() {
+        format!("'{}'", cmd as char)
+    } else {
+        format!("0x{cmd:02X}")
+    }
+}
+
+fn decode_event(entry: &TraceEntry) -> Option<(Lane, Kind)> {
+    let arg = entry.arg;
+    Some(match entry.event {
+        1 => (
+            Lane::UsbRx,
+            Kind::Instant(format!("command {}", command_name(arg))),
+        ),
+        2 => (
+            Lane::UsbTx,
+            Kind::Instant(format!("enqueue {}", command_name(arg))),
+        ),
+        3 => (
+            Lane::UsbTx,
+            Kind::Begin(format!("tx {}", command_name(arg))),
+        ),
+        4 => (Lane::UsbTx, Kind::End),
+        5 => (Lane::N64Command, Kind::Begin(command_name(arg))),
+        6 => (Lane::N64Command, Kind::End),
+        7 => (Lane::Sd, Kind::Begin(format!("read {arg} sectors"))),
+        8 => (Lane::Sd, Kind::End),
+        9 => (Lane::Sd, Kind::Begin(format!("write {arg} sectors"))),
+        10 => (Lane::Sd, Kind::End),
+        11 => {
+            let direction = if (arg & (1 << 16)) != 0 {
+                "write"
+            } else {
+                "read"
+            };
+            (
+                Lane::Dd,
+                Kind::Begin(format!("{direction} block {}", arg & 0xFFFF)),
+            )
+        }
+        12 => (Lane::Dd, Kind::End),
+        13 => (
+            Lane::Writeback,
+            Kind::Begin(String::from(match arg {
+                0 => "writeback to SD",
+                1 => "writeback to USB",
+                _ => "writeback",
+            })),
+        ),
+        14 => (Lane::Writeback, Kind::End),
+        15 => (
+            Lane::Flashram,
+            Kind::Begin(String::from(match arg {
+                1 => "erase all",
+                2 => "erase sector",
+                3 => "write page",
+                _ => "operation",
+            })),
+        ),
+        16 => (Lane::Flashram, Kind::End),
+        _ => return None,
+    })
+}
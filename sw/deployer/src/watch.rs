@@ -0,0 +1,44 @@
+use std::{fs, path::PathBuf, time::SystemTime};
+
+type FileState = (Option<SystemTime>, u64);
+
+pub struct FileWatch {
+    path: PathBuf,
+    current: Option<FileState>,
+    pending: Option<FileState>,
+}
+
+impl FileWatch {
+    pub fn new(path: &PathBuf) -> Self {
+        Self {
+            path: path.clone(),
+            current: Self::get_state(path),
+            pending: None,
+        }
+    }
+
+    fn get_state(path: &PathBuf) -> Option<FileState> {
+        let metadata = fs::metadata(path).ok()?;
+        Some((metadata.modified().ok(), metadata.len()))
+    }
+
+    pub fn poll(&mut self) -> bool {
+        // File might not exist or be partially written while build is in progress,
+        // change is reported only after its state stays the same between two polls
+        let Some(state) = Self::get_state(&self.path) else {
+            self.pending = None;
+            return false;
+        };
+        if Some(state) == self.current {
+            self.pending = None;
+            return false;
+        }
+        if Some(state) == self.pending {
+            self.current = Some(state);
+            self.pending = None;
+            return true;
+        }
+        self.pending = Some(state);
+        false
+    }
+}